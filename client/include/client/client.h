@@ -2,29 +2,89 @@
 
 #include "common/isocket.h"
 #include "common/message.h"
+#include "common/reliable_channel.h"
+#include "common/task.h"
+#include "client_events.h"
 #include "iclient_file_transfer_handler.h" // Stub
+#include <coroutine>
+#include <functional>
 #include <string>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
-#include <queue>
+#include <deque>
 #include <memory> // For std::unique_ptr
+#include <set>
+#include <vector>
 
 namespace chat_app {
 namespace client {
 
+// Headless chat client (client_lib). It does no console I/O: everything the
+// server sends is reported through ClientEvents. Sending never blocks on the
+// network; a send thread drains the queue.
 class Client {
 public:
+    // Runs one callback. Callbacks must run one at a time and in order, e.g.
+    // [&pool](std::function<void()> task) { pool.submit_ordered(key, std::move(task)); }
+    using Executor = std::function<void(std::function<void()>)>;
+
     Client();
     ~Client();
 
+    // Both only before connect_to_server. Without an executor, callbacks run
+    // on the receive thread and hold up the connection while they do.
+    void set_events(ClientEvents events) { events_ = std::move(events); }
+    void set_executor(Executor executor) { executor_ = std::move(executor); }
+    // Handles FILE_TRANSFER_* messages; without one they go to on_message.
+    void set_file_transfer_handler(std::unique_ptr<IClientFileTransferHandler> handler);
+
+    // Resumes the session of the previous connection, if there was one.
+    // ip_address may also be "unix:PATH" or "shm:PATH" for a same-host server.
     bool connect_to_server(const std::string& ip_address, int port);
     void disconnect();
-    void send_chat_message(const std::string& text);
-    
+    // Reconnects to the last server and catches up on what was missed meanwhile.
+    bool reconnect();
+    bool is_connected() const { return connected_; }
+    uint32_t client_id() const { return client_id_; } // 0 until the server's welcome arrives
+    // A reliable message is retransmitted until the server acknowledges it,
+    // across reconnects of the same session. False if not connected.
+    bool send_chat_message(const std::string& text, bool reliable = false);
+    // To one client only. If it is disconnected but may resume its session,
+    // the server keeps the message for it; otherwise on_error reports it
+    // undelivered. False if not connected.
+    bool send_direct_message(uint32_t recipient_id, const std::string& text, bool reliable = false);
+    // Latest-wins state such as a typing indicator: replaces an update for
+    // the same key that has not gone out yet, and the server passes on only
+    // the latest one to a recipient that is behind. Never replayed. False if
+    // not connected.
+    bool send_ephemeral(const std::string& key, const std::string& value);
+
+    // Connection multiplexing: extra logical clients on this connection, each
+    // with a server-assigned id (see on_virtual_client_attached). They do not
+    // survive a reconnect. A broadcast arrives once for all of them.
+    bool attach_virtual_client();
+    void detach_virtual_client(uint32_t virtual_id);
+    // Sends as one of the attached virtual clients; returns false if it is not one.
+    bool send_chat_message_as(uint32_t virtual_id, const std::string& text);
+
+    // Asks who is online. Only what changed since the cached roster is sent;
+    // on_roster reports the result.
+    bool request_roster();
+    // The same as a coroutine: co_await client.fetch_roster() yields who is
+    // online, or nothing if the connection ends first. The awaiting coroutine
+    // continues where callbacks run (see set_executor).
+    common::Task<std::vector<uint32_t>> fetch_roster();
+
+    // Searches the room's history on the server: words that must all occur
+    // and "quoted phrases". on_search_results reports a page of up to
+    // page_size hits, newest first, older than cursor (0: the newest).
+    // Returns the tag the results will carry, or 0 if not connected.
+    uint32_t search(const std::string& query, uint32_t page_size = 20, uint64_t cursor = 0);
+
     // For file transfer stub
-    void request_file_transfer(const std::string& recipient_id_str, const std::string& file_path);
+    bool request_file_transfer(const std::string& recipient_id_str, const std::string& file_path);
 
 
     // For internal use by threads or handlers
@@ -32,10 +92,31 @@ public:
 
 
 private:
+    class RosterAwaiter;
+    struct RosterWaiter {
+        std::coroutine_handle<> handle;
+        std::vector<uint32_t>* online;
+    };
+
     void receive_messages(); // Thread for receiving messages from server
     void send_messages();    // Thread for sending messages from queue
 
     void process_incoming_message(const common::Message& msg);
+    void deliver_message(const common::Message& msg); // To on_message or the file transfer handler
+    void report_presence(const common::Message& msg);
+    void report_error(std::string text);
+    void post(std::function<void()> task); // Runs a callback through executor_
+    void handle_session_message(const common::Message& msg);
+    void handle_roster_message(const common::Message& msg);
+    void handle_mux_attached(const common::Message& msg);
+    void report_search_results(const common::Message& msg);
+    void send_roster_request(bool report_result);
+    // Resends unacknowledged frames once the server knows the session; with
+    // fresh_session both sides start numbering again.
+    void restart_reliable_delivery(bool fresh_session);
+    bool transmit(const common::Message& msg); // Send thread only
+    bool flush_reliable();                     // Due ACK and retransmissions; send thread only
+    int64_t reliable_wait_ms();                // -1 if no timer is pending
 
     std::unique_ptr<common::ISocket> socket_;
     std::atomic<bool> connected_;
@@ -44,7 +125,7 @@ private:
     std::thread receive_thread_;
     std::thread send_thread_;
 
-    std::queue<common::Message> send_queue_;
+    std::deque<common::Message> send_queue_; // Scanned by send_ephemeral
     std::mutex send_queue_mutex_;
     std::condition_variable send_queue_cv_;
 
@@ -52,6 +133,38 @@ private:
     std::mutex receive_buffer_mutex_;
 
     std::unique_ptr<IClientFileTransferHandler> file_transfer_handler_; // Stub
+    ClientEvents events_;
+    Executor executor_;
+
+    // Session state. Written by the receive thread, read by connect_to_server
+    // once the previous connection's threads are gone.
+    std::string server_ip_;
+    int server_port_;
+    uint64_t session_token_;   // 0 until the first SESSION_WELCOME
+    uint32_t last_sequence_;   // Last broadcast sequence displayed
+    std::atomic<bool> resuming_; // SESSION_RESUME sent, SESSION_RESUMED not yet received
+    uint64_t fresh_token_;     // This connection's own session, used if the resume fails
+    uint32_t fresh_sequence_;
+    std::vector<common::Message> held_messages_; // Broadcasts that arrived while resuming
+
+    // Reliable delivery; survives reconnects like the session itself
+    common::ReliableConfig reliable_config_;
+    common::RetransmitWindow outbound_;
+    common::AckTracker inbound_;
+    std::mutex reliable_mutex_; // Protects outbound_ and inbound_
+
+    // Roster cache, kept current with ROSTER_DELTA replies
+    std::set<uint32_t> roster_;
+    uint32_t roster_epoch_;
+    uint32_t roster_version_; // 0: nothing cached
+    bool roster_requested_;   // An explicit request is outstanding
+    std::vector<RosterWaiter> roster_waiters_; // Suspended in fetch_roster()
+    std::mutex roster_mutex_;
+
+    std::set<uint32_t> virtual_clients_; // Attached on the current connection
+    std::atomic<uint32_t> next_attach_tag_;
+    std::atomic<uint32_t> next_search_tag_;
+    std::mutex virtual_clients_mutex_;
 };
 
 } // namespace client
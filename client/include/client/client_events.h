@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common/message.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace chat_app {
+namespace client {
+
+// A PRESENCE_DIGEST, decoded. With `truncated` the server only sent how many
+// clients joined and left, not who.
+struct PresenceUpdate {
+    uint32_t members = 0; // Online after the changes
+    bool truncated = false;
+    uint32_t joined_count = 0;
+    uint32_t left_count = 0;
+    std::vector<uint32_t> joined;
+    std::vector<uint32_t> left;
+};
+
+// A SEARCH_RESULTS, decoded. Hits are newest first.
+struct SearchResults {
+    struct Hit {
+        uint32_t sequence = 0;
+        uint32_t sender_id = 0;
+        std::string text;
+    };
+    uint32_t tag = 0;         // As returned by Client::search
+    uint64_t next_cursor = 0; // Pass to Client::search for the next page; 0 if there is none
+    std::vector<Hit> hits;
+};
+
+// What a Client reports to the program embedding it. Every callback is
+// optional. They run through the Client's executor (on its receive thread if
+// it has none), in the order the events happened.
+struct ClientEvents {
+    // Chat text, SERVER_SHUTDOWN and any type the client does not handle itself.
+    // For a broadcast, msg.header.sender_id is who sent it. A direct message
+    // has recipient_id set, and kFlagStored if it waited for us to resume.
+    std::function<void(const common::Message& msg)> on_message;
+    std::function<void(const PresenceUpdate& update)> on_presence;
+    // EPHEMERAL: sender_id's latest value for key; values superseded in
+    // transit are skipped.
+    std::function<void(uint32_t sender_id, const std::string& key, const std::string& value)> on_ephemeral;
+    // The answer to Client::request_roster(), ascending.
+    std::function<void(const std::vector<uint32_t>& online)> on_roster;
+    // The answer to Client::search().
+    std::function<void(const SearchResults& results)> on_search_results;
+    // SESSION_RESUMED: the missed broadcasts were delivered before this.
+    std::function<void(common::ResumeStatus status, uint32_t replayed)> on_session_resumed;
+    std::function<void(uint32_t virtual_id)> on_virtual_client_attached;
+    // ERROR_MESSAGE from the server, or a problem on our side of the connection.
+    std::function<void(const std::string& text)> on_error;
+    // The connection ended, whichever side ended it.
+    std::function<void()> on_disconnected;
+};
+
+} // namespace client
+} // namespace chat_app
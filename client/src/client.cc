@@ -1,128 +1,364 @@
 #include "client/client.h"
 #include "common/socket_factory.h"
 #include "common/message_serialization.h"
-#include "client/basic_client_file_transfer_handler.h" // Stub
-#include <iostream>
 #include <chrono>
+#include <algorithm> // For std::sort
+#include <iterator>  // For std::make_move_iterator
 
 namespace chat_app {
 namespace client {
 
-Client::Client() : connected_(false), client_id_(0) {
-    file_transfer_handler_ = std::make_unique<BasicClientFileTransferHandler>();
-    file_transfer_handler_->set_client_ptr(this); // For FT handler to send messages
-    std::cout << "Client created." << std::endl;
+namespace {
+
+int64_t steady_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool parse_presence(const common::Message& msg, PresenceUpdate& update) {
+    const auto& payload = msg.payload;
+    if (payload.size() < 13) return false;
+    update.truncated = payload[0] & common::kPresenceTruncated;
+    update.members = common::read_u32(payload.data() + 1);
+    size_t offset = 5;
+    for (int pass = 0; pass < 2; ++pass) { // Joined, then left
+        if (payload.size() < offset + 4) return false;
+        uint32_t count = common::read_u32(payload.data() + offset);
+        offset += 4;
+        (pass == 0 ? update.joined_count : update.left_count) = count;
+        if (update.truncated) continue;
+        if ((payload.size() - offset) / 4 < count) return false;
+        auto& ids = pass == 0 ? update.joined : update.left;
+        for (uint32_t i = 0; i < count; ++i, offset += 4) {
+            ids.push_back(common::read_u32(payload.data() + offset));
+        }
+    }
+    return true;
 }
 
+} // namespace
+
+Client::Client()
+    : connected_(false), client_id_(0), server_port_(0), session_token_(0), last_sequence_(0), resuming_(false),
+      fresh_token_(0), fresh_sequence_(0), outbound_(reliable_config_), inbound_(reliable_config_),
+      roster_epoch_(0), roster_version_(0), roster_requested_(false), next_attach_tag_(1),
+      next_search_tag_(1) {}
+
 Client::~Client() {
     disconnect();
-    std::cout << "Client destroyed." << std::endl;
+}
+
+void Client::set_file_transfer_handler(std::unique_ptr<IClientFileTransferHandler> handler) {
+    file_transfer_handler_ = std::move(handler);
+    if (file_transfer_handler_) file_transfer_handler_->set_client_ptr(this); // For FT handler to send messages
 }
 
 bool Client::connect_to_server(const std::string& ip_address, int port) {
     if (connected_) {
-        std::cout << "Client: Already connected." << std::endl;
         return true;
     }
 
-    socket_ = common::SocketFactory::create_socket();
-    if (!socket_ || !socket_->connect_socket(ip_address, port)) {
-        std::cerr << "Client: Failed to connect to server " << ip_address << ":" << port << std::endl;
+    std::string location;
+    common::Transport transport = common::SocketFactory::parse_address(ip_address, location);
+    socket_ = common::SocketFactory::create_socket(transport);
+    if (!socket_ || !socket_->connect_socket(location, port)) {
+        report_error("Failed to connect to server " + ip_address + ":" + std::to_string(port));
         socket_.reset(); // Release socket
         return false;
     }
 
+    server_ip_ = ip_address;
+    server_port_ = port;
     connected_ = true;
+    resuming_ = session_token_ != 0;
+    held_messages_.clear();
+    {
+        std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+        virtual_clients_.clear(); // They left with the previous connection
+    }
+    if (resuming_) {
+        // First thing on the wire, so the server replays before we miss more
+        common::Message resume(common::MessageType::SESSION_RESUME, 0, 0, "");
+        common::append_u64(resume.payload, session_token_);
+        common::append_u32(resume.payload, last_sequence_);
+        resume.header.payload_size = static_cast<uint32_t>(resume.payload.size());
+        add_message_to_send_queue(std::move(resume));
+    }
     receive_thread_ = std::thread(&Client::receive_messages, this);
     send_thread_ = std::thread(&Client::send_messages, this);
-
-    std::cout << "Client: Connected to server " << ip_address << ":" << port << "." << std::endl;
-    // Note: Client ID is usually assigned by the server upon connection or login.
-    // For this example, we'll assume the first message from the server might contain it,
-    // or we can send a HELLO message and get a response. For now, client_id_ remains 0
-    // until explicitly set (e.g. by a server message).
+    // client_id_ is set once the server's SESSION_WELCOME arrives
     return true;
 }
 
+bool Client::reconnect() {
+    if (server_ip_.empty()) return false;
+    disconnect();
+    return connect_to_server(server_ip_, server_port_);
+}
+
 void Client::disconnect() {
-    if (!connected_) return;
+    // The threads outlive a connection the server dropped; reap them too
+    if (!connected_ && !receive_thread_.joinable() && !send_thread_.joinable()) return;
 
-    std::cout << "Client: Disconnecting..." << std::endl;
     connected_ = false; // Signal threads to stop
 
     // Notify send_thread to wake up and exit
     send_queue_cv_.notify_one(); 
 
     if (socket_ && socket_->is_valid()) {
-        socket_->close_socket(); // This helps unblock receive_thread_
+        socket_->shutdown_socket(); // This unblocks receive_thread_; the socket is closed below
     }
 
     if (receive_thread_.joinable()) {
         receive_thread_.join();
     }
-    std::cout << "Client: Receive thread joined." << std::endl;
-    
+
     if (send_thread_.joinable()) {
         send_thread_.join();
     }
-    std::cout << "Client: Send thread joined." << std::endl;
 
     socket_.reset(); // Release socket
     // Clear send queue
     std::lock_guard<std::mutex> lock(send_queue_mutex_);
-    std::queue<common::Message> empty;
+    std::deque<common::Message> empty;
     std::swap(send_queue_, empty);
-
-    std::cout << "Client: Disconnected." << std::endl;
 }
 
-void Client::send_chat_message(const std::string& text) {
+bool Client::send_chat_message(const std::string& text, bool reliable) {
     if (!connected_) {
-        std::cerr << "Client: Not connected. Cannot send message." << std::endl;
-        return;
+        return false;
     }
     common::Message msg(common::MessageType::TEXT_MESSAGE, client_id_.load(), 0, text); // recipient 0 for broadcast to server
+    if (reliable) msg.header.flags |= common::kFlagReliable; // Numbered by the send thread
+    add_message_to_send_queue(std::move(msg));
+    return true;
+}
+
+bool Client::send_direct_message(uint32_t recipient_id, const std::string& text, bool reliable) {
+    if (!connected_ || recipient_id == 0) {
+        return false;
+    }
+    common::Message msg(common::MessageType::TEXT_MESSAGE, client_id_.load(), recipient_id, text);
+    if (reliable) msg.header.flags |= common::kFlagReliable;
     add_message_to_send_queue(std::move(msg));
+    return true;
 }
 
-void Client::request_file_transfer(const std::string& recipient_id_str, const std::string& file_path) {
+bool Client::send_ephemeral(const std::string& key, const std::string& value) {
     if (!connected_) {
-        std::cerr << "Client: Not connected. Cannot request file transfer." << std::endl;
-        return;
+        return false;
+    }
+    common::Message msg = common::make_ephemeral(client_id_.load(), key, value);
+    {
+        std::lock_guard<std::mutex> lock(send_queue_mutex_);
+        for (auto& queued : send_queue_) {
+            std::string queued_key;
+            std::string queued_value;
+            if (queued.header.type == common::MessageType::EPHEMERAL &&
+                queued.header.sender_id == msg.header.sender_id &&
+                common::parse_ephemeral(queued, queued_key, queued_value) && queued_key == key) {
+                queued = std::move(msg); // Superseded before it went out
+                return true;
+            }
+        }
+        send_queue_.push_back(std::move(msg));
+    }
+    send_queue_cv_.notify_one();
+    return true;
+}
+
+bool Client::attach_virtual_client() {
+    if (!connected_) {
+        return false;
+    }
+    common::Message attach(common::MessageType::MUX_ATTACH, client_id_.load(), 0, "");
+    common::append_u32(attach.payload, next_attach_tag_++);
+    attach.header.payload_size = static_cast<uint32_t>(attach.payload.size());
+    add_message_to_send_queue(std::move(attach));
+    return true;
+}
+
+uint32_t Client::search(const std::string& query, uint32_t page_size, uint64_t cursor) {
+    if (!connected_) {
+        return 0;
+    }
+    uint32_t tag = next_search_tag_++;
+    common::Message request(common::MessageType::SEARCH_REQUEST, client_id_.load(), 0, "");
+    common::append_u32(request.payload, tag);
+    common::append_u32(request.payload, page_size);
+    common::append_u64(request.payload, cursor);
+    request.payload.insert(request.payload.end(), query.begin(), query.end());
+    request.header.payload_size = static_cast<uint32_t>(request.payload.size());
+    add_message_to_send_queue(std::move(request));
+    return tag;
+}
+
+void Client::detach_virtual_client(uint32_t virtual_id) {
+    {
+        std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+        if (virtual_clients_.erase(virtual_id) == 0) return;
+    }
+    add_message_to_send_queue(common::Message(common::MessageType::MUX_DETACH, virtual_id, 0, ""));
+}
+
+bool Client::send_chat_message_as(uint32_t virtual_id, const std::string& text) {
+    {
+        std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+        if (virtual_clients_.count(virtual_id) == 0) return false;
+    }
+    add_message_to_send_queue(common::Message(common::MessageType::TEXT_MESSAGE, virtual_id, 0, text));
+    return true;
+}
+
+void Client::handle_mux_attached(const common::Message& msg) {
+    {
+        std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+        virtual_clients_.insert(msg.header.recipient_id);
+    }
+    if (!events_.on_virtual_client_attached) return;
+    uint32_t virtual_id = msg.header.recipient_id;
+    post([this, virtual_id] { events_.on_virtual_client_attached(virtual_id); });
+}
+
+class Client::RosterAwaiter {
+public:
+    RosterAwaiter(Client& client, std::vector<uint32_t>& online) : client_(client), online_(online) {}
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        Client& client = client_; // *this is gone once another thread resumes the coroutine
+        {
+            std::lock_guard<std::mutex> lock(client.roster_mutex_);
+            if (!client.connected_) return false; // The receive thread has already failed the waiters
+            client.roster_waiters_.push_back(RosterWaiter{handle, &online_});
+        }
+        client.send_roster_request(false);
+        return true;
+    }
+    void await_resume() const noexcept {}
+
+private:
+    Client& client_;
+    std::vector<uint32_t>& online_;
+};
+
+common::Task<std::vector<uint32_t>> Client::fetch_roster() {
+    std::vector<uint32_t> online;
+    co_await RosterAwaiter(*this, online);
+    co_return online;
+}
+
+bool Client::request_roster() {
+    if (!connected_) {
+        return false;
+    }
+    send_roster_request(true);
+    return true;
+}
+
+void Client::send_roster_request(bool report_result) {
+    common::Message request(common::MessageType::ROSTER_REQUEST, client_id_.load(), 0, "");
+    {
+        std::lock_guard<std::mutex> lock(roster_mutex_);
+        roster_requested_ = roster_requested_ || report_result;
+        common::append_u32(request.payload, roster_epoch_);
+        common::append_u32(request.payload, roster_version_);
+    }
+    request.header.payload_size = static_cast<uint32_t>(request.payload.size());
+    add_message_to_send_queue(std::move(request));
+}
+
+void Client::handle_roster_message(const common::Message& msg) {
+    const auto& payload = msg.payload;
+    auto ids_fit = [&payload](size_t offset, uint32_t count) { return (payload.size() - offset) / 4 >= count; };
+    std::unique_lock<std::mutex> lock(roster_mutex_);
+    if (msg.header.type == common::MessageType::ROSTER_SNAPSHOT) {
+        if (payload.size() < 12) return;
+        uint32_t count = common::read_u32(payload.data() + 8);
+        if (!ids_fit(12, count)) return;
+        roster_.clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            roster_.insert(common::read_u32(payload.data() + 12 + i * 4));
+        }
+        roster_epoch_ = common::read_u32(payload.data());
+        roster_version_ = common::read_u32(payload.data() + 4);
+    } else {
+        if (payload.size() < 16) return;
+        if (common::read_u32(payload.data()) != roster_epoch_ || common::read_u32(payload.data() + 4) != roster_version_) {
+            return; // Based on a version we no longer hold; a later reply brings us up to date
+        }
+        size_t offset = 12;
+        for (int pass = 0; pass < 2; ++pass) { // Added, then removed
+            if (payload.size() < offset + 4) return;
+            uint32_t count = common::read_u32(payload.data() + offset);
+            offset += 4;
+            if (!ids_fit(offset, count)) return;
+            for (uint32_t i = 0; i < count; ++i, offset += 4) {
+                uint32_t id = common::read_u32(payload.data() + offset);
+                if (pass == 0) {
+                    roster_.insert(id);
+                } else {
+                    roster_.erase(id);
+                }
+            }
+        }
+        roster_version_ = common::read_u32(payload.data() + 8);
+    }
+
+    std::vector<RosterWaiter> waiters;
+    waiters.swap(roster_waiters_);
+    for (const auto& waiter : waiters) {
+        waiter.online->assign(roster_.begin(), roster_.end());
+    }
+    bool report = roster_requested_ && events_.on_roster;
+    roster_requested_ = false;
+    std::vector<uint32_t> online;
+    if (report) online.assign(roster_.begin(), roster_.end());
+    lock.unlock(); // A resumed coroutine may well ask again
+
+    for (const auto& waiter : waiters) {
+        post([handle = waiter.handle] { handle.resume(); });
+    }
+    if (report) post([this, online] { events_.on_roster(online); });
+}
+
+bool Client::request_file_transfer(const std::string& recipient_id_str, const std::string& file_path) {
+    if (!connected_ || !file_transfer_handler_) {
+        return false;
     }
     file_transfer_handler_->request_file_transfer(recipient_id_str, file_path);
+    return true;
 }
 
 
 void Client::add_message_to_send_queue(common::Message msg) {
     {
         std::lock_guard<std::mutex> lock(send_queue_mutex_);
-        send_queue_.push(std::move(msg));
+        send_queue_.push_back(std::move(msg));
     }
     send_queue_cv_.notify_one(); // Notify send_thread
 }
 
 
 void Client::receive_messages() {
-    std::cout << "Client: Receive thread started." << std::endl;
-    std::vector<char> temp_buffer(4096);
+    constexpr size_t kReceiveChunk = 4096;
+    std::vector<char> temp_buffer(kReceiveChunk);
 
     while (connected_) {
         if (!socket_ || !socket_->is_valid()) {
-            if(connected_) std::cerr << "Client: Socket became invalid in receive thread." << std::endl;
+            if (connected_) report_error("Socket became invalid.");
             connected_ = false;
             break;
         }
 
-        int bytes_received = socket_->receive_data(temp_buffer, temp_buffer.size());
+        // Not temp_buffer.size(): receive_data shrinks it to what the last read returned
+        int bytes_received = socket_->receive_data(temp_buffer, kReceiveChunk);
 
         if (bytes_received < 0) { // Error
-            if (connected_) std::cerr << "Client: Receive error. Disconnecting." << std::endl;
+            if (connected_) report_error("Receive error. Disconnecting.");
             connected_ = false; // Signal other threads
             break;
         }
         if (bytes_received == 0) { // Connection closed by server
-            if (connected_) std::cout << "Client: Connection closed by server." << std::endl;
             connected_ = false; // Signal other threads
             break;
         }
@@ -141,7 +377,7 @@ void Client::receive_messages() {
 
                 common::MessageHeader temp_header;
                  if (!common::deserialize_header(receive_buffer_, temp_header)) {
-                     std::cerr << "Client: Failed to deserialize header from buffer." << std::endl;
+                     report_error("Failed to deserialize a header from the server.");
                      receive_buffer_.clear(); 
                      break;
                 }
@@ -149,101 +385,332 @@ void Client::receive_messages() {
                 if (receive_buffer_.size() < common::HEADER_SIZE + temp_header.payload_size) {
                     break; 
                 }
-                msg = common::deserialize_message_from_buffer(receive_buffer_);
-            }
-
-            if (msg.header.type == common::MessageType::ERROR_MESSAGE) {
-                std::cerr << "Client: Failed to deserialize message from server or incomplete." << std::endl;
-                break; 
+                // ERROR_MESSAGE is a frame like any other; failure is the return value
+                size_t consumed = 0;
+                if (!common::deserialize_message(receive_buffer_.data(), receive_buffer_.size(), msg, consumed)) {
+                    report_error("Failed to deserialize a message from the server.");
+                    receive_buffer_.clear();
+                    break;
+                }
+                receive_buffer_.erase(receive_buffer_.begin(), receive_buffer_.begin() + consumed);
             }
             process_incoming_message(msg);
         }
         // std::this_thread::sleep_for(std::chrono::milliseconds(10)); // If non-blocking
     }
-    std::cout << "Client: Receive thread finished." << std::endl;
     // If disconnected here, ensure main UI loop knows
     connected_ = false; 
     send_queue_cv_.notify_one(); // Wake up send thread if it's waiting, so it can exit
+    std::vector<RosterWaiter> roster_waiters;
+    {
+        std::lock_guard<std::mutex> lock(roster_mutex_);
+        roster_waiters.swap(roster_waiters_);
+    }
+    for (const auto& waiter : roster_waiters) {
+        post([handle = waiter.handle] { handle.resume(); }); // With an empty roster
+    }
+    if (events_.on_disconnected) post([this] { events_.on_disconnected(); });
 }
 
 void Client::send_messages() {
-    std::cout << "Client: Send thread started." << std::endl;
     while (connected_) {
         common::Message msg_to_send;
+        bool have_message = false;
+        int64_t wait_ms = reliable_wait_ms();
         {
             std::unique_lock<std::mutex> lock(send_queue_mutex_);
-            send_queue_cv_.wait(lock, [this] {
-                return !connected_ || !send_queue_.empty();
-            });
+            auto ready = [this] { return !connected_ || !send_queue_.empty(); };
+            if (wait_ms < 0) {
+                send_queue_cv_.wait(lock, ready);
+            } else {
+                send_queue_cv_.wait_for(lock, std::chrono::milliseconds(wait_ms), ready); // Also woken when an ACK falls due
+            }
 
             if (!connected_ && send_queue_.empty()) { // Check if woken up to exit
                 break;
             }
-            if (send_queue_.empty()) { // Spurious wakeup or woken to exit but queue is empty
-                continue;
+            if (!send_queue_.empty()) {
+                msg_to_send = std::move(send_queue_.front());
+                send_queue_.pop_front();
+                have_message = true;
             }
-
-            msg_to_send = std::move(send_queue_.front());
-            send_queue_.pop();
         } // Mutex released
 
-        if (socket_ && socket_->is_valid()) {
-            auto serialized_msg = common::serialize_message(msg_to_send);
-            if (socket_->send_data(serialized_msg) <= 0) {
-                std::cerr << "Client: Failed to send message. Disconnecting." << std::endl;
-                connected_ = false; // Signal other threads
-                if (socket_ && socket_->is_valid()) socket_->close_socket(); // Help unblock receive
-                break; 
-            }
-        } else {
-            if(connected_) std::cerr << "Client: Socket invalid in send thread." << std::endl;
+        if (!socket_ || !socket_->is_valid()) {
+            if (connected_) report_error("Socket became invalid.");
             connected_ = false;
             break;
         }
+        bool ok = true;
+        if (have_message) {
+            if ((msg_to_send.header.flags & common::kFlagReliable) && msg_to_send.header.delivery_sequence == 0) {
+                std::lock_guard<std::mutex> lock(reliable_mutex_);
+                if (!outbound_.track(msg_to_send, steady_now_ms())) {
+                    report_error("Too many unacknowledged messages; sending without delivery guarantee.");
+                    msg_to_send.header.flags &= ~common::kFlagReliable;
+                }
+            }
+            // While resuming, reliable frames wait for SESSION_RESUMED; the window resends them then
+            bool deferred = resuming_ && (msg_to_send.header.flags & common::kFlagReliable);
+            ok = deferred || transmit(msg_to_send);
+        }
+        ok = ok && flush_reliable();
+        if (!ok) {
+            report_error("Failed to send message. Disconnecting.");
+            connected_ = false; // Signal other threads
+            if (socket_ && socket_->is_valid()) socket_->shutdown_socket(); // Help unblock receive
+            break;
+        }
+    }
+}
+
+bool Client::transmit(const common::Message& msg) {
+    auto serialized_msg = common::serialize_message(msg);
+    return socket_->send_data(serialized_msg) > 0;
+}
+
+bool Client::flush_reliable() {
+    std::vector<common::Message> frames;
+    {
+        std::lock_guard<std::mutex> lock(reliable_mutex_);
+        int64_t now_ms = steady_now_ms();
+        if (inbound_.ms_until_ack(now_ms) == 0) {
+            frames.push_back(inbound_.make_ack());
+        }
+        if (!resuming_) {
+            for (auto& msg : outbound_.take_due(now_ms)) {
+                frames.push_back(std::move(msg));
+            }
+        }
+    }
+    for (const auto& frame : frames) {
+        if (!transmit(frame)) return false;
+    }
+    return true;
+}
+
+int64_t Client::reliable_wait_ms() {
+    std::lock_guard<std::mutex> lock(reliable_mutex_);
+    int64_t wait_ms = inbound_.ms_until_ack(steady_now_ms());
+    if (outbound_.size() > 0) {
+        // Retransmissions are checked at a quarter of their timeout
+        int64_t check_ms = std::max<int64_t>(reliable_config_.retransmit_after_ms / 4, 1);
+        wait_ms = wait_ms < 0 ? check_ms : std::min(wait_ms, check_ms);
     }
-    std::cout << "Client: Send thread finished." << std::endl;
+    return wait_ms;
+}
+
+void Client::restart_reliable_delivery(bool fresh_session) {
+    std::vector<common::Message> frames;
+    {
+        std::lock_guard<std::mutex> lock(reliable_mutex_);
+        int64_t now_ms = steady_now_ms();
+        if (fresh_session) inbound_.reset();
+        frames.push_back(inbound_.make_ack()); // Also opts this connection into reliable frames
+        for (auto& msg : fresh_session ? outbound_.restart(now_ms) : outbound_.take_all(now_ms)) {
+            frames.push_back(std::move(msg));
+        }
+    }
+    {
+        // Ahead of anything queued meanwhile, which may be numbered after these
+        std::lock_guard<std::mutex> lock(send_queue_mutex_);
+        send_queue_.insert(send_queue_.begin(), std::make_move_iterator(frames.begin()),
+                           std::make_move_iterator(frames.end()));
+    }
+    send_queue_cv_.notify_one();
 }
 
 void Client::process_incoming_message(const common::Message& msg) {
-    // Simple console output for now
-    std::string payload_str(msg.payload.begin(), msg.payload.end());
+    // Heartbeats are answered silently, without disturbing the prompt
+    if (msg.header.type == common::MessageType::PING) {
+        add_message_to_send_queue(common::Message(common::MessageType::PONG, client_id_.load(), 0, ""));
+        return;
+    }
+    if (msg.header.type == common::MessageType::PONG) {
+        return;
+    }
+    if (msg.header.type == common::MessageType::ACK) {
+        common::AckRanges ack;
+        if (common::parse_ack(msg, ack)) {
+            std::lock_guard<std::mutex> lock(reliable_mutex_);
+            outbound_.on_ack(ack);
+        }
+        return;
+    }
+    if (msg.header.flags & common::kFlagReliable) {
+        bool duplicate;
+        bool ack_now;
+        {
+            std::lock_guard<std::mutex> lock(reliable_mutex_);
+            int64_t now_ms = steady_now_ms();
+            duplicate = inbound_.is_duplicate(msg.header.delivery_sequence);
+            inbound_.on_receive(msg.header.delivery_sequence, now_ms);
+            ack_now = inbound_.ms_until_ack(now_ms) == 0;
+        }
+        if (ack_now) send_queue_cv_.notify_one(); // The send thread sends it
+        if (duplicate) return;
+    }
+    if (msg.header.type == common::MessageType::SESSION_WELCOME ||
+        msg.header.type == common::MessageType::SESSION_RESUMED) {
+        handle_session_message(msg);
+        return;
+    }
+    if (msg.header.type == common::MessageType::ROSTER_SNAPSHOT ||
+        msg.header.type == common::MessageType::ROSTER_DELTA) {
+        handle_roster_message(msg);
+        return;
+    }
+    if (msg.header.type == common::MessageType::MUX_ATTACHED) {
+        handle_mux_attached(msg);
+        return;
+    }
+    if (msg.header.type == common::MessageType::SEARCH_RESULTS) {
+        report_search_results(msg);
+        return;
+    }
+    if (msg.header.type == common::MessageType::PRESENCE_DIGEST && !msg.payload.empty() &&
+        (msg.payload[0] & common::kPresenceTruncated)) {
+        send_roster_request(false); // The digest only had counts; refresh the cache in the background
+    }
+    if (msg.header.sequence != 0) {
+        if (resuming_) {
+            held_messages_.push_back(msg); // Shown in order once the replay is complete
+            return;
+        }
+        last_sequence_ = msg.header.sequence;
+    }
+    deliver_message(msg);
+}
 
+void Client::handle_session_message(const common::Message& msg) {
+    const auto& payload = msg.payload;
+    if (msg.header.type == common::MessageType::SESSION_WELCOME) {
+        if (payload.size() < 12) return;
+        client_id_ = msg.header.recipient_id;
+        fresh_token_ = common::read_u64(payload.data());
+        fresh_sequence_ = common::read_u32(payload.data() + 8);
+        if (!resuming_) {
+            session_token_ = fresh_token_;
+            last_sequence_ = fresh_sequence_;
+            restart_reliable_delivery(true);
+        }
+        return;
+    }
+
+    // SESSION_RESUMED: the replay is complete, everything held can be shown
+    if (payload.size() < 13 || !resuming_) return;
+    auto status = static_cast<common::ResumeStatus>(payload[0]);
+    uint32_t replayed = common::read_u32(payload.data() + 9);
+    if (status == common::ResumeStatus::UNKNOWN) {
+        session_token_ = fresh_token_;
+        last_sequence_ = fresh_sequence_;
+    }
+    if (events_.on_session_resumed) {
+        post([this, status, replayed] { events_.on_session_resumed(status, replayed); });
+    }
+    resuming_ = false;
+    restart_reliable_delivery(status == common::ResumeStatus::UNKNOWN);
+
+    std::sort(held_messages_.begin(), held_messages_.end(), [](const common::Message& a, const common::Message& b) {
+        return a.header.sequence < b.header.sequence;
+    });
+    for (const auto& held : held_messages_) {
+        if (held.header.sequence <= last_sequence_) continue; // Replayed and delivered live
+        last_sequence_ = held.header.sequence;
+        deliver_message(held);
+    }
+    held_messages_.clear();
+}
+
+void Client::deliver_message(const common::Message& msg) {
     switch (msg.header.type) {
-        case common::MessageType::TEXT_MESSAGE:
-            std::cout << "\n[" << (msg.header.sender_id == 0 ? "Server" : "User " + std::to_string(msg.header.sender_id))
-                      << "]: " << payload_str << std::endl;
-            break;
-        case common::MessageType::CLIENT_JOINED:
-            // If server assigns ID upon join, this is where we might get it.
-            // For now, just print the notification.
-            // if (client_id_ == 0 && msg.header.recipient_id == SOME_SPECIAL_ID_FOR_SELF) {
-            //    client_id_ = msg.header.payload_as_uint32; // Example
-            // }
-            std::cout << "\n[Notification]: " << payload_str << std::endl;
-            break;
-        case common::MessageType::CLIENT_LEFT:
-            std::cout << "\n[Notification]: " << payload_str << std::endl;
-            break;
+        case common::MessageType::PRESENCE_DIGEST:
+            report_presence(msg);
+            return;
         case common::MessageType::SERVER_SHUTDOWN:
-            std::cout << "\n[Server]: " << payload_str << ". Disconnecting." << std::endl;
             connected_ = false; // Trigger disconnect
             break;
         case common::MessageType::FILE_TRANSFER_REQUEST: // Fallthrough for stubs
         case common::MessageType::FILE_TRANSFER_DATA:
         case common::MessageType::FILE_TRANSFER_ACK:
-            file_transfer_handler_->handle_message(msg);
+            if (file_transfer_handler_) {
+                file_transfer_handler_->handle_message(msg);
+                return;
+            }
             break;
         case common::MessageType::ERROR_MESSAGE:
-             std::cout << "\n[Error from Server]: " << payload_str << std::endl;
-             break;
+            report_error(std::string(msg.payload.begin(), msg.payload.end()));
+            return;
+        case common::MessageType::EPHEMERAL: {
+            std::string key;
+            std::string value;
+            if (!events_.on_ephemeral || !common::parse_ephemeral(msg, key, value)) break;
+            uint32_t sender_id = msg.header.sender_id;
+            post([this, sender_id, key, value] { events_.on_ephemeral(sender_id, key, value); });
+            return;
+        }
         default:
-            std::cout << "\nClient: Received unhandled message type: " << static_cast<int>(msg.header.type) << std::endl;
             break;
     }
-    std::cout << "Enter message (or '/quit', '/file <id> <path>'): "; // Re-prompt
-    std::cout.flush();
+    if (events_.on_message) {
+        post([this, msg] { events_.on_message(msg); });
+    }
+}
+
+void Client::report_presence(const common::Message& msg) {
+    if (!events_.on_presence) return;
+    PresenceUpdate update;
+    if (!parse_presence(msg, update)) {
+        report_error("Malformed presence digest.");
+        return;
+    }
+    post([this, update] { events_.on_presence(update); });
 }
 
+void Client::report_search_results(const common::Message& msg) {
+    if (!events_.on_search_results) return;
+    const auto& payload = msg.payload;
+    SearchResults results;
+    bool valid = payload.size() >= 16;
+    if (valid) {
+        results.tag = common::read_u32(payload.data());
+        results.next_cursor = common::read_u64(payload.data() + 4);
+        uint32_t count = common::read_u32(payload.data() + 12);
+        size_t offset = 16;
+        for (uint32_t i = 0; i < count && valid; ++i) {
+            valid = payload.size() - offset >= 12;
+            if (!valid) break;
+            SearchResults::Hit hit;
+            hit.sequence = common::read_u32(payload.data() + offset);
+            hit.sender_id = common::read_u32(payload.data() + offset + 4);
+            uint32_t size = common::read_u32(payload.data() + offset + 8);
+            offset += 12;
+            valid = payload.size() - offset >= size;
+            if (!valid) break;
+            hit.text.assign(payload.data() + offset, size);
+            offset += size;
+            results.hits.push_back(std::move(hit));
+        }
+    }
+    if (!valid) {
+        report_error("Malformed search results.");
+        return;
+    }
+    post([this, results] { events_.on_search_results(results); });
+}
+
+void Client::report_error(std::string text) {
+    if (!events_.on_error) return;
+    post([this, text] { events_.on_error(text); });
+}
+
+void Client::post(std::function<void()> task) {
+    if (executor_) {
+        executor_(std::move(task));
+    } else {
+        task();
+    }
+}
 
 } // namespace client
 } // namespace chat_app
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "client/client.h"
+#include "client/basic_client_file_transfer_handler.h" // Stub
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <vector> // For string splitting
@@ -15,11 +17,116 @@ std::vector<std::string> split(const std::string& s, char delimiter) {
     return tokens;
 }
 
+std::atomic<uint64_t> next_search_cursor{0}; // Of the last search results; 0 if there are no more
+
+void print_prompt() {
+    std::cout << "Enter message (or '/quit', '/file <id> <path>'): ";
+    std::cout.flush();
+}
+
+// "joined 4, 7; left 2 (12 online)"
+std::string describe_presence(const chat_app::client::PresenceUpdate& update) {
+    std::string text;
+    auto describe = [&](const char* label, uint32_t count, const std::vector<uint32_t>& ids) {
+        if (count == 0) return;
+        if (!text.empty()) text += "; ";
+        text += std::string(label) + " ";
+        if (update.truncated) {
+            text += std::to_string(count) + " clients";
+            return;
+        }
+        for (size_t i = 0; i < ids.size(); ++i) {
+            text += (i ? ", " : "") + std::to_string(ids[i]);
+        }
+    };
+    describe("joined", update.joined_count, update.joined);
+    describe("left", update.left_count, update.left);
+    return text + " (" + std::to_string(update.members) + " online)";
+}
+
+// The console UI: prints whatever the client reports, then prompts again.
+chat_app::client::ClientEvents console_events() {
+    using namespace chat_app;
+    client::ClientEvents events;
+    events.on_message = [](const common::Message& msg) {
+        std::string payload_str(msg.payload.begin(), msg.payload.end());
+        switch (msg.header.type) {
+            case common::MessageType::TEXT_MESSAGE:
+                std::cout << "\n[" << (msg.header.sender_id == 0 ? "Server" : "User " + std::to_string(msg.header.sender_id))
+                          << (msg.header.recipient_id != 0 ? " to you" : "")
+                          << ((msg.header.flags & common::kFlagStored) ? ", while you were away" : "")
+                          << "]: " << payload_str << std::endl;
+                break;
+            case common::MessageType::CLIENT_JOINED:
+            case common::MessageType::CLIENT_LEFT:
+                std::cout << "\n[Notification]: " << payload_str << std::endl;
+                break;
+            case common::MessageType::SERVER_SHUTDOWN:
+                std::cout << "\n[Server]: " << payload_str << ". Disconnecting." << std::endl;
+                break;
+            default:
+                std::cout << "\nClient: Received unhandled message type: " << static_cast<int>(msg.header.type) << std::endl;
+                break;
+        }
+        print_prompt();
+    };
+    events.on_presence = [](const client::PresenceUpdate& update) {
+        std::cout << "\n[Presence]: " << describe_presence(update) << std::endl;
+        print_prompt();
+    };
+    events.on_ephemeral = [](uint32_t sender_id, const std::string& key, const std::string& value) {
+        if (key == "typing") {
+            std::cout << "\n[User " << sender_id << (value == "1" ? " is typing]" : " stopped typing]") << std::endl;
+        } else {
+            std::cout << "\n[User " << sender_id << " " << key << "]: " << value << std::endl;
+        }
+        print_prompt();
+    };
+    events.on_roster = [](const std::vector<uint32_t>& online) {
+        std::cout << "\n[Online (" << online.size() << ")]:";
+        for (uint32_t id : online) {
+            std::cout << " " << id;
+        }
+        std::cout << std::endl;
+        print_prompt();
+    };
+    events.on_search_results = [](const client::SearchResults& results) {
+        std::cout << "\n[Search]: " << results.hits.size() << (results.hits.size() == 1 ? " match" : " matches")
+                  << (results.next_cursor ? "; '/more' for older ones" : "") << std::endl;
+        for (const auto& hit : results.hits) {
+            std::cout << "  #" << hit.sequence << " [User " << hit.sender_id << "]: " << hit.text << std::endl;
+        }
+        next_search_cursor = results.next_cursor;
+        print_prompt();
+    };
+    events.on_session_resumed = [](common::ResumeStatus status, uint32_t replayed) {
+        if (status == common::ResumeStatus::UNKNOWN) {
+            std::cout << "\n[Notification]: Could not resume the previous session; messages sent meanwhile are lost."
+                      << std::endl;
+        } else {
+            std::cout << "\n[Notification]: Session resumed, " << replayed << " missed messages"
+                      << (status == common::ResumeStatus::PARTIAL ? " (older ones are no longer available)" : "")
+                      << "." << std::endl;
+        }
+    };
+    events.on_virtual_client_attached = [](uint32_t virtual_id) {
+        std::cout << "\n[Notification]: Virtual client " << virtual_id << " attached." << std::endl;
+        print_prompt();
+    };
+    events.on_error = [](const std::string& text) {
+        std::cout << "\n[Error]: " << text << std::endl;
+    };
+    events.on_disconnected = [] {
+        std::cout << "\nClient: Connection closed." << std::endl;
+    };
+    return events;
+}
 
 int main(int argc, char* argv[]) {
     std::string server_ip = "127.0.0.1";
     int server_port = 8080;
 
+    // Same-host clients can pass unix:PATH or shm:PATH instead of an IP; the port is then unused
     if (argc > 1) {
         server_ip = argv[1];
     }
@@ -32,6 +139,8 @@ int main(int argc, char* argv[]) {
     }
 
     chat_app::client::Client client;
+    client.set_events(console_events());
+    client.set_file_transfer_handler(std::make_unique<chat_app::client::BasicClientFileTransferHandler>());
 
     if (!client.connect_to_server(server_ip, server_port)) {
         return 1;
@@ -39,7 +148,16 @@ int main(int argc, char* argv[]) {
 
     std::cout << "Connected to server. Type '/quit' to exit." << std::endl;
     std::cout << "Type '/file <recipient_id> <file_path>' to request a file transfer (stub)." << std::endl;
+    std::cout << "Type '/reconnect' to drop the connection and resume the session." << std::endl;
+    std::cout << "Type '/alert <text>' to send a message with guaranteed delivery." << std::endl;
+    std::cout << "Type '/who' to list who is online." << std::endl;
+    std::cout << "Type '/msg <id> <text>' to message one user; it waits for them if they are away." << std::endl;
+    std::cout << "Type '/typing', '/stopped' or '/status <text>' to update what others see of you." << std::endl;
+    std::cout << "Type '/search <words or \"a phrase\">' to search the history, '/more' for older matches." << std::endl;
+    std::cout << "Type '/attach', '/as <id> <text>' or '/detach <id>' to speak for extra users on this connection."
+              << std::endl;
     std::string line;
+    std::string last_search;
 
     while (true) {
         std::cout << "Enter message (or '/quit', '/file <id> <path>'): ";
@@ -48,8 +166,60 @@ int main(int argc, char* argv[]) {
         if (std::cin.eof() || line == "/quit") {
             break;
         }
-        
-        if (line.rfind("/file", 0) == 0) { // Check if line starts with /file
+
+        if (!client.is_connected() || line == "/reconnect") {
+            if (!client.is_connected()) std::cout << "Connection lost. Resuming session..." << std::endl;
+            if (!client.reconnect()) continue;
+            if (line == "/reconnect") continue;
+        }
+
+        if (line == "/who") {
+            client.request_roster();
+        } else if (line == "/typing" || line == "/stopped") {
+            client.send_ephemeral("typing", line == "/typing" ? "1" : "0");
+        } else if (line.rfind("/status ", 0) == 0) {
+            client.send_ephemeral("status", line.substr(8));
+        } else if (line.rfind("/search ", 0) == 0) {
+            last_search = line.substr(8);
+            next_search_cursor = 0;
+            client.search(last_search);
+        } else if (line == "/more") {
+            if (last_search.empty() || next_search_cursor == 0) {
+                std::cout << "No more matches." << std::endl;
+            } else {
+                client.search(last_search, 20, next_search_cursor);
+            }
+        } else if (line == "/attach") {
+            client.attach_virtual_client();
+        } else if (line.rfind("/as ", 0) == 0 || line.rfind("/detach ", 0) == 0) {
+            auto parts = split(line, ' ');
+            uint32_t virtual_id = 0;
+            try {
+                virtual_id = parts.size() > 1 ? static_cast<uint32_t>(std::stoul(parts[1])) : 0;
+            } catch (const std::exception&) {
+            }
+            size_t text_start = line.find(' ', 4);
+            std::string text = text_start == std::string::npos ? "" : line.substr(text_start + 1);
+            if (parts[0] == "/detach") {
+                client.detach_virtual_client(virtual_id);
+            } else if (text.empty() || !client.send_chat_message_as(virtual_id, text)) {
+                std::cout << "Usage: /as <attached virtual client id> <text>" << std::endl;
+            }
+        } else if (line.rfind("/msg ", 0) == 0) {
+            auto parts = split(line, ' ');
+            uint32_t recipient_id = 0;
+            try {
+                recipient_id = parts.size() > 1 ? static_cast<uint32_t>(std::stoul(parts[1])) : 0;
+            } catch (const std::exception&) {
+            }
+            size_t text_start = line.find(' ', 5);
+            std::string text = text_start == std::string::npos ? "" : line.substr(text_start + 1);
+            if (text.empty() || !client.send_direct_message(recipient_id, text, true)) {
+                std::cout << "Usage: /msg <user id> <text>" << std::endl;
+            }
+        } else if (line.rfind("/alert ", 0) == 0) {
+            client.send_chat_message(line.substr(7), true);
+        } else if (line.rfind("/file", 0) == 0) { // Check if line starts with /file
             auto parts = split(line, ' ');
             if (parts.size() == 3) {
                 client.request_file_transfer(parts[1], parts[2]);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "event_loop.h"
+#include "isocket.h" // For WaitResult
+#include "task.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// Awaitable I/O on a connected socket, driven by an EventLoop:
+//
+//     int n = co_await sock.recv(data, sizeof(data));
+//     co_await sock.send(frame);
+//
+// Does not own the descriptor and leaves it in blocking mode, so other
+// threads may keep writing to it with ISocket::send_data. Create, use and
+// destroy it on the loop thread, and only while no coroutine awaits it.
+class AsyncSocket : private EventLoop::Watcher {
+public:
+    static constexpr int kWouldBlock = -2;
+
+    class ReadyAwaiter {
+    public:
+        ReadyAwaiter(AsyncSocket& socket, bool for_write, int64_t timeout_ms)
+            : socket_(socket), for_write_(for_write), timeout_ms_(timeout_ms), result_(WaitResult::FAILED) {}
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        WaitResult await_resume() const noexcept { return result_; }
+
+    private:
+        friend class AsyncSocket;
+        AsyncSocket& socket_;
+        bool for_write_;
+        int64_t timeout_ms_;
+        WaitResult result_;
+        std::coroutine_handle<> handle_;
+        EventLoop::Timer timer_;
+    };
+
+    AsyncSocket(EventLoop& loop, int fd);
+    ~AsyncSocket();
+
+    AsyncSocket(const AsyncSocket&) = delete;
+    AsyncSocket& operator=(const AsyncSocket&) = delete;
+
+    bool is_watched() const { return watched_; }
+
+    // READABLE once data or EOF is waiting (or, for writable(), once there is
+    // room), TIMEOUT after timeout_ms (-1 waits forever), WOKEN after cancel().
+    ReadyAwaiter readable(int64_t timeout_ms = -1) { return ReadyAwaiter(*this, false, timeout_ms); }
+    ReadyAwaiter writable(int64_t timeout_ms = -1) { return ReadyAwaiter(*this, true, timeout_ms); }
+
+    // Returns bytes read, 0 on EOF, -1 on error or kWouldBlock.
+    int try_recv(char* data, size_t len);
+    // As try_recv, waiting until it would not block; -1 once cancelled.
+    Task<int> recv(char* data, size_t len);
+    // Writes all of data; returns data.size(), or -1 on failure or cancel.
+    Task<int> send(const std::vector<char>& data);
+
+    // Wakes the current and every later wait with WOKEN.
+    void cancel();
+
+private:
+    void on_ready(uint32_t events) override;
+    // Empties the slot and returns the coroutine to resume with result.
+    std::coroutine_handle<> release(ReadyAwaiter*& waiter, WaitResult result);
+    void wake(bool reader_ready, bool writer_ready, WaitResult result);
+
+    EventLoop& loop_;
+    int fd_;
+    bool watched_;
+    // Edge-triggered: assume ready until a call would block
+    bool readable_;
+    bool writable_;
+    bool hangup_;
+    bool cancelled_;
+    ReadyAwaiter* reader_;
+    ReadyAwaiter* writer_;
+};
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef> // For size_t
+#include <mutex>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// Receive buffers of one size shared by many connections. A reader borrows
+// one only once its socket is readable and gives it back before waiting
+// again, so idle connections hold no receive memory. Up to max_free returned
+// buffers are kept for the next borrower; the rest are freed.
+class BufferPool {
+public:
+    // A borrowed buffer, returned to the pool on destruction.
+    class Lease {
+    public:
+        Lease() = default;
+        ~Lease() { reset(); }
+        Lease(Lease&& other) noexcept : pool_(other.pool_), buffer_(std::move(other.buffer_)) { other.pool_ = nullptr; }
+        Lease& operator=(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        char* data() { return buffer_.data(); }
+        size_t size() const { return pool_ ? pool_->buffer_size_ : 0; }
+        // For ISocket::receive_data, which resizes it: pass size() as max_len.
+        std::vector<char>& buffer() { return buffer_; }
+        void reset(); // Returns the buffer early
+
+    private:
+        friend class BufferPool;
+        Lease(BufferPool* pool, std::vector<char> buffer) : pool_(pool), buffer_(std::move(buffer)) {}
+
+        BufferPool* pool_ = nullptr;
+        std::vector<char> buffer_;
+    };
+
+    BufferPool(size_t buffer_size, size_t max_free);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Must outlive the lease.
+    Lease acquire();
+
+    size_t buffer_size() const { return buffer_size_; }
+    size_t borrowed() const; // Buffers currently lent out
+    size_t free_count() const;
+
+private:
+    void release(std::vector<char> buffer);
+
+    const size_t buffer_size_;
+    const size_t max_free_;
+    mutable std::mutex mutex_;
+    std::vector<std::vector<char>> free_; // Each sized buffer_size_
+    size_t borrowed_;
+};
+
+} // namespace common
+} // namespace chat_app
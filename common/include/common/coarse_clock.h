@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint> // For int64_t
+#include <thread>
+
+namespace chat_app {
+namespace common {
+
+// Millisecond clock advanced by a background thread, so hot paths read the
+// time with one relaxed atomic load instead of a clock_gettime call.
+// Readings lag real time by at most one tick.
+class CoarseClock {
+public:
+    explicit CoarseClock(std::chrono::milliseconds tick = std::chrono::milliseconds(5));
+    ~CoarseClock();
+
+    CoarseClock(const CoarseClock&) = delete;
+    CoarseClock& operator=(const CoarseClock&) = delete;
+
+    void start();
+    void stop();
+
+    // Milliseconds on a monotonic scale. Valid before start() (it is
+    // sampled once on construction) but only advances while running.
+    int64_t now_ms() const {
+        return now_ms_.load(std::memory_order_relaxed);
+    }
+
+    std::chrono::milliseconds tick() const { return tick_; }
+
+private:
+    static int64_t sample_ms();
+    void run(); // Thread function
+
+    std::chrono::milliseconds tick_;
+    std::atomic<int64_t> now_ms_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+} // namespace common
+} // namespace chat_app
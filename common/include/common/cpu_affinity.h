@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// CPU topology and thread pinning (Linux). Elsewhere there are no usable CPUs
+// to report, pinning fails and every CPU is on an unknown node.
+
+// The CPUs this process may run on, ascending. Empty if unknown.
+std::vector<int> usable_cpus();
+
+// NUMA node of cpu, from sysfs. -1 if unknown.
+int numa_node_of(int cpu);
+
+// Restricts the calling thread to cpu. False if it cannot be.
+bool pin_current_thread(int cpu);
+
+// "0-3,8" <-> {0, 1, 2, 3, 8}. parse_cpu_list returns false on malformed text.
+bool parse_cpu_list(const std::string& text, std::vector<int>& cpus);
+std::string format_cpu_list(std::vector<int> cpus);
+
+} // namespace common
+} // namespace chat_app
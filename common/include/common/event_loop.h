@@ -0,0 +1,124 @@
+#pragma once
+
+#include "task.h"
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// One thread multiplexing many coroutines over epoll (Linux only; see
+// supported()). Coroutines wait for sockets through AsyncSocket and for time
+// through sleep_for; a waiting coroutine costs its frame, not a thread.
+//
+// post() and spawn() are thread-safe. Everything else, and every coroutine
+// the loop runs, belongs to the loop thread.
+class EventLoop {
+public:
+    // Told when a watched fd becomes ready. `events` is a mask of kReadable,
+    // kWritable, kHangup and kError.
+    class Watcher {
+    public:
+        virtual void on_ready(uint32_t events) = 0;
+
+    protected:
+        ~Watcher() = default;
+    };
+
+    static constexpr uint32_t kReadable = 0x1;
+    static constexpr uint32_t kWritable = 0x2;
+    static constexpr uint32_t kHangup = 0x4; // Peer closed; reads and writes will not block
+    // A pending error, or only a message on the socket's error queue such as
+    // a zero-copy send completion: worth one read or write attempt, which
+    // reports the error if there is one.
+    static constexpr uint32_t kError = 0x8;
+
+    using Timer = std::pair<int64_t, uint64_t>; // (deadline_ms, sequence)
+
+    class SleepAwaiter {
+    public:
+        SleepAwaiter(EventLoop& loop, int64_t delay_ms) : loop_(loop), delay_ms_(delay_ms) {}
+        bool await_ready() const noexcept { return delay_ms_ <= 0; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            loop_.add_timer(delay_ms_, [handle] { handle.resume(); });
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        EventLoop& loop_;
+        int64_t delay_ms_;
+    };
+
+    class YieldAwaiter {
+    public:
+        explicit YieldAwaiter(EventLoop& loop) : loop_(loop) {}
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            loop_.post([handle] { handle.resume(); });
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        EventLoop& loop_;
+    };
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    static bool supported();
+
+    // Runs the loop on a thread of its own, pinned to cpu if >= 0. False if
+    // the loop cannot run.
+    bool start(int cpu = -1);
+    void stop();  // Joins it; anything still posted is dropped
+
+    void post(std::function<void()> task);
+    // Runs task on the loop thread until it completes, then frees it.
+    void spawn(Task<void> task);
+    bool in_loop_thread() const { return std::this_thread::get_id() == thread_id_; }
+
+    // Edge-triggered readiness for fd, reported to watcher until unwatch().
+    // Write readiness is only reported while want_writable(fd, true).
+    bool watch(int fd, Watcher* watcher);
+    void want_writable(int fd, Watcher* watcher, bool enabled);
+    void unwatch(int fd, Watcher* watcher); // watcher may be freed right after
+
+    Timer add_timer(int64_t delay_ms, std::function<void()> callback);
+    void cancel_timer(const Timer& timer);
+    SleepAwaiter sleep_for(int64_t delay_ms) { return SleepAwaiter(*this, delay_ms); }
+    // Resumes after everything already posted or ready.
+    YieldAwaiter yield() { return YieldAwaiter(*this); }
+
+private:
+    void run(); // Thread function
+    void run_posted();
+    void run_due_timers();
+    int next_timeout_ms() const;
+
+    int epoll_fd_;
+    int wake_fd_; // eventfd; post() writes it
+    std::thread thread_;
+    std::thread::id thread_id_;
+    std::atomic<bool> running_;
+    int cpu_; // -1: not pinned
+
+    std::vector<std::function<void()>> posted_;
+    std::mutex posted_mutex_;
+
+    std::map<Timer, std::function<void()>> timers_; // Loop thread only
+    std::vector<Watcher*> retired_; // Unwatched while handling a batch of events; skip theirs
+    uint64_t next_timer_sequence_;
+};
+
+} // namespace common
+} // namespace chat_app
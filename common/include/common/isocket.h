@@ -3,24 +3,89 @@
 #include <string>
 #include <vector>
 #include <cstddef> // For size_t
+#include <cstdint>
 #include <memory>  // For std::unique_ptr
 
 namespace chat_app {
 namespace common {
 
+enum class WaitResult {
+    READABLE, // Data (or EOF / a pending connection) is ready
+    WOKEN,    // wake_fd became readable first
+    TIMEOUT,
+    FAILED
+};
+
 class ISocket {
 public:
     virtual ~ISocket() = default;
 
     virtual bool connect_socket(const std::string& ip_address, int port) = 0;
     virtual bool bind_socket(int port) = 0;
+    // Before bind_socket: lets several sockets listen on the same port, the
+    // kernel spreading new connections among them (SO_REUSEPORT). False where
+    // that is not supported.
+    virtual bool set_reuse_port(bool enabled) { (void)enabled; return false; }
+    // After bind_socket, on a listening socket: asks the kernel to prefer it,
+    // among the sockets sharing its port, for connections whose packets
+    // arrive on cpu (SO_INCOMING_CPU). False where that is not supported.
+    virtual bool set_incoming_cpu(int cpu) { (void)cpu; return false; }
+    // On an accepted socket: the CPU that last received its packets, or -1.
+    virtual int incoming_cpu() const { return -1; }
     virtual bool listen_socket(int backlog) = 0;
     virtual std::unique_ptr<ISocket> accept_socket() = 0;
+    // Writes all of data, however many send() calls that takes. Returns
+    // data.size(), or -1 on failure (after which the stream is unusable).
     virtual int send_data(const std::vector<char>& data) = 0;
+    // As send_data, for a frame that must not change until the socket is done
+    // with it. Large ones may then leave without a copy into the kernel
+    // (see enable_zerocopy); the socket keeps a reference until they have.
+    virtual int send_shared(const std::shared_ptr<const std::vector<char>>& frame) { return frame ? send_data(*frame) : -1; }
+    // Writes as much of [data, data + size) as the socket takes without
+    // blocking. Returns the bytes written (0 if none fit), or -1 on failure.
+    // Where that is not supported it writes all of them, blocking if need be.
+    virtual int try_send(const char* data, size_t size) {
+        return send_data(std::vector<char>(data, data + size)) < 0 ? -1 : static_cast<int>(size);
+    }
+    // What to poll for once try_send took less than it was given: a descriptor
+    // that turns readable (readable set) or writable when there is room again.
+    virtual int send_ready_fd(bool& readable) const {
+        readable = false;
+        return get_fd();
+    }
+    // Sends frames of at least min_bytes through send_shared with
+    // MSG_ZEROCOPY (Linux TCP). False where that is not supported.
+    virtual bool enable_zerocopy(size_t min_bytes) { (void)min_bytes; return false; }
+    // Makes a blocking send that gets nowhere for timeout_ms fail (SO_SNDTIMEO
+    // on TCP), leaving the stream unusable; 0 waits forever. False where that
+    // is not supported.
+    virtual bool set_send_timeout(int64_t timeout_ms) { (void)timeout_ms; return false; }
+    // Lets go of zero-copy frames the kernel has finished with. Sends do this
+    // too; a reader calls it when woken only by the completions. Returns how
+    // many completion notices it read.
+    virtual size_t reap_send_completions() { return 0; }
     virtual int receive_data(std::vector<char>& buffer, size_t max_len) = 0;
+    // Zero-copy frames the kernel may still be sending from outlive the
+    // descriptor, until their completions are in (see SocketFactory::reap_closed_sockets).
     virtual void close_socket() = 0;
+    // Closes our descriptor without ending the connection, which another
+    // process holds too and now owns (hot restart).
+    virtual void release_socket() { close_socket(); }
+    // The kernel numbers a connection's MSG_ZEROCOPY sends whoever makes
+    // them, so a process taking a connection over continues our count.
+    virtual uint32_t zerocopy_sends() { return 0; }
+    virtual void continue_zerocopy_numbering(uint32_t sends) { (void)sends; }
+    // Ends both directions of the connection so a thread blocked in
+    // accept/recv on this socket returns. Does not release the descriptor.
+    virtual void shutdown_socket() = 0;
     virtual bool is_valid() const = 0;
     virtual int get_fd() const = 0; // For select/poll if used later
+    // False if the stream does not live entirely in get_fd() (e.g. shared
+    // memory), so passing the descriptor to another process cannot move it.
+    virtual bool is_transferable() const { return true; }
+    // Blocks until the socket is readable, wake_fd (if >= 0, e.g. a WakeSignal)
+    // is readable, or timeout_ms passes (-1 waits forever).
+    virtual WaitResult wait_readable(int timeout_ms, int wake_fd = -1) = 0;
 };
 
 } // namespace common
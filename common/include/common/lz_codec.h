@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef> // For size_t
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// Small LZ77 block codec (LZ4-style sequences: token, literals, 16-bit
+// offset, extended lengths). Greedy single-probe hash matching: much less
+// ratio than zlib but cheap enough to run on every batch, and batches of chat
+// frames are dominated by repeated headers and phrases. No dependencies.
+
+// Appends the compressed form of [data, data + size) to `out`.
+void lz_compress(const char* data, size_t size, std::vector<char>& out);
+
+// Decodes a block produced by lz_compress into `out` (replacing its
+// contents). Fails on malformed input or if the output would not be exactly
+// original_size bytes.
+bool lz_decompress(const char* data, size_t size, size_t original_size, std::vector<char>& out);
+
+} // namespace common
+} // namespace chat_app
@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <cstdint> // For uint_t types
+#include <cstddef> // For size_t
 
 namespace chat_app {
 namespace common {
@@ -15,16 +16,56 @@ enum class MessageType : uint8_t {
     FILE_TRANSFER_REQUEST, // Stub
     FILE_TRANSFER_DATA,    // Stub
     FILE_TRANSFER_ACK,     // Stub
-    ERROR_MESSAGE
+    ERROR_MESSAGE,
+    PING,                  // Liveness probe; the receiver answers with PONG
+    PONG,
+    SESSION_WELCOME,       // Server -> new connection: recipient_id is its client id; payload u64 token, u32 sequence
+    SESSION_RESUME,        // Client -> server: payload u64 token, u32 last sequence seen
+    SESSION_RESUMED,       // Server -> client: payload u8 ResumeStatus, u64 token now in use, u32 messages replayed
+    ACK,                   // Reliable delivery, see common/reliable_channel.h
+    PRESENCE_DIGEST,       // Server -> clients: coalesced joins and leaves, see server/presence.h
+    ROSTER_REQUEST,        // Who is online; payloads in server/roster.h
+    ROSTER_SNAPSHOT,
+    ROSTER_DELTA,
+    MUX_ATTACH,            // Client -> server: add a virtual client to this connection; payload u32 tag
+    MUX_ATTACHED,          // Server -> client: recipient_id is the new virtual client's id; payload u32 tag
+    MUX_DETACH,            // Client -> server: sender_id is the virtual client leaving
+    EPHEMERAL,             // Latest-wins signal (typing, status): payload u8 key length, key, value.
+                           // Broadcast unsequenced and unreliable, never kept or replayed; a newer
+                           // one from the same sender with the same key replaces it while queued
+    SEARCH_REQUEST,        // Full-text search of the room's history; payloads in server/search_index.h
+    SEARCH_RESULTS,
+    MESSAGE_TYPE_COUNT     // Not a message type; new types go above this line
 };
 
+constexpr size_t kMessageTypeCount = static_cast<size_t>(MessageType::MESSAGE_TYPE_COUNT);
+
+// MessageHeader::flags
+constexpr uint8_t kFlagReliable = 0x01; // Carries a delivery_sequence and must be acknowledged
+constexpr uint8_t kFlagStored = 0x02;   // A direct message kept while its recipient was offline
+
 struct MessageHeader {
     MessageType type;
+    uint8_t flags;
     uint32_t sender_id;    // 0 for server
-    uint32_t recipient_id; // 0 for broadcast or server
+    uint32_t recipient_id; // 0 for broadcast or server; a client id for a direct TEXT_MESSAGE
     uint32_t payload_size;
+    uint32_t sequence;     // Position in the room's broadcast stream; 0 if not part of one
+    uint32_t delivery_sequence; // Per-connection number of a kFlagReliable frame
+
+    MessageHeader()
+        : type(MessageType::TEXT_MESSAGE), flags(0), sender_id(0), recipient_id(0), payload_size(0), sequence(0),
+          delivery_sequence(0) {}
+};
+
+// First payload byte of PRESENCE_DIGEST
+constexpr uint8_t kPresenceTruncated = 0x01; // Too many changes to list; only counts are given
 
-    MessageHeader() : type(MessageType::TEXT_MESSAGE), sender_id(0), recipient_id(0), payload_size(0) {}
+// Outcome of a SESSION_RESUME, first byte of SESSION_RESUMED.
+enum class ResumeStatus : uint8_t {
+    RESUMED, // Every missed broadcast was replayed
+    PARTIAL, // The oldest missed broadcasts had already left the server's history
+    UNKNOWN  // No such session (expired or from another server); continuing with the new one
 };
 
 const size_t HEADER_SIZE = sizeof(MessageHeader);
@@ -19,5 +19,21 @@ bool deserialize_header(const std::vector<char>& buffer, MessageHeader& header);
 // Returns an empty Message with an invalid type if deserialization fails.
 Message deserialize_message_from_buffer(std::vector<char>& buffer);
 
+// Deserializes one complete message from [data, data + size) without
+// modifying the input. On success sets consumed to the bytes used.
+// Returns false if the data does not hold a complete message.
+bool deserialize_message(const char* data, size_t size, Message& msg, size_t& consumed);
+
+// Little-endian integers for binary payloads of control messages.
+void append_u32(std::vector<char>& out, uint32_t value);
+void append_u64(std::vector<char>& out, uint64_t value);
+uint32_t read_u32(const char* data);
+uint64_t read_u64(const char* data);
+
+// EPHEMERAL payloads; keys are at most 255 bytes. parse_ephemeral returns
+// false if the payload is malformed.
+Message make_ephemeral(uint32_t sender_id, const std::string& key, const std::string& value);
+bool parse_ephemeral(const Message& msg, std::string& key, std::string& value);
+
 } // namespace common
 } // namespace chat_app
\ No newline at end of file
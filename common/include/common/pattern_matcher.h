@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef> // For size_t
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// Finds whether any of a set of byte patterns occurs in a text, in one pass
+// over the text however many patterns there are (Aho-Corasick). The automaton
+// is compiled to a dense DFA: one table load per input byte, no failure links
+// to chase at match time. Its columns are byte classes rather than bytes (all
+// bytes no pattern uses share one), which keeps the table small for large
+// pattern sets. ASCII letters match either case. Immutable once built, so any
+// number of threads may match with one instance.
+class PatternMatcher {
+public:
+    explicit PatternMatcher(const std::vector<std::string>& patterns); // Empty patterns are ignored
+
+    bool contains_any(const char* data, size_t size) const;
+
+    size_t pattern_count() const { return pattern_count_; }
+    size_t state_count() const { return accepting_.size(); }
+    size_t table_bytes() const { return next_.size() * sizeof(uint32_t); }
+
+private:
+    // Runs the automaton over p from the state whose row starts at row.
+    bool scan(const unsigned char* p, size_t size, uint32_t row = 0) const;
+
+    uint8_t class_of_[256];
+    size_t class_count_;
+    size_t pattern_count_;
+    size_t longest_; // Bytes in the longest pattern
+    std::vector<uint32_t> next_;    // [state * class_count_ + class] -> next state * class_count_;
+                                    // accepting states loop to themselves
+    std::vector<uint8_t> accepting_; // By state: some pattern ends here
+};
+
+} // namespace common
+} // namespace chat_app
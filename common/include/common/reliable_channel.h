@@ -0,0 +1,95 @@
+#pragma once
+
+// Optional at-least-once delivery on top of a connection.
+//
+// A sender marks a frame kFlagReliable and numbers it with the next
+// delivery_sequence of its RetransmitWindow, which keeps a copy until the
+// receiver acknowledges it. The receiver records frames in an AckTracker,
+// drops duplicates, and answers with batched ACK messages: one per
+// ack_every frames or after ack_delay_ms, whichever comes first.
+//
+// ACK payload: u32 cumulative (everything up to it arrived), u16 count, then
+// count x (u32 first, u32 last) ranges that arrived above the cumulative
+// point. An ACK, even an empty one, also tells the server that the client
+// understands reliable frames.
+//
+// Neither class is thread-safe.
+
+#include "message.h"
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+struct ReliableConfig {
+    size_t window_frames = 1024;        // Unacknowledged frames a sender keeps
+    size_t window_bytes = 1024 * 1024;  // ... and their payload bytes
+    size_t ack_every = 16;              // Frames received before an ACK goes out without waiting
+    int64_t ack_delay_ms = 50;          // Longest a received frame waits for its ACK
+    int64_t retransmit_after_ms = 1000; // Unacknowledged this long, a frame is sent again
+};
+
+struct AckRanges {
+    uint32_t cumulative = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> selective; // Inclusive, ascending, above cumulative
+};
+
+bool parse_ack(const Message& msg, AckRanges& ack);
+
+class RetransmitWindow {
+public:
+    explicit RetransmitWindow(const ReliableConfig& config = ReliableConfig());
+
+    // Numbers msg and keeps a copy until it is acknowledged. Returns false,
+    // leaving msg untouched, if the window is full.
+    bool track(Message& msg, int64_t now_ms);
+    void on_ack(const AckRanges& ack);
+    // Frames unacknowledged for retransmit_after_ms, in order. Each counts as
+    // sent again now.
+    std::vector<Message> take_due(int64_t now_ms);
+    // Every unacknowledged frame, e.g. to resend on a new connection.
+    std::vector<Message> take_all(int64_t now_ms);
+    // The receiver lost its state: renumbers the unacknowledged frames from 1
+    // and returns them for resending.
+    std::vector<Message> restart(int64_t now_ms);
+
+    size_t size() const { return pending_.size(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Pending {
+        Message msg;
+        int64_t sent_ms;
+    };
+
+    ReliableConfig config_;
+    std::map<uint32_t, Pending> pending_; // By delivery_sequence
+    uint32_t next_sequence_;
+    size_t bytes_;
+};
+
+class AckTracker {
+public:
+    explicit AckTracker(const ReliableConfig& config = ReliableConfig());
+
+    bool is_duplicate(uint32_t delivery_sequence) const;
+    void on_receive(uint32_t delivery_sequence, int64_t now_ms);
+    // Milliseconds until an ACK is due: 0 if now, -1 if nothing awaits one.
+    int64_t ms_until_ack(int64_t now_ms) const;
+    Message make_ack();
+    void reset(); // The sender starts numbering from 1 again
+
+private:
+    ReliableConfig config_;
+    uint32_t cumulative_;
+    std::set<uint32_t> above_; // Arrived beyond a gap
+    size_t unacked_;
+    int64_t first_unacked_ms_;
+};
+
+} // namespace common
+} // namespace chat_app
@@ -2,14 +2,34 @@
 
 #include "isocket.h"
 #include <memory>
+#include <string>
 
 namespace chat_app {
 namespace common {
 
+enum class Transport {
+    TCP,
+    UNIX_STREAM,   // AF_UNIX stream socket at a filesystem path (POSIX only)
+    SHARED_MEMORY  // Same-host shared memory rings, set up over an AF_UNIX socket (Linux only)
+};
+
 class SocketFactory {
 public:
-    static std::unique_ptr<ISocket> create_socket();
+    // For UNIX_STREAM and SHARED_MEMORY, `path` is where bind_socket binds;
+    // connect_socket takes the path as its address and ignores the port.
+    // Returns nullptr if the transport is unsupported on this platform.
+    static std::unique_ptr<ISocket> create_socket(Transport transport = Transport::TCP, const std::string& path = "");
+    // Wraps a descriptor that is already connected or listening, e.g. one
+    // inherited from another process. Returns nullptr where unsupported.
+    static std::unique_ptr<ISocket> adopt_socket(int fd);
+    // Splits a "unix:PATH" or "shm:PATH" address into its transport and path.
+    // Anything else is a TCP host, returned unchanged.
+    static Transport parse_address(const std::string& address, std::string& location);
+    // Lets go of zero-copy frames of closed sockets that the kernel has
+    // finished sending. Call now and then wherever zero-copy is enabled.
+    // Returns how many closed sockets still hold some.
+    static size_t reap_closed_sockets();
 };
 
 } // namespace common
-} // namespace chat_app
\ No newline at end of file
+} // namespace chat_app
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef> // For size_t
+#include <memory>
+#include <string>
+
+namespace chat_app {
+namespace common {
+
+// An append-only byte queue on disk. Bytes are appended with write() and
+// read back in order through a read-only mmap of the file, so reading them
+// costs no copy of our own. The file is unlinked as soon as it is created and
+// truncated whenever everything in it has been read, so it takes no space
+// once drained and none is left behind if the process dies (POSIX).
+class SpoolFile {
+public:
+    // Creates an anonymous spool in directory; null on failure or where
+    // spooling is not supported.
+    static std::unique_ptr<SpoolFile> create(const std::string& directory);
+    ~SpoolFile();
+
+    SpoolFile(const SpoolFile&) = delete;
+    SpoolFile& operator=(const SpoolFile&) = delete;
+
+    bool append(const char* data, size_t size); // False if the disk refused it
+    // The oldest unread bytes, valid until the next call; null if none (or
+    // if they cannot be mapped).
+    const char* peek(size_t& size);
+    void consume(size_t size); // At most what peek() returned
+    size_t pending() const { return write_offset_ - read_offset_; }
+
+private:
+    explicit SpoolFile(int fd) : fd_(fd) {}
+    void unmap();
+
+    int fd_;
+    size_t read_offset_ = 0;
+    size_t write_offset_ = 0;
+    char* mapped_ = nullptr; // [0, mapped_size_) of the file
+    size_t mapped_size_ = 0;
+};
+
+} // namespace common
+} // namespace chat_app
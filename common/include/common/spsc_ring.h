@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace chat_app {
+namespace common {
+
+// Bounded lock-free queue for exactly one producer and one consumer at a
+// time. Several threads may take turns producing if something else (a mutex)
+// keeps them from pushing at once; the same goes for consuming.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : capacity_(round_up(capacity)), mask_(capacity_ - 1),
+                                         slots_(std::make_unique<std::optional<T>[]>(capacity_)), head_(0), tail_(0) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer. False if the ring is full.
+    bool try_push(T&& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == capacity_) return false;
+        slots_[tail & mask_].emplace(std::move(value));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer. False if the ring is empty.
+    bool try_pop(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        std::optional<T>& slot = slots_[head & mask_];
+        value = std::move(*slot);
+        slot.reset();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+    size_t capacity() const { return capacity_; }
+
+private:
+    static size_t round_up(size_t n) {
+        size_t power = 2;
+        while (power < n) power <<= 1;
+        return power;
+    }
+
+    const size_t capacity_; // A power of two
+    const size_t mask_;
+    std::unique_ptr<std::optional<T>[]> slots_;
+    alignas(64) std::atomic<size_t> head_; // Next slot to pop; written by the consumer
+    alignas(64) std::atomic<size_t> tail_; // Next slot to push; written by the producer
+};
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,138 @@
+#pragma once
+
+// Task<T>: the return type of a C++20 coroutine that produces a T.
+//
+// A Task is lazy. Its body starts when the Task is first co_awaited, and the
+// awaiting coroutine resumes (by symmetric transfer, so chains of awaits do
+// not grow the stack) once the body co_returns. An exception escaping the
+// body is rethrown from the co_await. The awaiter owns the Task; destroying
+// a Task that never ran destroys its frame.
+//
+// To run a Task without awaiting it, hand it to EventLoop::spawn.
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace chat_app {
+namespace common {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept {
+            auto continuation = finished.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+    void rethrow_if_failed() {
+        if (exception) std::rethrow_exception(exception);
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    Task<T> get_return_object() noexcept;
+    template <typename U>
+    void return_value(U&& result) {
+        value.emplace(std::forward<U>(result));
+    }
+    T take() {
+        rethrow_if_failed();
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() noexcept {}
+    void take() { rethrow_if_failed(); }
+};
+
+} // namespace detail
+
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().take(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Runs a Task<void> to completion on its own and then frees itself.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept {
+            return DetachedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); } // Nobody to report it to
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+inline DetachedTask detach(Task<void> task) {
+    co_await std::move(task);
+}
+
+} // namespace detail
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef> // For size_t
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// Hierarchical timing wheel (Varghese & Lauck): kLevels wheels of kSlots
+// slots each, where one slot of level N spans a full turn of level N-1.
+// schedule() and cancel() are O(1); advance() is O(1) per elapsed tick plus
+// the timers that fire, with each timer cascading down at most kLevels-1
+// times. Timer nodes live in a slab indexed by TimerId, so scheduling does
+// not allocate once the slab has grown to the working set.
+//
+// Not thread-safe. Callbacks run inside advance() and may schedule or
+// cancel timers on the same wheel.
+class TimingWheel {
+public:
+    using Callback = std::function<void()>;
+    using TimerId = uint64_t; // Slab index in the low 32 bits, generation in the high 32
+    static constexpr TimerId kInvalidTimer = 0;
+
+    TimingWheel(std::chrono::milliseconds tick, int64_t now_ms);
+
+    // Fires `callback` once, on the first advance() at least delay_ms from now
+    // (rounded up to the tick).
+    TimerId schedule(int64_t delay_ms, Callback callback);
+    // Returns false if the timer already fired or was cancelled.
+    bool cancel(TimerId id);
+    // Runs every timer due at now_ms. Returns how many fired.
+    size_t advance(int64_t now_ms);
+
+    size_t size() const { return active_count_; }
+    std::chrono::milliseconds tick() const { return tick_; }
+
+private:
+    static constexpr int kSlotBits = 6;
+    static constexpr size_t kSlots = size_t(1) << kSlotBits;
+    static constexpr size_t kSlotMask = kSlots - 1;
+    static constexpr int kLevels = 4; // 64^4 ticks: ~19 days at 100 ms
+    static constexpr int32_t kNil = -1;
+
+    struct Node {
+        uint64_t expiry_tick = 0;
+        Callback callback;
+        int32_t prev = kNil;
+        int32_t next = kNil;
+        int32_t* head = nullptr; // Slot list the node is linked into, nullptr if free
+        uint32_t generation = 1;
+    };
+
+    void place(int32_t index); // Links a node into the slot for its expiry
+    void unlink(int32_t index);
+    void release(int32_t index);
+    void cascade(int level);
+
+    std::chrono::milliseconds tick_;
+    int64_t origin_ms_;
+    uint64_t current_tick_; // Next tick to process
+
+    std::vector<int32_t> slots_; // kLevels * kSlots list heads
+    std::vector<Node> nodes_;
+    std::vector<int32_t> free_nodes_;
+    size_t active_count_;
+};
+
+} // namespace common
+} // namespace chat_app
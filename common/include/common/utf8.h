@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef> // For size_t
+
+namespace chat_app {
+namespace common {
+
+// Strict UTF-8 validation (RFC 3629): no overlong forms, no surrogates,
+// nothing above U+10FFFF, no truncated sequences. On x86 CPUs with AVX2 it
+// checks 32 bytes per step with the Keiser-Lemire lookup tables; without, it
+// skips ASCII 16 bytes at a time (SSE2) or 8 (scalar) and decodes the rest.
+// The implementation is picked once, on first use.
+bool is_valid_utf8(const char* data, size_t size);
+
+// "avx2", "sse2" or "scalar": what is_valid_utf8 runs on this CPU.
+const char* utf8_implementation();
+
+} // namespace common
+} // namespace chat_app
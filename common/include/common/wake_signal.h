@@ -0,0 +1,29 @@
+#pragma once
+
+namespace chat_app {
+namespace common {
+
+// Level-triggered wakeup that any number of threads can poll alongside a
+// socket (see ISocket::wait_readable). Once notified it stays readable
+// until reset(). notify() and reset() must come from one thread at a time.
+// Backed by a pipe; a no-op with fd() == -1 on Windows.
+class WakeSignal {
+public:
+    WakeSignal();
+    ~WakeSignal();
+
+    WakeSignal(const WakeSignal&) = delete;
+    WakeSignal& operator=(const WakeSignal&) = delete;
+
+    void notify();
+    void reset();
+    int fd() const { return read_fd_; }
+
+private:
+    int read_fd_;
+    int write_fd_;
+    bool notified_;
+};
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef> // For size_t
+#include <cstdint> // For uint64_t
+#include <deque>
+#include <functional>
+#include <memory>  // For std::unique_ptr
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace chat_app {
+namespace common {
+
+// Thread pool with one deque per worker. A worker pops its own newest task
+// first and, when its deque is empty, steals the oldest task from another
+// worker. Tasks submitted with submit_ordered() run one at a time per key and
+// in submission order, whichever worker ends up running them.
+class WorkStealingExecutor {
+public:
+    using Task = std::function<void()>;
+
+    // num_threads == 0 uses std::thread::hardware_concurrency().
+    explicit WorkStealingExecutor(size_t num_threads = 0);
+    ~WorkStealingExecutor();
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    // Before start(): worker i is pinned to cpus[i % cpus.size()]. Empty
+    // (the default) leaves the workers unpinned.
+    void set_cpus(std::vector<int> cpus);
+    const std::vector<int>& cpus() const { return cpus_; }
+
+    void start();
+    void stop(); // Runs every queued task, then joins the workers
+
+    // Tasks submitted while the executor is not running are run inline.
+    void submit(Task task);
+    void submit_ordered(uint64_t key, Task task);
+
+    size_t thread_count() const;
+    bool is_running() const;
+
+private:
+    struct Worker {
+        std::deque<Task> tasks; // Owner pops the back, thieves take the front
+        std::mutex mutex;
+    };
+
+    // Tasks sharing a key, waiting for the previous one to finish.
+    struct Strand {
+        std::deque<Task> pending;
+    };
+
+    struct StrandStripe {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Strand> strands;
+    };
+
+    static constexpr size_t kStrandStripes = 64;
+    static constexpr size_t kStrandBatch = 16; // Tasks run per strand turn before yielding
+
+    void worker_loop(size_t index);
+    bool pop_local(size_t index, Task& task);
+    bool steal(size_t thief_index, Task& task);
+    void push(Task task);
+    void run_strand(uint64_t key);
+    StrandStripe& stripe_for(uint64_t key);
+
+    size_t num_threads_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::vector<int> cpus_;
+    std::atomic<bool> running_;
+    std::atomic<size_t> next_worker_; // Round-robin target for external submits
+
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    std::atomic<size_t> queued_; // Tasks sitting in worker deques
+    bool stopping_;              // Guarded by sleep_mutex_
+
+    StrandStripe strand_stripes_[kStrandStripes];
+};
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,157 @@
+#include "common/async_socket.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <cerrno>
+#endif
+
+namespace chat_app {
+namespace common {
+
+#ifdef __linux__
+
+AsyncSocket::AsyncSocket(EventLoop& loop, int fd)
+    : loop_(loop), fd_(fd), watched_(false), readable_(true), writable_(true), hangup_(false),
+      cancelled_(false), reader_(nullptr), writer_(nullptr) {
+    watched_ = fd_ >= 0 && loop_.watch(fd_, this);
+}
+
+AsyncSocket::~AsyncSocket() {
+    if (watched_) {
+        loop_.unwatch(fd_, this);
+    }
+}
+
+bool AsyncSocket::ReadyAwaiter::await_ready() {
+    if (socket_.cancelled_ || !socket_.watched_) {
+        result_ = socket_.cancelled_ ? WaitResult::WOKEN : WaitResult::FAILED;
+        return true;
+    }
+    if (socket_.hangup_ || (for_write_ ? socket_.writable_ : socket_.readable_)) {
+        result_ = WaitResult::READABLE;
+        return true;
+    }
+    return false;
+}
+
+void AsyncSocket::ReadyAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    ReadyAwaiter*& slot = for_write_ ? socket_.writer_ : socket_.reader_;
+    slot = this;
+    if (for_write_) {
+        socket_.loop_.want_writable(socket_.fd_, &socket_, true);
+    }
+    if (timeout_ms_ >= 0) {
+        timer_ = socket_.loop_.add_timer(timeout_ms_, [&socket = socket_, &slot] {
+            socket.release(slot, WaitResult::TIMEOUT).resume();
+        });
+    }
+}
+
+std::coroutine_handle<> AsyncSocket::release(ReadyAwaiter*& waiter, WaitResult result) {
+    ReadyAwaiter* finished = waiter;
+    waiter = nullptr;
+    if (finished->timeout_ms_ >= 0 && result != WaitResult::TIMEOUT) {
+        loop_.cancel_timer(finished->timer_);
+    }
+    if (finished->for_write_) {
+        loop_.want_writable(fd_, this, false);
+    }
+    finished->result_ = result;
+    return finished->handle_;
+}
+
+void AsyncSocket::wake(bool reader_ready, bool writer_ready, WaitResult result) {
+    std::coroutine_handle<> reader = reader_ && reader_ready ? release(reader_, result) : nullptr;
+    std::coroutine_handle<> writer = writer_ && writer_ready ? release(writer_, result) : nullptr;
+    if (reader && writer) {
+        loop_.post([writer] { writer.resume(); }); // The reader may destroy *this
+    } else if (writer) {
+        reader = writer;
+    }
+    if (reader) {
+        reader.resume(); // May destroy *this
+    }
+}
+
+void AsyncSocket::on_ready(uint32_t events) {
+    if (events & EventLoop::kReadable) readable_ = true;
+    if (events & EventLoop::kWritable) writable_ = true;
+    if (events & EventLoop::kHangup) hangup_ = true;
+    if (events & EventLoop::kError) readable_ = writable_ = true; // Until recv or send says otherwise
+    wake(readable_ || hangup_, writable_ || hangup_, WaitResult::READABLE);
+}
+
+void AsyncSocket::cancel() {
+    cancelled_ = true;
+    wake(true, true, WaitResult::WOKEN);
+}
+
+int AsyncSocket::try_recv(char* data, size_t len) {
+    while (true) {
+        ssize_t n = ::recv(fd_, data, len, MSG_DONTWAIT);
+        if (n >= 0) return static_cast<int>(n);
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            readable_ = false;
+            return kWouldBlock;
+        }
+        return -1;
+    }
+}
+
+Task<int> AsyncSocket::recv(char* data, size_t len) {
+    while (true) {
+        int n = try_recv(data, len);
+        if (n != kWouldBlock) co_return n;
+        if (co_await readable() != WaitResult::READABLE) co_return -1;
+    }
+}
+
+Task<int> AsyncSocket::send(const std::vector<char>& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            writable_ = false;
+            if (co_await writable() != WaitResult::READABLE) co_return -1;
+            continue;
+        }
+        co_return -1;
+    }
+    co_return static_cast<int>(data.size());
+}
+
+#else // !__linux__: EventLoop::supported() is false, so nothing creates one
+
+AsyncSocket::AsyncSocket(EventLoop& loop, int fd)
+    : loop_(loop), fd_(fd), watched_(false), readable_(false), writable_(false), hangup_(false),
+      cancelled_(false), reader_(nullptr), writer_(nullptr) {}
+AsyncSocket::~AsyncSocket() {}
+bool AsyncSocket::ReadyAwaiter::await_ready() { result_ = WaitResult::FAILED; return true; }
+void AsyncSocket::ReadyAwaiter::await_suspend(std::coroutine_handle<> handle) { (void)handle; }
+std::coroutine_handle<> AsyncSocket::release(ReadyAwaiter*& waiter, WaitResult result) {
+    (void)waiter;
+    (void)result;
+    return nullptr;
+}
+void AsyncSocket::wake(bool reader_ready, bool writer_ready, WaitResult result) {
+    (void)reader_ready;
+    (void)writer_ready;
+    (void)result;
+}
+void AsyncSocket::on_ready(uint32_t events) { (void)events; }
+void AsyncSocket::cancel() { cancelled_ = true; }
+int AsyncSocket::try_recv(char* data, size_t len) { (void)data; (void)len; return -1; }
+Task<int> AsyncSocket::recv(char* data, size_t len) { (void)data; (void)len; co_return -1; }
+Task<int> AsyncSocket::send(const std::vector<char>& data) { (void)data; co_return -1; }
+
+#endif // __linux__
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,61 @@
+#include "common/buffer_pool.h"
+#include <utility> // For std::move
+
+namespace chat_app {
+namespace common {
+
+BufferPool::Lease& BufferPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pool_ = other.pool_;
+        buffer_ = std::move(other.buffer_);
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+void BufferPool::Lease::reset() {
+    if (!pool_) return;
+    pool_->release(std::move(buffer_));
+    pool_ = nullptr;
+    buffer_ = std::vector<char>();
+}
+
+BufferPool::BufferPool(size_t buffer_size, size_t max_free)
+    : buffer_size_(buffer_size == 0 ? 1 : buffer_size), max_free_(max_free), borrowed_(0) {}
+
+BufferPool::Lease BufferPool::acquire() {
+    std::vector<char> buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++borrowed_;
+        if (!free_.empty()) {
+            buffer = std::move(free_.back());
+            free_.pop_back();
+        }
+    }
+    // Within the capacity a returned buffer kept, so this does not allocate
+    buffer.resize(buffer_size_);
+    return Lease(this, std::move(buffer));
+}
+
+void BufferPool::release(std::vector<char> buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --borrowed_;
+    if (free_.size() < max_free_ && buffer.capacity() >= buffer_size_) {
+        free_.push_back(std::move(buffer));
+    } // Otherwise freed on return
+}
+
+size_t BufferPool::borrowed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return borrowed_;
+}
+
+size_t BufferPool::free_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,40 @@
+#include "common/coarse_clock.h"
+
+namespace chat_app {
+namespace common {
+
+CoarseClock::CoarseClock(std::chrono::milliseconds tick)
+    : tick_(tick), now_ms_(sample_ms()), running_(false) {}
+
+CoarseClock::~CoarseClock() {
+    stop();
+}
+
+void CoarseClock::start() {
+    if (running_) return;
+    running_ = true;
+    now_ms_.store(sample_ms(), std::memory_order_relaxed);
+    thread_ = std::thread(&CoarseClock::run, this);
+}
+
+void CoarseClock::stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+int64_t CoarseClock::sample_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CoarseClock::run() {
+    while (running_) {
+        std::this_thread::sleep_for(tick_);
+        now_ms_.store(sample_ms(), std::memory_order_relaxed);
+    }
+}
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,106 @@
+#include "common/cpu_affinity.h"
+#include <algorithm>
+#include <sstream>
+
+#ifdef __linux__
+#include <dirent.h> // For opendir
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace chat_app {
+namespace common {
+
+#ifdef __linux__
+
+std::vector<int> usable_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+int numa_node_of(int cpu) {
+    // The CPU's sysfs directory links to its node as "node<N>"
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return -1;
+    int node = -1;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+            std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            node = std::stoi(name.substr(4));
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+bool pin_current_thread(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#else // !__linux__
+
+std::vector<int> usable_cpus() { return {}; }
+int numa_node_of(int cpu) { (void)cpu; return -1; }
+bool pin_current_thread(int cpu) { (void)cpu; return false; }
+
+#endif
+
+bool parse_cpu_list(const std::string& text, std::vector<int>& cpus) {
+    std::vector<int> parsed;
+    std::stringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        size_t dash = range.find('-');
+        try {
+            size_t used = 0;
+            int first = std::stoi(range.substr(0, dash), &used);
+            if (used != (dash == std::string::npos ? range.size() : dash)) return false;
+            int last = first;
+            if (dash != std::string::npos) {
+                std::string tail = range.substr(dash + 1);
+                last = std::stoi(tail, &used);
+                if (used != tail.size()) return false;
+            }
+            if (first < 0 || last < first) return false;
+            for (int cpu = first; cpu <= last; ++cpu) parsed.push_back(cpu);
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    if (parsed.empty()) return false;
+    std::sort(parsed.begin(), parsed.end());
+    parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+    cpus = std::move(parsed);
+    return true;
+}
+
+std::string format_cpu_list(std::vector<int> cpus) {
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    std::string text;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+        if (!text.empty()) text += ",";
+        text += std::to_string(cpus[i]);
+        if (j > i) text += "-" + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return text;
+}
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,217 @@
+#include "common/event_loop.h"
+#include "common/cpu_affinity.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio> // For perror
+#endif
+
+namespace chat_app {
+namespace common {
+
+namespace {
+
+int64_t steady_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+#ifdef __linux__
+
+EventLoop::EventLoop() : epoll_fd_(-1), wake_fd_(-1), running_(false), cpu_(-1), next_timer_sequence_(0) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        perror("EventLoop: cannot create epoll instance");
+        return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr; // Marks the wakeup fd
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+}
+
+EventLoop::~EventLoop() {
+    stop();
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+}
+
+bool EventLoop::supported() {
+    return true;
+}
+
+bool EventLoop::start(int cpu) {
+    if (epoll_fd_ < 0) return false;
+    if (running_) return true;
+    running_ = true;
+    cpu_ = cpu;
+    thread_ = std::thread(&EventLoop::run, this);
+    return true;
+}
+
+void EventLoop::stop() {
+    if (!running_) return;
+    running_ = false;
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0) {
+        perror("EventLoop: wakeup failed");
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(posted_mutex_);
+    posted_.clear();
+}
+
+void EventLoop::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        posted_.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("EventLoop: wakeup failed");
+    }
+}
+
+void EventLoop::spawn(Task<void> task) {
+    auto handle = detail::detach(std::move(task)).handle;
+    post([handle] { handle.resume(); });
+}
+
+bool EventLoop::watch(int fd, Watcher* watcher) {
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = watcher;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("EventLoop: epoll_ctl ADD failed");
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::want_writable(int fd, Watcher* watcher, bool enabled) {
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (enabled ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.ptr = watcher;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+}
+
+void EventLoop::unwatch(int fd, Watcher* watcher) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    retired_.push_back(watcher);
+}
+
+EventLoop::Timer EventLoop::add_timer(int64_t delay_ms, std::function<void()> callback) {
+    Timer timer(steady_now_ms() + delay_ms, next_timer_sequence_++);
+    timers_.emplace(timer, std::move(callback));
+    return timer;
+}
+
+void EventLoop::cancel_timer(const Timer& timer) {
+    timers_.erase(timer);
+}
+
+int EventLoop::next_timeout_ms() const {
+    if (timers_.empty()) return -1;
+    int64_t wait_ms = timers_.begin()->first.first - steady_now_ms();
+    return wait_ms <= 0 ? 0 : static_cast<int>(wait_ms);
+}
+
+void EventLoop::run() {
+    thread_id_ = std::this_thread::get_id();
+    if (cpu_ >= 0 && !pin_current_thread(cpu_)) {
+        std::cerr << "EventLoop: Cannot pin to CPU " << cpu_ << "; running unpinned." << std::endl;
+    }
+    constexpr int kMaxEvents = 128;
+    epoll_event events[kMaxEvents];
+    while (running_) {
+        int n = epoll_wait(epoll_fd_, events, kMaxEvents, next_timeout_ms());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("EventLoop: epoll_wait failed");
+            break;
+        }
+        retired_.clear(); // Events from before an unwatch can only be in this batch
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == nullptr) {
+                uint64_t count;
+                while (read(wake_fd_, &count, sizeof(count)) < 0 && errno == EINTR) {}
+                continue;
+            }
+            auto* watcher = static_cast<Watcher*>(events[i].data.ptr);
+            if (!retired_.empty() && std::find(retired_.begin(), retired_.end(), watcher) != retired_.end()) {
+                continue;
+            }
+            uint32_t ready = 0;
+            if (events[i].events & EPOLLIN) ready |= kReadable;
+            if (events[i].events & EPOLLOUT) ready |= kWritable;
+            if (events[i].events & (EPOLLHUP | EPOLLRDHUP)) ready |= kHangup;
+            if (events[i].events & EPOLLERR) ready |= kError;
+            watcher->on_ready(ready);
+        }
+        run_due_timers();
+        run_posted();
+    }
+    thread_id_ = std::thread::id();
+}
+
+void EventLoop::run_posted() {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        tasks.swap(posted_);
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+void EventLoop::run_due_timers() {
+    int64_t now_ms = steady_now_ms();
+    while (!timers_.empty() && timers_.begin()->first.first <= now_ms) {
+        auto callback = std::move(timers_.begin()->second);
+        timers_.erase(timers_.begin());
+        callback(); // May add or cancel timers
+    }
+}
+
+#else // !__linux__
+
+EventLoop::EventLoop() : epoll_fd_(-1), wake_fd_(-1), running_(false), cpu_(-1), next_timer_sequence_(0) {}
+EventLoop::~EventLoop() {}
+bool EventLoop::supported() { return false; }
+bool EventLoop::start(int cpu) {
+    (void)cpu;
+    std::cerr << "EventLoop: not supported on this platform." << std::endl;
+    return false;
+}
+void EventLoop::stop() {}
+void EventLoop::post(std::function<void()> task) { (void)task; }
+void EventLoop::spawn(Task<void> task) { (void)task; }
+bool EventLoop::watch(int fd, Watcher* watcher) { (void)fd; (void)watcher; return false; }
+void EventLoop::want_writable(int fd, Watcher* watcher, bool enabled) { (void)fd; (void)watcher; (void)enabled; }
+void EventLoop::unwatch(int fd, Watcher* watcher) { (void)fd; (void)watcher; }
+EventLoop::Timer EventLoop::add_timer(int64_t delay_ms, std::function<void()> callback) {
+    (void)callback;
+    return Timer(steady_now_ms() + delay_ms, next_timer_sequence_++);
+}
+void EventLoop::cancel_timer(const Timer& timer) { (void)timer; }
+int EventLoop::next_timeout_ms() const { return -1; }
+void EventLoop::run() {}
+void EventLoop::run_posted() {}
+void EventLoop::run_due_timers() {}
+
+#endif // __linux__
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,124 @@
+#include "common/lz_codec.h"
+#include <cstdint>
+#include <cstring> // For memcpy
+
+namespace chat_app {
+namespace common {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashBits = 12;
+constexpr size_t kLastLiterals = 5; // The tail is always emitted as literals
+
+uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hash4(const char* p) {
+    return (read32(p) * 2654435761u) >> (32 - kHashBits);
+}
+
+void put_length(std::vector<char>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+void emit_sequence(std::vector<char>& out, const char* literals, size_t literal_length, size_t offset,
+                   size_t match_length) {
+    size_t match_code = match_length >= kMinMatch ? match_length - kMinMatch : 0;
+    uint8_t token = static_cast<uint8_t>((literal_length >= 15 ? 15 : literal_length) << 4) |
+                    static_cast<uint8_t>(match_code >= 15 ? 15 : match_code);
+    out.push_back(static_cast<char>(token));
+    if (literal_length >= 15) put_length(out, literal_length - 15);
+    out.insert(out.end(), literals, literals + literal_length);
+    if (match_length == 0) return; // Final literal-only sequence
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_code >= 15) put_length(out, match_code - 15);
+}
+
+bool get_length(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (in >= end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+void lz_compress(const char* data, size_t size, std::vector<char>& out) {
+    out.reserve(out.size() + size + size / 255 + 16);
+    const char* anchor = data;
+    const char* end = data + size;
+
+    if (size > kMinMatch + kLastLiterals) {
+        std::vector<int32_t> table(size_t(1) << kHashBits, -1);
+        const char* match_limit = end - kLastLiterals;
+        const char* p = data;
+        while (p + kMinMatch <= match_limit) {
+            uint32_t h = hash4(p);
+            int32_t candidate = table[h];
+            table[h] = static_cast<int32_t>(p - data);
+            if (candidate < 0 || static_cast<size_t>(p - data - candidate) > kMaxOffset ||
+                read32(data + candidate) != read32(p)) {
+                ++p;
+                continue;
+            }
+            const char* match = data + candidate;
+            size_t length = kMinMatch;
+            while (p + length < match_limit && match[length] == p[length]) {
+                ++length;
+            }
+            emit_sequence(out, anchor, static_cast<size_t>(p - anchor), static_cast<size_t>(p - match), length);
+            p += length;
+            anchor = p;
+        }
+    }
+    emit_sequence(out, anchor, static_cast<size_t>(end - anchor), 0, 0);
+}
+
+bool lz_decompress(const char* data, size_t size, size_t original_size, std::vector<char>& out) {
+    out.clear();
+    out.reserve(original_size);
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = in + size;
+
+    while (in < end) {
+        uint8_t token = *in++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !get_length(in, end, literal_length)) return false;
+        if (static_cast<size_t>(end - in) < literal_length || out.size() + literal_length > original_size) {
+            return false;
+        }
+        out.insert(out.end(), in, in + literal_length);
+        in += literal_length;
+        if (in == end) break; // Final sequence carries no match
+
+        if (end - in < 2) return false;
+        size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !get_length(in, end, match_length)) return false;
+        match_length += kMinMatch;
+        if (offset == 0 || offset > out.size() || out.size() + match_length > original_size) return false;
+
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < match_length; ++i) { // Byte-wise: source and destination may overlap
+            out.push_back(out[from + i]);
+        }
+    }
+    return out.size() == original_size;
+}
+
+} // namespace common
+} // namespace chat_app
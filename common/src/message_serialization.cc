@@ -61,6 +61,54 @@ Message deserialize_message_from_buffer(std::vector<char>& buffer) {
     return msg;
 }
 
+bool deserialize_message(const char* data, size_t size, Message& msg, size_t& consumed) {
+    if (size < HEADER_SIZE) return false;
+    std::memcpy(&msg.header, data, HEADER_SIZE);
+    if (size - HEADER_SIZE < msg.header.payload_size) return false;
+    msg.payload.assign(data + HEADER_SIZE, data + HEADER_SIZE + msg.header.payload_size);
+    consumed = HEADER_SIZE + msg.header.payload_size;
+    return true;
+}
+
+void append_u32(std::vector<char>& out, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void append_u64(std::vector<char>& out, uint64_t value) {
+    append_u32(out, static_cast<uint32_t>(value));
+    append_u32(out, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t read_u32(const char* data) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(data);
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+}
+
+uint64_t read_u64(const char* data) {
+    return read_u32(data) | (static_cast<uint64_t>(read_u32(data + 4)) << 32);
+}
+
+Message make_ephemeral(uint32_t sender_id, const std::string& key, const std::string& value) {
+    Message msg(MessageType::EPHEMERAL, sender_id, 0, "");
+    size_t key_size = std::min<size_t>(key.size(), 255);
+    msg.payload.reserve(1 + key_size + value.size());
+    msg.payload.push_back(static_cast<char>(key_size));
+    msg.payload.insert(msg.payload.end(), key.begin(), key.begin() + static_cast<std::ptrdiff_t>(key_size));
+    msg.payload.insert(msg.payload.end(), value.begin(), value.end());
+    msg.header.payload_size = static_cast<uint32_t>(msg.payload.size());
+    return msg;
+}
+
+bool parse_ephemeral(const Message& msg, std::string& key, std::string& value) {
+    if (msg.payload.empty()) return false;
+    size_t key_size = static_cast<uint8_t>(msg.payload[0]);
+    if (msg.payload.size() < 1 + key_size) return false;
+    key.assign(msg.payload.begin() + 1, msg.payload.begin() + 1 + static_cast<std::ptrdiff_t>(key_size));
+    value.assign(msg.payload.begin() + 1 + static_cast<std::ptrdiff_t>(key_size), msg.payload.end());
+    return true;
+}
 
 } // namespace common
 } // namespace chat_app
\ No newline at end of file
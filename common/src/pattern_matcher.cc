@@ -0,0 +1,142 @@
+#include "common/pattern_matcher.h"
+#include <deque>
+
+namespace chat_app {
+namespace common {
+
+namespace {
+
+constexpr uint32_t kNoState = UINT32_MAX;
+constexpr size_t kCheckEvery = 256; // Input bytes between looks for a match
+constexpr size_t kLanes = 4;         // Stretches of a long text scanned side by side
+constexpr size_t kMinLaneBytes = 512;
+
+unsigned char fold_case(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+} // namespace
+
+PatternMatcher::PatternMatcher(const std::vector<std::string>& patterns) : class_count_(1), pattern_count_(0), longest_(0) {
+    // Class 0 is every byte no pattern uses; each byte a pattern uses gets its own
+    bool used[256] = {};
+    for (const std::string& pattern : patterns) {
+        for (char c : pattern) used[fold_case(static_cast<unsigned char>(c))] = true;
+    }
+    for (int b = 0; b < 256; ++b) {
+        class_of_[b] = used[b] ? static_cast<uint8_t>(class_count_++) : 0;
+    }
+    for (int b = 'A'; b <= 'Z'; ++b) class_of_[b] = class_of_[b - 'A' + 'a'];
+
+    // The trie, root state 0
+    next_.assign(class_count_, kNoState);
+    accepting_.assign(1, 0);
+    for (const std::string& pattern : patterns) {
+        if (pattern.empty()) continue;
+        ++pattern_count_;
+        uint32_t state = 0;
+        for (char c : pattern) {
+            size_t edge = state * class_count_ + class_of_[static_cast<unsigned char>(c)];
+            if (next_[edge] == kNoState) {
+                next_[edge] = static_cast<uint32_t>(accepting_.size());
+                accepting_.push_back(0);
+                next_.resize(next_.size() + class_count_, kNoState);
+            }
+            state = next_[edge];
+        }
+        accepting_[state] = 1;
+        if (pattern.size() > longest_) longest_ = pattern.size();
+    }
+
+    // Breadth first, so a state's failure state (always shallower) is complete
+    // before it: missing transitions become those of the failure state
+    std::vector<uint32_t> failure(accepting_.size(), 0);
+    std::deque<uint32_t> queue;
+    for (size_t c = 0; c < class_count_; ++c) {
+        uint32_t& child = next_[c];
+        if (child == kNoState) {
+            child = 0;
+        } else {
+            queue.push_back(child);
+        }
+    }
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        accepting_[state] |= accepting_[failure[state]]; // A pattern ending in a suffix ends here too
+        for (size_t c = 0; c < class_count_; ++c) {
+            uint32_t& child = next_[state * class_count_ + c];
+            uint32_t fallback = next_[failure[state] * class_count_ + c];
+            if (child == kNoState) {
+                child = fallback;
+            } else {
+                failure[child] = fallback;
+                queue.push_back(child);
+            }
+        }
+    }
+
+    // Once anything has matched the answer is known; stay put
+    for (uint32_t state = 0; state < accepting_.size(); ++state) {
+        if (!accepting_[state]) continue;
+        for (size_t c = 0; c < class_count_; ++c) next_[state * class_count_ + c] = state;
+    }
+    // Store each target as the offset of its row, saving a multiply per input byte
+    for (uint32_t& target : next_) target *= static_cast<uint32_t>(class_count_);
+}
+
+bool PatternMatcher::contains_any(const char* data, size_t size) const {
+    if (pattern_count_ == 0) return false;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if (size < kLanes * kMinLaneBytes) return scan(p, size);
+
+    // Each step of the automaton waits on the load before it, so one pass
+    // runs at the table's load latency. Long texts are cut into stretches
+    // walked in lockstep, whose loads overlap. Each stretch starts longest_ - 1
+    // bytes early so matches across a cut are still seen.
+    const uint32_t* next = next_.data();
+    size_t lane_bytes = (size + kLanes - 1) / kLanes;
+    size_t overlap = longest_ - 1;
+    const unsigned char* pos[kLanes];
+    size_t length[kLanes];
+    size_t common = size; // Walked by every lane in lockstep; each finishes its rest alone
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        size_t begin = lane * lane_bytes;
+        size_t end = begin + lane_bytes < size ? begin + lane_bytes : size;
+        begin = begin > overlap ? begin - overlap : 0;
+        pos[lane] = p + begin;
+        length[lane] = end - begin;
+        if (length[lane] < common) common = length[lane];
+    }
+    uint32_t row[kLanes] = {};
+    for (size_t i = 0; i < common;) {
+        size_t end = common - i > kCheckEvery ? i + kCheckEvery : common;
+        for (; i < end; ++i) {
+            row[0] = next[row[0] + class_of_[pos[0][i]]];
+            row[1] = next[row[1] + class_of_[pos[1][i]]];
+            row[2] = next[row[2] + class_of_[pos[2][i]]];
+            row[3] = next[row[3] + class_of_[pos[3][i]]];
+        }
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            if (accepting_[row[lane] / class_count_]) return true;
+        }
+    }
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        if (scan(pos[lane] + common, length[lane] - common, row[lane])) return true;
+    }
+    return false;
+}
+
+bool PatternMatcher::scan(const unsigned char* p, size_t size, uint32_t row) const {
+    const uint32_t* next = next_.data();
+    size_t i = 0;
+    while (i < size) {
+        size_t end = size - i > kCheckEvery ? i + kCheckEvery : size;
+        for (; i < end; ++i) row = next[row + class_of_[p[i]]];
+        if (accepting_[row / class_count_]) return true;
+    }
+    return accepting_[row / class_count_] != 0;
+}
+
+} // namespace common
+} // namespace chat_app
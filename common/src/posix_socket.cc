@@ -5,24 +5,135 @@
 #include <unistd.h>     // For close, read, write
 #include <sys/socket.h> // For socket, bind, listen, accept, connect
 #include <netinet/in.h> // For sockaddr_in
+#include <sys/un.h>     // For sockaddr_un
 #include <arpa/inet.h>  // For inet_pton
 #include <fcntl.h>      // For fcntl, O_NONBLOCK
+#include <poll.h>       // For poll
+#include <sys/time.h>   // For timeval
+#include <cerrno>       // For errno, EINTR
+#include <deque>
+#include <mutex>
 
 #ifndef _WIN32 // Guard for Posix-specific code
 
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h> // For sock_extended_err
+#define CHAT_APP_HAS_ZEROCOPY 1
+#endif
+
 namespace chat_app {
 namespace common {
 
+namespace {
+#ifdef CHAT_APP_HAS_ZEROCOPY
+using ZerocopyFrames = std::deque<std::pair<uint32_t, std::shared_ptr<const std::vector<char>>>>; // (calls through, frame)
+
+// Reads MSG_ZEROCOPY completion notices off fd's error queue, advancing
+// `completed` past the calls they cover. Sets `copied` if the kernel
+// reported copying after all. Returns how many notices it read.
+size_t read_zerocopy_completions(int fd, uint32_t& completed, bool& copied) {
+    size_t notices = 0;
+    while (true) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break; // EAGAIN: none waiting
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            bool recverr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                           (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!recverr) continue;
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            ++notices;
+            // Calls ee_info..ee_data are done; TCP completes them in order
+            if (static_cast<int32_t>(err.ee_data + 1 - completed) > 0) {
+                completed = err.ee_data + 1;
+            }
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) copied = true;
+        }
+    }
+    return notices;
+}
+
+// Drops the frames whose calls have all completed.
+void release_completed(ZerocopyFrames& frames, uint32_t completed) {
+    while (!frames.empty() && static_cast<int32_t>(frames.front().first - completed) <= 0) {
+        frames.pop_front();
+    }
+}
+
+// Frames of closed sockets that the kernel may still be sending from. It
+// pins their pages but does not copy them, so memory freed and reused before
+// it is done would go out in their place. A grave with a descriptor (a
+// duplicate of the closed one) is reaped as its completions come in; one
+// without (the connection was handed to another process, which now reads
+// the completions) is kept until this process exits.
+struct ZerocopyGrave {
+    int fd;
+    uint32_t completed;
+    ZerocopyFrames frames;
+};
+
+std::mutex& zerocopy_graveyard_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Under zerocopy_graveyard_mutex(). Never destroyed: freeing the frames at
+// exit would write allocator bookkeeping into pages still being sent.
+std::vector<ZerocopyGrave>& zerocopy_graveyard() {
+    static auto* graves = new std::vector<ZerocopyGrave>();
+    return *graves;
+}
+
+size_t reap_zerocopy_graveyard() {
+    std::lock_guard<std::mutex> lock(zerocopy_graveyard_mutex());
+    auto& graves = zerocopy_graveyard();
+    for (size_t i = 0; i < graves.size();) {
+        ZerocopyGrave& grave = graves[i];
+        if (grave.fd >= 0) {
+            bool copied = false;
+            read_zerocopy_completions(grave.fd, grave.completed, copied);
+            release_completed(grave.frames, grave.completed);
+            if (grave.frames.empty()) {
+                close(grave.fd);
+                grave = std::move(graves.back());
+                graves.pop_back();
+                continue;
+            }
+        }
+        ++i;
+    }
+    return graves.size();
+}
+#else
+size_t reap_zerocopy_graveyard() {
+    return 0;
+}
+#endif
+} // namespace
+
+// A TCP socket, or with AF_UNIX a stream socket at a filesystem path: the
+// path to bind is given up front, connect_socket takes it as the address and
+// ignores the port. Both carry the same byte stream, so nothing above cares.
 class PosixSocket : public ISocket {
 public:
-    PosixSocket() : sockfd_(-1) {}
-    explicit PosixSocket(int fd) : sockfd_(fd) {} // For accepted sockets
+    PosixSocket() : sockfd_(-1), family_(AF_INET), reuse_port_(false), zerocopy_min_bytes_(0),
+                    zerocopy_next_(0), zerocopy_completed_(0) {}
+    explicit PosixSocket(int fd) : sockfd_(fd), family_(AF_INET), reuse_port_(false), zerocopy_min_bytes_(0),
+                                   zerocopy_next_(0), zerocopy_completed_(0) {} // For accepted sockets
+    PosixSocket(int family, const std::string& path) : sockfd_(-1), family_(family), reuse_port_(false),
+                                                       path_(path), zerocopy_min_bytes_(0), zerocopy_next_(0),
+                                                       zerocopy_completed_(0) {}
 
     ~PosixSocket() override {
         close_socket();
     }
 
     bool connect_socket(const std::string& ip_address, int port) override {
+        if (family_ == AF_UNIX) return connect_unix(ip_address);
         sockfd_ = socket(AF_INET, SOCK_STREAM, 0);
         if (sockfd_ < 0) {
             perror("PosixSocket: socket creation failed");
@@ -51,6 +162,7 @@ public:
     }
 
     bool bind_socket(int port) override {
+        if (family_ == AF_UNIX) return bind_unix();
         sockfd_ = socket(AF_INET, SOCK_STREAM, 0);
         if (sockfd_ < 0) {
             perror("PosixSocket: socket creation failed");
@@ -63,7 +175,13 @@ public:
             close_socket();
             return false;
         }
-
+#ifdef SO_REUSEPORT
+        if (reuse_port_ && setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+            perror("PosixSocket: setsockopt SO_REUSEPORT failed");
+            close_socket();
+            return false;
+        }
+#endif
 
         sockaddr_in serv_addr{};
         serv_addr.sin_family = AF_INET;
@@ -78,6 +196,44 @@ public:
         return true;
     }
 
+    bool set_reuse_port(bool enabled) override {
+#ifdef SO_REUSEPORT
+        reuse_port_ = enabled && family_ == AF_INET;
+        return reuse_port_ == enabled;
+#else
+        return !enabled;
+#endif
+    }
+
+    bool set_incoming_cpu(int cpu) override {
+#ifdef SO_INCOMING_CPU
+        if (sockfd_ < 0 || family_ != AF_INET) return false;
+        return setsockopt(sockfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    bool set_send_timeout(int64_t timeout_ms) override {
+        if (sockfd_ < 0 || timeout_ms < 0) return false;
+        timeval timeout{};
+        timeout.tv_sec = static_cast<decltype(timeout.tv_sec)>(timeout_ms / 1000);
+        timeout.tv_usec = static_cast<decltype(timeout.tv_usec)>((timeout_ms % 1000) * 1000);
+        return setsockopt(sockfd_, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout)) == 0;
+    }
+
+    int incoming_cpu() const override {
+#ifdef SO_INCOMING_CPU
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if (sockfd_ < 0 || getsockopt(sockfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) != 0) return -1;
+        return cpu;
+#else
+        return -1;
+#endif
+    }
+
     bool listen_socket(int backlog) override {
         if (listen(sockfd_, backlog) < 0) {
             perror("PosixSocket: listen failed");
@@ -87,7 +243,7 @@ public:
     }
 
     std::unique_ptr<ISocket> accept_socket() override {
-        sockaddr_in cli_addr{};
+        sockaddr_storage cli_addr{};
         socklen_t clilen = sizeof(cli_addr);
         int newsockfd = accept(sockfd_, (struct sockaddr*)&cli_addr, &clilen);
         if (newsockfd < 0) {
@@ -103,11 +259,63 @@ public:
 
     int send_data(const std::vector<char>& data) override {
         if (sockfd_ < 0 || data.empty()) return -1;
-        ssize_t n = send(sockfd_, data.data(), data.size(), 0); // MSG_NOSIGNAL might be useful
-        if (n < 0) {
+        return send_all(data.data(), data.size());
+    }
+
+    int send_shared(const std::shared_ptr<const std::vector<char>>& frame) override {
+        if (sockfd_ < 0 || !frame || frame->empty()) return -1;
+#ifdef CHAT_APP_HAS_ZEROCOPY
+        bool zerocopy;
+        {
+            std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+            if (zerocopy_next_ != zerocopy_completed_) {
+                reap_locked(); // Also keeps the error queue from filling up
+            }
+            zerocopy = zerocopy_min_bytes_ != 0 && frame->size() >= zerocopy_min_bytes_;
+        }
+        if (zerocopy) return send_zerocopy(frame); // Only these take a reference
+#endif
+        return send_all(frame->data(), frame->size());
+    }
+
+    int try_send(const char* data, size_t size) override {
+        if (sockfd_ < 0) return -1;
+        while (true) {
+#ifdef MSG_NOSIGNAL
+            ssize_t n = send(sockfd_, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+            ssize_t n = send(sockfd_, data, size, MSG_DONTWAIT);
+#endif
+            if (n >= 0) return static_cast<int>(n);
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0; // Send buffer full
             perror("PosixSocket: send failed");
+            return -1;
         }
-        return static_cast<int>(n);
+    }
+
+    bool enable_zerocopy(size_t min_bytes) override {
+#ifdef CHAT_APP_HAS_ZEROCOPY
+        int on = 1;
+        if (sockfd_ < 0 || min_bytes == 0 || setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0) {
+            return false; // E.g. not TCP
+        }
+        std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+        zerocopy_min_bytes_ = min_bytes;
+        return true;
+#else
+        (void)min_bytes;
+        return false;
+#endif
+    }
+
+    size_t reap_send_completions() override {
+#ifdef CHAT_APP_HAS_ZEROCOPY
+        std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+        return reap_locked();
+#else
+        return 0;
+#endif
     }
 
     int receive_data(std::vector<char>& buffer, size_t max_len) override {
@@ -131,12 +339,55 @@ public:
     }
 
     void close_socket() override {
+#ifdef CHAT_APP_HAS_ZEROCOPY
+        {
+            std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+            if (sockfd_ >= 0 && zerocopy_next_ != zerocopy_completed_) reap_locked();
+            if (sockfd_ >= 0 && !zerocopy_pending_.empty()) {
+                // The duplicate that hears the completions must not keep the connection open
+                shutdown(sockfd_, SHUT_WR);
+                int fd = dup(sockfd_);
+                if (fd < 0) perror("PosixSocket: dup failed; keeping zero-copy frames for good");
+                bury_pending_locked(fd);
+            }
+        }
+#endif
+        if (sockfd_ >= 0) {
+            close(sockfd_);
+            sockfd_ = -1;
+        }
+    }
+
+    void release_socket() override {
+#ifdef CHAT_APP_HAS_ZEROCOPY
+        {
+            std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+            if (sockfd_ >= 0 && zerocopy_next_ != zerocopy_completed_) reap_locked();
+            if (!zerocopy_pending_.empty()) bury_pending_locked(-1); // Its completions are the new owner's
+        }
+#endif
         if (sockfd_ >= 0) {
             close(sockfd_);
             sockfd_ = -1;
         }
     }
 
+    uint32_t zerocopy_sends() override {
+        std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+        return zerocopy_next_;
+    }
+
+    void continue_zerocopy_numbering(uint32_t sends) override {
+        std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+        zerocopy_next_ = zerocopy_completed_ = sends; // Completions of the earlier owner's calls are ignored
+    }
+
+    void shutdown_socket() override {
+        if (sockfd_ >= 0) {
+            shutdown(sockfd_, SHUT_RDWR);
+        }
+    }
+
     bool is_valid() const override {
         return sockfd_ >= 0;
     }
@@ -145,8 +396,168 @@ public:
         return sockfd_;
     }
 
+    WaitResult wait_readable(int timeout_ms, int wake_fd) override {
+        if (sockfd_ < 0) return WaitResult::FAILED;
+        pollfd fds[2] = {{sockfd_, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        nfds_t count = wake_fd >= 0 ? 2 : 1;
+        while (true) {
+            int n = poll(fds, count, timeout_ms);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("PosixSocket: poll failed");
+                return WaitResult::FAILED;
+            }
+            if (n == 0) return WaitResult::TIMEOUT;
+            if (count == 2 && fds[1].revents != 0) return WaitResult::WOKEN;
+            if (fds[0].revents == POLLERR && reap_send_completions() > 0) {
+                continue; // Only zero-copy completions; nothing to read
+            }
+            return WaitResult::READABLE; // Includes POLLHUP/POLLERR: recv reports those
+        }
+    }
+
 private:
+    // Writes all of [data, data + size), however many send() calls that takes.
+    int send_all(const char* data, size_t size) {
+        size_t sent = 0;
+        while (sent < size) { // send() may take only part of a large frame
+#ifdef MSG_NOSIGNAL
+            // A peer that vanished must not take the process down with SIGPIPE
+            ssize_t n = send(sockfd_, data + sent, size - sent, MSG_NOSIGNAL);
+#else
+            ssize_t n = send(sockfd_, data + sent, size - sent, 0);
+#endif
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) { // Only with a send timeout
+                    std::cerr << "PosixSocket: send timed out; the peer is not reading." << std::endl;
+                    return -1;
+                }
+                perror("PosixSocket: send failed");
+                return -1;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return static_cast<int>(sent);
+    }
+
+#ifdef CHAT_APP_HAS_ZEROCOPY
+    // Callers serialize sends (as they must for any stream), so the kernel
+    // numbers our MSG_ZEROCOPY calls in the order zerocopy_next_ counts them.
+    int send_zerocopy(const std::shared_ptr<const std::vector<char>>& frame) {
+        const char* data = frame->data();
+        const size_t size = frame->size();
+        size_t sent = 0;
+        uint32_t calls = 0;
+        bool copy_rest = false;
+        bool failed = false;
+        while (sent < size) {
+            ssize_t n = send(sockfd_, data + sent, size - sent, MSG_ZEROCOPY | MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == ENOBUFS) {
+                    copy_rest = true; // Out of room to track pinned pages
+                } else {
+                    perror("PosixSocket: send failed");
+                    failed = true;
+                }
+                break;
+            }
+            sent += static_cast<size_t>(n);
+            ++calls;
+        }
+        if (calls != 0) {
+            std::lock_guard<std::mutex> lock(zerocopy_mutex_);
+            zerocopy_next_ += calls;
+            // A reader may have reaped the completion already
+            if (static_cast<int32_t>(zerocopy_next_ - zerocopy_completed_) > 0) {
+                zerocopy_pending_.emplace_back(zerocopy_next_, frame);
+            }
+        }
+        if (failed || (copy_rest && send_all(data + sent, size - sent) < 0)) return -1;
+        return static_cast<int>(size);
+    }
+
+    // Reads completion notices off the error queue and drops the frames they
+    // cover. Requires zerocopy_mutex_.
+    size_t reap_locked() {
+        if (sockfd_ < 0) return 0;
+        // Even with nothing outstanding: a notice can beat send_zerocopy's bookkeeping
+        bool copied = false;
+        size_t notices = read_zerocopy_completions(sockfd_, zerocopy_completed_, copied);
+        if (copied) {
+            zerocopy_min_bytes_ = 0; // The route copies anyway (e.g. loopback); copying up front is cheaper
+        }
+        release_completed(zerocopy_pending_, zerocopy_completed_);
+        return notices;
+    }
+
+    // Hands the frames still in flight to the graveyard, with fd to reap
+    // them through (-1: kept for good). Requires zerocopy_mutex_.
+    void bury_pending_locked(int fd) {
+        std::lock_guard<std::mutex> lock(zerocopy_graveyard_mutex());
+        zerocopy_graveyard().push_back(ZerocopyGrave{fd, zerocopy_completed_, std::move(zerocopy_pending_)});
+        zerocopy_pending_.clear();
+    }
+#endif
+
+    static bool fill_unix_address(const std::string& path, sockaddr_un& addr) {
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "PosixSocket: invalid Unix socket path: " << path << std::endl;
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    bool connect_unix(const std::string& path) {
+        sockaddr_un addr{};
+        if (!fill_unix_address(path, addr)) return false;
+        sockfd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sockfd_ < 0) {
+            perror("PosixSocket: socket creation failed");
+            return false;
+        }
+        if (connect(sockfd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("PosixSocket: connection failed");
+            close_socket();
+            return false;
+        }
+        return true;
+    }
+
+    bool bind_unix() {
+        sockaddr_un addr{};
+        if (!fill_unix_address(path_, addr)) return false;
+        sockfd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sockfd_ < 0) {
+            perror("PosixSocket: socket creation failed");
+            return false;
+        }
+        unlink(path_.c_str()); // A stale file from an earlier run would make bind fail
+        if (bind(sockfd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("PosixSocket: bind failed");
+            close_socket();
+            return false;
+        }
+        return true;
+    }
+
     int sockfd_;
+    int family_;
+    bool reuse_port_; // TCP only
+    std::string path_; // AF_UNIX only: where bind_socket binds
+
+    // Zero-copy sends (enable_zerocopy). The kernel numbers each MSG_ZEROCOPY
+    // send() call from 0; a frame is released once its last call completes.
+    std::mutex zerocopy_mutex_; // The sender and a reaping reader share these
+    size_t zerocopy_min_bytes_; // 0: copy every send
+    uint32_t zerocopy_next_;      // Calls made so far
+    uint32_t zerocopy_completed_; // Calls before this one have completed
+#ifdef CHAT_APP_HAS_ZEROCOPY
+    ZerocopyFrames zerocopy_pending_;
+#endif
 };
 
 } // namespace common
@@ -0,0 +1,152 @@
+#include "common/reliable_channel.h"
+#include "common/message_serialization.h"
+
+namespace chat_app {
+namespace common {
+
+namespace {
+
+constexpr size_t kMaxAckRanges = 64; // Older gaps are reported again in the next ACK
+
+} // namespace
+
+bool parse_ack(const Message& msg, AckRanges& ack) {
+    const auto& payload = msg.payload;
+    if (payload.size() < 6) return false;
+    ack.cumulative = read_u32(payload.data());
+    size_t count = static_cast<unsigned char>(payload[4]) | (static_cast<unsigned char>(payload[5]) << 8);
+    if ((payload.size() - 6) / 8 < count) return false;
+    ack.selective.clear();
+    for (size_t i = 0; i < count; ++i) {
+        const char* range = payload.data() + 6 + i * 8;
+        ack.selective.emplace_back(read_u32(range), read_u32(range + 4));
+    }
+    return true;
+}
+
+// --- RetransmitWindow ---
+
+RetransmitWindow::RetransmitWindow(const ReliableConfig& config) : config_(config), next_sequence_(1), bytes_(0) {}
+
+bool RetransmitWindow::track(Message& msg, int64_t now_ms) {
+    if (pending_.size() >= config_.window_frames || bytes_ + msg.payload.size() > config_.window_bytes) {
+        return false;
+    }
+    msg.header.flags |= kFlagReliable;
+    msg.header.delivery_sequence = next_sequence_++;
+    bytes_ += msg.payload.size();
+    pending_.emplace(msg.header.delivery_sequence, Pending{msg, now_ms});
+    return true;
+}
+
+void RetransmitWindow::on_ack(const AckRanges& ack) {
+    auto release = [this](std::map<uint32_t, Pending>::iterator first, std::map<uint32_t, Pending>::iterator last) {
+        for (auto it = first; it != last; ++it) {
+            bytes_ -= it->second.msg.payload.size();
+        }
+        pending_.erase(first, last);
+    };
+    release(pending_.begin(), pending_.upper_bound(ack.cumulative));
+    for (const auto& range : ack.selective) {
+        if (range.first > range.second) continue;
+        release(pending_.lower_bound(range.first), pending_.upper_bound(range.second));
+    }
+}
+
+std::vector<Message> RetransmitWindow::take_due(int64_t now_ms) {
+    std::vector<Message> due;
+    for (auto& entry : pending_) {
+        if (now_ms - entry.second.sent_ms < config_.retransmit_after_ms) continue;
+        entry.second.sent_ms = now_ms;
+        due.push_back(entry.second.msg);
+    }
+    return due;
+}
+
+std::vector<Message> RetransmitWindow::take_all(int64_t now_ms) {
+    std::vector<Message> all;
+    all.reserve(pending_.size());
+    for (auto& entry : pending_) {
+        entry.second.sent_ms = now_ms;
+        all.push_back(entry.second.msg);
+    }
+    return all;
+}
+
+std::vector<Message> RetransmitWindow::restart(int64_t now_ms) {
+    std::map<uint32_t, Pending> old;
+    old.swap(pending_);
+    next_sequence_ = 1;
+    bytes_ = 0;
+    std::vector<Message> renumbered;
+    for (auto& entry : old) {
+        Message& msg = entry.second.msg;
+        track(msg, now_ms); // Cannot fail: the window held these already
+        renumbered.push_back(msg);
+    }
+    return renumbered;
+}
+
+// --- AckTracker ---
+
+AckTracker::AckTracker(const ReliableConfig& config)
+    : config_(config), cumulative_(0), unacked_(0), first_unacked_ms_(0) {}
+
+bool AckTracker::is_duplicate(uint32_t delivery_sequence) const {
+    return delivery_sequence <= cumulative_ || above_.count(delivery_sequence) != 0;
+}
+
+void AckTracker::on_receive(uint32_t delivery_sequence, int64_t now_ms) {
+    if (unacked_++ == 0) first_unacked_ms_ = now_ms;
+    if (is_duplicate(delivery_sequence)) return; // Our ACK was lost or late; repeat it
+    if (delivery_sequence != cumulative_ + 1) {
+        above_.insert(delivery_sequence);
+        return;
+    }
+    ++cumulative_;
+    while (!above_.empty() && *above_.begin() == cumulative_ + 1) {
+        above_.erase(above_.begin());
+        ++cumulative_;
+    }
+}
+
+int64_t AckTracker::ms_until_ack(int64_t now_ms) const {
+    if (unacked_ == 0) return -1;
+    if (unacked_ >= config_.ack_every) return 0;
+    int64_t waited = now_ms - first_unacked_ms_;
+    return waited >= config_.ack_delay_ms ? 0 : config_.ack_delay_ms - waited;
+}
+
+Message AckTracker::make_ack() {
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (uint32_t sequence : above_) {
+        if (!ranges.empty() && ranges.back().second + 1 == sequence) {
+            ranges.back().second = sequence;
+        } else if (ranges.size() < kMaxAckRanges) {
+            ranges.emplace_back(sequence, sequence);
+        } else {
+            break;
+        }
+    }
+
+    Message ack(MessageType::ACK, 0, 0, "");
+    append_u32(ack.payload, cumulative_);
+    ack.payload.push_back(static_cast<char>(ranges.size() & 0xFF));
+    ack.payload.push_back(static_cast<char>(ranges.size() >> 8));
+    for (const auto& range : ranges) {
+        append_u32(ack.payload, range.first);
+        append_u32(ack.payload, range.second);
+    }
+    ack.header.payload_size = static_cast<uint32_t>(ack.payload.size());
+    unacked_ = 0;
+    return ack;
+}
+
+void AckTracker::reset() {
+    cumulative_ = 0;
+    above_.clear();
+    unacked_ = 0;
+}
+
+} // namespace common
+} // namespace chat_app
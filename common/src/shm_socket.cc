@@ -0,0 +1,474 @@
+// Contents of shm_socket.cc
+#include "common/isocket.h"
+#include <algorithm>    // For std::min
+#include <atomic>
+#include <cstdint>
+#include <cstring>      // For memcpy
+#include <iostream>
+#include <new>          // For placement new
+#include <string>
+
+#ifdef __linux__ // memfd and eventfd are Linux-specific
+
+#include <unistd.h>      // For close, read, write, unlink, ftruncate
+#include <sys/mman.h>    // For memfd_create, mmap
+#include <sys/eventfd.h> // For eventfd
+#include <sys/socket.h>  // For socket, sendmsg, recvmsg
+#include <sys/un.h>      // For sockaddr_un
+#include <poll.h>        // For poll
+#include <cerrno>        // For errno, EINTR
+
+namespace chat_app {
+namespace common {
+
+// Same-host transport. A client connects to an AF_UNIX socket at the path and
+// receives, over SCM_RIGHTS, a shared memory segment holding one
+// single-producer/single-consumer byte ring per direction, plus an eventfd
+// per ring side for wakeups. Frames then move with two memcpys and, while the
+// other side is busy, no system call at all: a side only sleeps on its
+// eventfd after a short spin finds nothing to do, and the other side only
+// writes to that eventfd if it sees the sleeping flag.
+//
+// The AF_UNIX connection stays open to carry liveness: its EOF, or a local
+// shutdown_socket(), ends the stream the same way a TCP FIN would.
+namespace shm {
+
+constexpr uint32_t kMagic = 0x43525348;   // "HSRC"
+constexpr uint32_t kVersion = 1;
+constexpr uint64_t kRingBytes = 1 << 20;  // Per direction; a power of two
+constexpr int kSpinIterations = 2000;     // Checks of an empty (full) ring before sleeping
+constexpr int kFdCount = 5;               // Segment, then data and space eventfds of each ring
+
+struct RingControl {
+    alignas(64) std::atomic<uint64_t> head;        // Bytes ever written; stored by the producer only
+    alignas(64) std::atomic<uint64_t> tail;        // Bytes ever read; stored by the consumer only
+    alignas(64) std::atomic<uint32_t> consumer_sleeping;
+    std::atomic<uint32_t> producer_sleeping;
+};
+
+struct Segment {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_bytes;
+    RingControl rings[2]; // [0] client to server, [1] server to client
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared rings need address-free atomics");
+
+constexpr size_t kDataOffset = (sizeof(Segment) + 4095) & ~size_t(4095);
+constexpr size_t kSegmentBytes = kDataOffset + 2 * kRingBytes;
+
+void signal(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+}
+
+void drain(int fd) {
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+}
+
+bool send_fds(int channel_fd, const int* fds, int count) {
+    char byte = 'S';
+    iovec iov{&byte, 1};
+    char control[CMSG_SPACE(sizeof(int) * kFdCount)] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    ssize_t n;
+    do {
+        n = sendmsg(channel_fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == 1;
+}
+
+bool receive_fds(int channel_fd, int* fds, int count) {
+    char byte = 0;
+    iovec iov{&byte, 1};
+    char control[CMSG_SPACE(sizeof(int) * kFdCount)] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(channel_fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    cmsghdr* cmsg = n == 1 ? CMSG_FIRSTHDR(&msg) : nullptr;
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return false;
+    int received = static_cast<int>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * std::min(received, count));
+    if (received != count) {
+        for (int i = 0; i < std::min(received, count); ++i) close(fds[i]);
+        return false;
+    }
+    return true;
+}
+
+} // namespace shm
+
+class ShmSocket : public ISocket {
+public:
+    explicit ShmSocket(const std::string& path) : path_(path) {}
+
+    ~ShmSocket() override {
+        close_socket();
+    }
+
+    bool connect_socket(const std::string& ip_address, int /*port*/) override {
+        sockaddr_un addr{};
+        if (!fill_address(ip_address, addr)) return false;
+        control_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (control_fd_ < 0) {
+            perror("ShmSocket: socket creation failed");
+            return false;
+        }
+        if (connect(control_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("ShmSocket: connection failed");
+            close_socket();
+            return false;
+        }
+        int fds[shm::kFdCount];
+        if (!shm::receive_fds(control_fd_, fds, shm::kFdCount)) {
+            std::cerr << "ShmSocket: server did not send a shared memory segment." << std::endl;
+            close_socket();
+            return false;
+        }
+        bool ok = attach(fds, false);
+        close(fds[0]); // The mapping keeps the segment alive
+        if (!ok) {
+            for (int i = 1; i < shm::kFdCount; ++i) close(fds[i]);
+            close_socket();
+            return false;
+        }
+        return true;
+    }
+
+    bool bind_socket(int /*port*/) override {
+        sockaddr_un addr{};
+        if (!fill_address(path_, addr)) return false;
+        control_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (control_fd_ < 0) {
+            perror("ShmSocket: socket creation failed");
+            return false;
+        }
+        unlink(path_.c_str()); // A stale file from an earlier run would make bind fail
+        if (bind(control_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("ShmSocket: bind failed");
+            close_socket();
+            return false;
+        }
+        return true;
+    }
+
+    bool listen_socket(int backlog) override {
+        if (listen(control_fd_, backlog) < 0) {
+            perror("ShmSocket: listen failed");
+            return false;
+        }
+        return true;
+    }
+
+    std::unique_ptr<ISocket> accept_socket() override {
+        int channel_fd = accept4(control_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (channel_fd < 0) {
+            return nullptr; // Can be non-fatal if server is shutting down
+        }
+        auto connection = std::make_unique<ShmSocket>(path_);
+        connection->control_fd_ = channel_fd;
+
+        int fds[shm::kFdCount];
+        fds[0] = memfd_create("chat_app_shm", MFD_CLOEXEC);
+        for (int i = 1; i < shm::kFdCount; ++i) {
+            fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        }
+        bool ok = std::all_of(fds, fds + shm::kFdCount, [](int fd) { return fd >= 0; }) &&
+                  ftruncate(fds[0], shm::kSegmentBytes) == 0;
+        if (!ok) {
+            perror("ShmSocket: cannot create a shared memory segment");
+        }
+        // The segment fd is closed once both sides have mapped it
+        ok = ok && connection->attach(fds, true) && shm::send_fds(channel_fd, fds, shm::kFdCount);
+        close(fds[0]);
+        if (!ok) {
+            for (int i = 1; i < shm::kFdCount; ++i) {
+                if (fds[i] >= 0 && !connection->owns(fds[i])) close(fds[i]);
+            }
+            return nullptr;
+        }
+        return connection;
+    }
+
+    int send_data(const std::vector<char>& data) override {
+        if (!segment_ || data.empty()) return -1;
+        const uint64_t mask = segment_->ring_bytes - 1;
+        uint64_t head = tx_->head.load(std::memory_order_relaxed);
+        size_t sent = 0;
+        while (sent < data.size()) {
+            uint64_t space = segment_->ring_bytes - (head - tx_->tail.load(std::memory_order_acquire));
+            if (space == 0) {
+                if (!wait_for_space(head)) return -1;
+                continue;
+            }
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(space, data.size() - sent));
+            size_t offset = static_cast<size_t>(head & mask);
+            size_t first = std::min(chunk, static_cast<size_t>(segment_->ring_bytes) - offset);
+            std::memcpy(tx_data_ + offset, data.data() + sent, first);
+            std::memcpy(tx_data_, data.data() + sent + first, chunk - first);
+            head += chunk;
+            sent += chunk;
+            tx_->head.store(head, std::memory_order_seq_cst);
+            if (tx_->consumer_sleeping.load(std::memory_order_seq_cst)) {
+                shm::signal(tx_data_fd_);
+            }
+        }
+        return static_cast<int>(sent);
+    }
+
+    int try_send(const char* data, size_t size) override {
+        if (!segment_) return -1;
+        if (tx_->producer_sleeping.load(std::memory_order_relaxed)) {
+            tx_->producer_sleeping.store(0, std::memory_order_relaxed);
+            shm::drain(tx_space_fd_); // The wakeup that brought the caller here, if any
+        }
+        const uint64_t mask = segment_->ring_bytes - 1;
+        uint64_t head = tx_->head.load(std::memory_order_relaxed);
+        size_t sent = 0;
+        while (sent < size) {
+            uint64_t space = segment_->ring_bytes - (head - tx_->tail.load(std::memory_order_acquire));
+            if (space == 0) {
+                // Have the consumer signal tx_space_fd_ (see send_ready_fd) when it frees some
+                tx_->producer_sleeping.store(1, std::memory_order_seq_cst);
+                if (head - tx_->tail.load(std::memory_order_acquire) != segment_->ring_bytes) continue;
+                if (sent == 0 && channel_closed()) return -1;
+                break;
+            }
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(space, size - sent));
+            size_t offset = static_cast<size_t>(head & mask);
+            size_t first = std::min(chunk, static_cast<size_t>(segment_->ring_bytes) - offset);
+            std::memcpy(tx_data_ + offset, data + sent, first);
+            std::memcpy(tx_data_, data + sent + first, chunk - first);
+            head += chunk;
+            sent += chunk;
+            tx_->head.store(head, std::memory_order_seq_cst);
+            if (tx_->consumer_sleeping.load(std::memory_order_seq_cst)) {
+                shm::signal(tx_data_fd_);
+            }
+        }
+        return static_cast<int>(sent);
+    }
+
+    bool set_send_timeout(int64_t timeout_ms) override {
+        if (timeout_ms < 0) return false;
+        send_timeout_ms_ = timeout_ms;
+        return true;
+    }
+
+    int send_ready_fd(bool& readable) const override {
+        readable = true;
+        return tx_space_fd_;
+    }
+
+    int receive_data(std::vector<char>& buffer, size_t max_len) override {
+        if (!segment_) return -1;
+        const uint64_t mask = segment_->ring_bytes - 1;
+        while (true) {
+            uint64_t tail = rx_->tail.load(std::memory_order_relaxed);
+            uint64_t available = rx_->head.load(std::memory_order_acquire) - tail;
+            if (available > 0) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(available, max_len));
+                size_t offset = static_cast<size_t>(tail & mask);
+                size_t first = std::min(n, static_cast<size_t>(segment_->ring_bytes) - offset);
+                buffer.resize(n);
+                std::memcpy(buffer.data(), rx_data_ + offset, first);
+                std::memcpy(buffer.data() + first, rx_data_, n - first);
+                rx_->tail.store(tail + n, std::memory_order_seq_cst);
+                if (rx_->producer_sleeping.load(std::memory_order_seq_cst)) {
+                    shm::signal(rx_space_fd_);
+                }
+                return static_cast<int>(n);
+            }
+            if (channel_closed()) {
+                buffer.clear();
+                return 0; // Everything the peer wrote has been read
+            }
+            if (wait_readable(-1, -1) == WaitResult::FAILED) return -1;
+        }
+    }
+
+    void close_socket() override {
+        if (segment_) {
+            munmap(segment_, shm::kSegmentBytes);
+            segment_ = nullptr;
+        }
+        for (int* fd : {&rx_data_fd_, &rx_space_fd_, &tx_data_fd_, &tx_space_fd_, &control_fd_}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    void shutdown_socket() override {
+        if (control_fd_ >= 0) {
+            shutdown(control_fd_, SHUT_RDWR); // Wakes our own waiters and tells the peer
+        }
+    }
+
+    bool is_valid() const override {
+        return control_fd_ >= 0;
+    }
+
+    int get_fd() const override {
+        return control_fd_;
+    }
+
+    bool is_transferable() const override {
+        return false; // The stream lives in the mapping, not in the descriptor
+    }
+
+    WaitResult wait_readable(int timeout_ms, int wake_fd) override {
+        if (control_fd_ < 0) return WaitResult::FAILED;
+        if (!segment_) return poll_fds(-1, timeout_ms, wake_fd); // A listener
+        while (true) {
+            for (int i = 0; i < shm::kSpinIterations; ++i) {
+                if (rx_readable()) return WaitResult::READABLE;
+            }
+            rx_->consumer_sleeping.store(1, std::memory_order_seq_cst);
+            if (rx_readable()) { // Written before the producer could see the flag
+                rx_->consumer_sleeping.store(0, std::memory_order_relaxed);
+                return WaitResult::READABLE;
+            }
+            WaitResult result = poll_fds(rx_data_fd_, timeout_ms, wake_fd);
+            rx_->consumer_sleeping.store(0, std::memory_order_relaxed);
+            // A leftover wakeup for data we already read is not readable
+            if (result != WaitResult::READABLE || rx_readable() || channel_closed()) return result;
+        }
+    }
+
+private:
+    static bool fill_address(const std::string& path, sockaddr_un& addr) {
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "ShmSocket: invalid socket path: " << path << std::endl;
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    // Maps the segment (initializing it on the server side) and, on success,
+    // takes over the eventfds in fds[1..4]. fds[0] stays with the caller.
+    bool attach(const int* fds, bool server_side) {
+        void* base = mmap(nullptr, shm::kSegmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (base == MAP_FAILED) {
+            perror("ShmSocket: mmap failed");
+            return false;
+        }
+        if (server_side) {
+            segment_ = new (base) shm::Segment{shm::kMagic, shm::kVersion, shm::kRingBytes, {}};
+        } else {
+            segment_ = static_cast<shm::Segment*>(base);
+            if (segment_->magic != shm::kMagic || segment_->version != shm::kVersion ||
+                segment_->ring_bytes != shm::kRingBytes) {
+                std::cerr << "ShmSocket: incompatible shared memory segment." << std::endl;
+                munmap(base, shm::kSegmentBytes);
+                segment_ = nullptr;
+                return false;
+            }
+        }
+        char* data = static_cast<char*>(base) + shm::kDataOffset;
+        int rx = server_side ? 0 : 1;
+        int tx = 1 - rx;
+        rx_ = &segment_->rings[rx];
+        tx_ = &segment_->rings[tx];
+        rx_data_ = data + rx * shm::kRingBytes;
+        tx_data_ = data + tx * shm::kRingBytes;
+        rx_data_fd_ = fds[1 + rx * 2];
+        rx_space_fd_ = fds[2 + rx * 2];
+        tx_data_fd_ = fds[1 + tx * 2];
+        tx_space_fd_ = fds[2 + tx * 2];
+        return true;
+    }
+
+    bool owns(int fd) const {
+        return fd == rx_data_fd_ || fd == rx_space_fd_ || fd == tx_data_fd_ || fd == tx_space_fd_;
+    }
+
+    bool rx_readable() const {
+        return rx_->head.load(std::memory_order_acquire) != rx_->tail.load(std::memory_order_relaxed);
+    }
+
+    // Blocks until the consumer frees space in tx_. False if the stream ended,
+    // or the consumer freed none within send_timeout_ms_.
+    bool wait_for_space(uint64_t head) {
+        auto full = [&] { return head - tx_->tail.load(std::memory_order_acquire) == segment_->ring_bytes; };
+        for (int i = 0; i < shm::kSpinIterations; ++i) {
+            if (!full()) return true;
+        }
+        while (true) {
+            tx_->producer_sleeping.store(1, std::memory_order_seq_cst);
+            if (!full()) {
+                tx_->producer_sleeping.store(0, std::memory_order_relaxed);
+                return true;
+            }
+            int timeout_ms = send_timeout_ms_ > 0 ? static_cast<int>(send_timeout_ms_) : -1;
+            WaitResult result = poll_fds(tx_space_fd_, timeout_ms, -1);
+            tx_->producer_sleeping.store(0, std::memory_order_relaxed);
+            if (result == WaitResult::TIMEOUT && full()) {
+                std::cerr << "ShmSocket: send timed out; the peer is not reading." << std::endl;
+                return false;
+            }
+            if (result == WaitResult::FAILED || channel_closed()) return false;
+        }
+    }
+
+    // The AF_UNIX channel never carries data after setup, so readable means EOF
+    bool channel_closed() {
+        char byte;
+        ssize_t n = recv(control_fd_, &byte, 1, MSG_DONTWAIT);
+        return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+    }
+
+    WaitResult poll_fds(int event_fd, int timeout_ms, int wake_fd) {
+        pollfd fds[3] = {{control_fd_, POLLIN, 0}, {event_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        while (true) {
+            int n = poll(fds, 3, timeout_ms); // Negative fds are ignored
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("ShmSocket: poll failed");
+                return WaitResult::FAILED;
+            }
+            if (n == 0) return WaitResult::TIMEOUT;
+            if (fds[1].revents != 0) shm::drain(event_fd);
+            if (fds[2].revents != 0) return WaitResult::WOKEN;
+            return WaitResult::READABLE; // Includes the channel's EOF: receive_data reports it
+        }
+    }
+
+    std::string path_;           // Where a listener binds
+    int control_fd_ = -1;        // Listening socket, or the connection's AF_UNIX channel
+    shm::Segment* segment_ = nullptr;
+    shm::RingControl* rx_ = nullptr;
+    shm::RingControl* tx_ = nullptr;
+    char* rx_data_ = nullptr;
+    char* tx_data_ = nullptr;
+    int rx_data_fd_ = -1;        // We sleep on it for data
+    int rx_space_fd_ = -1;       // We signal the producer on it
+    int tx_data_fd_ = -1;        // We signal the consumer on it
+    int tx_space_fd_ = -1;       // We sleep on it for space
+    int64_t send_timeout_ms_ = 0; // 0: wait_for_space waits forever
+};
+
+} // namespace common
+} // namespace chat_app
+
+#endif // __linux__
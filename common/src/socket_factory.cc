@@ -4,18 +4,64 @@
 #include "winsock_socket.cc" // Include .cc directly for simplicity here, or link separately
 #else
 #include "posix_socket.cc"   // Include .cc directly for simplicity here, or link separately
+#include "shm_socket.cc"
 #endif
 
 namespace chat_app {
 namespace common {
 
-std::unique_ptr<ISocket> SocketFactory::create_socket() {
+std::unique_ptr<ISocket> SocketFactory::create_socket(Transport transport, const std::string& path) {
 #ifdef _WIN32
+    (void)path;
+    if (transport != Transport::TCP) return nullptr;
     return std::make_unique<WinsockSocket>();
 #else
-    return std::make_unique<PosixSocket>();
+    switch (transport) {
+    case Transport::UNIX_STREAM:
+        return std::make_unique<PosixSocket>(AF_UNIX, path);
+    case Transport::SHARED_MEMORY:
+#ifdef __linux__
+        return std::make_unique<ShmSocket>(path);
+#else
+        return nullptr;
+#endif
+    case Transport::TCP:
+    default:
+        return std::make_unique<PosixSocket>();
+    }
+#endif
+}
+
+std::unique_ptr<ISocket> SocketFactory::adopt_socket(int fd) {
+#ifdef _WIN32
+    (void)fd;
+    return nullptr;
+#else
+    if (fd < 0) return nullptr;
+    return std::make_unique<PosixSocket>(fd);
 #endif
 }
 
+size_t SocketFactory::reap_closed_sockets() {
+#ifdef _WIN32
+    return 0;
+#else
+    return reap_zerocopy_graveyard();
+#endif
+}
+
+Transport SocketFactory::parse_address(const std::string& address, std::string& location) {
+    if (address.rfind("unix:", 0) == 0) {
+        location = address.substr(5);
+        return Transport::UNIX_STREAM;
+    }
+    if (address.rfind("shm:", 0) == 0) {
+        location = address.substr(4);
+        return Transport::SHARED_MEMORY;
+    }
+    location = address;
+    return Transport::TCP;
+}
+
 } // namespace common
 } // namespace chat_app
\ No newline at end of file
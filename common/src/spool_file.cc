@@ -0,0 +1,106 @@
+#include "common/spool_file.h"
+#include <cstdio> // For perror
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace chat_app {
+namespace common {
+
+#ifndef _WIN32
+
+std::unique_ptr<SpoolFile> SpoolFile::create(const std::string& directory) {
+    std::string path = (directory.empty() ? std::string(".") : directory) + "/chat_spool.XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if (fd < 0) {
+        perror("SpoolFile: mkstemp failed");
+        return nullptr;
+    }
+    unlink(name.data()); // Lives on only through fd
+    return std::unique_ptr<SpoolFile>(new SpoolFile(fd));
+}
+
+SpoolFile::~SpoolFile() {
+    unmap();
+    close(fd_);
+}
+
+bool SpoolFile::append(const char* data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = pwrite(fd_, data + written, size - written, static_cast<off_t>(write_offset_ + written));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("SpoolFile: write failed");
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    write_offset_ += size;
+    return true;
+}
+
+const char* SpoolFile::peek(size_t& size) {
+    size = pending();
+    if (size == 0) return nullptr;
+    if (mapped_size_ < write_offset_) {
+        // Remapped only when what we want is past the end of the mapping
+        if (read_offset_ >= mapped_size_) {
+            unmap();
+            void* mapped = mmap(nullptr, write_offset_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (mapped == MAP_FAILED) {
+                perror("SpoolFile: mmap failed");
+                size = 0;
+                return nullptr;
+            }
+            mapped_ = static_cast<char*>(mapped);
+            mapped_size_ = write_offset_;
+        } else {
+            size = mapped_size_ - read_offset_; // The rest once this is read
+        }
+    }
+    return mapped_ + read_offset_;
+}
+
+void SpoolFile::consume(size_t size) {
+    read_offset_ += size;
+    if (read_offset_ < write_offset_) return;
+    // Drained: start over at the front of an empty file
+    unmap();
+    read_offset_ = write_offset_ = 0;
+    if (ftruncate(fd_, 0) != 0) {
+        perror("SpoolFile: ftruncate failed");
+    }
+}
+
+void SpoolFile::unmap() {
+    if (mapped_) {
+        munmap(mapped_, mapped_size_);
+        mapped_ = nullptr;
+        mapped_size_ = 0;
+    }
+}
+
+#else // _WIN32: no spooling; outbound queues stay in memory
+
+std::unique_ptr<SpoolFile> SpoolFile::create(const std::string& directory) {
+    (void)directory;
+    return nullptr;
+}
+SpoolFile::~SpoolFile() {}
+bool SpoolFile::append(const char* data, size_t size) { (void)data; (void)size; return false; }
+const char* SpoolFile::peek(size_t& size) { size = 0; return nullptr; }
+void SpoolFile::consume(size_t size) { (void)size; }
+void SpoolFile::unmap() {}
+
+#endif
+
+} // namespace common
+} // namespace chat_app
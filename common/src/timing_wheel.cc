@@ -0,0 +1,144 @@
+#include "common/timing_wheel.h"
+
+namespace chat_app {
+namespace common {
+
+TimingWheel::TimingWheel(std::chrono::milliseconds tick, int64_t now_ms)
+    : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+      origin_ms_(now_ms),
+      current_tick_(0),
+      slots_(kLevels * kSlots, kNil),
+      active_count_(0) {}
+
+TimingWheel::TimerId TimingWheel::schedule(int64_t delay_ms, Callback callback) {
+    uint64_t ticks = delay_ms <= 0 ? 0 : static_cast<uint64_t>((delay_ms + tick_.count() - 1) / tick_.count());
+
+    int32_t index;
+    if (!free_nodes_.empty()) {
+        index = free_nodes_.back();
+        free_nodes_.pop_back();
+    } else {
+        index = static_cast<int32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+    Node& node = nodes_[index];
+    node.expiry_tick = current_tick_ + ticks;
+    node.callback = std::move(callback);
+    place(index);
+    ++active_count_;
+    return (static_cast<uint64_t>(node.generation) << 32) | static_cast<uint32_t>(index + 1);
+}
+
+bool TimingWheel::cancel(TimerId id) {
+    if (id == kInvalidTimer) return false;
+    int64_t index = static_cast<int64_t>(id & 0xFFFFFFFFu) - 1;
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (index < 0 || index >= static_cast<int64_t>(nodes_.size())) return false;
+
+    Node& node = nodes_[index];
+    if (node.head == nullptr || node.generation != generation) return false;
+    unlink(static_cast<int32_t>(index));
+    release(static_cast<int32_t>(index));
+    --active_count_;
+    return true;
+}
+
+size_t TimingWheel::advance(int64_t now_ms) {
+    if (now_ms < origin_ms_) return 0;
+    uint64_t target_tick = static_cast<uint64_t>((now_ms - origin_ms_) / tick_.count());
+    size_t fired = 0;
+
+    while (current_tick_ <= target_tick) {
+        size_t slot = current_tick_ & kSlotMask;
+        if (slot == 0) {
+            // Level 0 wrapped: pull the next span of each higher level down
+            for (int level = 1; level < kLevels; ++level) {
+                cascade(level);
+                if (((current_tick_ >> (kSlotBits * level)) & kSlotMask) != 0) break;
+            }
+        }
+
+        // Detach first: callbacks may cancel entries of this very list
+        int32_t& head = slots_[slot];
+        int32_t due = head;
+        head = kNil;
+        for (int32_t i = due; i != kNil; i = nodes_[i].next) {
+            nodes_[i].head = &due;
+        }
+        ++current_tick_; // Timers scheduled from callbacks land in later slots
+
+        while (due != kNil) {
+            int32_t index = due;
+            unlink(index);
+            Callback callback = std::move(nodes_[index].callback);
+            release(index);
+            --active_count_;
+            ++fired;
+            if (callback) callback(); // May grow nodes_; no Node references held here
+        }
+    }
+    return fired;
+}
+
+void TimingWheel::place(int32_t index) {
+    Node& node = nodes_[index];
+    uint64_t expiry = node.expiry_tick < current_tick_ ? current_tick_ : node.expiry_tick;
+    uint64_t delta = expiry - current_tick_;
+
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+        ++level;
+    }
+    if (level == kLevels - 1) {
+        uint64_t max_delta = (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+        if (delta > max_delta) {
+            // Beyond the top wheel: park at its far end; the next cascade re-places it
+            expiry = current_tick_ + max_delta;
+        }
+    }
+
+    int32_t& head = slots_[level * kSlots + ((expiry >> (kSlotBits * level)) & kSlotMask)];
+    node.prev = kNil;
+    node.next = head;
+    if (head != kNil) nodes_[head].prev = index;
+    head = index;
+    node.head = &head;
+}
+
+void TimingWheel::unlink(int32_t index) {
+    Node& node = nodes_[index];
+    if (node.prev != kNil) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        *node.head = node.next;
+    }
+    if (node.next != kNil) nodes_[node.next].prev = node.prev;
+    node.prev = kNil;
+    node.next = kNil;
+    node.head = nullptr;
+}
+
+void TimingWheel::release(int32_t index) {
+    Node& node = nodes_[index];
+    node.callback = nullptr;
+    node.head = nullptr;
+    ++node.generation; // Stale TimerIds for this slot no longer match
+    free_nodes_.push_back(index);
+}
+
+void TimingWheel::cascade(int level) {
+    int32_t& head = slots_[level * kSlots + ((current_tick_ >> (kSlotBits * level)) & kSlotMask)];
+    int32_t moving = head;
+    head = kNil;
+    for (int32_t i = moving; i != kNil; i = nodes_[i].next) {
+        nodes_[i].head = &moving;
+    }
+    while (moving != kNil) {
+        int32_t index = moving;
+        unlink(index);
+        place(index);
+    }
+}
+
+} // namespace common
+} // namespace chat_app
@@ -0,0 +1,245 @@
+#include "common/utf8.h"
+#include <cstdint>
+#include <cstring> // For memcpy
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHAT_UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+namespace chat_app {
+namespace common {
+
+namespace {
+
+using Validator = bool (*)(const unsigned char*, size_t);
+
+// Decodes the sequence at p[i], moving i past it. False if it is not valid UTF-8.
+bool decode_one(const unsigned char* p, size_t n, size_t& i) {
+    unsigned char lead = p[i];
+    if (lead < 0x80) {
+        ++i;
+        return true;
+    }
+    size_t length;
+    uint32_t code_point;
+    uint32_t smallest; // Anything below this has a shorter encoding
+    if ((lead & 0xE0) == 0xC0) {
+        length = 2;
+        code_point = lead & 0x1F;
+        smallest = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 3;
+        code_point = lead & 0x0F;
+        smallest = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        length = 4;
+        code_point = lead & 0x07;
+        smallest = 0x10000;
+    } else {
+        return false; // A continuation byte or 0xF8..0xFF
+    }
+    if (n - i < length) return false;
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char c = p[i + k];
+        if ((c & 0xC0) != 0x80) return false;
+        code_point = (code_point << 6) | (c & 0x3F);
+    }
+    if (code_point < smallest || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+        return false;
+    }
+    i += length;
+    return true;
+}
+
+bool validate_scalar(const unsigned char* p, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if (n - i >= 8) {
+            uint64_t word;
+            std::memcpy(&word, p + i, sizeof(word));
+            if ((word & 0x8080808080808080ull) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        if (!decode_one(p, n, i)) return false;
+    }
+    return true;
+}
+
+#if defined(CHAT_UTF8_X86) && defined(__SSE2__)
+
+bool validate_sse2(const unsigned char* p, size_t n) {
+    size_t i = 0;
+    while (n - i >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        if (_mm_movemask_epi8(block) == 0) {
+            i += 16;
+            continue;
+        }
+        // Decode up to the end of the block; the last sequence may run past it
+        size_t end = i + 16;
+        while (i < end) {
+            if (!decode_one(p, n, i)) return false;
+        }
+    }
+    while (i < n) {
+        if (!decode_one(p, n, i)) return false;
+    }
+    return true;
+}
+
+#endif
+
+#ifdef CHAT_UTF8_X86
+
+// Keiser & Lemire, "Validating UTF-8 in less than one instruction per byte"
+// (2021). Each byte is classified by three 16-entry tables, indexed by the high
+// and low nibble of the byte before it and the high nibble of the byte itself;
+// their AND is non-zero exactly where that pair of bytes breaks a rule. What
+// pairs cannot see (continuations the lead two or three bytes back demands) is
+// checked against the bytes two and three back.
+constexpr uint8_t kTooShort = 1 << 0;    // Lead followed by a lead or ASCII
+constexpr uint8_t kTooLong = 1 << 1;     // ASCII followed by a continuation
+constexpr uint8_t kOverlong3 = 1 << 2;   // E0 80..9F
+constexpr uint8_t kTooLarge = 1 << 3;    // F4 90..BF, F5..FF
+constexpr uint8_t kSurrogate = 1 << 4;   // ED A0..BF
+constexpr uint8_t kOverlong2 = 1 << 5;   // C0, C1
+constexpr uint8_t kTooLarge1000 = 1 << 6; // F5..FF 80..8F
+constexpr uint8_t kOverlong4 = 1 << 6;   // F0 80..8F
+constexpr uint8_t kTwoConts = 1 << 7;    // Continuation followed by a continuation
+constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts; // Decided by the high nibble alone
+
+__attribute__((target("avx2"))) inline __m256i lookup16(__m256i index, const uint8_t (&table)[16]) {
+    __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(half), index);
+}
+
+__attribute__((target("avx2"))) inline __m256i high_nibbles(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+// The 32 bytes ending `shift` bytes before the end of input, continuing from previous.
+template <int shift>
+__attribute__((target("avx2"))) inline __m256i preceding(__m256i input, __m256i previous) {
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - shift);
+}
+
+__attribute__((target("avx2"))) __m256i block_errors(__m256i input, __m256i previous) {
+    static const uint8_t first_high[16] = {
+        kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, // 0xxx ASCII
+        kTwoConts, kTwoConts, kTwoConts, kTwoConts,                                     // 10xx continuation
+        kTooShort | kOverlong2,                                                         // 1100
+        kTooShort,                                                                      // 1101
+        kTooShort | kOverlong3 | kSurrogate,                                            // 1110
+        kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,                             // 1111
+    };
+    static const uint8_t first_low[16] = {
+        kCarry | kOverlong3 | kOverlong2 | kOverlong4, // xxxx0000
+        kCarry | kOverlong2,                          // xxxx0001
+        kCarry,
+        kCarry,
+        kCarry | kTooLarge, // xxxx0100
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000 | kSurrogate, // xxxx1101
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+    };
+    static const uint8_t second_high[16] = {
+        kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, // ASCII
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,           // 1000
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,                            // 1001
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,                            // 1010
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,                            // 1011
+        kTooShort, kTooShort, kTooShort, kTooShort,                                            // Lead
+    };
+    __m256i prev1 = preceding<1>(input, previous);
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(lookup16(high_nibbles(prev1), first_high),
+                         lookup16(_mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)), first_low)),
+        lookup16(high_nibbles(input), second_high));
+    // A continuation is due here if the byte two back is a 3- or 4-byte lead,
+    // or the byte three back a 4-byte lead; the pair tables flagged it as kTwoConts
+    __m256i third = _mm256_subs_epu8(preceding<2>(input, previous), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(preceding<3>(input, previous), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m256i due = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(due, special);
+}
+
+// Non-zero if the block ends inside a sequence.
+__attribute__((target("avx2"))) inline __m256i ends_incomplete(__m256i input) {
+    const __m256i last_complete = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+    return _mm256_subs_epu8(input, last_complete);
+}
+
+__attribute__((target("avx2"))) bool validate_avx2(const unsigned char* p, size_t n) {
+    __m256i error = _mm256_setzero_si256();
+    __m256i previous = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    auto check = [&](__m256i input) __attribute__((target("avx2"))) {
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, incomplete);
+            incomplete = _mm256_setzero_si256();
+        } else {
+            error = _mm256_or_si256(error, block_errors(input, previous));
+            incomplete = ends_incomplete(input);
+        }
+        previous = input;
+    };
+    size_t i = 0;
+    for (; n - i >= 32; i += 32) {
+        check(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)));
+    }
+    // The tail, padded with ASCII so a sequence cut off at the end shows as too short
+    alignas(32) unsigned char tail[32] = {};
+    std::memcpy(tail, p + i, n - i);
+    check(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+#endif // CHAT_UTF8_X86
+
+struct Implementation {
+    const char* name;
+    Validator validate;
+};
+
+Implementation choose() {
+#ifdef CHAT_UTF8_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {"avx2", validate_avx2};
+#ifdef __SSE2__
+    return {"sse2", validate_sse2};
+#endif
+#endif
+    return {"scalar", validate_scalar};
+}
+
+const Implementation& implementation() {
+    static const Implementation chosen = choose();
+    return chosen;
+}
+
+} // namespace
+
+bool is_valid_utf8(const char* data, size_t size) {
+    return implementation().validate(reinterpret_cast<const unsigned char*>(data), size);
+}
+
+const char* utf8_implementation() {
+    return implementation().name;
+}
+
+} // namespace common
+} // namespace chat_app
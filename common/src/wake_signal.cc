@@ -0,0 +1,53 @@
+#include "common/wake_signal.h"
+#include <iostream>
+
+#ifndef _WIN32
+#include <unistd.h> // For pipe, read, write, close
+#include <fcntl.h>  // For fcntl, O_NONBLOCK
+#endif
+
+namespace chat_app {
+namespace common {
+
+WakeSignal::WakeSignal() : read_fd_(-1), write_fd_(-1), notified_(false) {
+#ifndef _WIN32
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("WakeSignal: pipe failed");
+        return;
+    }
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+    fcntl(read_fd_, F_SETFL, fcntl(read_fd_, F_GETFL, 0) | O_NONBLOCK); // reset() drains without blocking
+#endif
+}
+
+WakeSignal::~WakeSignal() {
+#ifndef _WIN32
+    if (read_fd_ >= 0) close(read_fd_);
+    if (write_fd_ >= 0) close(write_fd_);
+#endif
+}
+
+void WakeSignal::notify() {
+#ifndef _WIN32
+    if (write_fd_ < 0 || notified_) return;
+    char byte = 1;
+    if (write(write_fd_, &byte, 1) == 1) {
+        notified_ = true;
+    }
+#endif
+}
+
+void WakeSignal::reset() {
+#ifndef _WIN32
+    if (read_fd_ < 0) return;
+    char buffer[16];
+    while (read(read_fd_, buffer, sizeof(buffer)) > 0) {
+    }
+    notified_ = false;
+#endif
+}
+
+} // namespace common
+} // namespace chat_app
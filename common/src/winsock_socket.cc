@@ -132,11 +132,22 @@ public:
 
     int send_data(const std::vector<char>& data) override {
         if (sock_ == INVALID_SOCKET || data.empty()) return -1;
-        int n = send(sock_, data.data(), static_cast<int>(data.size()), 0);
-        if (n == SOCKET_ERROR) {
-            std::cerr << "WinsockSocket: send failed: " << WSAGetLastError() << std::endl;
+        size_t sent = 0;
+        while (sent < data.size()) { // send() may take only part of a large frame
+            int n = send(sock_, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+            if (n == SOCKET_ERROR) {
+                std::cerr << "WinsockSocket: send failed: " << WSAGetLastError() << std::endl;
+                return -1;
+            }
+            sent += static_cast<size_t>(n);
         }
-        return n;
+        return static_cast<int>(sent);
+    }
+
+    bool set_send_timeout(int64_t timeout_ms) override {
+        if (sock_ == INVALID_SOCKET || timeout_ms < 0) return false;
+        DWORD timeout = static_cast<DWORD>(timeout_ms);
+        return setsockopt(sock_, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout)) == 0;
     }
 
     int receive_data(std::vector<char>& buffer, size_t max_len) override {
@@ -166,6 +177,11 @@ public:
             sock_ = INVALID_SOCKET;
         }
     }
+    void shutdown_socket() override {
+        if (sock_ != INVALID_SOCKET) {
+            shutdown(sock_, SD_BOTH);
+        }
+    }
     bool is_valid() const override {
         return sock_ != INVALID_SOCKET;
     }
@@ -173,6 +189,20 @@ public:
         return static_cast<int>(sock_);
     }
 
+    // wake_fd is a POSIX descriptor and is ignored here.
+    WaitResult wait_readable(int timeout_ms, int /*wake_fd*/) override {
+        if (sock_ == INVALID_SOCKET) return WaitResult::FAILED;
+        WSAPOLLFD fd{};
+        fd.fd = sock_;
+        fd.events = POLLRDNORM;
+        int n = WSAPoll(&fd, 1, timeout_ms);
+        if (n == SOCKET_ERROR) {
+            std::cerr << "WinsockSocket: WSAPoll failed: " << WSAGetLastError() << std::endl;
+            return WaitResult::FAILED;
+        }
+        return n == 0 ? WaitResult::TIMEOUT : WaitResult::READABLE;
+    }
+
 private:
     SOCKET sock_;
 };
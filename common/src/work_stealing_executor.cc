@@ -0,0 +1,203 @@
+#include "common/work_stealing_executor.h"
+#include "common/cpu_affinity.h"
+#include <iostream>
+
+namespace chat_app {
+namespace common {
+
+namespace {
+// Lets a worker push follow-up tasks onto its own deque.
+thread_local WorkStealingExecutor* tls_executor = nullptr;
+thread_local size_t tls_worker_index = 0;
+
+void run_task(WorkStealingExecutor::Task& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        std::cerr << "WorkStealingExecutor: Task threw: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "WorkStealingExecutor: Task threw an unknown exception." << std::endl;
+    }
+}
+} // namespace
+
+WorkStealingExecutor::WorkStealingExecutor(size_t num_threads)
+    : num_threads_(num_threads), running_(false), next_worker_(0), queued_(0), stopping_(false) {
+    if (num_threads_ == 0) {
+        num_threads_ = std::thread::hardware_concurrency();
+        if (num_threads_ == 0) num_threads_ = 2; // hardware_concurrency() may be unknown
+    }
+    for (size_t i = 0; i < num_threads_; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+    stop();
+}
+
+void WorkStealingExecutor::set_cpus(std::vector<int> cpus) {
+    if (!running_) cpus_ = std::move(cpus);
+}
+
+void WorkStealingExecutor::start() {
+    if (running_) return;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = false;
+    }
+    running_ = true;
+    for (size_t i = 0; i < num_threads_; ++i) {
+        threads_.emplace_back(&WorkStealingExecutor::worker_loop, this, i);
+    }
+}
+
+void WorkStealingExecutor::stop() {
+    if (!running_) return;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+    running_ = false;
+}
+
+void WorkStealingExecutor::submit(Task task) {
+    if (!running_) {
+        run_task(task);
+        return;
+    }
+    push(std::move(task));
+}
+
+void WorkStealingExecutor::submit_ordered(uint64_t key, Task task) {
+    if (!running_) {
+        run_task(task);
+        return;
+    }
+    auto& stripe = stripe_for(key);
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto result = stripe.strands.try_emplace(key);
+        result.first->second.pending.push_back(std::move(task));
+        schedule = result.second; // A live strand entry means a turn is already queued or running
+    }
+    if (schedule) {
+        push([this, key] { run_strand(key); });
+    }
+}
+
+size_t WorkStealingExecutor::thread_count() const {
+    return num_threads_;
+}
+
+bool WorkStealingExecutor::is_running() const {
+    return running_;
+}
+
+void WorkStealingExecutor::push(Task task) {
+    size_t index = (tls_executor == this)
+        ? tls_worker_index
+        : next_worker_.fetch_add(1, std::memory_order_relaxed) % num_threads_;
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Incremented under sleep_mutex_ so a worker about to sleep cannot miss it
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        queued_.fetch_add(1, std::memory_order_relaxed);
+    }
+    sleep_cv_.notify_one();
+}
+
+bool WorkStealingExecutor::pop_local(size_t index, Task& task) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingExecutor::steal(size_t thief_index, Task& task) {
+    for (size_t offset = 1; offset < num_threads_; ++offset) {
+        Worker& victim = *workers_[(thief_index + offset) % num_threads_];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingExecutor::worker_loop(size_t index) {
+    tls_executor = this;
+    tls_worker_index = index;
+    if (!cpus_.empty() && !pin_current_thread(cpus_[index % cpus_.size()])) {
+        std::cerr << "WorkStealingExecutor: Cannot pin worker " << index << " to CPU "
+                  << cpus_[index % cpus_.size()] << "; running unpinned." << std::endl;
+    }
+
+    while (true) {
+        Task task;
+        if (pop_local(index, task) || steal(index, task)) {
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            run_task(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        if (queued_.load(std::memory_order_relaxed) > 0) {
+            // A task exists but try_lock skipped its deque; retry without sleeping
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        if (stopping_) break;
+        sleep_cv_.wait(lock, [this] {
+            return stopping_ || queued_.load(std::memory_order_relaxed) > 0;
+        });
+    }
+
+    tls_executor = nullptr;
+}
+
+void WorkStealingExecutor::run_strand(uint64_t key) {
+    auto& stripe = stripe_for(key);
+    for (size_t i = 0; i < kStrandBatch; ++i) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            auto& pending = stripe.strands[key].pending;
+            task = std::move(pending.front());
+            pending.pop_front();
+        }
+
+        run_task(task);
+
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.strands.find(key);
+        if (it->second.pending.empty()) {
+            stripe.strands.erase(it);
+            return;
+        }
+    }
+    // Yield the worker so one busy key cannot starve the others
+    push([this, key] { run_strand(key); });
+}
+
+WorkStealingExecutor::StrandStripe& WorkStealingExecutor::stripe_for(uint64_t key) {
+    return strand_stripes_[key % kStrandStripes];
+}
+
+} // namespace common
+} // namespace chat_app
@@ -1,13 +1,24 @@
 #pragma once
 
+#include "common/async_socket.h"
+#include "common/event_loop.h"
 #include "common/isocket.h"
 #include "common/message.h"
+#include "common/task.h"
+#include "common/work_stealing_executor.h"
 #include "imessage_handler.h" // For IMessageHandler
+#include "memory_budget.h"
+#include "outbound_queue.h"
+#include "rate_limiter.h"
+#include "session_store.h" // For ReliableState
 #include <thread>
 #include <atomic>
 #include <memory> // For std::unique_ptr
 #include <vector> // For internal buffer
+#include <unordered_set>
 #include <mutex>  // For receive_buffer_mutex_
+#include <condition_variable> // For dispatch_cv_
+#include <functional>
 
 namespace chat_app {
 namespace server {
@@ -16,28 +27,147 @@ class Server; // Forward declaration
 
 class ClientHandler {
 public:
-    ClientHandler(uint32_t id, std::unique_ptr<common::ISocket> socket, Server& server_ref, IMessageHandler& msg_handler);
+    // With a loop, the connection is read by a coroutine on it rather than
+    // by a thread of its own.
+    ClientHandler(uint32_t id, std::unique_ptr<common::ISocket> socket, Server& server_ref, IMessageHandler& msg_handler,
+                  common::WorkStealingExecutor& executor, common::EventLoop* loop = nullptr);
     ~ClientHandler();
 
     void start();
-    void stop(); // Signals the thread to stop and joins it
+    void stop(); // Signals the reader to stop, waits for it and for queued dispatches
+    // Safe from any thread. A kFlagReliable message is numbered and kept for
+    // retransmission if the client has opted in, and sent plainly otherwise.
     void send_message(const common::Message& msg);
+    // Sends a frame that is already serialized, e.g. one shared by many
+    // recipients. It must not change afterwards: a large one may be sent
+    // without copying, the socket holding on to it until the kernel is done.
+    void send_serialized(const std::shared_ptr<const std::vector<char>>& frame);
+    // As above, then calls on_written(true) once the socket has taken all of
+    // frame, i.e. once the outbound backlog it joined has drained, or
+    // on_written(false) if the connection fails first. Called without locks
+    // of ours, but maybe under a lock of Server's; keep it short.
+    void send_serialized(const std::shared_ptr<const std::vector<char>>& frame,
+                         std::function<void(bool written)> on_written);
+    // As send_serialized for an EPHEMERAL frame: while the connection has an
+    // outbound backlog, it replaces any frame still queued for the same slot.
+    void send_latest(const std::shared_ptr<const std::vector<char>>& frame, const std::string& slot);
     uint32_t get_id() const;
     bool is_running() const;
+    // Coarse-clock time of the last bytes received from the peer.
+    int64_t last_activity_ms() const { return last_activity_ms_.load(std::memory_order_relaxed); }
+    // Forces the receive thread out of recv; it then exits through the normal disconnect path.
+    void shutdown_connection();
+    bool is_shut_down() const { return shut_down_.load(std::memory_order_relaxed); }
+    // What the connection holds: received data not yet handled, its
+    // retransmit window and outbound backlog. Released when the handler goes.
+    const MemoryBudget::Account& memory() const { return memory_; }
+
+    // Server's outbound thread, once the socket is writable again: writes what
+    // it takes of the backlog, and tells Server when none is left.
+    void drain_outbound();
+
+    // Hot restart. quiesce() waits until the receive thread has left because of
+    // Server::quiesce_fd() and every queued message is handled; the socket stays
+    // open and connected. resume() restarts reading; abandon() closes our
+    // descriptor without shutting the connection down.
+    void quiesce();
+    void resume();
+    void abandon();
+    int socket_fd() const;
+    int send_ready_fd(bool& readable) const; // What Server polls for drain_outbound (see ISocket)
+    bool is_transferable() const; // False for shared memory connections
+    uint32_t zerocopy_sends() const; // For the successor to continue (see ISocket::zerocopy_sends)
+    // Which of Server's shards the connection belongs to, if it is sharded.
+    void set_shard_index(size_t index) { shard_index_ = index; }
+    size_t shard_index() const { return shard_index_; }
+    std::vector<char> receive_buffer_snapshot();
+    void restore_receive_buffer(std::vector<char> data); // Before start()
+
+    // Connection multiplexing: the virtual clients this connection speaks for
+    // besides itself. Changed only by Server, under its group's lock (see Server).
+    void add_virtual_client(uint32_t virtual_id);
+    bool remove_virtual_client(uint32_t virtual_id);
+    bool owns_virtual_client(uint32_t virtual_id) const;
+    std::vector<uint32_t> virtual_clients() const;
+    size_t virtual_client_count() const { return virtual_client_count_.load(std::memory_order_relaxed); }
+
+    // Reliable delivery (see common/reliable_channel.h).
+    void on_ack(const common::Message& ack);
+    // Hands over the session's state when the connection ends or is superseded.
+    std::unique_ptr<ReliableState> take_reliable_state();
+    // Continues a resumed session's state and resends what it never had acknowledged.
+    void adopt_reliable_state(std::unique_ptr<ReliableState> state);
 
 private:
+    void start_reader();
+    void join_reader();
     void run(); // Thread function
+    common::Task<void> read_loop(); // Runs on loop_ instead of run()
+    void finish_reading(); // Closes the socket and reports the disconnect
+    // Frames and dispatches received bytes. Given pause_ms, stops after a frame
+    // the rate limiter delays and reports the delay instead of sleeping here.
+    void receive_frames(const char* data, size_t size, int64_t* pause_ms);
+    void dispatch(common::Message msg); // Hands a decoded message to the executor
+    // Applies rate limits; false if the message must not be handled
+    bool admit(const common::Message& msg, int64_t* pause_ms);
+    bool is_new_reliable(const common::Message& msg); // A duplicate is only acknowledged again
+    void record_reliable(const common::Message& msg);  // Once admitted: acknowledge it
+    int ack_wait_ms(); // Timeout for the next wait_readable, -1 if no ACK is pending
+    void flush_ack(bool force);
+    void send_locked(const common::Message& msg); // Requires send_mutex_
+    // Hands a frame to the socket, or to outbound_ if there is one; false if
+    // the connection failed. Require send_mutex_.
+    bool write_locked(const std::shared_ptr<const std::vector<char>>& frame);
+    bool write_locked(std::vector<char> frame);
+    // Once the backlog is gone: hands back the callbacks waiting for it. Requires send_mutex_.
+    std::vector<std::function<void(bool)>> take_written_callbacks_locked();
+    void charge_outbound_locked(); // Brings memory_ up to date with reliable_; requires send_mutex_
+    void charge_receive_buffer_locked(); // Likewise with receive_buffer_; requires receive_buffer_mutex_
+    // How long to wait out memory pressure before the next read; 0 reads now.
+    int64_t memory_backoff_ms() const;
 
     uint32_t id_;
     std::unique_ptr<common::ISocket> socket_;
     Server& server_; // Reference to the main server
     IMessageHandler& message_handler_; // Reference to the message handler strategy
+    common::WorkStealingExecutor& executor_; // Runs message_handler_ off the receive thread
     
     std::thread thread_;
     std::atomic<bool> running_;
+    std::atomic<bool> shut_down_; // By shutdown_connection(); a reader paused for memory reads on to the end
+
+    common::EventLoop* loop_; // Null: thread_ reads the socket
+    size_t shard_index_;
+    common::AsyncSocket* async_socket_; // While read_loop runs; loop thread only
+    bool reader_active_; // read_loop spawned and not yet finished
+    std::mutex reader_mutex_;
+    std::condition_variable reader_cv_;
+
+    std::vector<char> receive_buffer_; // Only a frame split across reads; see receive_frames
+    std::mutex receive_buffer_mutex_; // Protects receive_buffer_ and charged_receive_buffer_
+    MemoryBudget::Account memory_;
+    int64_t charged_receive_buffer_; // receive_buffer_'s capacity as charged to memory_
+    int64_t charged_outbound_;       // reliable_'s retransmit window as charged; under send_mutex_
+
+    RateLimiter::ConnectionState rate_state_; // Receive thread only
+    std::mutex send_mutex_; // Serializes writes to socket_; protects reliable_
+    std::unique_ptr<ReliableState> reliable_; // Null once handed over
+    std::atomic<int64_t> last_activity_ms_;
+    bool zerocopy_; // socket_ sends large shared frames with MSG_ZEROCOPY
+    std::unique_ptr<OutboundQueue> outbound_; // With a spool directory; under send_mutex_
+    bool outbound_backlog_; // outbound_ holds something and Server knows; under send_mutex_
+    // send_serialized's on_written callbacks waiting for the backlog to drain; under send_mutex_
+    std::vector<std::function<void(bool)>> written_callbacks_;
+
+    std::unordered_set<uint32_t> virtual_clients_;
+    mutable std::mutex virtual_clients_mutex_; // The receive thread checks sender ids against it
+    std::atomic<size_t> virtual_client_count_; // Lets plain connections skip that lock
 
-    std::vector<char> receive_buffer_;
-    std::mutex receive_buffer_mutex_; // Protects receive_buffer_
+    // Messages handed to executor_ that have not been handled yet.
+    // stop() waits for this to reach zero so no task outlives the handler.
+    size_t pending_dispatches_;
+    std::mutex dispatch_mutex_;
+    std::condition_variable dispatch_cv_;
 };
 
 } // namespace server
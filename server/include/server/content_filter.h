@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common/pattern_matcher.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace chat_app {
+namespace server {
+
+// TEXT_MESSAGE payloads are checked once, on arrival, before they are fanned
+// out: they must be valid UTF-8 and must not contain any blocklisted pattern.
+// The blocklist file has one pattern per line, matched anywhere in the text
+// and ASCII-case-insensitively; blank lines and lines starting with '#' are
+// skipped.
+struct ContentFilterConfig {
+    bool require_utf8 = true;
+    std::string blocklist_path; // Empty: nothing is blocked
+};
+
+enum class FilterVerdict { PASS, INVALID_UTF8, BLOCKED };
+
+// The blocklist is compiled into a common::PatternMatcher. reload() compiles
+// the file again and swaps the result in atomically; checks already running
+// finish on the matcher they started with. Thread-safe.
+class ContentFilter {
+public:
+    explicit ContentFilter(const ContentFilterConfig& config); // Loads the blocklist, if any
+
+    FilterVerdict check(const char* data, size_t size) const;
+    // Rereads the blocklist file. False, keeping the current blocklist, if it
+    // cannot be read.
+    bool reload();
+
+private:
+    ContentFilterConfig config_;
+    std::atomic<std::shared_ptr<const common::PatternMatcher>> matcher_; // Null without a blocklist
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,102 @@
+#pragma once
+
+// Multi-node federation: server processes peer with each other over a
+// dedicated TCP link per pair of nodes, so clients of one chat can sit on
+// different servers.
+//
+// Nodes form a full mesh. Each node tells its peers which rooms it has local
+// members in (MEMBERSHIP, sent in full when a link comes up and then only
+// when a room's local count flips between zero and non-zero). A locally
+// originated broadcast is relayed once to every peer with members in the
+// room, and the receiving node fans it out to its own clients without
+// relaying it further. Relays are batched per link for a couple of
+// milliseconds and compressed with common::lz_compress when that pays off.
+//
+// Link frame: [u32 length][u8 kind][u8 flags][u16 reserved] then `length`
+// payload bytes, all integers little-endian.
+//   HELLO        u32 node_id, u32 version
+//   MEMBERSHIP   u32 count, then count x (u32 room_id, u32 members)
+//   RELAY_BATCH  a run of (u32 room_id, serialized common::Message); with
+//                kFlagCompressed the payload is u32 original_size followed
+//                by an LZ block
+
+#include "common/isocket.h"
+#include "common/message.h"
+#include "common/wake_signal.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+class Server; // Forward declaration
+
+struct FederationConfig {
+    uint32_t node_id = 0;            // 0 disables federation; otherwise unique in the mesh, at most 255
+    int listen_port = 0;             // Port peers dial to reach this node; 0 accepts no links
+    std::vector<std::string> peers;  // "ipv4:port" of the nodes this one dials
+    int64_t batch_window_ms = 2;     // How long relays may wait for company on a link
+    size_t max_batch_bytes = 64 * 1024;
+    size_t compress_min_bytes = 256; // Smaller batches are sent as-is
+    int64_t redial_interval_ms = 2000;
+};
+
+class Federation {
+public:
+    Federation(const FederationConfig& config, Server& server);
+    ~Federation();
+
+    Federation(const Federation&) = delete;
+    Federation& operator=(const Federation&) = delete;
+
+    bool enabled() const { return config_.node_id != 0; }
+    bool start();
+    void stop(); // Drops every link; peers redial once we are back
+
+    // Queues a locally originated message for every peer with members in room_id.
+    void relay(const common::Message& msg, uint32_t room_id);
+    // Adds change (joins, or leaves if negative) to this node's member count
+    // for room_id and tells peers if the room became (or stopped being) of
+    // interest. Counted here, so callers need no lock of their own to keep
+    // concurrent changes in order.
+    void change_local_members(uint32_t room_id, int64_t change);
+
+private:
+    class PeerLink;
+
+    void accept_links();                    // Thread function
+    void dial_peer(std::string address);    // Thread function, one per configured peer
+    std::shared_ptr<PeerLink> adopt_link(std::unique_ptr<common::ISocket> socket, bool dialed);
+    // Called from a link's receive thread once the peer has introduced itself.
+    // Returns false if the link duplicates a better one and must close.
+    bool register_link(PeerLink& link);
+    bool has_live_link(uint32_t node_id);
+    void send_full_membership(PeerLink& link);
+    void prune_dead_links(); // Joins finished links; never call from a link thread
+
+    FederationConfig config_;
+    Server& server_;
+    std::atomic<bool> running_;
+    std::unique_ptr<common::ISocket> listen_socket_;
+    common::WakeSignal stop_signal_;
+    std::thread accept_thread_;
+    std::vector<std::thread> dial_threads_;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_; // Interrupts redial back-off
+
+    std::vector<std::shared_ptr<PeerLink>> links_;
+    std::mutex links_mutex_; // Protects links_
+
+    std::unordered_map<uint32_t, size_t> local_members_; // room_id -> members on this node
+    std::mutex members_mutex_; // Protects local_members_; taken before links_mutex_
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "server_config.h"
+#include "common/coarse_clock.h"
+#include "common/timing_wheel.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+class Server; // Forward declarations
+class ClientHandler;
+
+// Detects dead peers with one timing-wheel timer per connection.
+//
+// A new connection is sent a PING on the next tick and must show some activity
+// within handshake_timeout_ms. After that, a connection that has been quiet
+// for idle_interval_ms is sent a PING and must show activity within
+// pong_timeout_ms. Any inbound frame counts as activity. A connection that
+// misses either deadline is shut down, which sends it down the normal
+// disconnect path.
+//
+// Received messages only update the handler's last-activity timestamp. The
+// timer is not re-armed per message. When it fires it compares that timestamp
+// against its deadline, so each check is O(1) and no check scans every client.
+class HeartbeatMonitor {
+public:
+    HeartbeatMonitor(const HeartbeatConfig& config, const common::CoarseClock& clock, Server& server);
+    ~HeartbeatMonitor();
+
+    void start();
+    void stop();
+
+    void track(uint32_t client_id);   // Call once the client is reachable through the server
+    void untrack(uint32_t client_id);
+
+    size_t tracked_count();
+
+private:
+    struct PeerState {
+        common::TimingWheel::TimerId timer = common::TimingWheel::kInvalidTimer;
+        int64_t ping_sent_ms = 0;
+        bool ping_outstanding = false;
+        bool handshake_pending = true;
+    };
+
+    void run(); // Thread function
+    void on_timer(uint32_t client_id); // Runs inside timers_.advance(), mutex_ held; queues a check
+    // Takes mutex_ for the peer's state, then sends its PING or shuts it down
+    // without it. client is null if the connection is gone.
+    void check(uint32_t client_id, ClientHandler* client);
+    void arm(uint32_t client_id, PeerState& peer, int64_t delay_ms);
+
+    HeartbeatConfig config_;
+    const common::CoarseClock& clock_;
+    Server& server_;
+
+    common::TimingWheel timers_;
+    std::unordered_map<uint32_t, PeerState> peers_;
+    std::vector<uint32_t> due_; // Fired timers, for run() to check once mutex_ is released
+    std::mutex mutex_; // Protects timers_, peers_ and due_
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::condition_variable stop_cv_;
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,67 @@
+#pragma once
+
+// Zero-downtime upgrade: a running server hands its listening socket, its
+// client sockets and the little per-connection state that lives outside the
+// kernel to a freshly started server over a Unix socket (SCM_RIGHTS), then
+// exits. Clients see no disconnect.
+//
+// Both processes are started with the same --upgrade-socket=PATH. A new
+// process first tries to take over from whoever listens on PATH and, either
+// way, then listens on PATH itself for its own successor.
+//
+// POSIX only; on Windows every entry point reports failure.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common/wake_signal.h"
+
+namespace chat_app {
+namespace server {
+
+class Server; // Forward declaration
+
+struct ConnectionHandoff {
+    uint32_t client_id = 0;
+    int fd = -1;
+    uint32_t zerocopy_sends = 0; // MSG_ZEROCOPY calls made on it so far
+    std::vector<char> partial_frame; // Bytes received but not yet a complete message
+    std::vector<uint32_t> rooms;
+};
+
+struct HandoffState {
+    int listen_fd = -1;
+    uint32_t next_client_id = 1;
+    std::vector<ConnectionHandoff> connections;
+};
+
+// Predecessor side: waits on PATH for a successor and hands the server over.
+class UpgradeListener {
+public:
+    UpgradeListener(const std::string& path, Server& server);
+    ~UpgradeListener();
+
+    bool start(); // Replaces any stale socket file at PATH
+    void stop();
+
+private:
+    void run(); // Thread function
+    bool serve_successor(int channel_fd);
+
+    std::string path_;
+    Server& server_;
+    int listen_fd_;
+    std::thread thread_;
+    common::WakeSignal stop_signal_;
+};
+
+// Successor side. Returns false, leaving channel_fd at -1, if nobody is
+// listening on PATH. On success the caller owns every fd in `state` and must
+// answer through finish_takeover() once it has adopted them (or failed to).
+bool take_over_from_predecessor(const std::string& path, HandoffState& state, int& channel_fd);
+void finish_takeover(int channel_fd, bool adopted);
+
+} // namespace server
+} // namespace chat_app
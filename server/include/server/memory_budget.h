@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace chat_app {
+namespace server {
+
+// What the bytes are held for.
+enum class MemoryUse {
+    RECEIVE,    // Partial frames and received messages waiting for a handler
+    OUTBOUND,   // Broadcast frames in flight and retransmit windows
+    HISTORY,    // Room history and detached sessions kept for resumption
+    FILE_RELAY, // File chunks being relayed
+    COUNT       // Not a use
+};
+
+const char* memory_use_name(MemoryUse use);
+
+// Soft and hard watermarks on the bytes the server accounts for (see
+// MemoryBudget); 0 leaves that watermark off. Between them, connections
+// holding more than their share of received data stop being read. Above the
+// hard one nobody is read, new connections are turned away and the heaviest
+// connection is dropped every check_interval_ms until usage falls below it.
+struct MemoryConfig {
+    size_t soft_limit_bytes = 0;
+    size_t hard_limit_bytes = 0;
+    int64_t check_interval_ms = 100; // How often the cleanup thread sheds load
+    int64_t read_backoff_ms = 20;    // How long a paused reader waits before looking again
+};
+
+enum class MemoryPressure { NORMAL, SOFT, HARD };
+
+// Byte counts per MemoryUse, server-wide and per connection. Charging is two
+// relaxed atomic adds on counters of their own cache line, so it is cheap
+// enough for every message; readings are approximate while others charge.
+class MemoryBudget {
+public:
+    // One connection's share. Whatever it still holds is released with it.
+    class Account {
+    public:
+        explicit Account(MemoryBudget& budget);
+        ~Account();
+
+        Account(const Account&) = delete;
+        Account& operator=(const Account&) = delete;
+
+        // Negative bytes release.
+        void charge(MemoryUse use, int64_t bytes);
+        int64_t used(MemoryUse use) const { return used_[static_cast<size_t>(use)].load(std::memory_order_relaxed); }
+        int64_t total() const;
+
+    private:
+        MemoryBudget& budget_;
+        std::atomic<int64_t> used_[static_cast<size_t>(MemoryUse::COUNT)];
+    };
+
+    explicit MemoryBudget(const MemoryConfig& config);
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // Bytes held on behalf of no connection in particular.
+    void charge(MemoryUse use, int64_t bytes);
+
+    int64_t used(MemoryUse use) const { return used_[static_cast<size_t>(use)].bytes.load(std::memory_order_relaxed); }
+    int64_t total() const;
+    size_t accounts() const { return accounts_.load(std::memory_order_relaxed); }
+    MemoryPressure pressure() const;
+    const MemoryConfig& config() const { return config_; }
+
+    // Whether a connection's reader should wait before reading more: under
+    // soft pressure if it holds more received data than the average
+    // connection, under hard pressure always.
+    bool should_pause_reading(const Account& account) const;
+
+private:
+    struct alignas(64) Counter {
+        std::atomic<int64_t> bytes{0};
+    };
+
+    MemoryConfig config_;
+    Counter used_[static_cast<size_t>(MemoryUse::COUNT)];
+    std::atomic<size_t> accounts_;
+};
+
+} // namespace server
+} // namespace chat_app
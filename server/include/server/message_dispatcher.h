@@ -0,0 +1,51 @@
+#pragma once
+
+#include "imessage_handler.h"
+#include "common/message.h"
+#include <array>
+#include <utility> // For std::index_sequence
+
+namespace chat_app {
+namespace server {
+
+// Everything a pipeline stage sees for one inbound message.
+struct DispatchContext {
+    common::Message& msg;
+    ClientHandler& client_handler;
+    Server& server;
+};
+
+// Runs Stages::process(ctx) left to right until one returns false.
+// Stages are plain types with a static process() so the whole chain
+// inlines into the dispatch table entry, with no virtual calls.
+template <typename... Stages>
+struct Pipeline {
+    static void run(DispatchContext& ctx) {
+        (void)(Stages::process(ctx) && ...);
+    }
+};
+
+// Logs messages whose type has no route.
+struct ReportUnhandled {
+    static bool process(DispatchContext& ctx);
+};
+
+// Route for a message type. Specialize it (see message_routes.h) to handle a
+// new type; types without a specialization fall through to ReportUnhandled.
+template <common::MessageType Type>
+struct MessageRoute {
+    using pipeline = Pipeline<ReportUnhandled>;
+};
+
+// Dispatches on msg.header.type through a table built at compile time from
+// the MessageRoute specializations: one bounds check and one indirect call.
+class MessageDispatcher : public IMessageHandler {
+public:
+    void handle_message(common::Message& msg, ClientHandler& client_handler, Server& server) override;
+
+    using RouteFn = void (*)(DispatchContext&);
+    using RouteTable = std::array<RouteFn, common::kMessageTypeCount>;
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,232 @@
+#pragma once
+
+// Per-type routes for MessageDispatcher. Only message_dispatcher.cc should
+// include this: every specialization must be visible where the table is built.
+//
+// To handle a new message type, add it to common::MessageType and specialize
+// MessageRoute for it here with the stages it needs, e.g.
+//   template <> struct MessageRoute<common::MessageType::X> {
+//       using pipeline = Pipeline<RequireOpenConnection, HandleX>;
+//   };
+
+#include "message_dispatcher.h"
+#include "server.h"
+#include "client_handler.h"
+#include "common/message_serialization.h"
+#include <iostream>
+
+namespace chat_app {
+namespace server {
+
+// --- Stages ---
+
+// Drops messages whose connection was torn down before the executor got to
+// them; there is nobody left to answer and nothing to fan out on their behalf.
+struct RequireOpenConnection {
+    static bool process(DispatchContext& ctx) {
+        return ctx.client_handler.is_running();
+    }
+};
+
+// Fans the message out to every other client. The sender may be one of the
+// connection's virtual clients rather than the connection itself.
+struct BroadcastToOthers {
+    static bool process(DispatchContext& ctx) {
+        ctx.server.broadcast_message(ctx.msg, ctx.msg.header.sender_id);
+        return true;
+    }
+};
+
+// A message with a recipient goes to that client alone (see
+// Server::send_direct) and ends the pipeline; anything else continues.
+struct DeliverDirect {
+    static bool process(DispatchContext& ctx) {
+        if (ctx.msg.header.recipient_id == 0) return true;
+        ctx.server.send_direct(ctx.client_handler, ctx.msg);
+        return false;
+    }
+};
+
+// Text is checked once here, before fan-out, rather than once per recipient.
+// For EPHEMERAL (after RequireEphemeralKey) that is its key and its value; the
+// length byte between them is not text.
+struct FilterContent {
+    static FilterVerdict verdict(DispatchContext& ctx) {
+        const ContentFilter& filter = ctx.server.content_filter();
+        if (ctx.msg.header.type != common::MessageType::EPHEMERAL) {
+            return filter.check(ctx.msg.payload.data(), ctx.msg.payload.size());
+        }
+        std::string key;
+        std::string value;
+        common::parse_ephemeral(ctx.msg, key, value);
+        FilterVerdict result = filter.check(key.data(), key.size());
+        return result != FilterVerdict::PASS ? result : filter.check(value.data(), value.size());
+    }
+
+    static bool process(DispatchContext& ctx) {
+        const char* reason = nullptr;
+        switch (verdict(ctx)) {
+        case FilterVerdict::PASS:
+            return true;
+        case FilterVerdict::INVALID_UTF8:
+            reason = "Invalid UTF-8; message dropped.";
+            break;
+        case FilterVerdict::BLOCKED:
+            reason = "Blocked content; message dropped.";
+            break;
+        }
+        ctx.client_handler.send_message(
+            common::Message(common::MessageType::ERROR_MESSAGE, 0, ctx.client_handler.get_id(), reason));
+        return false;
+    }
+};
+
+// EPHEMERAL payloads must name their key, which decides what they supersede.
+struct RequireEphemeralKey {
+    static bool process(DispatchContext& ctx) {
+        std::string key;
+        std::string value;
+        if (common::parse_ephemeral(ctx.msg, key, value)) return true;
+        ctx.client_handler.send_message(common::Message(common::MessageType::ERROR_MESSAGE, 0,
+                                                        ctx.client_handler.get_id(), "Malformed ephemeral message."));
+        return false;
+    }
+};
+
+// Hands the message to the federation for peers with members in the room.
+struct RelayToPeers {
+    static bool process(DispatchContext& ctx) {
+        ctx.server.federation().relay(ctx.msg, kLobbyRoomId);
+        return true;
+    }
+};
+
+// Answers a client's liveness probe.
+struct ReplyPong {
+    static bool process(DispatchContext& ctx) {
+        ctx.client_handler.send_message(
+            common::Message(common::MessageType::PONG, 0, ctx.client_handler.get_id(), ""));
+        return true;
+    }
+};
+
+// Picks up a session the client had on an earlier connection.
+struct ResumeSession {
+    static bool process(DispatchContext& ctx) {
+        const auto& payload = ctx.msg.payload;
+        if (payload.size() < 12) {
+            ctx.client_handler.send_message(common::Message(common::MessageType::ERROR_MESSAGE, 0,
+                                                            ctx.client_handler.get_id(), "Malformed session resume."));
+            return false;
+        }
+        ctx.server.resume_session(ctx.client_handler, common::read_u64(payload.data()),
+                                  common::read_u32(payload.data() + 8));
+        return true;
+    }
+};
+
+// Releases acknowledged frames from the connection's retransmit window.
+struct ApplyAck {
+    static bool process(DispatchContext& ctx) {
+        ctx.client_handler.on_ack(ctx.msg);
+        return true;
+    }
+};
+
+// Answers with a roster delta or the cached snapshot, see roster.h.
+struct ServeRoster {
+    static bool process(DispatchContext& ctx) {
+        const auto& payload = ctx.msg.payload;
+        uint32_t epoch = payload.size() >= 8 ? common::read_u32(payload.data()) : 0;
+        uint32_t version = payload.size() >= 8 ? common::read_u32(payload.data() + 4) : 0;
+        auto frame = ctx.server.roster(kLobbyRoomId).reply(epoch, version);
+        ctx.client_handler.send_serialized(frame);
+        return true;
+    }
+};
+
+// Answers from the room's search index, see search_index.h.
+struct ServeSearch {
+    static bool process(DispatchContext& ctx) {
+        ctx.client_handler.send_message(ctx.server.search().reply(kLobbyRoomId, ctx.client_handler.get_id(), ctx.msg));
+        return true;
+    }
+};
+
+// Adds a virtual client to a multiplexed connection, see Server::attach_virtual_client.
+struct AttachVirtualClient {
+    static bool process(DispatchContext& ctx) {
+        if (ctx.msg.payload.size() < 4) {
+            ctx.client_handler.send_message(common::Message(common::MessageType::ERROR_MESSAGE, 0,
+                                                            ctx.client_handler.get_id(), "Malformed attach."));
+            return false;
+        }
+        ctx.server.attach_virtual_client(ctx.client_handler, common::read_u32(ctx.msg.payload.data()));
+        return true;
+    }
+};
+
+// The receive thread only keeps sender ids the connection owns, so this is
+// either one of its virtual clients or the connection itself (ignored).
+struct DetachVirtualClient {
+    static bool process(DispatchContext& ctx) {
+        ctx.server.detach_virtual_client(ctx.client_handler, ctx.msg.header.sender_id);
+        return true;
+    }
+};
+
+// --- Routes ---
+
+template <>
+struct MessageRoute<common::MessageType::TEXT_MESSAGE> {
+    using pipeline = Pipeline<RequireOpenConnection, FilterContent, DeliverDirect, BroadcastToOthers, RelayToPeers>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::EPHEMERAL> {
+    using pipeline = Pipeline<RequireOpenConnection, RequireEphemeralKey, FilterContent, BroadcastToOthers, RelayToPeers>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::PING> {
+    using pipeline = Pipeline<RequireOpenConnection, ReplyPong>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::SESSION_RESUME> {
+    using pipeline = Pipeline<RequireOpenConnection, ResumeSession>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::ACK> {
+    using pipeline = Pipeline<ApplyAck>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::ROSTER_REQUEST> {
+    using pipeline = Pipeline<RequireOpenConnection, ServeRoster>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::SEARCH_REQUEST> {
+    using pipeline = Pipeline<RequireOpenConnection, ServeSearch>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::MUX_ATTACH> {
+    using pipeline = Pipeline<RequireOpenConnection, AttachVirtualClient>;
+};
+
+template <>
+struct MessageRoute<common::MessageType::MUX_DETACH> {
+    using pipeline = Pipeline<RequireOpenConnection, DetachVirtualClient>;
+};
+
+// Receiving it already refreshed the connection's activity timestamp
+template <>
+struct MessageRoute<common::MessageType::PONG> {
+    using pipeline = Pipeline<>;
+};
+
+} // namespace server
+} // namespace chat_app
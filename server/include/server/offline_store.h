@@ -0,0 +1,117 @@
+#pragma once
+
+#include "common/message.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+// Direct messages to disconnected recipients are kept in files under
+// `directory` until their session resumes. Off when it is empty.
+struct OfflineConfig {
+    std::string directory;
+    size_t max_bytes_per_recipient = 1024 * 1024; // Further messages are refused
+    uint64_t max_total_bytes = 1ull << 30;        // Across all recipients
+    int64_t max_age_ms = 24LL * 60 * 60 * 1000;   // Older messages are dropped undelivered
+};
+
+// Per-session mailboxes of direct messages.
+//
+// A mailbox is named after the client id its session was opened with, which
+// stays the same however often the session resumes on a new connection, and
+// is an append-only file of records: u64 time stored (ms since the epoch),
+// u32 sender id, u32 size, payload. Each store() appends one record with a
+// single write, and read() turns the whole file into one buffer of frames
+// for a single write to the recipient's connection. Nothing is deleted until
+// consume() is told the frames went out, so a connection that drops first
+// finds them again on the next resume. All that stays in memory is a
+// mailbox's size and the time of its newest record; on start() that is
+// rebuilt from the files' sizes and modification times.
+//
+// The disk I/O is not meant to happen under the caller's own lock. Instead
+// the caller takes a Ticket under that lock, which fixes the order of the
+// mailbox's stores and reads without touching the disk, and redeems it
+// after releasing the lock: a read then sees every store ticketed before it.
+//
+// Client ids start over in every process that does not take over from a
+// predecessor, so mailboxes survive a hot restart but not a cold one.
+//
+// Mailboxes whose newest record is past max_age_ms are deleted by a sweep
+// that store() runs at most once a minute; older records in a mailbox that is
+// still in use are skipped by read().
+class OfflineStore {
+    struct Mailbox;
+
+public:
+    // A mailbox's place in line; every one reserve() hands out must be
+    // redeemed by store() or read(), or those behind it wait forever.
+    struct Ticket {
+        uint32_t mailbox_id = 0;
+        std::shared_ptr<Mailbox> mailbox; // Null if the store is off
+        uint64_t number = 0;
+    };
+
+    explicit OfflineStore(const OfflineConfig& config);
+
+    OfflineStore(const OfflineStore&) = delete;
+    OfflineStore& operator=(const OfflineStore&) = delete;
+
+    bool enabled() const { return !config_.directory.empty(); }
+    // Picks up the mailboxes in the directory, deleting those past
+    // max_age_ms. Without keep_existing (a cold start) all of them are deleted.
+    void start(bool keep_existing);
+
+    // Memory only; cheap enough to call under the lock that orders deliveries.
+    Ticket reserve(uint32_t mailbox_id);
+
+    // Waits for the ticket's turn and appends msg (a direct message to the
+    // ticket's mailbox). False if the store is off, a cap was reached or the
+    // disk refused it.
+    bool store(const Ticket& ticket, const common::Message& msg);
+    // Waits for the ticket's turn and returns the mailbox's messages as
+    // serialized frames, oldest first, marked kFlagStored; null if there are
+    // none. count is set to how many there are, and end to where they end,
+    // for consume().
+    std::shared_ptr<const std::vector<char>> read(const Ticket& ticket, size_t& count, uint64_t& end);
+    // Deletes what read(ticket) returned up to `end`, once it has been sent;
+    // anything stored since stays. Needs no turn of its own; repeating it, or
+    // a stale end, is harmless.
+    void consume(const Ticket& ticket, uint64_t end);
+
+private:
+    struct Mailbox {
+        std::mutex mutex;
+        std::condition_variable turn_cv;
+        uint64_t issued = 0;    // Tickets handed out; under OfflineStore::mutex_
+        uint64_t served = 0;    // Tickets redeemed; under mutex
+        uint64_t bytes = 0;     // File size; under mutex
+        uint64_t consumed = 0;  // Bytes ever deleted from the front, so ends stay comparable; under mutex
+        int64_t newest_ms = 0;  // Wall-clock time of the last store; under mutex
+    };
+
+    std::string path_for(uint32_t mailbox_id) const;
+    // Blocks until ticket is next in line for its mailbox; returns its lock
+    std::unique_lock<std::mutex> wait_turn(const Ticket& ticket);
+    void finish_turn(Mailbox& mailbox, std::unique_lock<std::mutex>& lock);
+    void sweep(int64_t now_ms);
+    // Drops a mailbox nobody holds a ticket for from mailboxes_ once it is
+    // empty. Requires mutex_.
+    void forget_if_idle_locked(uint32_t mailbox_id);
+
+    OfflineConfig config_;
+    std::mutex mutex_; // Protects mailboxes_ and last_sweep_ms_; taken before a Mailbox's
+    std::unordered_map<uint32_t, std::shared_ptr<Mailbox>> mailboxes_;
+    std::atomic<uint64_t> total_bytes_;
+    int64_t last_sweep_ms_;
+};
+
+} // namespace server
+} // namespace chat_app
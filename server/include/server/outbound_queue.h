@@ -0,0 +1,78 @@
+#pragma once
+
+#include "common/isocket.h"
+#include "common/spool_file.h"
+#include "memory_budget.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+// With a spool directory, sending to a connection never waits for it. What
+// its socket will not take is queued in memory up to memory_bytes, then
+// appended to a spool file in spool_directory (see common/spool_file.h), and
+// the server's outbound thread writes the backlog out in order as the peer
+// catches up. A connection whose spool passes max_spool_bytes is dropped.
+// Without one, a send blocks until the socket has taken the frame.
+struct OutboundConfig {
+    std::string spool_directory;
+    size_t memory_bytes = 256 * 1024;           // Queued per connection before spilling
+    size_t max_spool_bytes = 256 * 1024 * 1024; // On disk per connection
+    int64_t rescan_interval_ms = 100;           // Longest the outbound thread waits on sockets
+};
+
+// One connection's outbound backlog: frames in memory, then spooled bytes,
+// then the latest frame of each latest-wins slot (EPHEMERAL messages). A slot
+// holds one frame however many are written to it while the backlog lasts, so
+// superseded ones never reach the socket; the survivors go out once
+// everything else queued has. Frames held in memory are charged to the
+// connection as MemoryUse::OUTBOUND, a shared frame once per queue holding
+// it. Not thread-safe; ClientHandler guards it with its send mutex.
+class OutboundQueue {
+public:
+    OutboundQueue(const OutboundConfig& config, MemoryBudget::Account& memory);
+    ~OutboundQueue();
+
+    OutboundQueue(const OutboundQueue&) = delete;
+    OutboundQueue& operator=(const OutboundQueue&) = delete;
+
+    // Writes what the socket takes of frame now and queues the rest behind
+    // the backlog. False if the socket failed or the spool is full or cannot
+    // be written; the connection is then unusable.
+    bool write(common::ISocket& socket, const std::shared_ptr<const std::vector<char>>& frame);
+    // As write, except that while queued the frame replaces whatever was
+    // queued for the same slot.
+    bool write_latest(common::ISocket& socket, const std::shared_ptr<const std::vector<char>>& frame,
+                      const std::string& slot);
+    // Writes what the socket takes of the backlog without blocking. False as for write.
+    bool drain(common::ISocket& socket);
+    // Writes out the whole backlog, blocking until the socket has taken it.
+    bool flush(common::ISocket& socket);
+
+    bool empty() const { return frames_.empty() && spooled_bytes() == 0 && latest_order_.empty(); }
+    size_t memory_bytes() const { return memory_bytes_; }
+    size_t spooled_bytes() const { return spool_ ? spool_->pending() : 0; }
+
+private:
+    bool spool(const char* data, size_t size);
+    void pop_front();
+    void charge(int64_t bytes);
+
+    const OutboundConfig& config_;
+    MemoryBudget::Account& memory_;
+    std::deque<std::shared_ptr<const std::vector<char>>> frames_; // Always older than the spool's bytes
+    size_t front_offset_; // Bytes of frames_.front() already written
+    size_t memory_bytes_; // Of frames_ and latest_, as charged
+    std::unique_ptr<common::SpoolFile> spool_; // Created on first overflow
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<char>>> latest_; // By slot
+    std::deque<std::string> latest_order_; // Slots in latest_, in the order they were first queued
+};
+
+} // namespace server
+} // namespace chat_app
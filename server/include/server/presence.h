@@ -0,0 +1,59 @@
+#pragma once
+
+#include "server_config.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace chat_app {
+namespace server {
+
+class Server; // Forward declaration
+
+// Coalesces joins and leaves into PRESENCE_DIGEST broadcasts.
+//
+// The first change after a quiet period opens a window of window_ms. When
+// the window closes, everything that changed in it goes out as one digest.
+// A client that joined and left within one window does not appear at all.
+// If a burst changes more than max_ids_per_digest clients, only counts are
+// sent and clients re-fetch the roster. That way a reconnect storm costs one
+// bounded frame per client per window rather than one frame per client per
+// event. Rooms above suppress_above_members get no digests.
+//
+// Digest payload: u8 flags (kPresenceTruncated), u32 members now on the
+// originating server,
+// u32 joined count, joined ids, u32 left count, left ids. When truncated the
+// counts are kept but the id lists are empty. Digests are relayed to
+// federation peers like any other broadcast.
+class PresenceAggregator {
+public:
+    PresenceAggregator(const PresenceConfig& config, Server& server);
+    ~PresenceAggregator();
+
+    void start();
+    void stop(); // Flushes what is pending
+
+    void joined(uint32_t client_id);
+    void left(uint32_t client_id);
+
+private:
+    void run(); // Thread function
+    void flush(std::unordered_set<uint32_t> joined, std::unordered_set<uint32_t> left);
+
+    PresenceConfig config_;
+    Server& server_;
+
+    std::unordered_set<uint32_t> joined_;
+    std::unordered_set<uint32_t> left_;
+    std::mutex mutex_; // Protects joined_ and left_
+    std::condition_variable cv_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "common/coarse_clock.h"
+#include <cstddef> // For size_t
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+// What happens to a message that exceeds its budget.
+enum class ThrottleAction {
+    DELAY,     // Stall the sender's receive loop until tokens refill (TCP backpressure)
+    DROP,      // Discard the message and tell the sender with an ERROR_MESSAGE
+    DISCONNECT // Close the sender's connection
+};
+
+bool parse_throttle_action(const std::string& name, ThrottleAction& action);
+const char* throttle_action_name(ThrottleAction action);
+
+struct RateLimitConfig {
+    // Per connection
+    double messages_per_sec = 50;
+    double message_burst = 100;
+    double bytes_per_sec = 256 * 1024;
+    double byte_burst = 1024 * 1024;
+
+    // Per room, shared by every sender in it. Fanned-out messages cost
+    // recipients times their size, so these are the amplification cap.
+    double room_messages_per_sec = 500;
+    double room_message_burst = 1000;
+    double room_bytes_per_sec = 4 * 1024 * 1024;
+    double room_byte_burst = 8 * 1024 * 1024;
+
+    ThrottleAction action = ThrottleAction::DROP;
+    int64_t max_delay_ms = 2000; // DELAY falls back to DROP past this
+};
+
+// Classic token bucket. Refills lazily from the coarse clock on each call.
+class TokenBucket {
+public:
+    TokenBucket() : rate_(0), burst_(0), tokens_(0), last_ms_(0) {}
+    TokenBucket(double rate_per_sec, double burst, int64_t now_ms)
+        : rate_(rate_per_sec), burst_(burst), tokens_(burst), last_ms_(now_ms) {}
+
+    // Takes `cost` tokens if available.
+    bool try_consume(double cost, int64_t now_ms);
+    // Takes `cost` tokens, going into debt if needed.
+    // Returns how long to wait (ms) until the debt is repaid.
+    int64_t consume_with_debt(double cost, int64_t now_ms);
+    // Puts back tokens taken by a consume that was later rejected elsewhere.
+    void refund(double cost) { tokens_ += cost; }
+
+private:
+    void refill(int64_t now_ms);
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    int64_t last_ms_;
+};
+
+enum class RateDecision {
+    ALLOW,
+    DELAY,
+    DROP,
+    DISCONNECT
+};
+
+// Cumulative throttle counts for one client.
+struct ThrottleCounters {
+    uint32_t client_id = 0;
+    uint64_t delayed = 0;
+    uint64_t dropped = 0;
+    uint64_t disconnected = 0;
+    uint64_t room_limited = 0; // Subset of the above caused by the room budget
+};
+
+class RateLimiter {
+public:
+    // Budget of one connection. Only that connection's receive thread touches it.
+    struct ConnectionState {
+        TokenBucket messages;
+        TokenBucket bytes;
+        int64_t last_error_reply_ms = 0; // Bounds ERROR_MESSAGE replies to one per second
+    };
+
+    RateLimiter(const RateLimitConfig& config, const common::CoarseClock& clock);
+
+    ConnectionState make_connection_state() const;
+
+    // Charges one message of `bytes` to the connection and, for fanned-out
+    // messages, to `room_id`. On DELAY, delay_ms is how long to wait.
+    RateDecision admit(uint32_t client_id, ConnectionState& state, bool fanned_out, uint32_t room_id,
+                       size_t bytes, int64_t& delay_ms);
+
+    // True at most once per second per connection.
+    bool should_reply_with_error(ConnectionState& state);
+
+    std::vector<ThrottleCounters> snapshot() const;
+    // Logs clients throttled since the previous call. Cheap when nobody was.
+    void log_throttled_clients();
+    void forget_client(uint32_t client_id);
+
+    const RateLimitConfig& config() const { return config_; }
+
+private:
+    struct RoomBudget {
+        TokenBucket messages;
+        TokenBucket bytes;
+    };
+
+    RoomBudget& room_budget(uint32_t room_id, int64_t now_ms); // Requires rooms_mutex_
+    RateDecision throttle(uint32_t client_id, bool room_limited);
+    void count(uint32_t client_id, RateDecision decision, bool room_limited);
+
+    RateLimitConfig config_;
+    const common::CoarseClock& clock_;
+
+    std::unordered_map<uint32_t, RoomBudget> rooms_;
+    std::mutex rooms_mutex_;
+
+    // Only touched when a message is throttled, never on the allow path.
+    std::unordered_map<uint32_t, ThrottleCounters> counters_;
+    std::unordered_set<uint32_t> recently_throttled_;
+    mutable std::mutex counters_mutex_;
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+// Versioned member list of a room, answering ROSTER_REQUEST.
+//
+// Every join or leave bumps the version and is kept in a bounded change log.
+// A client that knows an older version gets a ROSTER_DELTA listing only what
+// changed since then. A client that knows nothing, or whose version has left
+// the log, gets the full ROSTER_SNAPSHOT. The snapshot frame is serialized at
+// most once per version, lazily on the first request that needs it, and
+// shared by every request until the next change.
+//
+// Versions are only meaningful within one epoch, which is chosen at random
+// per process. A request from another epoch gets a snapshot.
+//
+// Payloads (little-endian):
+//   ROSTER_REQUEST   u32 epoch, u32 version (0: send a snapshot)
+//   ROSTER_SNAPSHOT  u32 epoch, u32 version, u32 count, ids (ascending)
+//   ROSTER_DELTA     u32 epoch, u32 from_version, u32 to_version,
+//                    u32 added count, ids, u32 removed count, ids
+class Roster {
+public:
+    explicit Roster(size_t max_log_entries = 4096);
+
+    void add(uint32_t client_id);
+    void remove(uint32_t client_id);
+
+    // Serialized frame answering a client that holds `version` of `epoch`.
+    std::shared_ptr<const std::vector<char>> reply(uint32_t epoch, uint32_t version);
+
+    size_t size();
+
+private:
+    struct Change {
+        uint32_t version;
+        uint32_t client_id;
+        bool added;
+    };
+
+    void record(uint32_t client_id, bool added); // Requires mutex_
+    std::shared_ptr<const std::vector<char>> snapshot(); // Requires mutex_
+
+    size_t max_log_entries_;
+    std::mutex mutex_;
+    uint32_t epoch_;
+    uint32_t version_;
+    std::set<uint32_t> members_;
+    std::deque<Change> log_; // Oldest first
+    std::shared_ptr<const std::vector<char>> snapshot_;
+    uint32_t snapshot_version_;
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common/message.h"
+#include "memory_budget.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+// Full-text search over a room's chat history, kept in segment files under
+// `directory`. Off when it is empty.
+struct SearchConfig {
+    std::string directory;
+    size_t segment_messages = 16384;         // The live segment is written out at either limit
+    size_t segment_bytes = 8 * 1024 * 1024;  // Of text
+    size_t max_results = 100;                // Most hits one SEARCH_RESULTS carries
+};
+
+// Inverted index of TEXT_MESSAGE broadcasts, answering SEARCH_REQUEST.
+//
+// Text is split into terms at ASCII punctuation and white space; ASCII letters
+// are lowercased and other bytes (UTF-8 letters) kept as they are. Each
+// message gets the next id, ascending in time, and for every (room, term) a
+// posting list records the messages holding the term and where: message ids
+// and term positions delta-encoded as varints, so a term's list only grows at
+// its end.
+//
+// New messages go into a live segment in memory. Once it is full it is sealed,
+// and a writer thread writes it out as an immutable segment file (terms sorted
+// for binary search, then posting lists, then the messages' text) and
+// replaces it with a read-only mapping of that file. Segments in the
+// directory are opened on start, so the history survives restarts; stop()
+// writes out the live segment. A query visits segments newest first and stops
+// once a page is full, so recent hits cost only the newest segments.
+//
+// A query is words that must all occur (AND) and "quoted phrases" whose words
+// must occur in order, next to each other. Hits come newest first.
+//
+// Payloads (little-endian):
+//   SEARCH_REQUEST  u32 tag, u32 page size, u64 cursor (0: start at the newest), query
+//   SEARCH_RESULTS  u32 tag, u64 next cursor (0: no more hits), u32 hit count, then
+//                   per hit: u32 sequence, u32 sender id, u32 text size, text
+class SearchIndex {
+public:
+    // The live segment is charged to memory as MemoryUse::HISTORY, if given.
+    explicit SearchIndex(const SearchConfig& config, MemoryBudget* memory = nullptr);
+    ~SearchIndex();
+
+    SearchIndex(const SearchIndex&) = delete;
+    SearchIndex& operator=(const SearchIndex&) = delete;
+
+    bool enabled() const { return !config_.directory.empty(); }
+    // Opens the segments in the directory and starts the writer thread.
+    void start();
+    // Writes out everything indexed so far and stops the writer thread.
+    // Messages added until the next start() are not indexed.
+    void stop();
+
+    // Indexes a stamped TEXT_MESSAGE broadcast in room_id.
+    void add(uint32_t room_id, const common::Message& msg);
+
+    struct Hit {
+        uint64_t id; // Continue below this to page on
+        uint32_t sequence;
+        uint32_t sender_id;
+        std::string text;
+    };
+    // Up to limit hits for query in room_id with ids below `before` (0: no
+    // bound), newest first. next_cursor is set to where the next page starts,
+    // or 0 if there are no more hits.
+    std::vector<Hit> search(uint32_t room_id, const std::string& query, size_t limit, uint64_t before,
+                            uint64_t& next_cursor);
+    // SEARCH_RESULTS for recipient_id answering `request`, or an ERROR_MESSAGE
+    // if it is malformed.
+    common::Message reply(uint32_t room_id, uint32_t recipient_id, const common::Message& request);
+
+    class Segment; // Defined in search_index.cc
+
+private:
+    class LiveSegment;
+
+    void seal_locked(); // Requires mutex_
+    void write_segments(); // Writer thread
+    void load_segments();  // Requires mutex_
+
+    SearchConfig config_;
+    MemoryBudget* memory_;
+    std::mutex mutex_;
+    std::condition_variable sealed_cv_;
+    bool running_;
+    uint64_t next_id_; // Message ids start at 1
+    std::shared_ptr<LiveSegment> live_;
+    std::vector<std::shared_ptr<const Segment>> segments_; // Sealed or written, oldest first
+    std::deque<std::shared_ptr<LiveSegment>> unwritten_;   // Sealed, for the writer thread
+    std::thread writer_;
+};
+
+} // namespace server
+} // namespace chat_app
@@ -1,9 +1,25 @@
 #pragma once
 
 #include "common/isocket.h"
+#include "common/work_stealing_executor.h"
+#include "common/coarse_clock.h"
+#include "common/buffer_pool.h"
+#include "common/event_loop.h"
 #include "client_handler.h" // For ClientHandler
 #include "imessage_handler.h" // For IMessageHandler
-#include "broadcast_message_handler.h" // Default handler
+#include "message_dispatcher.h" // Default handler
+#include "rate_limiter.h"
+#include "server_config.h"
+#include "heartbeat_monitor.h"
+#include "hot_restart.h"
+#include "federation.h"
+#include "session_store.h"
+#include "presence.h"
+#include "roster.h"
+#include "shard.h"
+#include "common/wake_signal.h"
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <thread>
 #include <mutex>
@@ -15,39 +31,226 @@
 namespace chat_app {
 namespace server {
 
+// Every client currently shares one broadcast domain.
+constexpr uint32_t kLobbyRoomId = 0;
+
 class Server {
 public:
-    Server(int port);
+    explicit Server(int port, const ServerConfig& config = ServerConfig());
     ~Server();
 
     void start();
     void stop();
     bool is_running_properly() const;
 
+    // Hot restart (see hot_restart.h).
+    // Starts with sockets and state inherited from a predecessor instead of binding.
+    bool start_from_handoff(HandoffState& state);
+    // Stops reading from every socket, without closing any, and describes them in
+    // `state`. Must be followed by complete_handoff() or abort_handoff().
+    bool export_for_handoff(HandoffState& state);
+    // The successor owns the sockets now: drop our descriptors and stop.
+    void complete_handoff();
+    // The successor failed: resume serving where export_for_handoff() left off.
+    void abort_handoff();
+    bool is_quiescing() const { return quiescing_; }
+    int quiesce_fd() const { return quiesce_signal_.fd(); }
+
+    // An EPHEMERAL message is neither sequenced nor kept for resumption, and
+    // goes out latest-wins (see ClientHandler::send_latest).
     void broadcast_message(const common::Message& msg, uint32_t sender_id_to_exclude = 0);
+    // Fans out a message relayed by another node. Never relayed any further.
+    void deliver_from_peer(const common::Message& msg, uint32_t room_id);
+    // Handles SESSION_RESUME: replays what the session missed, then
+    // SESSION_RESUMED, then the direct messages kept for it.
+    void resume_session(ClientHandler& client_handler, uint64_t token, uint32_t last_seen);
+    // A TEXT_MESSAGE for msg.header.recipient_id alone. If that client is not
+    // connected but its session can still be resumed, it is kept for it in
+    // the offline store; otherwise the sender gets an ERROR_MESSAGE.
+    void send_direct(ClientHandler& sender, const common::Message& msg);
     void signal_client_finished(uint32_t client_id);
 
+    // Connection multiplexing: a gateway or bot fleet attaches virtual clients
+    // to its connection, each a member with an id of its own, and sends with
+    // sender_id set to one of them. A broadcast reaches the connection once;
+    // the gateway hands it to every logical client there but the sender.
+    void attach_virtual_client(ClientHandler& client_handler, uint32_t tag);
+    void detach_virtual_client(ClientHandler& client_handler, uint32_t virtual_id);
+
+    RateLimiter& rate_limiter() { return rate_limiter_; }
+    const common::CoarseClock& clock() const { return clock_; }
+    common::BufferPool& receive_pool() { return receive_pool_; }
+    size_t max_frame_bytes() const { return config_.receive_buffers.max_frame_bytes; }
+    MemoryBudget& memory() { return memory_; }
+    const common::ReliableConfig& reliable_config() const { return config_.reliable; }
+    size_t zerocopy_min_bytes() const { return config_.zerocopy_min_bytes; }
+    const OutboundConfig& outbound_config() const { return config_.outbound; }
+    // From a ClientHandler, under its send mutex: its outbound queue has a
+    // backlog for the outbound thread to write out, or has none left.
+    void outbound_backlogged(uint32_t client_id);
+    void outbound_drained(uint32_t client_id);
+    Federation& federation() { return federation_; }
+    ContentFilter& content_filter() { return content_filter_; }
+    SearchIndex& search() { return search_; }
+    size_t member_count(uint32_t room_id);
+    Roster& roster(uint32_t room_id) { (void)room_id; return lobby_roster_; }
+    void log_throttled_clients();
+
+    // Runs fn(client_id, ClientHandler*) for each of client_ids, the handler
+    // null if there is no such client, holding only the removal lock: the
+    // handlers cannot be deleted meanwhile, yet fn may block on them without
+    // stalling everything that needs their group's lock.
+    template <typename Fn>
+    void with_clients_held(const std::vector<uint32_t>& client_ids, Fn&& fn) {
+        std::lock_guard<std::mutex> removal_lock(removal_mutex_);
+        std::vector<ClientHandler*> handlers;
+        handlers.reserve(client_ids.size());
+        for (uint32_t client_id : client_ids) {
+            with_connection(client_id, [&handlers](ClientHandler* handler) { handlers.push_back(handler); });
+        }
+        for (size_t i = 0; i < client_ids.size(); ++i) {
+            fn(client_ids[i], handlers[i]);
+        }
+    }
+    int64_t send_timeout_ms() const { return config_.heartbeat.send_timeout_ms; }
+
 private:
-    void accept_connections(); // Thread function for accepting new clients
+    // Connections and the lock that protects them: every connection when
+    // unsharded, or one shard's (group i is shard i's), so sharded
+    // connections are added, removed and looked up without a lock they all
+    // share. Taken after order_mutex_.
+    struct ClientGroup {
+        std::mutex mutex;
+        std::unordered_map<uint32_t, std::unique_ptr<ClientHandler>> clients; // Keyed by client id
+    };
+    // Where to look a client up by id, e.g. for a direct message.
+    struct Route {
+        uint32_t connection_id; // Its own, or that of the connection it is a virtual client on
+        size_t group;
+    };
+
+    // Thread function for accepting new clients. With shards, connections from a
+    // shard's own listener stay in that shard; null spreads them round-robin.
+    void accept_connections(common::ISocket& listener, Shard* shard);
     void cleanup_clients();    // Thread function for cleaning up disconnected clients
     void remove_client(uint32_t client_id);
+    // handed_off: continuing a predecessor's client ids, so state kept under
+    // them (the offline store's queues) still belongs to the same clients.
+    void start_threads(bool handed_off);
+    // Resolves config_.placement into CPUs for the executors, shards and
+    // event loops; before any of them start.
+    void plan_placement();
+    void log_placement() const;
+    bool open_local_listeners(); // Binds the paths in config_.local
+    bool open_shard_listeners(); // One more SO_REUSEPORT socket on port_ for each shard after the first
+    void start_accept_threads();
+    void join_accept_threads();
+    void start_event_loops();
+    void stop_event_loops();
+    Shard* shard_for(Shard* accepted_by, const common::ISocket* socket = nullptr); // Null when unsharded
+    common::EventLoop* event_loop_for(const common::ISocket& socket, Shard* shard); // Null: use a thread
+    // The shard or event loop (by index) to take socket under
+    // config_.placement.steer_incoming_cpu, rotating among equally good
+    // ones; -1 leaves the choice to the caller.
+    int steered_slot(const common::ISocket& socket, std::atomic<size_t>& rotation) const;
+    // Starts a new handler and registers it in the shard's group, or the only one.
+    void add_client(std::unique_ptr<ClientHandler> client_handler, Shard* shard);
+    // Waits until every shard has handled all queued before. Requires order_mutex_.
+    void flush_shards_locked();
+    void welcome_locked(ClientHandler& client_handler); // Requires order_mutex_
+    // Sends msg to every recipient, in parallel partitions for large sets, and
+    // returns once all have it. Requires order_mutex_, which keeps successive
+    // broadcasts in order for each recipient, and the recipients' group lock,
+    // which keeps them alive. A non-empty slot sends it latest-wins.
+    void fan_out_locked(const std::vector<ClientHandler*>& recipients, const common::Message& msg,
+                        const std::string& slot);
+    // msg serialized once for many recipients, charged to memory_ while alive.
+    std::shared_ptr<const std::vector<char>> make_shared_frame(const common::Message& msg);
+    // Cleanup thread, every config_.memory.check_interval_ms: reports changes
+    // of memory pressure and drops the heaviest connection under hard pressure.
+    void shed_load();
+    // Outbound thread (with a spool directory): waits for backlogged
+    // connections' sockets to take more and has them write it.
+    void drain_outbound();
+    // The group of the connection client_id is, or that has it as a virtual
+    // client, whose id is set in connection_id; null if there is none.
+    ClientGroup* group_of(uint32_t client_id, uint32_t& connection_id);
+    // Calls fn with that connection, or null, holding its group's lock.
+    template <typename Fn>
+    void with_connection(uint32_t client_id, Fn&& fn) {
+        uint32_t connection_id = 0;
+        ClientGroup* group = group_of(client_id, connection_id);
+        if (!group) {
+            fn(nullptr);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(group->mutex);
+        auto it = group->clients.find(connection_id);
+        fn(it == group->clients.end() ? nullptr : it->second.get());
+    }
 
     int port_;
+    ServerConfig config_;
+    common::CoarseClock clock_; // Must precede rate_limiter_ and heartbeats_
+    common::BufferPool receive_pool_; // Outlives every handler's reads
+    MemoryBudget memory_; // Must precede sessions_ and outlive every handler
+    MemoryPressure memory_pressure_; // As last reported; cleanup thread only
+    RateLimiter rate_limiter_;
+    HeartbeatMonitor heartbeats_;
+    Federation federation_;
+    SessionStore sessions_;
+    ContentFilter content_filter_;
+    SearchIndex search_; // Written to under order_mutex_, by broadcast_message
+    OfflineStore offline_; // Ticketed under order_mutex_, so a resume sees every message; its I/O is not
+    PresenceAggregator presence_;
+    Roster lobby_roster_; // Updated under the group lock of the connections it lists
     std::unique_ptr<common::ISocket> listen_socket_;
     std::atomic<bool> running_;
     std::atomic<uint32_t> next_client_id_;
 
-    std::thread accept_thread_;
+    std::vector<std::unique_ptr<common::ISocket>> local_listeners_; // Unix and shared memory
+    std::vector<std::unique_ptr<Shard>> shards_; // Empty when unsharded
+    std::vector<std::unique_ptr<common::ISocket>> shard_listeners_; // Shard i + 1's; shard 0 uses listen_socket_
+    std::atomic<size_t> next_shard_;
+    std::vector<std::thread> accept_threads_; // One per listening socket
     std::thread cleanup_thread_;
+    std::thread outbound_thread_;
+    std::vector<std::unique_ptr<common::EventLoop>> event_loops_; // Outlive every handler reading on them
+    std::atomic<size_t> next_event_loop_;
+    std::vector<int> placement_cpus_; // Dealt to pinned threads; empty when they are not
+    std::vector<int> loop_cpus_;      // CPU of each shard, or else each event loop
+    std::vector<int> loop_nodes_;     // And its NUMA node (-1 if unknown)
 
-    std::vector<std::unique_ptr<ClientHandler>> clients_;
-    std::mutex clients_mutex_; // Protects clients_ vector
+    // Orders broadcasts against each other and against what must not
+    // interleave with them: a new connection's welcome and a resume's replay.
+    // Unsharded it is held through the fan-out, sharded only while a
+    // broadcast is stamped and queued to the shards. Taken before any group's.
+    std::mutex order_mutex_;
+    std::vector<std::unique_ptr<ClientGroup>> client_groups_;
+    std::unordered_map<uint32_t, Route> routes_; // Connections and virtual clients by id
+    std::mutex routes_mutex_; // Protects routes_; may be taken under a group's lock, never the other way round
+    std::atomic<size_t> local_members_; // Connections and virtual clients
+
+    // Held across a handoff so cleanup cannot free a handler being exported,
+    // and by with_clients_held. Taken before order_mutex_.
+    std::mutex removal_mutex_;
+    std::unique_lock<std::mutex> handoff_lock_;
+    std::atomic<bool> quiescing_;
+    common::WakeSignal quiesce_signal_; // Wakes accept and receive threads for a handoff
 
     std::queue<uint32_t> finished_client_ids_;
     std::mutex finished_clients_mutex_;
     std::condition_variable finished_clients_cv_;
 
-    BroadcastMessageHandler default_message_handler_; // Example, can be more complex
+    std::unordered_set<uint32_t> backlogged_clients_; // Whose outbound queues are not empty
+    std::mutex backlog_mutex_; // Protects backlogged_clients_; taken last
+    common::WakeSignal backlog_signal_; // Wakes the outbound thread for a new backlog or stop
+
+    MessageDispatcher default_message_handler_; // Routes by message type, see message_routes.h
+    common::WorkStealingExecutor handler_executor_; // Runs message handlers off the receive threads
+    // Delivers partitions of large broadcasts. Never takes order_mutex_ or a
+    // group's lock, so a broadcaster holding them can wait for them.
+    common::WorkStealingExecutor fanout_executor_;
     // std::unique_ptr<IMessageHandler> message_handler_; // More general
 };
 
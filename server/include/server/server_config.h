@@ -0,0 +1,115 @@
+#pragma once
+
+#include "rate_limiter.h"
+#include "federation.h"
+#include "session_store.h"
+#include "memory_budget.h"
+#include "outbound_queue.h"
+#include "content_filter.h"
+#include "search_index.h"
+#include "offline_store.h"
+#include "common/reliable_channel.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+struct HeartbeatConfig {
+    int64_t idle_interval_ms = 30000;     // Quiet time before the server probes a client with PING
+    int64_t pong_timeout_ms = 10000;      // How long a probed client has to show any sign of life
+    int64_t handshake_timeout_ms = 10000; // New connections must answer the first PING within this
+    // A send that makes no progress for this long fails the connection, so a
+    // dead peer cannot hold up whoever sends to it; 0 waits forever.
+    int64_t send_timeout_ms = 10000;
+    std::chrono::milliseconds tick{100};  // Timing wheel resolution
+};
+
+struct PresenceConfig {
+    int64_t window_ms = 250;             // Joins and leaves within this are sent as one digest
+    size_t max_ids_per_digest = 256;     // Larger bursts are reported as counts only
+    size_t suppress_above_members = 1000; // No presence in bigger rooms; 0 never suppresses
+};
+
+// Broadcasts to many connections are split into partitions that worker
+// threads deliver in parallel; smaller ones are sent from the calling thread.
+struct FanoutConfig {
+    size_t parallel_threshold = 2048; // Recipients before fan-out goes parallel; 0 never does
+    size_t min_partition = 512;       // Fewer recipients than this are not worth a handoff
+    size_t workers = 0;               // Fan-out threads; 0 uses one per core
+};
+
+// A sharded server splits its connections across `count` shards, each with
+// its own SO_REUSEPORT listening socket, accept thread and event loop that
+// reads the shard's connections and delivers broadcasts to them (Linux).
+// Broadcasts reach the shards through mailboxes (see shard.h). 0 is unsharded.
+struct ShardConfig {
+    size_t count = 0;
+    size_t mailbox_capacity = 65536; // Entries queued per shard before broadcasters wait
+};
+
+// Connections read into buffers borrowed from one shared pool and keep only
+// an incomplete frame between reads, so an idle connection holds no receive
+// buffer beyond a partial message. That one grows with the frame, up to
+// max_frame_bytes: a header announcing a larger frame disconnects the client
+// before any of it is buffered.
+struct ReceiveBufferConfig {
+    size_t buffer_size = 16384;          // Bytes read per recv
+    size_t max_free = 256;               // Returned buffers kept for reuse; more are freed
+    size_t max_frame_bytes = 1024 * 1024; // Header included; 0 allows any size
+};
+
+// Thread placement on multi-socket hosts (Linux). With pin_threads, each
+// shard's event loop and accept thread, each event loop, and each executor
+// worker is pinned to one of `cpus` in turn (empty: every CPU the process may
+// use). Memory a pinned thread touches first, such as a shard's mailbox and
+// its connections' receive buffers, is then allocated on that CPU's NUMA node.
+struct PlacementConfig {
+    bool pin_threads = false;
+    std::vector<int> cpus;
+    // Puts each connection on the shard or event loop pinned to the CPU that
+    // receives its packets (SO_INCOMING_CPU), or else one on the same NUMA
+    // node. Shards' listeners also ask the kernel to route by it. Needs
+    // pin_threads.
+    bool steer_incoming_cpu = false;
+};
+
+// Same-host clients can skip the TCP loopback stack. Both are served next
+// to the TCP port; an empty path leaves that transport off.
+struct LocalTransportConfig {
+    std::string unix_path; // AF_UNIX stream socket
+    std::string shm_path;  // AF_UNIX socket that hands out shared memory rings (Linux)
+};
+
+struct ServerConfig {
+    RateLimitConfig rate_limits;
+    HeartbeatConfig heartbeat;
+    PresenceConfig presence;
+    FederationConfig federation;
+    SessionConfig sessions;
+    common::ReliableConfig reliable;
+    LocalTransportConfig local;
+    FanoutConfig fanout;
+    ShardConfig shards; // Replaces event_loops and parallel fan-out when enabled
+    PlacementConfig placement;
+    ReceiveBufferConfig receive_buffers;
+    MemoryConfig memory;
+    OutboundConfig outbound;
+    ContentFilterConfig content_filter;
+    SearchConfig search;
+    OfflineConfig offline;
+    size_t max_virtual_clients = 4096; // Logical clients one multiplexed connection may attach
+    // Broadcast frames at least this large go to TCP connections with
+    // MSG_ZEROCOPY (Linux), each kept until every recipient's kernel is done
+    // with it. Connections whose route copies anyway (loopback) fall back on
+    // their own. 0 copies every send; below ~10 KiB it does not pay.
+    size_t zerocopy_min_bytes = 0;
+    // Epoll threads reading TCP and Unix socket connections as coroutines
+    // (Linux). 0 gives every connection a receive thread of its own.
+    size_t event_loops = 0;
+};
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "common/message.h"
+#include "common/reliable_channel.h"
+#include "memory_budget.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+struct SessionConfig {
+    size_t history_messages = 1024;      // Broadcasts kept per room for catch-up
+    size_t history_bytes = 1024 * 1024;  // Payload bytes kept per room
+    int64_t resume_window_ms = 300000;   // How long a dropped session can be resumed
+    size_t max_sessions = 65536;         // Oldest detached sessions are evicted beyond this
+};
+
+// Reliable-delivery state of a session (see common/reliable_channel.h). Lives
+// in the connection's ClientHandler and moves to the SessionStore when the
+// connection ends, so a resumed session continues both numberings.
+struct ReliableState {
+    explicit ReliableState(const common::ReliableConfig& config) : outbound(config), inbound(config) {}
+
+    common::RetransmitWindow outbound;
+    common::AckTracker inbound;
+    bool enabled = false; // The client has sent an ACK, so it understands reliable frames
+};
+
+// Session tokens and per-room broadcast sequencing.
+//
+// Every connection opens a session whose token it learns in SESSION_WELCOME.
+// Every broadcast in a room is stamped with the room's next sequence number
+// and kept in a bounded history. A client that reconnects presents its old
+// token and the last sequence it saw, and gets only the broadcasts it missed.
+class SessionStore {
+public:
+    // History and detached sessions' retransmit windows are charged to
+    // memory as MemoryUse::HISTORY, if given.
+    explicit SessionStore(const SessionConfig& config, MemoryBudget* memory = nullptr);
+
+    // Opens a session for a new connection. Returns its token and the room's
+    // current sequence, i.e. where the connection's stream starts.
+    std::pair<uint64_t, uint32_t> open(uint32_t client_id, uint32_t room_id, int64_t now_ms);
+    // The connection is gone; its session, with the reliable-delivery state
+    // the connection leaves behind, stays resumable for resume_window_ms.
+    void detach(uint32_t client_id, int64_t now_ms, std::unique_ptr<ReliableState> reliable);
+
+    // Assigns msg the room's next sequence number and records it. The client
+    // the broadcast skipped is remembered so a replay skips it too.
+    void stamp(uint32_t room_id, common::Message& msg, uint32_t excluded_client);
+
+    // Moves the session behind `token` onto client_id, which drops the session
+    // that connection opened itself, and appends to `missed` the broadcasts
+    // after last_seen that the session's previous connection did not get.
+    // previous_client is set to that connection's id (0 if UNKNOWN) and
+    // `reliable` to the state it left behind (null if it is still attached).
+    common::ResumeStatus resume(uint64_t token, uint32_t client_id, uint32_t room_id, uint32_t last_seen,
+                                uint32_t& previous_client, std::vector<common::Message>& missed,
+                                std::unique_ptr<ReliableState>& reliable);
+
+    // While client_id's connection is open or its session can still be
+    // resumed, i.e. someone may still read what is addressed to that id: the
+    // id the session was opened with, which stays the same across resumes
+    // (see OfflineStore). Otherwise 0.
+    uint32_t mailbox_id(uint32_t client_id, int64_t now_ms);
+
+    // Drops the oldest broadcasts of the rooms with the most history until at
+    // least `bytes` of it are released, or none is left. Returns the bytes
+    // released. Sessions resuming from before them get ResumeStatus::PARTIAL.
+    int64_t trim_history(int64_t bytes);
+
+private:
+    struct Session {
+        uint32_t client_id = 0;
+        uint32_t first_client_id = 0; // Its mailbox_id
+        bool attached = true;
+        int64_t detached_at_ms = 0;
+        uint32_t start_sequence = 0; // Room sequence when the current connection joined
+        std::unique_ptr<ReliableState> reliable; // Only while detached
+        int64_t charged_bytes = 0;               // Its retransmit window, while detached
+    };
+
+    struct HistoryEntry {
+        common::Message msg;
+        uint32_t excluded_client;
+    };
+
+    struct Room {
+        uint32_t last_sequence = 0;
+        std::deque<HistoryEntry> history;
+        size_t history_bytes = 0;
+    };
+
+    // Tokens are bearer credentials. They come from the system's CSPRNG, and
+    // sessions_ spreads them over buckets by a hash keyed with a secret and
+    // compares them without branching on their bits, so lookup timing does
+    // not tell a prober how close a guess was.
+    struct TokenHash {
+        uint64_t key;
+        size_t operator()(uint64_t token) const;
+    };
+    struct TokenEqual {
+        bool operator()(uint64_t a, uint64_t b) const;
+    };
+
+    void expire(int64_t now_ms); // Requires mutex_
+    int64_t drop_oldest(Room& room); // Requires mutex_ and history; returns the bytes released
+    void charge(int64_t bytes);
+
+    SessionConfig config_;
+    MemoryBudget* memory_;
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, Session, TokenHash, TokenEqual> sessions_; // Keyed by token
+    std::unordered_map<uint32_t, uint64_t> client_tokens_; // Attached sessions by client id
+    std::unordered_map<uint32_t, uint64_t> detached_clients_; // Detached sessions by their last client id
+    std::deque<std::pair<uint64_t, int64_t>> detached_;    // (token, detached_at_ms), oldest first
+    std::unordered_map<uint32_t, Room> rooms_;
+};
+
+} // namespace server
+} // namespace chat_app
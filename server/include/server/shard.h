@@ -0,0 +1,98 @@
+#pragma once
+
+#include "common/event_loop.h"
+#include "common/message.h"
+#include "common/spsc_ring.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+class ClientHandler; // Forward declaration
+
+// One slice of a sharded server (see ShardConfig): an event loop that reads
+// the shard's connections and sends them broadcasts. Server accepts for each
+// shard on a listening socket of its own.
+//
+// Broadcasts, joins and leaves reach the loop through a lock-free mailbox,
+// drained in batches, so each shard fans out to its own connections in
+// parallel with the others and the broadcaster does not wait for any of it.
+// Producers take turns on a lock of the shard's own. Server queues every
+// broadcast to all shards under its order_mutex_, which gives them the same
+// broadcast order; joins, leaves and barriers need no global lock.
+//
+// Which connections belong to the shard, for adding, removing and looking
+// them up, is kept by Server in a map under a lock of the shard's own too
+// (Server::ClientGroup), so connections come and go on one shard without
+// contending with the others.
+//
+// A shard pinned to a CPU allocates its mailbox from the loop thread, so the
+// kernel's first-touch policy puts it on that CPU's NUMA node; so do the
+// receive buffers its connections grow there.
+class Shard {
+public:
+    struct Broadcast {
+        common::Message msg;     // Numbered per connection by send_message if reliable
+        std::shared_ptr<const std::vector<char>> frame; // Otherwise serialized once for every shard
+        uint32_t exclude_id = 0; // As Server::broadcast_message's sender_id_to_exclude
+        std::string slot;        // EPHEMERAL: see ClientHandler::send_latest
+    };
+
+    Shard(size_t index, size_t mailbox_capacity);
+    ~Shard();
+
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    size_t index() const { return index_; }
+    common::EventLoop& loop() { return loop_; }
+    int cpu() const { return cpu_; } // -1: not pinned
+
+    void start(int cpu = -1);
+    void stop(); // Handles whatever is still queued, then stops the loop
+
+    // Producer side; any thread. A full mailbox makes the caller wait for room.
+    void join(ClientHandler* handler);
+    // `left` counts down once the shard has let go of handler.
+    void leave(ClientHandler* handler, std::latch* left);
+    void deliver(std::shared_ptr<const Broadcast> broadcast);
+    // `reached` counts down once everything queued before it has been handled.
+    void barrier(std::latch* reached);
+
+private:
+    struct Entry {
+        enum class Kind { JOIN, LEAVE, DELIVER, BARRIER };
+        Kind kind = Kind::BARRIER;
+        ClientHandler* handler = nullptr;
+        std::shared_ptr<const Broadcast> broadcast;
+        std::latch* done = nullptr;
+    };
+
+    static constexpr size_t kDrainBatch = 256; // Entries per turn before the loop's reads get one
+
+    void push(Entry entry);
+    void schedule_drain();
+    void drain(); // Loop thread
+    void handle(Entry& entry);
+
+    size_t index_;
+    size_t mailbox_capacity_;
+    int cpu_;
+    common::EventLoop loop_;
+    std::unique_ptr<common::SpscRing<Entry>> mailbox_; // Allocated by start()
+    std::mutex producer_mutex_; // The ring takes one producer at a time
+    std::atomic<bool> drain_scheduled_;
+    std::vector<ClientHandler*> members_; // Consumer only
+    std::unordered_map<ClientHandler*, size_t> member_slots_; // Index into members_
+};
+
+} // namespace server
+} // namespace chat_app
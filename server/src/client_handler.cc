@@ -1,14 +1,51 @@
 #include "server/client_handler.h"
 #include "server/server.h" // For Server::signal_client_finished
 #include "common/message_serialization.h"
+#include "common/reliable_channel.h"
+#include <algorithm> // For std::min
+#include <cstring>   // For std::memcpy
 #include <iostream>
 #include <chrono>   // For sleep_for
 
 namespace chat_app {
 namespace server {
 
-ClientHandler::ClientHandler(uint32_t id, std::unique_ptr<common::ISocket> socket, Server& server_ref, IMessageHandler& msg_handler)
-    : id_(id), socket_(std::move(socket)), server_(server_ref), message_handler_(msg_handler), running_(false) {
+namespace {
+// Size of the frame [data, data + size) starts with, as its header says; 0
+// if the header is not all there yet.
+size_t announced_frame_size(const char* data, size_t size) {
+    if (size < common::HEADER_SIZE) return 0;
+    common::MessageHeader header;
+    std::memcpy(&header, data, common::HEADER_SIZE);
+    return common::HEADER_SIZE + header.payload_size;
+}
+
+// Bytes buffer lacks to hold its first frame whole; 0 if it does or is empty.
+size_t missing_frame_bytes(const std::vector<char>& buffer) {
+    if (buffer.empty()) return 0;
+    if (buffer.size() < common::HEADER_SIZE) return common::HEADER_SIZE - buffer.size();
+    size_t frame_size = announced_frame_size(buffer.data(), buffer.size());
+    return buffer.size() < frame_size ? frame_size - buffer.size() : 0;
+}
+} // namespace
+
+ClientHandler::ClientHandler(uint32_t id, std::unique_ptr<common::ISocket> socket, Server& server_ref, IMessageHandler& msg_handler,
+                             common::WorkStealingExecutor& executor, common::EventLoop* loop)
+    : id_(id), socket_(std::move(socket)), server_(server_ref), message_handler_(msg_handler), executor_(executor),
+      running_(false), shut_down_(false), loop_(loop), shard_index_(0), async_socket_(nullptr), reader_active_(false),
+      memory_(server_ref.memory()), charged_receive_buffer_(0), charged_outbound_(0),
+      rate_state_(server_ref.rate_limiter().make_connection_state()),
+      reliable_(std::make_unique<ReliableState>(server_ref.reliable_config())), last_activity_ms_(0),
+      outbound_backlog_(false), virtual_client_count_(0), pending_dispatches_(0) {
+    if (!server_ref.outbound_config().spool_directory.empty()) {
+        outbound_ = std::make_unique<OutboundQueue>(server_ref.outbound_config(), memory_);
+    }
+    // Queued frames are written in pieces, which zero-copy sends do not do
+    zerocopy_ = !outbound_ && server_ref.zerocopy_min_bytes() != 0 && socket_ &&
+                socket_->enable_zerocopy(server_ref.zerocopy_min_bytes());
+    if (socket_ && server_ref.send_timeout_ms() > 0) {
+        socket_->set_send_timeout(server_ref.send_timeout_ms());
+    }
     std::cout << "ClientHandler " << id_ << " created." << std::endl;
 }
 
@@ -25,17 +62,48 @@ ClientHandler::~ClientHandler() {
 void ClientHandler::start() {
     if (running_) return;
     running_ = true;
-    thread_ = std::thread(&ClientHandler::run, this);
+    start_reader();
     std::cout << "ClientHandler " << id_ << " started." << std::endl;
 }
 
+void ClientHandler::start_reader() {
+    if (loop_) {
+        {
+            std::lock_guard<std::mutex> lock(reader_mutex_);
+            reader_active_ = true;
+        }
+        loop_->spawn(read_loop());
+    } else {
+        thread_ = std::thread(&ClientHandler::run, this);
+    }
+}
+
+void ClientHandler::join_reader() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::unique_lock<std::mutex> lock(reader_mutex_);
+    reader_cv_.wait(lock, [this] { return !reader_active_; });
+}
+
 void ClientHandler::stop() {
     running_ = false; // Signal thread to stop
     if (socket_ && socket_->is_valid()) {
-        socket_->close_socket(); // This can help unblock recv
+        socket_->shutdown_socket(); // Unblocks recv; the reader closes the socket on its way out
     }
-    if (thread_.joinable()) {
-        thread_.join();
+    join_reader();
+    {
+        // Queued handler tasks reference *this; let them finish first
+        std::unique_lock<std::mutex> lock(dispatch_mutex_);
+        dispatch_cv_.wait(lock, [this] { return pending_dispatches_ == 0; });
+    }
+    std::vector<std::function<void(bool)>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        callbacks = take_written_callbacks_locked(); // Their frames never made it out
+    }
+    for (auto& callback : callbacks) {
+        callback(false);
     }
     std::cout << "ClientHandler " << id_ << " stopped." << std::endl;
 }
@@ -45,14 +113,311 @@ void ClientHandler::send_message(const common::Message& msg) {
         std::cerr << "ClientHandler " << id_ << ": Cannot send message, socket invalid or not running." << std::endl;
         return;
     }
-    auto serialized_msg = common::serialize_message(msg);
-    if (socket_->send_data(serialized_msg) <= 0) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    send_locked(msg);
+}
+
+void ClientHandler::send_serialized(const std::shared_ptr<const std::vector<char>>& frame) {
+    if (!socket_ || !socket_->is_valid() || !running_) return;
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!write_locked(frame)) {
+        std::cerr << "ClientHandler " << id_ << ": Failed to send message." << std::endl;
+        running_ = false;
+    }
+}
+
+void ClientHandler::send_serialized(const std::shared_ptr<const std::vector<char>>& frame,
+                                    std::function<void(bool written)> on_written) {
+    bool written = false;
+    if (socket_ && socket_->is_valid() && running_) {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        written = write_locked(frame);
+        if (!written) {
+            std::cerr << "ClientHandler " << id_ << ": Failed to send message." << std::endl;
+            running_ = false;
+        } else if (outbound_backlog_) {
+            written_callbacks_.push_back(std::move(on_written)); // Somewhere in the backlog
+            return;
+        }
+    }
+    on_written(written);
+}
+
+std::vector<std::function<void(bool)>> ClientHandler::take_written_callbacks_locked() {
+    std::vector<std::function<void(bool)>> callbacks;
+    callbacks.swap(written_callbacks_);
+    return callbacks;
+}
+
+void ClientHandler::send_locked(const common::Message& msg) {
+    const common::Message* to_send = &msg;
+    common::Message numbered;
+    if (msg.header.flags & common::kFlagReliable) {
+        numbered = msg;
+        numbered.header.flags &= ~common::kFlagReliable;
+        numbered.header.delivery_sequence = 0;
+        if (reliable_ && reliable_->enabled &&
+            !reliable_->outbound.track(numbered, server_.clock().now_ms())) {
+            std::cerr << "ClientHandler " << id_ << ": Retransmit window full; sending without delivery guarantee."
+                      << std::endl;
+        }
+        charge_outbound_locked();
+        to_send = &numbered;
+    }
+    if (!write_locked(common::serialize_message(*to_send))) {
         std::cerr << "ClientHandler " << id_ << ": Failed to send message." << std::endl;
         // Consider this a disconnect
         running_ = false; 
     }
 }
 
+void ClientHandler::send_latest(const std::shared_ptr<const std::vector<char>>& frame, const std::string& slot) {
+    if (!socket_ || !socket_->is_valid() || !running_) return;
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    bool written;
+    if (!outbound_) {
+        written = socket_->send_shared(frame) > 0; // Nothing ever waits to be superseded
+    } else {
+        written = outbound_->write_latest(*socket_, frame, slot);
+        if (written && !outbound_backlog_ && !outbound_->empty()) {
+            outbound_backlog_ = true;
+            server_.outbound_backlogged(id_);
+        }
+    }
+    if (!written) {
+        std::cerr << "ClientHandler " << id_ << ": Failed to send message." << std::endl;
+        running_ = false;
+    }
+}
+
+bool ClientHandler::write_locked(const std::shared_ptr<const std::vector<char>>& frame) {
+    if (!outbound_) return socket_->send_shared(frame) > 0;
+    if (!outbound_->write(*socket_, frame)) {
+        socket_->shutdown_socket(); // Too far behind to keep: the reader ends the connection
+        return false;
+    }
+    if (!outbound_backlog_ && !outbound_->empty()) {
+        outbound_backlog_ = true;
+        server_.outbound_backlogged(id_);
+    }
+    return true;
+}
+
+bool ClientHandler::write_locked(std::vector<char> frame) {
+    if (!outbound_) return socket_->send_data(frame) > 0;
+    return write_locked(std::make_shared<const std::vector<char>>(std::move(frame)));
+}
+
+void ClientHandler::drain_outbound() {
+    std::vector<std::function<void(bool)>> callbacks;
+    bool written = false;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        if (!outbound_backlog_) return;
+        if (!outbound_->drain(*socket_)) {
+            std::cerr << "ClientHandler " << id_ << ": Failed to send queued messages." << std::endl;
+            running_ = false;
+            socket_->shutdown_socket();
+        }
+        if (!running_ || outbound_->empty()) {
+            outbound_backlog_ = false;
+            server_.outbound_drained(id_);
+            written = running_;
+            callbacks = take_written_callbacks_locked();
+        }
+    }
+    for (auto& callback : callbacks) {
+        callback(written);
+    }
+}
+
+void ClientHandler::on_ack(const common::Message& ack) {
+    common::AckRanges ranges;
+    if (!common::parse_ack(ack, ranges)) return;
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!reliable_) return;
+    reliable_->enabled = true;
+    reliable_->outbound.on_ack(ranges);
+    charge_outbound_locked();
+}
+
+std::unique_ptr<ReliableState> ClientHandler::take_reliable_state() {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    std::unique_ptr<ReliableState> state = std::move(reliable_);
+    charge_outbound_locked(); // Whoever takes it accounts for it now
+    return state;
+}
+
+void ClientHandler::charge_outbound_locked() {
+    int64_t held = reliable_ ? static_cast<int64_t>(reliable_->outbound.bytes()) : 0;
+    memory_.charge(MemoryUse::OUTBOUND, held - charged_outbound_);
+    charged_outbound_ = held;
+}
+
+void ClientHandler::charge_receive_buffer_locked() {
+    int64_t held = static_cast<int64_t>(receive_buffer_.capacity());
+    memory_.charge(MemoryUse::RECEIVE, held - charged_receive_buffer_);
+    charged_receive_buffer_ = held;
+}
+
+int64_t ClientHandler::memory_backoff_ms() const {
+    if (is_shut_down()) return 0; // Reading on is how the reader learns of it
+    const MemoryBudget& budget = server_.memory();
+    return budget.should_pause_reading(memory_) ? budget.config().read_backoff_ms : 0;
+}
+
+void ClientHandler::adopt_reliable_state(std::unique_ptr<ReliableState> state) {
+    if (!state) return;
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    reliable_ = std::move(state);
+    charge_outbound_locked();
+    if (!socket_ || !socket_->is_valid() || !running_) return;
+    for (const auto& msg : reliable_->outbound.take_all(server_.clock().now_ms())) {
+        // Already numbered: not through send_locked
+        if (!write_locked(common::serialize_message(msg))) {
+            running_ = false;
+            break;
+        }
+    }
+    charge_outbound_locked();
+}
+
+bool ClientHandler::is_new_reliable(const common::Message& msg) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!reliable_ || !reliable_->inbound.is_duplicate(msg.header.delivery_sequence)) return true;
+    // Retransmitted before our ACK got there: acknowledge again, handle once
+    reliable_->inbound.on_receive(msg.header.delivery_sequence, server_.clock().now_ms());
+    return false;
+}
+
+void ClientHandler::record_reliable(const common::Message& msg) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (reliable_) reliable_->inbound.on_receive(msg.header.delivery_sequence, server_.clock().now_ms());
+}
+
+int ClientHandler::ack_wait_ms() {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!reliable_) return -1;
+    return static_cast<int>(reliable_->inbound.ms_until_ack(server_.clock().now_ms()));
+}
+
+void ClientHandler::flush_ack(bool force) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!reliable_ || !socket_ || !socket_->is_valid()) return;
+    int64_t wait_ms = reliable_->inbound.ms_until_ack(server_.clock().now_ms());
+    if (wait_ms < 0 || (wait_ms > 0 && !force)) return;
+    common::Message ack = reliable_->inbound.make_ack();
+    ack.header.recipient_id = id_;
+    send_locked(ack);
+}
+
+void ClientHandler::shutdown_connection() {
+    shut_down_.store(true, std::memory_order_relaxed);
+    if (socket_ && socket_->is_valid()) {
+        socket_->shutdown_socket();
+    }
+}
+
+void ClientHandler::quiesce() {
+    if (loop_) {
+        // quiesce_fd() only wakes threads; a coroutine has to be told directly
+        loop_->post([this] {
+            if (async_socket_) async_socket_->cancel();
+        });
+    }
+    join_reader();
+    std::unique_lock<std::mutex> lock(dispatch_mutex_);
+    dispatch_cv_.wait(lock, [this] { return pending_dispatches_ == 0; });
+    lock.unlock();
+    // The successor writes to the stream next, so the backlog has to be out first
+    std::vector<std::function<void(bool)>> callbacks;
+    bool written = false;
+    {
+        std::lock_guard<std::mutex> send_lock(send_mutex_);
+        if (!outbound_backlog_) return;
+        if (socket_ && socket_->is_valid()) {
+            written = outbound_->flush(*socket_);
+            if (!written) {
+                std::cerr << "ClientHandler " << id_ << ": Failed to send queued messages before handoff." << std::endl;
+            }
+        }
+        outbound_backlog_ = false;
+        server_.outbound_drained(id_);
+        callbacks = take_written_callbacks_locked();
+    }
+    for (auto& callback : callbacks) {
+        callback(written);
+    }
+}
+
+void ClientHandler::resume() {
+    if (!running_ || thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(reader_mutex_);
+        if (reader_active_) return;
+    }
+    start_reader();
+}
+
+void ClientHandler::abandon() {
+    running_ = false;
+    if (socket_) {
+        socket_->release_socket();
+    }
+}
+
+int ClientHandler::socket_fd() const {
+    return socket_ ? socket_->get_fd() : -1;
+}
+
+int ClientHandler::send_ready_fd(bool& readable) const {
+    readable = false;
+    return socket_ ? socket_->send_ready_fd(readable) : -1;
+}
+
+uint32_t ClientHandler::zerocopy_sends() const {
+    return socket_ ? socket_->zerocopy_sends() : 0;
+}
+
+bool ClientHandler::is_transferable() const {
+    return socket_ && socket_->is_transferable();
+}
+
+void ClientHandler::add_virtual_client(uint32_t virtual_id) {
+    std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+    virtual_clients_.insert(virtual_id);
+    virtual_client_count_ = virtual_clients_.size();
+}
+
+bool ClientHandler::remove_virtual_client(uint32_t virtual_id) {
+    std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+    if (virtual_clients_.erase(virtual_id) == 0) return false;
+    virtual_client_count_ = virtual_clients_.size();
+    return true;
+}
+
+bool ClientHandler::owns_virtual_client(uint32_t virtual_id) const {
+    if (virtual_client_count() == 0) return false;
+    std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+    return virtual_clients_.count(virtual_id) != 0;
+}
+
+std::vector<uint32_t> ClientHandler::virtual_clients() const {
+    std::lock_guard<std::mutex> lock(virtual_clients_mutex_);
+    return std::vector<uint32_t>(virtual_clients_.begin(), virtual_clients_.end());
+}
+
+std::vector<char> ClientHandler::receive_buffer_snapshot() {
+    std::lock_guard<std::mutex> lock(receive_buffer_mutex_);
+    return receive_buffer_;
+}
+
+void ClientHandler::restore_receive_buffer(std::vector<char> data) {
+    std::lock_guard<std::mutex> lock(receive_buffer_mutex_);
+    receive_buffer_ = std::move(data);
+    charge_receive_buffer_locked();
+}
+
 uint32_t ClientHandler::get_id() const {
     return id_;
 }
@@ -63,7 +428,6 @@ bool ClientHandler::is_running() const {
 
 void ClientHandler::run() {
     std::cout << "ClientHandler " << id_ << " thread running." << std::endl;
-    std::vector<char> temp_buffer(4096); // Temporary buffer for each recv call
 
     while (running_) {
         if (!socket_ || !socket_->is_valid()) {
@@ -72,7 +436,30 @@ void ClientHandler::run() {
             break;
         }
 
-        int bytes_received = socket_->receive_data(temp_buffer, temp_buffer.size());
+        int64_t backoff_ms = memory_backoff_ms();
+        if (backoff_ms > 0 && !server_.is_quiescing()) {
+            // Unread data pushes back on the sender through TCP until memory is freed
+            std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+            continue;
+        }
+
+        // Wake up on our own when a batched ACK falls due
+        common::WaitResult ready = socket_->wait_readable(ack_wait_ms(), server_.quiesce_fd());
+        if (ready == common::WaitResult::WOKEN) {
+            if (server_.is_quiescing()) {
+                // Handing this connection to a successor: leave the socket and buffer as they are
+                std::cout << "ClientHandler " << id_ << " quiesced for handoff." << std::endl;
+                return;
+            }
+            continue;
+        }
+        if (ready == common::WaitResult::TIMEOUT) {
+            flush_ack(true);
+            continue;
+        }
+
+        common::BufferPool::Lease chunk = server_.receive_pool().acquire(); // Back to the pool before the next wait
+        int bytes_received = socket_->receive_data(chunk.buffer(), chunk.size());
 
         if (bytes_received < 0) { // Error
             std::cerr << "ClientHandler " << id_ << ": Receive error. Disconnecting." << std::endl;
@@ -85,55 +472,177 @@ void ClientHandler::run() {
             break;
         }
 
-        // Append received data to internal buffer
+        last_activity_ms_.store(server_.clock().now_ms(), std::memory_order_relaxed);
+
+        receive_frames(chunk.data(), static_cast<size_t>(bytes_received), nullptr);
+        flush_ack(false); // Only if ack_every frames are waiting
+    }
+
+    finish_reading();
+}
+
+common::Task<void> ClientHandler::read_loop() {
+    std::cout << "ClientHandler " << id_ << " reading on an event loop." << std::endl;
+    bool quiesced = false;
+    {
+        common::AsyncSocket socket(*loop_, socket_->get_fd());
+        async_socket_ = &socket;
+        while (running_) {
+            if (server_.is_quiescing()) {
+                quiesced = true;
+                break;
+            }
+            int64_t backoff_ms = memory_backoff_ms();
+            if (backoff_ms > 0) {
+                co_await loop_->sleep_for(backoff_ms); // As in run(): TCP pushes back meanwhile
+                continue;
+            }
+            common::WaitResult ready = co_await socket.readable(ack_wait_ms());
+            if (ready == common::WaitResult::WOKEN) { // Cancelled by quiesce()
+                quiesced = true;
+                break;
+            }
+            if (ready == common::WaitResult::TIMEOUT) {
+                flush_ack(true);
+                continue;
+            }
+            int bytes_received = -1;
+            bool filled = false; // Likely more waiting
+            int64_t pause_ms = 0;
+            if (ready == common::WaitResult::READABLE) {
+                // Framed before the next suspension, so whatever it holds is never kept
+                common::BufferPool::Lease chunk = server_.receive_pool().acquire();
+                bytes_received = socket.try_recv(chunk.data(), chunk.size());
+                if (bytes_received > 0) {
+                    filled = static_cast<size_t>(bytes_received) == chunk.size();
+                    last_activity_ms_.store(server_.clock().now_ms(), std::memory_order_relaxed);
+                    receive_frames(chunk.data(), static_cast<size_t>(bytes_received), &pause_ms);
+                    flush_ack(false);
+                }
+            }
+            if (bytes_received == common::AsyncSocket::kWouldBlock) {
+                if (zerocopy_) socket_->reap_send_completions(); // Perhaps what woke us
+                continue;
+            }
+            if (bytes_received < 0) {
+                std::cerr << "ClientHandler " << id_ << ": Receive error. Disconnecting." << std::endl;
+                running_ = false;
+                break;
+            }
+            if (bytes_received == 0) {
+                std::cout << "ClientHandler " << id_ << ": Connection closed by peer." << std::endl;
+                running_ = false;
+                break;
+            }
+            while (pause_ms > 0 && running_) {
+                co_await loop_->sleep_for(pause_ms); // Unread data pushes back on the sender through TCP
+                pause_ms = 0;
+                receive_frames(nullptr, 0, &pause_ms); // What the chunk held beyond the delayed frame
+                flush_ack(false);
+            }
+            if (filled) {
+                co_await loop_->yield(); // Let the loop's other connections in first
+            }
+        }
+        async_socket_ = nullptr;
+    } // Unwatched before the descriptor can be closed
+
+    if (quiesced) {
+        std::cout << "ClientHandler " << id_ << " quiesced for handoff." << std::endl;
+    } else {
+        finish_reading();
+    }
+    std::lock_guard<std::mutex> lock(reader_mutex_);
+    reader_active_ = false;
+    reader_cv_.notify_all(); // Last use of *this: stop() may free it once the lock is released
+}
+
+void ClientHandler::receive_frames(const char* data, size_t size, int64_t* pause_ms) {
+    // Frames are decoded straight from data; receive_buffer_ only holds what
+    // is left between reads: an incomplete frame, or the rest of a delayed read
+    while (true) {
+        common::Message msg;
         {
             std::lock_guard<std::mutex> lock(receive_buffer_mutex_);
-            receive_buffer_.insert(receive_buffer_.end(), temp_buffer.begin(), temp_buffer.begin() + bytes_received);
-        }
-        
-        // Try to process messages from the buffer
-        while (true) {
-            common::Message msg;
-            {
-                std::lock_guard<std::mutex> lock(receive_buffer_mutex_);
-                if (receive_buffer_.size() < common::HEADER_SIZE) break; // Not enough for header
-
-                // Peek at header to get payload size
-                common::MessageHeader temp_header;
-                if (!common::deserialize_header(receive_buffer_, temp_header)) {
-                     std::cerr << "ClientHandler " << id_ << ": Failed to deserialize header from buffer." << std::endl;
-                     receive_buffer_.clear(); // Corrupted, clear buffer
-                     break;
+            size_t limit = server_.max_frame_bytes();
+            size_t missing;
+            while (size > 0 && (missing = missing_frame_bytes(receive_buffer_)) > 0) {
+                if (limit != 0 && announced_frame_size(receive_buffer_.data(), receive_buffer_.size()) > limit) {
+                    break; // Refused below, before growing for it
                 }
-
-                if (receive_buffer_.size() < common::HEADER_SIZE + temp_header.payload_size) {
-                    break; // Not enough for full message yet
+                size_t take = std::min(size, missing); // Top up the kept frame, nothing beyond it
+                receive_buffer_.insert(receive_buffer_.end(), data, data + take);
+                charge_receive_buffer_locked(); // As it grows, so the budget can stop the reads that grow it
+                data += take;
+                size -= take;
+            }
+            size_t frame_size = receive_buffer_.empty() ? announced_frame_size(data, size)
+                                                        : announced_frame_size(receive_buffer_.data(), receive_buffer_.size());
+            if (limit != 0 && frame_size > limit) {
+                std::cerr << "ClientHandler " << id_ << ": Frame of " << frame_size << " bytes exceeds the limit of "
+                          << limit << ". Disconnecting." << std::endl;
+                running_ = false;
+                receive_buffer_.clear();
+                size = 0;
+                break;
+            }
+            size_t consumed = 0;
+            if (!receive_buffer_.empty()) {
+                if (!common::deserialize_message(receive_buffer_.data(), receive_buffer_.size(), msg, consumed)) {
+                    break; // Still incomplete, and data is used up
+                }
+                receive_buffer_.erase(receive_buffer_.begin(), receive_buffer_.begin() + consumed);
+            } else {
+                if (!common::deserialize_message(data, size, msg, consumed)) {
+                    receive_buffer_.assign(data, data + size); // Incomplete: keep it for the next read
+                    size = 0;
+                    break;
                 }
-                
-                // Now deserialize the full message
-                msg = common::deserialize_message_from_buffer(receive_buffer_);
+                data += consumed;
+                size -= consumed;
             }
+        }
 
+        if (msg.header.type == common::MessageType::ERROR_MESSAGE) { // Clients have no business sending these
+            std::cerr << "ClientHandler " << id_ << ": Ignoring an error message from the client." << std::endl;
+            continue;
+        }
+        
+        // Ensure sender ID is set correctly by the server for messages from this client.
+        // A multiplexed connection may send on behalf of any of its virtual clients.
+        if (msg.header.sender_id != id_ && !owns_virtual_client(msg.header.sender_id)) {
+            msg.header.sender_id = id_;
+        }
 
-            if (msg.header.type == common::MessageType::ERROR_MESSAGE) { // Deserialization failed for a full message
-                std::cerr << "ClientHandler " << id_ << ": Failed to deserialize message or incomplete message." << std::endl;
-                // If it's truly an error, might disconnect. If incomplete, we'd normally wait.
-                // For this simple example, if deserialize_message_from_buffer returns ERROR, we break the inner loop.
-                // The outer loop will try to receive more data.
-                break; 
-            }
-            
-            // Ensure sender ID is set correctly by the server for messages from this client
-            msg.header.sender_id = id_; 
-            
-            std::cout << "ClientHandler " << id_ << ": Received message of type " 
-                      << static_cast<int>(msg.header.type) << " size " << msg.header.payload_size << std::endl;
-            message_handler_.handle_message(msg, *this, server_);
+        bool reliable = (msg.header.flags & common::kFlagReliable) != 0;
+        if (reliable && !is_new_reliable(msg)) {
+            continue;
         }
-         // Small sleep to prevent busy-looping if socket is non-blocking and no data
-         // std::this_thread::sleep_for(std::chrono::milliseconds(10)); 
+
+        if (!admit(msg, pause_ms)) {
+            if (!running_) break;
+            continue; // Not acknowledged, so a reliable sender retransmits it later
+        }
+        if (reliable) {
+            record_reliable(msg);
+        }
+        
+        std::cout << "ClientHandler " << id_ << ": Received message of type " 
+                  << static_cast<int>(msg.header.type) << " size " << msg.header.payload_size << std::endl;
+        dispatch(std::move(msg));
+        if (pause_ms && *pause_ms > 0) break; // The caller waits before framing the rest
     }
 
+    std::lock_guard<std::mutex> lock(receive_buffer_mutex_);
+    if (size > 0) {
+        receive_buffer_.insert(receive_buffer_.end(), data, data + size); // Framed after the pause
+    } else if (receive_buffer_.empty() && receive_buffer_.capacity() != 0) {
+        std::vector<char>().swap(receive_buffer_); // Idle connections keep no receive memory
+    }
+    charge_receive_buffer_locked();
+}
+
+void ClientHandler::finish_reading() {
     std::cout << "ClientHandler " << id_ << " thread finishing." << std::endl;
     if (socket_ && socket_->is_valid()) {
         socket_->close_socket();
@@ -141,5 +650,73 @@ void ClientHandler::run() {
     server_.signal_client_finished(id_);
 }
 
+bool ClientHandler::admit(const common::Message& msg, int64_t* pause_ms) {
+    // Only broadcast text is fanned out, so only it is charged to the room
+    bool fanned_out = msg.header.type == common::MessageType::TEXT_MESSAGE;
+    if (msg.header.type == common::MessageType::ACK) {
+        return true; // Batched already; throttling them would only provoke retransmissions
+    }
+    int64_t delay_ms = 0;
+    RateDecision decision = server_.rate_limiter().admit(id_, rate_state_, fanned_out, kLobbyRoomId,
+                                                         common::HEADER_SIZE + msg.payload.size(), delay_ms);
+    switch (decision) {
+        case RateDecision::ALLOW:
+            return true;
+        case RateDecision::DELAY:
+            if (pause_ms) {
+                *pause_ms = delay_ms; // The event loop must not sleep; read_loop waits instead
+                return true;
+            }
+            // Not reading from the socket meanwhile pushes back on the sender through TCP
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+            return true;
+        case RateDecision::DROP:
+            if (server_.rate_limiter().should_reply_with_error(rate_state_)) {
+                send_message(common::Message(common::MessageType::ERROR_MESSAGE, 0, id_,
+                                             "Rate limit exceeded; message dropped."));
+            }
+            return false;
+        case RateDecision::DISCONNECT:
+            std::cerr << "ClientHandler " << id_ << ": Rate limit exceeded. Disconnecting." << std::endl;
+            running_ = false;
+            return false;
+    }
+    return false;
+}
+
+void ClientHandler::dispatch(common::Message msg) {
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        ++pending_dispatches_;
+    }
+    // Held by this connection until handled; a backlog here is what marks a heavy sender
+    int64_t queued_bytes = static_cast<int64_t>(common::HEADER_SIZE + msg.payload.size());
+    memory_.charge(MemoryUse::RECEIVE, queued_bytes);
+    // Keyed by connection id so this client's messages are handled in arrival order
+    executor_.submit_ordered(id_, [this, queued_bytes, msg = std::move(msg)]() mutable {
+        // Released however the handler leaves, or stop() and quiesce() would wait forever
+        struct Done {
+            ClientHandler& handler;
+            int64_t queued_bytes;
+            ~Done() {
+                handler.memory_.charge(MemoryUse::RECEIVE, -queued_bytes);
+                std::lock_guard<std::mutex> lock(handler.dispatch_mutex_);
+                if (--handler.pending_dispatches_ == 0) {
+                    handler.dispatch_cv_.notify_all();
+                }
+            }
+        } done{*this, queued_bytes};
+        try {
+            message_handler_.handle_message(msg, *this, server_);
+        } catch (const std::exception& e) {
+            std::cerr << "ClientHandler " << id_ << ": Handling a message of type " << static_cast<int>(msg.header.type)
+                      << " failed: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "ClientHandler " << id_ << ": Handling a message of type " << static_cast<int>(msg.header.type)
+                      << " failed." << std::endl;
+        }
+    });
+}
+
 } // namespace server
 } // namespace chat_app
\ No newline at end of file
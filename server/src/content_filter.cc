@@ -0,0 +1,53 @@
+#include "server/content_filter.h"
+#include "common/utf8.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace chat_app {
+namespace server {
+
+ContentFilter::ContentFilter(const ContentFilterConfig& config) : config_(config) {
+    if (config_.require_utf8) {
+        std::cout << "ContentFilter: Validating UTF-8 (" << common::utf8_implementation() << ")." << std::endl;
+    }
+    if (!config_.blocklist_path.empty()) reload();
+}
+
+FilterVerdict ContentFilter::check(const char* data, size_t size) const {
+    if (config_.require_utf8 && !common::is_valid_utf8(data, size)) return FilterVerdict::INVALID_UTF8;
+    std::shared_ptr<const common::PatternMatcher> matcher = matcher_.load(std::memory_order_acquire);
+    if (matcher && matcher->contains_any(data, size)) return FilterVerdict::BLOCKED;
+    return FilterVerdict::PASS;
+}
+
+bool ContentFilter::reload() {
+    if (config_.blocklist_path.empty()) return false;
+    std::ifstream file(config_.blocklist_path, std::ios::binary);
+    if (!file) {
+        std::cerr << "ContentFilter: Cannot read blocklist " << config_.blocklist_path
+                  << "; keeping the current one." << std::endl;
+        return false;
+    }
+    std::vector<std::string> patterns;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        patterns.push_back(std::move(line));
+    }
+
+    // Compiled off to the side; checks keep using the old matcher until the swap
+    auto started = std::chrono::steady_clock::now();
+    auto matcher = std::make_shared<const common::PatternMatcher>(patterns);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    std::cout << "ContentFilter: Loaded " << matcher->pattern_count() << " patterns from " << config_.blocklist_path
+              << " (" << matcher->state_count() << " states, " << matcher->table_bytes() / 1024 << " KiB, "
+              << elapsed.count() << " ms)." << std::endl;
+    matcher_.store(std::move(matcher), std::memory_order_release);
+    return true;
+}
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,487 @@
+#include "server/federation.h"
+#include "server/server.h"
+#include "common/lz_codec.h"
+#include "common/message_serialization.h"
+#include "common/socket_factory.h"
+#include <chrono>
+#include <iostream>
+#include <unordered_set>
+
+namespace chat_app {
+namespace server {
+
+namespace {
+
+constexpr uint32_t kProtocolVersion = 1;
+constexpr size_t kFrameHeaderSize = 8;
+constexpr uint32_t kMaxFramePayload = 16 * 1024 * 1024;
+constexpr size_t kMaxQueuedBatches = 64; // Per link; relays beyond this are dropped
+constexpr uint8_t kFlagCompressed = 0x01;
+
+enum class LinkFrameKind : uint8_t {
+    HELLO = 1,
+    MEMBERSHIP = 2,
+    RELAY_BATCH = 3,
+};
+
+std::vector<char> make_frame(LinkFrameKind kind, uint8_t flags, const char* payload, size_t size) {
+    std::vector<char> frame;
+    frame.reserve(kFrameHeaderSize + size);
+    common::append_u32(frame, static_cast<uint32_t>(size));
+    frame.push_back(static_cast<char>(kind));
+    frame.push_back(static_cast<char>(flags));
+    frame.push_back(0);
+    frame.push_back(0);
+    frame.insert(frame.end(), payload, payload + size);
+    return frame;
+}
+
+std::vector<char> membership_frame(const std::vector<std::pair<uint32_t, size_t>>& rooms) {
+    std::vector<char> payload;
+    common::append_u32(payload, static_cast<uint32_t>(rooms.size()));
+    for (const auto& room : rooms) {
+        common::append_u32(payload, room.first);
+        common::append_u32(payload, static_cast<uint32_t>(room.second));
+    }
+    return make_frame(LinkFrameKind::MEMBERSHIP, 0, payload.data(), payload.size());
+}
+
+// "a.b.c.d:port"
+bool parse_address(const std::string& address, std::string& ip, int& port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0) return false;
+    try {
+        port = std::stoi(address.substr(colon + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    ip = address.substr(0, colon);
+    return port > 0 && port < 65536;
+}
+
+} // namespace
+
+// One link to one peer node: a receive thread parsing link frames and a send
+// thread draining a batch of queued relays every batch_window_ms.
+class Federation::PeerLink {
+public:
+    PeerLink(Federation& owner, std::unique_ptr<common::ISocket> socket, bool dialed)
+        : owner_(owner), socket_(std::move(socket)), dialed_(dialed), alive_(true), node_id_(0),
+          registered_(false), dropped_relays_(0) {}
+
+    void start() {
+        std::vector<char> hello;
+        common::append_u32(hello, owner_.config_.node_id);
+        common::append_u32(hello, kProtocolVersion);
+        queue_frame(make_frame(LinkFrameKind::HELLO, 0, hello.data(), hello.size()));
+        receive_thread_ = std::thread(&PeerLink::receive_loop, this);
+        send_thread_ = std::thread(&PeerLink::send_loop, this);
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!alive_) return;
+            alive_ = false;
+        }
+        cv_.notify_all();
+        socket_->shutdown_socket();
+    }
+
+    void join() {
+        if (receive_thread_.joinable()) receive_thread_.join();
+        if (send_thread_.joinable()) send_thread_.join();
+        socket_->close_socket();
+        if (dropped_relays_ > 0) {
+            std::cerr << "Federation: Dropped " << dropped_relays_ << " relays to node " << node_id_
+                      << " that could not keep up." << std::endl;
+        }
+    }
+
+    bool alive() const { return alive_; }
+    bool registered() const { return registered_; }
+    void mark_registered() { registered_ = true; }
+    uint32_t node_id() const { return node_id_; }
+    // Links are deduplicated by the node id of the side that dialed.
+    uint32_t dialer_id() const { return dialed_ ? owner_.config_.node_id : node_id_.load(); }
+
+    bool wants(uint32_t room_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return alive_ && registered_ && peer_rooms_.count(room_id) != 0;
+    }
+
+    void queue_relay(uint32_t room_id, const std::vector<char>& serialized) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!alive_) return;
+        if (batch_.size() >= owner_.config_.max_batch_bytes * kMaxQueuedBatches) {
+            ++dropped_relays_;
+            return;
+        }
+        bool was_empty = batch_.empty();
+        common::append_u32(batch_, room_id);
+        batch_.insert(batch_.end(), serialized.begin(), serialized.end());
+        bool full = batch_.size() >= owner_.config_.max_batch_bytes;
+        lock.unlock();
+        if (was_empty || full) cv_.notify_one();
+    }
+
+    void queue_frame(std::vector<char> frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!alive_) return;
+            frames_.push_back(std::move(frame));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void send_loop() {
+        const auto window = std::chrono::milliseconds(owner_.config_.batch_window_ms);
+        const size_t max_batch = owner_.config_.max_batch_bytes;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return !alive_ || !frames_.empty() || !batch_.empty(); });
+            if (!alive_) break;
+            if (frames_.empty() && batch_.size() < max_batch) {
+                // Let more relays join the batch; the first one sets the deadline
+                cv_.wait_for(lock, window, [this, max_batch] { return !alive_ || batch_.size() >= max_batch; });
+                if (!alive_) break;
+            }
+            std::vector<std::vector<char>> frames;
+            frames.swap(frames_);
+            std::vector<char> batch;
+            batch.swap(batch_);
+            lock.unlock();
+
+            bool ok = true;
+            for (const auto& frame : frames) {
+                ok = ok && socket_->send_data(frame) > 0;
+            }
+            if (ok && !batch.empty()) {
+                ok = socket_->send_data(encode_batch(batch)) > 0;
+            }
+            lock.lock();
+            if (!ok) break;
+        }
+        lock.unlock();
+        close();
+    }
+
+    std::vector<char> encode_batch(const std::vector<char>& batch) {
+        if (batch.size() >= owner_.config_.compress_min_bytes) {
+            std::vector<char> compressed;
+            common::append_u32(compressed, static_cast<uint32_t>(batch.size()));
+            common::lz_compress(batch.data(), batch.size(), compressed);
+            if (compressed.size() < batch.size()) {
+                return make_frame(LinkFrameKind::RELAY_BATCH, kFlagCompressed, compressed.data(), compressed.size());
+            }
+        }
+        return make_frame(LinkFrameKind::RELAY_BATCH, 0, batch.data(), batch.size());
+    }
+
+    void receive_loop() {
+        std::vector<char> buffer;
+        std::vector<char> chunk;
+        while (alive_) {
+            int n = socket_->receive_data(chunk, 64 * 1024);
+            if (n <= 0) break;
+            buffer.insert(buffer.end(), chunk.begin(), chunk.begin() + n);
+
+            size_t offset = 0;
+            bool ok = true;
+            while (ok && buffer.size() - offset >= kFrameHeaderSize) {
+                const char* header = buffer.data() + offset;
+                uint32_t length = common::read_u32(header);
+                if (length > kMaxFramePayload) {
+                    ok = false;
+                    break;
+                }
+                if (buffer.size() - offset - kFrameHeaderSize < length) break;
+                ok = handle_frame(static_cast<LinkFrameKind>(header[4]), static_cast<uint8_t>(header[5]),
+                                  header + kFrameHeaderSize, length);
+                offset += kFrameHeaderSize + length;
+            }
+            if (!ok) break;
+            buffer.erase(buffer.begin(), buffer.begin() + offset);
+        }
+        if (registered_) {
+            std::cout << "Federation: Link to node " << node_id_ << " closed." << std::endl;
+        }
+        close();
+    }
+
+    bool handle_frame(LinkFrameKind kind, uint8_t flags, const char* payload, size_t size) {
+        if (!registered_ && kind != LinkFrameKind::HELLO) return false; // HELLO comes first
+        switch (kind) {
+        case LinkFrameKind::HELLO: {
+            if (registered_ || size < 8) return false;
+            uint32_t node_id = common::read_u32(payload);
+            uint32_t version = common::read_u32(payload + 4);
+            if (version != kProtocolVersion || node_id == 0 || node_id == owner_.config_.node_id) {
+                std::cerr << "Federation: Rejecting link from node " << node_id << " (protocol " << version
+                          << ")." << std::endl;
+                return false;
+            }
+            node_id_ = node_id;
+            if (!owner_.register_link(*this)) return false;
+            owner_.send_full_membership(*this);
+            std::cout << "Federation: Linked with node " << node_id << "." << std::endl;
+            return true;
+        }
+        case LinkFrameKind::MEMBERSHIP: {
+            if (size < 4) return false;
+            uint32_t count = common::read_u32(payload);
+            if ((size - 4) / 8 < count) return false;
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t room_id = common::read_u32(payload + 4 + i * 8);
+                uint32_t members = common::read_u32(payload + 8 + i * 8);
+                if (members > 0) {
+                    peer_rooms_.insert(room_id);
+                } else {
+                    peer_rooms_.erase(room_id);
+                }
+            }
+            return true;
+        }
+        case LinkFrameKind::RELAY_BATCH: {
+            if (flags & kFlagCompressed) {
+                if (size < 4) return false;
+                uint32_t original_size = common::read_u32(payload);
+                if (original_size > kMaxFramePayload ||
+                    !common::lz_decompress(payload + 4, size - 4, original_size, inflated_)) {
+                    std::cerr << "Federation: Corrupt batch from node " << node_id_ << "." << std::endl;
+                    return false;
+                }
+                payload = inflated_.data();
+                size = inflated_.size();
+            }
+            size_t offset = 0;
+            while (offset < size) {
+                common::Message msg;
+                size_t consumed = 0;
+                if (size - offset < 4 ||
+                    !common::deserialize_message(payload + offset + 4, size - offset - 4, msg, consumed)) {
+                    return false;
+                }
+                owner_.server_.deliver_from_peer(msg, common::read_u32(payload + offset));
+                offset += 4 + consumed;
+            }
+            return true;
+        }
+        }
+        return true; // Unknown kinds are skipped for forward compatibility
+    }
+
+    Federation& owner_;
+    std::unique_ptr<common::ISocket> socket_;
+    const bool dialed_;
+    std::atomic<bool> alive_;
+    std::atomic<uint32_t> node_id_;
+    std::atomic<bool> registered_;
+
+    std::mutex mutex_; // Protects frames_, batch_, peer_rooms_ and dropped_relays_
+    std::condition_variable cv_;
+    std::vector<std::vector<char>> frames_; // Control frames, sent ahead of the batch
+    std::vector<char> batch_;               // Pending (room_id, message) records
+    std::unordered_set<uint32_t> peer_rooms_; // Rooms the peer has members in
+    size_t dropped_relays_;
+    std::vector<char> inflated_; // Receive-thread scratch for decompression
+
+    std::thread receive_thread_;
+    std::thread send_thread_;
+};
+
+Federation::Federation(const FederationConfig& config, Server& server)
+    : config_(config), server_(server), running_(false) {}
+
+Federation::~Federation() {
+    stop();
+}
+
+bool Federation::start() {
+    if (!enabled() || running_) return false;
+
+    if (config_.listen_port > 0) {
+        listen_socket_ = common::SocketFactory::create_socket();
+        if (!listen_socket_->bind_socket(config_.listen_port) || !listen_socket_->listen_socket(16)) {
+            std::cerr << "Federation: Cannot listen on port " << config_.listen_port << "." << std::endl;
+            listen_socket_.reset();
+            return false;
+        }
+    }
+
+    stop_signal_.reset();
+    running_ = true;
+    accept_thread_ = std::thread(&Federation::accept_links, this);
+    for (const auto& address : config_.peers) {
+        dial_threads_.emplace_back(&Federation::dial_peer, this, address);
+    }
+    std::cout << "Federation: Node " << config_.node_id << " up, listening on port " << config_.listen_port
+              << ", dialing " << config_.peers.size() << " peers." << std::endl;
+    return true;
+}
+
+void Federation::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    stop_signal_.notify();
+    stop_cv_.notify_all();
+
+    if (accept_thread_.joinable()) accept_thread_.join();
+    for (auto& thread : dial_threads_) {
+        thread.join();
+    }
+    dial_threads_.clear();
+    if (listen_socket_) {
+        listen_socket_->close_socket();
+        listen_socket_.reset();
+    }
+
+    std::vector<std::shared_ptr<PeerLink>> links;
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        links.swap(links_);
+    }
+    for (auto& link : links) {
+        link->close();
+    }
+    for (auto& link : links) {
+        link->join();
+    }
+}
+
+void Federation::relay(const common::Message& msg, uint32_t room_id) {
+    if (!running_) return;
+    std::vector<char> serialized; // Once, however many links want it
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    for (auto& link : links_) {
+        if (!link->wants(room_id)) continue;
+        if (serialized.empty()) serialized = common::serialize_message(msg);
+        link->queue_relay(room_id, serialized);
+    }
+}
+
+void Federation::change_local_members(uint32_t room_id, int64_t change) {
+    if (!enabled()) return;
+    std::lock_guard<std::mutex> members_lock(members_mutex_);
+    size_t& known = local_members_[room_id];
+    size_t members = static_cast<size_t>(static_cast<int64_t>(known) + change);
+    bool interest_changed = (known == 0) != (members == 0);
+    known = members;
+    if (members == 0) local_members_.erase(room_id);
+    if (!interest_changed || !running_) return;
+
+    std::vector<char> frame = membership_frame({{room_id, members}});
+    std::lock_guard<std::mutex> links_lock(links_mutex_);
+    for (auto& link : links_) {
+        if (link->registered()) link->queue_frame(frame);
+    }
+}
+
+void Federation::send_full_membership(PeerLink& link) {
+    // Under members_mutex_ so no interest change can overtake the summary
+    std::lock_guard<std::mutex> lock(members_mutex_);
+    std::vector<std::pair<uint32_t, size_t>> rooms(local_members_.begin(), local_members_.end());
+    link.queue_frame(membership_frame(rooms));
+}
+
+std::shared_ptr<Federation::PeerLink> Federation::adopt_link(std::unique_ptr<common::ISocket> socket,
+                                                             bool dialed) {
+    auto link = std::make_shared<PeerLink>(*this, std::move(socket), dialed);
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        links_.push_back(link);
+    }
+    link->start();
+    return link;
+}
+
+bool Federation::register_link(PeerLink& link) {
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    for (auto& other : links_) {
+        if (other.get() == &link || !other->alive() || !other->registered() ||
+            other->node_id() != link.node_id()) {
+            continue;
+        }
+        // Both nodes pick the same survivor: the link dialed by the lower node id.
+        // Between two links dialed by the same side the newer one wins.
+        if (other->dialer_id() < link.dialer_id()) return false;
+        other->close();
+    }
+    link.mark_registered(); // Under links_mutex_, so a concurrent duplicate sees it
+    return true;
+}
+
+bool Federation::has_live_link(uint32_t node_id) {
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    for (auto& link : links_) {
+        if (link->alive() && link->node_id() == node_id) return true;
+    }
+    return false;
+}
+
+void Federation::prune_dead_links() {
+    std::vector<std::shared_ptr<PeerLink>> dead;
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        for (auto it = links_.begin(); it != links_.end();) {
+            if ((*it)->alive()) {
+                ++it;
+            } else {
+                dead.push_back(std::move(*it));
+                it = links_.erase(it);
+            }
+        }
+    }
+    for (auto& link : dead) {
+        link->join();
+    }
+}
+
+void Federation::accept_links() {
+    while (running_) {
+        if (!listen_socket_) {
+            std::unique_lock<std::mutex> lock(stop_mutex_);
+            stop_cv_.wait_for(lock, std::chrono::seconds(1), [this] { return !running_; });
+        } else {
+            common::WaitResult ready = listen_socket_->wait_readable(1000, stop_signal_.fd());
+            if (ready == common::WaitResult::WOKEN) break;
+            if (ready == common::WaitResult::READABLE) {
+                auto socket = listen_socket_->accept_socket();
+                if (socket && socket->is_valid()) adopt_link(std::move(socket), false);
+            }
+        }
+        prune_dead_links(); // This thread doubles as the reaper of closed links
+    }
+}
+
+void Federation::dial_peer(std::string address) {
+    std::string ip;
+    int port = 0;
+    if (!parse_address(address, ip, port)) {
+        std::cerr << "Federation: Ignoring malformed peer address " << address << "." << std::endl;
+        return;
+    }
+
+    uint32_t peer_node = 0; // Learned from the first successful link
+    std::shared_ptr<PeerLink> link;
+    while (running_) {
+        bool connected = (link && link->alive()) || (peer_node != 0 && has_live_link(peer_node));
+        if (!connected) {
+            auto socket = common::SocketFactory::create_socket();
+            if (socket->connect_socket(ip, port)) {
+                link = adopt_link(std::move(socket), true);
+            }
+        }
+        std::unique_lock<std::mutex> lock(stop_mutex_);
+        stop_cv_.wait_for(lock, std::chrono::milliseconds(config_.redial_interval_ms), [this] { return !running_; });
+        if (link && link->node_id() != 0) peer_node = link->node_id();
+    }
+}
+
+} // namespace server
+} // namespace chat_app
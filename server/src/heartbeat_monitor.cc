@@ -0,0 +1,130 @@
+#include "server/heartbeat_monitor.h"
+#include "server/server.h"
+#include "server/client_handler.h"
+#include <iostream>
+
+namespace chat_app {
+namespace server {
+
+HeartbeatMonitor::HeartbeatMonitor(const HeartbeatConfig& config, const common::CoarseClock& clock, Server& server)
+    : config_(config), clock_(clock), server_(server), timers_(config.tick, clock.now_ms()), running_(false) {}
+
+HeartbeatMonitor::~HeartbeatMonitor() {
+    stop();
+}
+
+void HeartbeatMonitor::start() {
+    if (running_) return;
+    running_ = true;
+    thread_ = std::thread(&HeartbeatMonitor::run, this);
+}
+
+void HeartbeatMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    stop_cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void HeartbeatMonitor::track(uint32_t client_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PeerState& peer = peers_[client_id];
+    // Due at once: the first PING doubles as the handshake probe, and the
+    // monitor's thread sends it so this caller never waits on the connection
+    arm(client_id, peer, 0);
+}
+
+void HeartbeatMonitor::untrack(uint32_t client_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(client_id);
+    if (it == peers_.end()) return;
+    timers_.cancel(it->second.timer);
+    peers_.erase(it);
+}
+
+size_t HeartbeatMonitor::tracked_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peers_.size();
+}
+
+void HeartbeatMonitor::arm(uint32_t client_id, PeerState& peer, int64_t delay_ms) {
+    peer.timer = timers_.schedule(delay_ms, [this, client_id] { on_timer(client_id); });
+}
+
+void HeartbeatMonitor::on_timer(uint32_t client_id) {
+    auto it = peers_.find(client_id);
+    if (it == peers_.end()) return;
+    it->second.timer = common::TimingWheel::kInvalidTimer;
+    due_.push_back(client_id);
+}
+
+void HeartbeatMonitor::check(uint32_t client_id, ClientHandler* client) {
+    enum class Action { NONE, PING, REAP } action = Action::NONE;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = peers_.find(client_id);
+        if (it == peers_.end()) return; // Untracked meanwhile
+        if (!client) {
+            peers_.erase(it);
+            return;
+        }
+        if (!client->is_running()) return; // Already on its way out through cleanup
+        PeerState& peer = it->second;
+        const int64_t now = clock_.now_ms();
+        int64_t last_activity = client->last_activity_ms();
+
+        if (peer.ping_outstanding) {
+            if (last_activity >= peer.ping_sent_ms) {
+                peer.ping_outstanding = false;
+                peer.handshake_pending = false;
+                arm(client_id, peer, config_.idle_interval_ms - (now - last_activity));
+                return;
+            }
+            std::cout << "HeartbeatMonitor: Client " << client_id
+                      << (peer.handshake_pending ? " missed its handshake deadline." : " stopped answering PING.")
+                      << " Reaping connection." << std::endl;
+            action = Action::REAP;
+        } else if (peer.handshake_pending || now - last_activity >= config_.idle_interval_ms) {
+            peer.ping_outstanding = true;
+            peer.ping_sent_ms = now;
+            arm(client_id, peer, peer.handshake_pending ? config_.handshake_timeout_ms : config_.pong_timeout_ms);
+            action = Action::PING;
+        } else {
+            arm(client_id, peer, config_.idle_interval_ms - (now - last_activity));
+        }
+    }
+    // Outside mutex_: a send may block until the connection's send timeout
+    if (action == Action::PING) {
+        client->send_message(common::Message(common::MessageType::PING, 0, client_id, ""));
+    } else if (action == Action::REAP) {
+        client->shutdown_connection(); // Receive thread exits and signals the server
+    }
+}
+
+void HeartbeatMonitor::run() {
+    std::vector<uint32_t> due;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        stop_cv_.wait_for(lock, timers_.tick(), [this] { return !running_; });
+        if (!running_) break;
+        timers_.advance(clock_.now_ms());
+        if (due_.empty()) continue;
+        due.swap(due_);
+        lock.unlock();
+        // Neither mutex_ nor a lock of Server's is held while we talk to the
+        // clients, so one that stopped reading stalls neither broadcasts nor
+        // its own removal; the removal lock keeps the handlers alive meanwhile
+        server_.with_clients_held(due, [this](uint32_t client_id, ClientHandler* client) {
+            check(client_id, client);
+        });
+        due.clear();
+        lock.lock();
+    }
+}
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,400 @@
+#include "server/hot_restart.h"
+#include "server/server.h"
+#include <algorithm> // For std::min
+#include <cstring>   // For memcpy, strncpy
+#include <iostream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace chat_app {
+namespace server {
+
+#ifndef _WIN32
+
+namespace {
+
+// Control protocol, one SOCK_SEQPACKET datagram per record:
+//   successor   -> UPGRADE_REQUEST
+//   predecessor -> BEGIN [listen fd] { next_client_id, connection_count }
+//               -> CONNECTION [client fd] { client_id, zerocopy_sends, room_count, partial_size, rooms... }
+//                  followed by PARTIAL_CHUNK records carrying partial_size bytes
+//               -> END
+//   successor   -> ACK (fds adopted, predecessor exits) or ABORT (predecessor resumes)
+// Both ends run on the same host and build, so integers go in host byte order.
+enum class ControlKind : uint16_t {
+    UPGRADE_REQUEST = 1,
+    BEGIN,
+    CONNECTION,
+    PARTIAL_CHUNK,
+    END,
+    ACK,
+    ABORT
+};
+
+struct ControlHeader {
+    uint32_t magic;
+    uint16_t version;
+    ControlKind kind;
+};
+
+constexpr uint32_t kControlMagic = 0x43484F46; // "CHOF"
+constexpr uint16_t kControlVersion = 1;
+constexpr size_t kChunkSize = 32 * 1024;
+constexpr int kChannelTimeoutSec = 10;
+
+void append_u32(std::vector<char>& out, uint32_t value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+bool read_u32(const std::vector<char>& in, size_t& offset, uint32_t& value) {
+    if (in.size() < offset + sizeof(value)) return false;
+    std::memcpy(&value, in.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+bool send_record(int channel_fd, ControlKind kind, const std::vector<char>& body, int pass_fd = -1) {
+    ControlHeader header{kControlMagic, kControlVersion, kind};
+    iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<char*>(body.data());
+    iov[1].iov_len = body.size();
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = body.empty() ? 1 : 2;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (pass_fd >= 0) {
+        std::memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+
+    while (sendmsg(channel_fd, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno == EINTR) continue;
+        perror("HotRestart: sendmsg failed");
+        return false;
+    }
+    return true;
+}
+
+// received_fd is -1 unless the record carried a descriptor.
+bool receive_record(int channel_fd, ControlKind& kind, std::vector<char>& body, int& received_fd) {
+    std::vector<char> buffer(sizeof(ControlHeader) + kChunkSize + 256);
+    iovec iov{buffer.data(), buffer.size()};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    received_fd = -1;
+    ssize_t n;
+    while ((n = recvmsg(channel_fd, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+        if (errno == EINTR) continue;
+        perror("HotRestart: recvmsg failed");
+        return false;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&received_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    ControlHeader header{};
+    if (static_cast<size_t>(n) < sizeof(header) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        std::cerr << "HotRestart: Malformed control record." << std::endl;
+        if (received_fd >= 0) close(received_fd);
+        return false;
+    }
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.magic != kControlMagic || header.version != kControlVersion) {
+        std::cerr << "HotRestart: Peer speaks an incompatible handoff protocol." << std::endl;
+        if (received_fd >= 0) close(received_fd);
+        return false;
+    }
+    kind = header.kind;
+    body.assign(buffer.begin() + sizeof(header), buffer.begin() + n);
+    return true;
+}
+
+bool make_address(const std::string& path, sockaddr_un& addr) {
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "HotRestart: Socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return true;
+}
+
+void set_channel_timeout(int fd) {
+    timeval tv{kChannelTimeoutSec, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool send_state(int channel_fd, const HandoffState& state) {
+    std::vector<char> body;
+    append_u32(body, state.next_client_id);
+    append_u32(body, static_cast<uint32_t>(state.connections.size()));
+    if (!send_record(channel_fd, ControlKind::BEGIN, body, state.listen_fd)) return false;
+
+    for (const auto& connection : state.connections) {
+        body.clear();
+        append_u32(body, connection.client_id);
+        append_u32(body, connection.zerocopy_sends);
+        append_u32(body, static_cast<uint32_t>(connection.rooms.size()));
+        append_u32(body, static_cast<uint32_t>(connection.partial_frame.size()));
+        for (uint32_t room : connection.rooms) {
+            append_u32(body, room);
+        }
+        if (!send_record(channel_fd, ControlKind::CONNECTION, body, connection.fd)) return false;
+
+        for (size_t offset = 0; offset < connection.partial_frame.size(); offset += kChunkSize) {
+            size_t length = std::min(kChunkSize, connection.partial_frame.size() - offset);
+            body.assign(connection.partial_frame.begin() + offset, connection.partial_frame.begin() + offset + length);
+            if (!send_record(channel_fd, ControlKind::PARTIAL_CHUNK, body)) return false;
+        }
+    }
+    return send_record(channel_fd, ControlKind::END, {});
+}
+
+void close_received_fds(HandoffState& state) {
+    if (state.listen_fd >= 0) close(state.listen_fd);
+    state.listen_fd = -1;
+    for (auto& connection : state.connections) {
+        if (connection.fd >= 0) close(connection.fd);
+    }
+    state.connections.clear();
+}
+
+bool receive_state(int channel_fd, HandoffState& state) {
+    ControlKind kind;
+    std::vector<char> body;
+    int fd = -1;
+    if (!receive_record(channel_fd, kind, body, fd)) return false;
+    uint32_t connection_count = 0;
+    size_t offset = 0;
+    if (kind != ControlKind::BEGIN || fd < 0 || !read_u32(body, offset, state.next_client_id) ||
+        !read_u32(body, offset, connection_count)) {
+        std::cerr << "HotRestart: Expected BEGIN with the listening socket." << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    state.listen_fd = fd;
+
+    for (uint32_t i = 0; i < connection_count; ++i) {
+        if (!receive_record(channel_fd, kind, body, fd)) {
+            close_received_fds(state);
+            return false;
+        }
+        ConnectionHandoff connection;
+        connection.fd = fd;
+        uint32_t room_count = 0;
+        uint32_t partial_size = 0;
+        offset = 0;
+        bool ok = kind == ControlKind::CONNECTION && fd >= 0 && read_u32(body, offset, connection.client_id) &&
+                  read_u32(body, offset, connection.zerocopy_sends) && read_u32(body, offset, room_count) && read_u32(body, offset, partial_size);
+        for (uint32_t r = 0; ok && r < room_count; ++r) {
+            uint32_t room = 0;
+            ok = read_u32(body, offset, room);
+            connection.rooms.push_back(room);
+        }
+        state.connections.push_back(std::move(connection));
+        if (!ok) {
+            std::cerr << "HotRestart: Malformed CONNECTION record." << std::endl;
+            close_received_fds(state);
+            return false;
+        }
+
+        auto& partial = state.connections.back().partial_frame;
+        partial.reserve(partial_size);
+        while (partial.size() < partial_size) {
+            if (!receive_record(channel_fd, kind, body, fd) || kind != ControlKind::PARTIAL_CHUNK ||
+                partial.size() + body.size() > partial_size) {
+                std::cerr << "HotRestart: Malformed PARTIAL_CHUNK record." << std::endl;
+                if (fd >= 0) close(fd);
+                close_received_fds(state);
+                return false;
+            }
+            partial.insert(partial.end(), body.begin(), body.end());
+        }
+    }
+
+    if (!receive_record(channel_fd, kind, body, fd) || kind != ControlKind::END) {
+        std::cerr << "HotRestart: Expected END." << std::endl;
+        if (fd >= 0) close(fd);
+        close_received_fds(state);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// --- UpgradeListener ---
+
+UpgradeListener::UpgradeListener(const std::string& path, Server& server)
+    : path_(path), server_(server), listen_fd_(-1) {}
+
+UpgradeListener::~UpgradeListener() {
+    stop();
+}
+
+bool UpgradeListener::start() {
+    sockaddr_un addr;
+    if (!make_address(path_, addr)) return false;
+
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        perror("UpgradeListener: socket creation failed");
+        return false;
+    }
+    unlink(path_.c_str()); // Predecessor's (or a stale) name; its open listener is unaffected
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd_, 1) < 0) {
+        perror("UpgradeListener: bind/listen failed");
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    thread_ = std::thread(&UpgradeListener::run, this);
+    std::cout << "UpgradeListener: Waiting for a successor on " << path_ << "." << std::endl;
+    return true;
+}
+
+void UpgradeListener::stop() {
+    stop_signal_.notify();
+    if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+void UpgradeListener::run() {
+    while (true) {
+        pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {stop_signal_.fd(), POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("UpgradeListener: poll failed");
+            return;
+        }
+        if (fds[1].revents != 0) return;
+
+        int channel_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (channel_fd < 0) continue;
+        set_channel_timeout(channel_fd);
+        bool handed_off = serve_successor(channel_fd);
+        close(channel_fd);
+        if (handed_off) return;
+    }
+}
+
+bool UpgradeListener::serve_successor(int channel_fd) {
+    ControlKind kind;
+    std::vector<char> body;
+    int fd = -1;
+    if (!receive_record(channel_fd, kind, body, fd) || kind != ControlKind::UPGRADE_REQUEST) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    std::cout << "UpgradeListener: Successor connected. Handing off..." << std::endl;
+    HandoffState state;
+    if (!server_.export_for_handoff(state)) {
+        std::cerr << "UpgradeListener: Server is not in a state to hand off." << std::endl;
+        return false;
+    }
+
+    bool acked = send_state(channel_fd, state) && receive_record(channel_fd, kind, body, fd) &&
+                 kind == ControlKind::ACK;
+    if (fd >= 0) close(fd);
+    if (!acked) {
+        std::cerr << "UpgradeListener: Successor did not confirm. Resuming service." << std::endl;
+        server_.abort_handoff();
+        return false;
+    }
+
+    std::cout << "UpgradeListener: Handed off " << state.connections.size() << " connections." << std::endl;
+    close(listen_fd_); // The successor owns PATH now; don't unlink it
+    listen_fd_ = -1;
+    server_.complete_handoff();
+    return true;
+}
+
+// --- Successor side ---
+
+bool take_over_from_predecessor(const std::string& path, HandoffState& state, int& channel_fd) {
+    channel_fd = -1;
+    sockaddr_un addr;
+    if (!make_address(path, addr)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("HotRestart: socket creation failed");
+        return false;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd); // ENOENT / ECONNREFUSED: no predecessor, start fresh
+        return false;
+    }
+    set_channel_timeout(fd);
+
+    std::cout << "HotRestart: Taking over from the server on " << path << "..." << std::endl;
+    if (!send_record(fd, ControlKind::UPGRADE_REQUEST, {}) || !receive_state(fd, state)) {
+        std::cerr << "HotRestart: Takeover failed; the predecessor keeps serving." << std::endl;
+        close(fd);
+        return false;
+    }
+    channel_fd = fd;
+    return true;
+}
+
+void finish_takeover(int channel_fd, bool adopted) {
+    if (channel_fd < 0) return;
+    send_record(channel_fd, adopted ? ControlKind::ACK : ControlKind::ABORT, {});
+    close(channel_fd);
+}
+
+#else // _WIN32
+
+UpgradeListener::UpgradeListener(const std::string& path, Server& server)
+    : path_(path), server_(server), listen_fd_(-1) {}
+UpgradeListener::~UpgradeListener() {}
+bool UpgradeListener::start() {
+    std::cerr << "UpgradeListener: Hot restart is not supported on Windows." << std::endl;
+    return false;
+}
+void UpgradeListener::stop() {}
+void UpgradeListener::run() {}
+bool UpgradeListener::serve_successor(int) { return false; }
+
+bool take_over_from_predecessor(const std::string&, HandoffState&, int& channel_fd) {
+    channel_fd = -1;
+    return false;
+}
+void finish_takeover(int, bool) {}
+
+#endif // _WIN32
+
+} // namespace server
+} // namespace chat_app
@@ -1,10 +1,12 @@
 #include "server/server.h"
+#include "common/cpu_affinity.h"
 #include <iostream>
 #include <string>
 #include <csignal> // For signal handling
 #include <memory>  // For std::unique_ptr
 
 std::unique_ptr<chat_app::server::Server> server_instance;
+volatile std::sig_atomic_t reload_requested = 0;
 
 void signal_handler(int signum) {
     std::cout << "\nInterrupt signal (" << signum << ") received.\n";
@@ -15,29 +17,187 @@ void signal_handler(int signum) {
     exit(signum);
 }
 
+// SIGHUP: reload the content filter's blocklist, from the main loop
+void reload_handler(int signum) {
+    (void)signum;
+    reload_requested = 1;
+}
+
+// Returns true and sets value if arg is "--name=value".
+bool parse_flag(const std::string& arg, const std::string& name, std::string& value) {
+    std::string prefix = "--" + name + "=";
+    if (arg.rfind(prefix, 0) != 0) return false;
+    value = arg.substr(prefix.size());
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     int port = 8080;
-    if (argc > 1) {
+    chat_app::server::ServerConfig config;
+    chat_app::server::RateLimitConfig& rate_limits = config.rate_limits;
+
+    // Usage: server_app [port] [--throttle=delay|drop|disconnect] [--msg-rate=N] [--byte-rate=N]
+    //                   [--idle-timeout-ms=N] [--pong-timeout-ms=N] [--send-timeout-ms=N]
+    //                   [--upgrade-socket=PATH] [--node-id=N --federation-port=P [--peer=IP:PORT]...]
+    //                   [--resume-window-ms=N] [--history-messages=N]
+    //                   [--presence-window-ms=N] [--presence-max-members=N]
+    //                   [--unix-socket=PATH] [--shm-socket=PATH] [--max-virtual-clients=N]
+    //                   [--event-loops=N] [--fanout-threshold=N] [--fanout-min-partition=N]
+    //                   [--fanout-workers=N] [--shards=N] [--pin-threads=all|CPU-LIST]
+    //                   [--steer-incoming-cpu] [--receive-buffer-size=N] [--max-frame-bytes=BYTES]
+    //                   [--zerocopy-min-bytes=N]
+    //                   [--memory-soft-limit=BYTES] [--memory-hard-limit=BYTES]
+    //                   [--spool-dir=PATH] [--spool-after=BYTES] [--max-spool=BYTES]
+    //                   [--blocklist=PATH] [--allow-invalid-utf8] [--search-dir=PATH]
+    //                   [--offline-dir=PATH] [--offline-max-bytes=BYTES] [--offline-max-age-ms=N]
+    // SIGHUP reloads the blocklist.
+    std::string upgrade_socket;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value;
         try {
-            port = std::stoi(argv[1]);
+            if (parse_flag(arg, "throttle", value)) {
+                if (!chat_app::server::parse_throttle_action(value, rate_limits.action)) {
+                    std::cerr << "Unknown throttle action: " << value << ". Using "
+                              << chat_app::server::throttle_action_name(rate_limits.action) << std::endl;
+                }
+            } else if (parse_flag(arg, "msg-rate", value)) {
+                rate_limits.messages_per_sec = std::stod(value);
+                rate_limits.message_burst = rate_limits.messages_per_sec * 2;
+            } else if (parse_flag(arg, "byte-rate", value)) {
+                rate_limits.bytes_per_sec = std::stod(value);
+                rate_limits.byte_burst = rate_limits.bytes_per_sec * 4;
+            } else if (parse_flag(arg, "idle-timeout-ms", value)) {
+                config.heartbeat.idle_interval_ms = std::stoll(value);
+            } else if (parse_flag(arg, "pong-timeout-ms", value)) {
+                config.heartbeat.pong_timeout_ms = std::stoll(value);
+                config.heartbeat.handshake_timeout_ms = config.heartbeat.pong_timeout_ms;
+            } else if (parse_flag(arg, "send-timeout-ms", value)) {
+                config.heartbeat.send_timeout_ms = std::stoll(value);
+            } else if (parse_flag(arg, "upgrade-socket", value)) {
+                upgrade_socket = value;
+            } else if (parse_flag(arg, "node-id", value)) {
+                config.federation.node_id = static_cast<uint32_t>(std::stoul(value));
+                if (config.federation.node_id > 255) {
+                    std::cerr << "Node id must be at most 255. Federation disabled." << std::endl;
+                    config.federation.node_id = 0;
+                }
+            } else if (parse_flag(arg, "federation-port", value)) {
+                config.federation.listen_port = std::stoi(value);
+            } else if (parse_flag(arg, "peer", value)) {
+                config.federation.peers.push_back(value);
+            } else if (parse_flag(arg, "resume-window-ms", value)) {
+                config.sessions.resume_window_ms = std::stoll(value);
+            } else if (parse_flag(arg, "history-messages", value)) {
+                config.sessions.history_messages = std::stoul(value);
+            } else if (parse_flag(arg, "presence-window-ms", value)) {
+                config.presence.window_ms = std::stoll(value);
+            } else if (parse_flag(arg, "presence-max-members", value)) {
+                config.presence.suppress_above_members = std::stoul(value);
+            } else if (parse_flag(arg, "unix-socket", value)) {
+                config.local.unix_path = value;
+            } else if (parse_flag(arg, "shm-socket", value)) {
+                config.local.shm_path = value;
+            } else if (parse_flag(arg, "max-virtual-clients", value)) {
+                config.max_virtual_clients = std::stoul(value);
+            } else if (parse_flag(arg, "event-loops", value)) {
+                config.event_loops = std::stoul(value);
+            } else if (parse_flag(arg, "fanout-threshold", value)) {
+                config.fanout.parallel_threshold = std::stoul(value);
+            } else if (parse_flag(arg, "fanout-min-partition", value)) {
+                config.fanout.min_partition = std::stoul(value);
+            } else if (parse_flag(arg, "fanout-workers", value)) {
+                config.fanout.workers = std::stoul(value);
+            } else if (parse_flag(arg, "shards", value)) {
+                config.shards.count = std::stoul(value);
+            } else if (parse_flag(arg, "pin-threads", value)) {
+                config.placement.pin_threads = true;
+                config.placement.cpus.clear(); // "all"
+                if (value != "all" && !chat_app::common::parse_cpu_list(value, config.placement.cpus)) {
+                    std::cerr << "Invalid CPU list: " << value << ". Pinning over all CPUs." << std::endl;
+                }
+            } else if (arg == "--steer-incoming-cpu") {
+                config.placement.steer_incoming_cpu = true;
+            } else if (parse_flag(arg, "receive-buffer-size", value)) {
+                config.receive_buffers.buffer_size = std::stoul(value);
+            } else if (parse_flag(arg, "max-frame-bytes", value)) {
+                config.receive_buffers.max_frame_bytes = std::stoul(value);
+            } else if (parse_flag(arg, "zerocopy-min-bytes", value)) {
+                config.zerocopy_min_bytes = std::stoul(value);
+            } else if (parse_flag(arg, "memory-soft-limit", value)) {
+                config.memory.soft_limit_bytes = std::stoull(value);
+            } else if (parse_flag(arg, "memory-hard-limit", value)) {
+                config.memory.hard_limit_bytes = std::stoull(value);
+            } else if (parse_flag(arg, "spool-dir", value)) {
+                config.outbound.spool_directory = value;
+            } else if (parse_flag(arg, "spool-after", value)) {
+                config.outbound.memory_bytes = std::stoull(value);
+            } else if (parse_flag(arg, "max-spool", value)) {
+                config.outbound.max_spool_bytes = std::stoull(value);
+            } else if (parse_flag(arg, "blocklist", value)) {
+                config.content_filter.blocklist_path = value;
+            } else if (arg == "--allow-invalid-utf8") {
+                config.content_filter.require_utf8 = false;
+            } else if (parse_flag(arg, "search-dir", value)) {
+                config.search.directory = value;
+            } else if (parse_flag(arg, "offline-dir", value)) {
+                config.offline.directory = value;
+            } else if (parse_flag(arg, "offline-max-bytes", value)) {
+                config.offline.max_bytes_per_recipient = std::stoull(value);
+            } else if (parse_flag(arg, "offline-max-age-ms", value)) {
+                config.offline.max_age_ms = std::stoll(value);
+            } else {
+                port = std::stoi(arg);
+            }
         } catch (const std::exception& e) {
-            std::cerr << "Invalid port number: " << argv[1] << ". Using default " << port << std::endl;
+            std::cerr << "Invalid argument: " << arg << ". Ignoring." << std::endl;
         }
     }
 
     signal(SIGINT, signal_handler);  // Handle Ctrl+C
     signal(SIGTERM, signal_handler); // Handle termination signal
+#ifdef SIGHUP
+    signal(SIGHUP, reload_handler);
+#endif
 
-    server_instance = std::make_unique<chat_app::server::Server>(port);
-    server_instance->start();
+    server_instance = std::make_unique<chat_app::server::Server>(port, config);
+
+    // With --upgrade-socket, take over from a running server if there is one,
+    // then wait on the same path to hand over to our own successor.
+    std::unique_ptr<chat_app::server::UpgradeListener> upgrade_listener;
+    chat_app::server::HandoffState handoff;
+    int handoff_channel = -1;
+    if (!upgrade_socket.empty() &&
+        chat_app::server::take_over_from_predecessor(upgrade_socket, handoff, handoff_channel)) {
+        bool adopted = server_instance->start_from_handoff(handoff);
+        chat_app::server::finish_takeover(handoff_channel, adopted);
+        if (!adopted) {
+            std::cerr << "Failed to adopt the predecessor's sockets." << std::endl;
+            return 1;
+        }
+    } else {
+        server_instance->start();
+    }
+    if (!upgrade_socket.empty()) {
+        upgrade_listener = std::make_unique<chat_app::server::UpgradeListener>(upgrade_socket, *server_instance);
+        upgrade_listener->start();
+    }
 
     std::cout << "Server is running. Press Ctrl+C to exit." << std::endl;
     
     // Keep main thread alive, server operations are in other threads.
     // The signal handler will take care of shutdown.
+    int ticks = 0;
     while (true) {
         // Can add a command processing loop here for server commands if needed
         std::this_thread::sleep_for(std::chrono::seconds(1)); 
+        if (reload_requested && server_instance) {
+            reload_requested = 0;
+            server_instance->content_filter().reload();
+        }
+        if (++ticks % 10 == 0 && server_instance) {
+            server_instance->log_throttled_clients();
+        }
         if (!server_instance || !server_instance->is_running_properly()) { // Add is_running_properly() to server if needed
              break; // Or if server signals it's no longer running
         }
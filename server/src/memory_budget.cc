@@ -0,0 +1,93 @@
+#include "server/memory_budget.h"
+
+namespace chat_app {
+namespace server {
+
+namespace {
+// Below this a connection is never "heavy", however light the others are
+constexpr int64_t kMinHeavyBytes = 4096;
+} // namespace
+
+const char* memory_use_name(MemoryUse use) {
+    switch (use) {
+        case MemoryUse::RECEIVE: return "receive";
+        case MemoryUse::OUTBOUND: return "outbound";
+        case MemoryUse::HISTORY: return "history";
+        case MemoryUse::FILE_RELAY: return "file relay";
+        case MemoryUse::COUNT: break;
+    }
+    return "unknown";
+}
+
+MemoryBudget::Account::Account(MemoryBudget& budget) : budget_(budget) {
+    for (auto& used : used_) {
+        used.store(0, std::memory_order_relaxed);
+    }
+    budget_.accounts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+MemoryBudget::Account::~Account() {
+    for (size_t i = 0; i < static_cast<size_t>(MemoryUse::COUNT); ++i) {
+        int64_t held = used_[i].load(std::memory_order_relaxed);
+        if (held != 0) budget_.charge(static_cast<MemoryUse>(i), -held);
+    }
+    budget_.accounts_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MemoryBudget::Account::charge(MemoryUse use, int64_t bytes) {
+    if (bytes == 0) return;
+    used_[static_cast<size_t>(use)].fetch_add(bytes, std::memory_order_relaxed);
+    budget_.charge(use, bytes);
+}
+
+int64_t MemoryBudget::Account::total() const {
+    int64_t sum = 0;
+    for (const auto& used : used_) {
+        sum += used.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+MemoryBudget::MemoryBudget(const MemoryConfig& config) : config_(config), accounts_(0) {}
+
+void MemoryBudget::charge(MemoryUse use, int64_t bytes) {
+    used_[static_cast<size_t>(use)].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+int64_t MemoryBudget::total() const {
+    int64_t sum = 0;
+    for (const auto& counter : used_) {
+        sum += counter.bytes.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+MemoryPressure MemoryBudget::pressure() const {
+    if (config_.soft_limit_bytes == 0 && config_.hard_limit_bytes == 0) return MemoryPressure::NORMAL;
+    int64_t in_use = total();
+    if (config_.hard_limit_bytes != 0 && in_use >= static_cast<int64_t>(config_.hard_limit_bytes)) {
+        return MemoryPressure::HARD;
+    }
+    if (config_.soft_limit_bytes != 0 && in_use >= static_cast<int64_t>(config_.soft_limit_bytes)) {
+        return MemoryPressure::SOFT;
+    }
+    return MemoryPressure::NORMAL;
+}
+
+bool MemoryBudget::should_pause_reading(const Account& account) const {
+    switch (pressure()) {
+        case MemoryPressure::NORMAL:
+            return false;
+        case MemoryPressure::HARD:
+            return true;
+        case MemoryPressure::SOFT:
+            break;
+    }
+    size_t connections = accounts();
+    int64_t average = connections == 0 ? 0 : used(MemoryUse::RECEIVE) / static_cast<int64_t>(connections);
+    int64_t held = account.used(MemoryUse::RECEIVE);
+    return held >= kMinHeavyBytes && held > average;
+}
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,37 @@
+#include "server/message_dispatcher.h"
+#include "server/message_routes.h" // Route specializations, must precede the table
+#include <iostream>
+
+namespace chat_app {
+namespace server {
+
+namespace {
+
+template <size_t... Index>
+constexpr MessageDispatcher::RouteTable make_route_table(std::index_sequence<Index...>) {
+    return {{&MessageRoute<static_cast<common::MessageType>(Index)>::pipeline::run...}};
+}
+
+constexpr MessageDispatcher::RouteTable kRouteTable =
+    make_route_table(std::make_index_sequence<common::kMessageTypeCount>{});
+
+} // namespace
+
+bool ReportUnhandled::process(DispatchContext& ctx) {
+    std::cerr << "MessageDispatcher: Received unhandled message type: "
+              << static_cast<int>(ctx.msg.header.type) << " from client " << ctx.client_handler.get_id() << std::endl;
+    return false;
+}
+
+void MessageDispatcher::handle_message(common::Message& msg, ClientHandler& client_handler, Server& server) {
+    DispatchContext ctx{msg, client_handler, server};
+    auto index = static_cast<size_t>(msg.header.type);
+    if (index >= kRouteTable.size()) { // Type byte comes straight off the wire
+        ReportUnhandled::process(ctx);
+        return;
+    }
+    kRouteTable[index](ctx);
+}
+
+} // namespace server
+} // namespace chat_app
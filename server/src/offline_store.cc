@@ -0,0 +1,297 @@
+#include "server/offline_store.h"
+#include "common/message_serialization.h"
+#include <algorithm> // For std::min
+#include <chrono>
+#include <cstdio>  // For fopen, perror, snprintf
+#include <cstdlib> // For strtoul
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace chat_app {
+namespace server {
+
+namespace {
+constexpr size_t kRecordHeaderSize = 16; // u64 stored at, u32 sender id, u32 size
+constexpr int64_t kSweepIntervalMs = 60000;
+constexpr char kSuffix[] = ".dm";
+
+int64_t wall_clock_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+OfflineStore::OfflineStore(const OfflineConfig& config)
+    : config_(config), total_bytes_(0), last_sweep_ms_(0) {}
+
+std::string OfflineStore::path_for(uint32_t mailbox_id) const {
+    char name[16];
+    std::snprintf(name, sizeof(name), "%08x", mailbox_id);
+    return config_.directory + "/" + name + kSuffix;
+}
+
+void OfflineStore::start(bool keep_existing) {
+    if (!enabled()) return;
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::error_code error;
+    std::filesystem::create_directories(config_.directory, error);
+    mailboxes_.clear();
+    total_bytes_ = 0;
+    size_t discarded = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.directory, error)) {
+        const auto& path = entry.path();
+        if (path.extension() != kSuffix) continue;
+        std::string stem = path.stem().string();
+        char* end = nullptr;
+        unsigned long mailbox_id = std::strtoul(stem.c_str(), &end, 16);
+        if (stem.size() != 8 || *end != '\0') continue;
+        std::error_code file_error;
+        if (!keep_existing) { // The ids are about to be handed out again, to other clients
+            if (std::filesystem::remove(path, file_error)) ++discarded;
+            continue;
+        }
+        uint64_t bytes = std::filesystem::file_size(path, file_error);
+        auto modified = std::filesystem::last_write_time(path, file_error);
+        if (file_error) continue;
+        auto mailbox = std::make_shared<Mailbox>();
+        mailbox->bytes = bytes;
+        mailbox->newest_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::file_clock::to_sys(modified).time_since_epoch()).count();
+        mailboxes_[static_cast<uint32_t>(mailbox_id)] = std::move(mailbox);
+        total_bytes_ += bytes;
+    }
+    if (error) {
+        std::cerr << "OfflineStore: Cannot read " << config_.directory << ": " << error.message() << std::endl;
+    }
+    if (discarded != 0) {
+        std::cout << "OfflineStore: Discarded the mailboxes of " << discarded << " clients of a previous run."
+                  << std::endl;
+    }
+    std::cout << "OfflineStore: " << mailboxes_.size() << " mailboxes have " << total_bytes_
+              << " bytes of messages waiting in " << config_.directory << "." << std::endl;
+    last_sweep_ms_ = wall_clock_ms();
+    lock.unlock();
+    sweep(last_sweep_ms_);
+}
+
+OfflineStore::Ticket OfflineStore::reserve(uint32_t mailbox_id) {
+    Ticket ticket;
+    ticket.mailbox_id = mailbox_id;
+    if (!enabled()) return ticket;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& mailbox = mailboxes_[mailbox_id];
+    if (!mailbox) mailbox = std::make_shared<Mailbox>();
+    ticket.mailbox = mailbox;
+    ticket.number = ++mailbox->issued;
+    return ticket;
+}
+
+std::unique_lock<std::mutex> OfflineStore::wait_turn(const Ticket& ticket) {
+    Mailbox& mailbox = *ticket.mailbox;
+    std::unique_lock<std::mutex> lock(mailbox.mutex);
+    mailbox.turn_cv.wait(lock, [&] { return mailbox.served + 1 == ticket.number; });
+    return lock;
+}
+
+void OfflineStore::finish_turn(Mailbox& mailbox, std::unique_lock<std::mutex>& lock) {
+    ++mailbox.served;
+    lock.unlock();
+    mailbox.turn_cv.notify_all();
+}
+
+bool OfflineStore::store(const Ticket& ticket, const common::Message& msg) {
+    if (!ticket.mailbox) return false;
+    int64_t now_ms = wall_clock_ms();
+    bool sweep_due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sweep_due = now_ms - last_sweep_ms_ >= kSweepIntervalMs;
+        if (sweep_due) last_sweep_ms_ = now_ms;
+    }
+    if (sweep_due) sweep(now_ms);
+
+    uint64_t record_bytes = kRecordHeaderSize + msg.payload.size();
+    std::vector<char> record;
+    record.reserve(record_bytes);
+    common::append_u64(record, static_cast<uint64_t>(now_ms));
+    common::append_u32(record, msg.header.sender_id);
+    common::append_u32(record, static_cast<uint32_t>(msg.payload.size()));
+    record.insert(record.end(), msg.payload.begin(), msg.payload.end());
+
+    Mailbox& mailbox = *ticket.mailbox;
+    std::unique_lock<std::mutex> lock = wait_turn(ticket);
+    bool stored = false;
+    uint64_t queued = mailbox.bytes;
+    if (queued + record_bytes <= config_.max_bytes_per_recipient &&
+        total_bytes_.load(std::memory_order_relaxed) + record_bytes <= config_.max_total_bytes) {
+        std::string path = path_for(ticket.mailbox_id);
+        std::FILE* file = std::fopen(path.c_str(), "ab");
+        if (!file) {
+            perror("OfflineStore: fopen failed");
+        } else {
+            stored = std::fwrite(record.data(), 1, record.size(), file) == record.size();
+            stored = std::fclose(file) == 0 && stored;
+            if (!stored) {
+                perror("OfflineStore: write failed");
+                std::error_code error;
+                std::filesystem::resize_file(path, queued, error); // No torn record for read() to trip over
+            }
+        }
+    }
+    if (stored) {
+        mailbox.bytes += record_bytes;
+        mailbox.newest_ms = now_ms;
+        total_bytes_ += record_bytes;
+    }
+    finish_turn(mailbox, lock);
+    if (!stored) {
+        std::lock_guard<std::mutex> map_lock(mutex_);
+        forget_if_idle_locked(ticket.mailbox_id); // reserve() may have made it just for this
+    }
+    return stored;
+}
+
+std::shared_ptr<const std::vector<char>> OfflineStore::read(const Ticket& ticket, size_t& count, uint64_t& end) {
+    count = 0;
+    end = 0;
+    if (!ticket.mailbox) return nullptr;
+    Mailbox& mailbox = *ticket.mailbox;
+    std::vector<char> records;
+    {
+        std::unique_lock<std::mutex> lock = wait_turn(ticket);
+        if (mailbox.bytes != 0) {
+            std::ifstream file(path_for(ticket.mailbox_id), std::ios::binary);
+            records.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        end = mailbox.consumed + records.size();
+        finish_turn(mailbox, lock);
+    }
+
+    int64_t cutoff_ms = wall_clock_ms() - config_.max_age_ms;
+    auto frames = std::make_shared<std::vector<char>>();
+    frames->reserve(records.size() + records.size() / 2); // Frame headers are larger than ours
+    size_t offset = 0;
+    while (records.size() - offset >= kRecordHeaderSize) {
+        const char* record = records.data() + offset;
+        int64_t stored_ms = static_cast<int64_t>(common::read_u64(record));
+        uint32_t sender_id = common::read_u32(record + 8);
+        uint32_t size = common::read_u32(record + 12);
+        if (records.size() - offset - kRecordHeaderSize < size) break; // Torn by a crash
+        offset += kRecordHeaderSize + size;
+        if (stored_ms < cutoff_ms) continue;
+
+        common::Message msg;
+        msg.header.type = common::MessageType::TEXT_MESSAGE;
+        msg.header.flags = common::kFlagStored;
+        msg.header.sender_id = sender_id;
+        msg.header.recipient_id = ticket.mailbox_id;
+        msg.header.payload_size = size;
+        msg.payload.assign(record + kRecordHeaderSize, record + kRecordHeaderSize + size);
+        std::vector<char> frame = common::serialize_message(msg);
+        frames->insert(frames->end(), frame.begin(), frame.end());
+        ++count;
+    }
+    if (count == 0) {
+        consume(ticket, end); // Nothing in it young enough to deliver
+        std::lock_guard<std::mutex> lock(mutex_);
+        forget_if_idle_locked(ticket.mailbox_id);
+        return nullptr;
+    }
+    return frames;
+}
+
+void OfflineStore::consume(const Ticket& ticket, uint64_t end) {
+    if (!ticket.mailbox) return;
+    Mailbox& mailbox = *ticket.mailbox;
+    {
+        std::lock_guard<std::mutex> lock(mailbox.mutex);
+        // A mailbox forgotten since is empty, so there is nothing to do either
+        if (end <= mailbox.consumed || mailbox.bytes == 0) return;
+        uint64_t delivered = std::min(end - mailbox.consumed, mailbox.bytes);
+        std::string path = path_for(ticket.mailbox_id);
+        if (delivered < mailbox.bytes) {
+            // Stored since the read: keep those, in a file that replaces this one whole
+            std::vector<char> rest;
+            {
+                std::ifstream file(path, std::ios::binary);
+                file.seekg(static_cast<std::streamoff>(delivered));
+                rest.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            }
+            std::string temporary = path + ".tmp";
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(rest.data(), static_cast<std::streamsize>(rest.size()));
+            file.close();
+            std::error_code error;
+            if (!file || rest.size() != mailbox.bytes - delivered) {
+                std::cerr << "OfflineStore: Cannot rewrite " << path << "; its messages may be delivered again."
+                          << std::endl;
+                std::filesystem::remove(temporary, error);
+                return;
+            }
+            std::filesystem::rename(temporary, path, error);
+            if (error) {
+                std::cerr << "OfflineStore: Cannot replace " << path << ": " << error.message() << std::endl;
+                return;
+            }
+        } else {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+            if (error) {
+                std::cerr << "OfflineStore: Cannot remove " << path << ": " << error.message() << std::endl;
+                return;
+            }
+        }
+        mailbox.consumed += delivered;
+        mailbox.bytes -= delivered;
+        total_bytes_ -= delivered;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    forget_if_idle_locked(ticket.mailbox_id);
+}
+
+void OfflineStore::sweep(int64_t now_ms) {
+    std::vector<std::pair<uint32_t, std::shared_ptr<Mailbox>>> mailboxes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        mailboxes.assign(mailboxes_.begin(), mailboxes_.end());
+    }
+    size_t expired = 0;
+    for (auto& entry : mailboxes) {
+        Mailbox& mailbox = *entry.second;
+        std::lock_guard<std::mutex> lock(mailbox.mutex);
+        if (mailbox.bytes == 0 || now_ms - mailbox.newest_ms <= config_.max_age_ms) continue;
+        std::error_code error;
+        std::filesystem::remove(path_for(entry.first), error);
+        if (error) {
+            std::cerr << "OfflineStore: Cannot remove " << path_for(entry.first) << ": " << error.message() << std::endl;
+            continue;
+        }
+        mailbox.consumed += mailbox.bytes; // Ends read before this are spent too
+        total_bytes_ -= mailbox.bytes;
+        mailbox.bytes = 0;
+        ++expired;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : mailboxes) {
+        forget_if_idle_locked(entry.first);
+    }
+    if (expired != 0) {
+        std::cout << "OfflineStore: Dropped the expired messages of " << expired << " mailboxes." << std::endl;
+    }
+}
+
+void OfflineStore::forget_if_idle_locked(uint32_t mailbox_id) {
+    auto it = mailboxes_.find(mailbox_id);
+    if (it == mailboxes_.end()) return;
+    Mailbox& mailbox = *it->second;
+    // Busy means in use; whoever has it calls this again when done
+    std::unique_lock<std::mutex> lock(mailbox.mutex, std::try_to_lock);
+    if (!lock.owns_lock() || mailbox.bytes != 0 || mailbox.served != mailbox.issued) return;
+    lock.unlock();
+    mailboxes_.erase(it);
+}
+
+} // namespace server
+} // namespace chat_app
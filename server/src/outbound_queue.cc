@@ -0,0 +1,143 @@
+#include "server/outbound_queue.h"
+#include <algorithm>
+#include <iostream>
+
+namespace chat_app {
+namespace server {
+
+namespace {
+constexpr size_t kFlushChunk = 65536; // Blocking writes of spooled bytes, copied this much at a time
+} // namespace
+
+OutboundQueue::OutboundQueue(const OutboundConfig& config, MemoryBudget::Account& memory)
+    : config_(config), memory_(memory), front_offset_(0), memory_bytes_(0) {}
+
+OutboundQueue::~OutboundQueue() {
+    charge(-static_cast<int64_t>(memory_bytes_));
+}
+
+bool OutboundQueue::write(common::ISocket& socket, const std::shared_ptr<const std::vector<char>>& frame) {
+    size_t sent = 0;
+    if (empty()) {
+        int n = socket.try_send(frame->data(), frame->size());
+        if (n < 0) return false;
+        sent = static_cast<size_t>(n);
+        if (sent == frame->size()) return true;
+    }
+    // Once anything is spooled, everything after it is too, so order holds
+    if (spooled_bytes() != 0 || memory_bytes_ + frame->size() > config_.memory_bytes) {
+        return spool(frame->data() + sent, frame->size() - sent);
+    }
+    frames_.push_back(frame);
+    if (sent != 0) front_offset_ = sent; // The queue was empty, so it is the front
+    charge(static_cast<int64_t>(frame->size()));
+    return true;
+}
+
+bool OutboundQueue::write_latest(common::ISocket& socket, const std::shared_ptr<const std::vector<char>>& frame,
+                                 const std::string& slot) {
+    if (empty()) return write(socket, frame); // Partly written frames are no longer anyone's latest
+    auto it = latest_.find(slot);
+    if (it == latest_.end()) {
+        latest_.emplace(slot, frame);
+        latest_order_.push_back(slot);
+    } else {
+        charge(-static_cast<int64_t>(it->second->size())); // Superseded before it was sent
+        it->second = frame;
+    }
+    charge(static_cast<int64_t>(frame->size()));
+    return true;
+}
+
+bool OutboundQueue::drain(common::ISocket& socket) {
+    while (!frames_.empty()) {
+        const std::vector<char>& frame = *frames_.front();
+        int n = socket.try_send(frame.data() + front_offset_, frame.size() - front_offset_);
+        if (n < 0) return false;
+        front_offset_ += static_cast<size_t>(n);
+        if (front_offset_ < frame.size()) return true; // The socket is full again
+        pop_front();
+    }
+    while (spooled_bytes() != 0) {
+        size_t size = 0;
+        const char* data = spool_->peek(size);
+        if (!data) return false;
+        int n = socket.try_send(data, size);
+        if (n < 0) return false;
+        spool_->consume(static_cast<size_t>(n));
+        if (static_cast<size_t>(n) < size) return true;
+    }
+    while (!latest_order_.empty()) {
+        auto it = latest_.find(latest_order_.front());
+        std::shared_ptr<const std::vector<char>> frame = std::move(it->second);
+        latest_.erase(it);
+        latest_order_.pop_front();
+        charge(-static_cast<int64_t>(frame->size()));
+        int n = socket.try_send(frame->data(), frame->size());
+        if (n < 0) return false;
+        if (static_cast<size_t>(n) < frame->size()) { // The rest goes first next time
+            frames_.push_front(frame);
+            front_offset_ = static_cast<size_t>(n);
+            charge(static_cast<int64_t>(frame->size()));
+            return true;
+        }
+    }
+    return true;
+}
+
+bool OutboundQueue::flush(common::ISocket& socket) {
+    while (!frames_.empty()) {
+        const std::vector<char>& frame = *frames_.front();
+        if (socket.send_data(std::vector<char>(frame.begin() + static_cast<std::ptrdiff_t>(front_offset_), frame.end())) < 0) {
+            return false;
+        }
+        pop_front();
+    }
+    while (spooled_bytes() != 0) {
+        size_t size = 0;
+        const char* data = spool_->peek(size);
+        if (!data) return false;
+        size = std::min(size, kFlushChunk);
+        if (socket.send_data(std::vector<char>(data, data + size)) < 0) return false;
+        spool_->consume(size);
+    }
+    bool sent = true;
+    for (const std::string& slot : latest_order_) {
+        const std::vector<char>& frame = *latest_[slot];
+        charge(-static_cast<int64_t>(frame.size()));
+        if (sent && socket.send_data(frame) < 0) sent = false;
+    }
+    latest_.clear();
+    latest_order_.clear();
+    return sent;
+}
+
+bool OutboundQueue::spool(const char* data, size_t size) {
+    if (!spool_) {
+        spool_ = common::SpoolFile::create(config_.spool_directory);
+        if (!spool_) {
+            std::cerr << "OutboundQueue: Cannot create a spool in " << config_.spool_directory << "." << std::endl;
+            return false;
+        }
+    }
+    if (spool_->pending() + size > config_.max_spool_bytes) {
+        std::cerr << "OutboundQueue: Spool full at " << spool_->pending() << " bytes." << std::endl;
+        return false;
+    }
+    return spool_->append(data, size);
+}
+
+void OutboundQueue::pop_front() {
+    size_t size = frames_.front()->size();
+    frames_.pop_front();
+    front_offset_ = 0;
+    charge(-static_cast<int64_t>(size));
+}
+
+void OutboundQueue::charge(int64_t bytes) {
+    memory_bytes_ = static_cast<size_t>(static_cast<int64_t>(memory_bytes_) + bytes);
+    memory_.charge(MemoryUse::OUTBOUND, bytes);
+}
+
+} // namespace server
+} // namespace chat_app
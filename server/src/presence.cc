@@ -0,0 +1,93 @@
+#include "server/presence.h"
+#include "server/server.h"
+#include "common/message_serialization.h"
+#include <chrono>
+
+namespace chat_app {
+namespace server {
+
+PresenceAggregator::PresenceAggregator(const PresenceConfig& config, Server& server)
+    : config_(config), server_(server), running_(false) {}
+
+PresenceAggregator::~PresenceAggregator() {
+    stop();
+}
+
+void PresenceAggregator::start() {
+    if (running_) return;
+    running_ = true;
+    thread_ = std::thread(&PresenceAggregator::run, this);
+}
+
+void PresenceAggregator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void PresenceAggregator::joined(uint32_t client_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        joined_.insert(client_id);
+    }
+    cv_.notify_one();
+}
+
+void PresenceAggregator::left(uint32_t client_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (joined_.erase(client_id) != 0) return; // Came and went within one window
+        left_.insert(client_id);
+    }
+    cv_.notify_one();
+}
+
+void PresenceAggregator::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        cv_.wait(lock, [this] { return !running_ || !joined_.empty() || !left_.empty(); });
+        if (running_) {
+            // Let the rest of the burst arrive
+            cv_.wait_for(lock, std::chrono::milliseconds(config_.window_ms), [this] { return !running_; });
+        }
+        std::unordered_set<uint32_t> joined;
+        std::unordered_set<uint32_t> left;
+        joined.swap(joined_);
+        left.swap(left_);
+        lock.unlock();
+        flush(std::move(joined), std::move(left));
+        lock.lock();
+    }
+}
+
+void PresenceAggregator::flush(std::unordered_set<uint32_t> joined, std::unordered_set<uint32_t> left) {
+    if (joined.empty() && left.empty()) return;
+    size_t members = server_.member_count(kLobbyRoomId);
+    if (config_.suppress_above_members > 0 && members > config_.suppress_above_members) return;
+
+    bool truncated = joined.size() + left.size() > config_.max_ids_per_digest;
+    common::Message digest(common::MessageType::PRESENCE_DIGEST, 0, 0, "");
+    auto& payload = digest.payload;
+    payload.reserve(13 + (truncated ? 0 : 4 * (joined.size() + left.size())));
+    payload.push_back(static_cast<char>(truncated ? common::kPresenceTruncated : 0));
+    common::append_u32(payload, static_cast<uint32_t>(members));
+    for (const auto* ids : {&joined, &left}) {
+        common::append_u32(payload, static_cast<uint32_t>(ids->size()));
+        if (truncated) continue;
+        for (uint32_t id : *ids) {
+            common::append_u32(payload, id);
+        }
+    }
+    digest.header.payload_size = static_cast<uint32_t>(payload.size());
+
+    server_.broadcast_message(digest);
+    server_.federation().relay(digest, kLobbyRoomId);
+}
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,204 @@
+#include "server/rate_limiter.h"
+#include <algorithm> // For std::max, std::min
+#include <cmath>     // For std::ceil
+#include <iostream>
+
+namespace chat_app {
+namespace server {
+
+bool parse_throttle_action(const std::string& name, ThrottleAction& action) {
+    if (name == "delay") {
+        action = ThrottleAction::DELAY;
+    } else if (name == "drop") {
+        action = ThrottleAction::DROP;
+    } else if (name == "disconnect") {
+        action = ThrottleAction::DISCONNECT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* throttle_action_name(ThrottleAction action) {
+    switch (action) {
+        case ThrottleAction::DELAY: return "delay";
+        case ThrottleAction::DROP: return "drop";
+        case ThrottleAction::DISCONNECT: return "disconnect";
+    }
+    return "unknown";
+}
+
+// --- TokenBucket ---
+
+void TokenBucket::refill(int64_t now_ms) {
+    if (now_ms > last_ms_) {
+        tokens_ = std::min(burst_, tokens_ + static_cast<double>(now_ms - last_ms_) * rate_ / 1000.0);
+        last_ms_ = now_ms;
+    }
+}
+
+bool TokenBucket::try_consume(double cost, int64_t now_ms) {
+    if (rate_ <= 0) return true; // Unlimited
+    refill(now_ms);
+    if (tokens_ < cost) return false;
+    tokens_ -= cost;
+    return true;
+}
+
+int64_t TokenBucket::consume_with_debt(double cost, int64_t now_ms) {
+    if (rate_ <= 0) return 0;
+    refill(now_ms);
+    tokens_ -= cost;
+    if (tokens_ >= 0) return 0;
+    return static_cast<int64_t>(std::ceil(-tokens_ * 1000.0 / rate_));
+}
+
+// --- RateLimiter ---
+
+RateLimiter::RateLimiter(const RateLimitConfig& config, const common::CoarseClock& clock)
+    : config_(config), clock_(clock) {}
+
+RateLimiter::ConnectionState RateLimiter::make_connection_state() const {
+    ConnectionState state;
+    int64_t now = clock_.now_ms();
+    state.messages = TokenBucket(config_.messages_per_sec, config_.message_burst, now);
+    state.bytes = TokenBucket(config_.bytes_per_sec, config_.byte_burst, now);
+    return state;
+}
+
+RateLimiter::RoomBudget& RateLimiter::room_budget(uint32_t room_id, int64_t now_ms) {
+    auto it = rooms_.find(room_id);
+    if (it == rooms_.end()) {
+        RoomBudget budget;
+        budget.messages = TokenBucket(config_.room_messages_per_sec, config_.room_message_burst, now_ms);
+        budget.bytes = TokenBucket(config_.room_bytes_per_sec, config_.room_byte_burst, now_ms);
+        it = rooms_.emplace(room_id, budget).first;
+    }
+    return it->second;
+}
+
+RateDecision RateLimiter::admit(uint32_t client_id, ConnectionState& state, bool fanned_out, uint32_t room_id,
+                                size_t bytes, int64_t& delay_ms) {
+    const int64_t now = clock_.now_ms();
+    const double cost = static_cast<double>(bytes);
+    delay_ms = 0;
+
+    if (config_.action == ThrottleAction::DELAY) {
+        int64_t wait = std::max(state.messages.consume_with_debt(1, now), state.bytes.consume_with_debt(cost, now));
+        int64_t room_wait = 0;
+        if (fanned_out) {
+            std::lock_guard<std::mutex> lock(rooms_mutex_);
+            RoomBudget& room = room_budget(room_id, now);
+            room_wait = std::max(room.messages.consume_with_debt(1, now), room.bytes.consume_with_debt(cost, now));
+            if (std::max(wait, room_wait) > config_.max_delay_ms) {
+                room.messages.refund(1);
+                room.bytes.refund(cost);
+            }
+        }
+        int64_t total_wait = std::max(wait, room_wait);
+        if (total_wait <= 0) return RateDecision::ALLOW;
+        if (total_wait > config_.max_delay_ms) {
+            // Too far behind to catch up by waiting; don't let the debt keep growing
+            state.messages.refund(1);
+            state.bytes.refund(cost);
+            count(client_id, RateDecision::DROP, room_wait > wait);
+            return RateDecision::DROP;
+        }
+        delay_ms = total_wait;
+        count(client_id, RateDecision::DELAY, room_wait > wait);
+        return RateDecision::DELAY;
+    }
+
+    if (!state.messages.try_consume(1, now)) {
+        return throttle(client_id, false);
+    }
+    if (!state.bytes.try_consume(cost, now)) {
+        state.messages.refund(1);
+        return throttle(client_id, false);
+    }
+    if (fanned_out) {
+        std::lock_guard<std::mutex> lock(rooms_mutex_);
+        RoomBudget& room = room_budget(room_id, now);
+        bool room_ok = room.messages.try_consume(1, now);
+        if (room_ok && !room.bytes.try_consume(cost, now)) {
+            room.messages.refund(1);
+            room_ok = false;
+        }
+        if (!room_ok) {
+            state.messages.refund(1);
+            state.bytes.refund(cost);
+            return throttle(client_id, true);
+        }
+    }
+    return RateDecision::ALLOW;
+}
+
+RateDecision RateLimiter::throttle(uint32_t client_id, bool room_limited) {
+    // A busy room is not this sender's fault alone; never disconnect for it
+    RateDecision decision = (config_.action == ThrottleAction::DISCONNECT && !room_limited)
+        ? RateDecision::DISCONNECT
+        : RateDecision::DROP;
+    count(client_id, decision, room_limited);
+    return decision;
+}
+
+bool RateLimiter::should_reply_with_error(ConnectionState& state) {
+    int64_t now = clock_.now_ms();
+    if (now - state.last_error_reply_ms < 1000) return false;
+    state.last_error_reply_ms = now;
+    return true;
+}
+
+void RateLimiter::count(uint32_t client_id, RateDecision decision, bool room_limited) {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    ThrottleCounters& counters = counters_[client_id];
+    counters.client_id = client_id;
+    switch (decision) {
+        case RateDecision::DELAY: ++counters.delayed; break;
+        case RateDecision::DROP: ++counters.dropped; break;
+        case RateDecision::DISCONNECT: ++counters.disconnected; break;
+        case RateDecision::ALLOW: break;
+    }
+    if (room_limited) ++counters.room_limited;
+    recently_throttled_.insert(client_id);
+}
+
+std::vector<ThrottleCounters> RateLimiter::snapshot() const {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    std::vector<ThrottleCounters> result;
+    result.reserve(counters_.size());
+    for (const auto& entry : counters_) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+namespace {
+void log_counters(const char* prefix, const ThrottleCounters& c) {
+    std::cout << prefix << "client " << c.client_id << " delayed=" << c.delayed << " dropped=" << c.dropped
+              << " disconnected=" << c.disconnected << " room_limited=" << c.room_limited << std::endl;
+}
+} // namespace
+
+void RateLimiter::log_throttled_clients() {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    for (uint32_t client_id : recently_throttled_) {
+        auto it = counters_.find(client_id);
+        if (it != counters_.end()) {
+            log_counters("RateLimiter: Throttled ", it->second);
+        }
+    }
+    recently_throttled_.clear();
+}
+
+void RateLimiter::forget_client(uint32_t client_id) {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    auto it = counters_.find(client_id);
+    if (it == counters_.end()) return;
+    log_counters("RateLimiter: Final counts for ", it->second);
+    counters_.erase(it);
+    recently_throttled_.erase(client_id);
+}
+
+} // namespace server
+} // namespace chat_app
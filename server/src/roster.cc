@@ -0,0 +1,98 @@
+#include "server/roster.h"
+#include "common/message.h"
+#include "common/message_serialization.h"
+#include <map>
+#include <random>
+
+namespace chat_app {
+namespace server {
+
+namespace {
+
+std::shared_ptr<const std::vector<char>> make_frame(common::MessageType type, std::vector<char> payload) {
+    common::Message msg(type, 0, 0, "");
+    msg.payload = std::move(payload);
+    msg.header.payload_size = static_cast<uint32_t>(msg.payload.size());
+    return std::make_shared<const std::vector<char>>(common::serialize_message(msg));
+}
+
+} // namespace
+
+Roster::Roster(size_t max_log_entries)
+    : max_log_entries_(max_log_entries), epoch_(std::random_device{}()), version_(1), snapshot_version_(0) {}
+
+void Roster::add(uint32_t client_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (members_.insert(client_id).second) record(client_id, true);
+}
+
+void Roster::remove(uint32_t client_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (members_.erase(client_id) != 0) record(client_id, false);
+}
+
+void Roster::record(uint32_t client_id, bool added) {
+    if (++version_ == 0) version_ = 1; // 0 is reserved for "nothing known"
+    log_.push_back(Change{version_, client_id, added});
+    if (log_.size() > max_log_entries_) log_.pop_front();
+}
+
+size_t Roster::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return members_.size();
+}
+
+std::shared_ptr<const std::vector<char>> Roster::snapshot() {
+    if (snapshot_ && snapshot_version_ == version_) return snapshot_;
+    std::vector<char> payload;
+    payload.reserve(12 + 4 * members_.size());
+    common::append_u32(payload, epoch_);
+    common::append_u32(payload, version_);
+    common::append_u32(payload, static_cast<uint32_t>(members_.size()));
+    for (uint32_t id : members_) {
+        common::append_u32(payload, id);
+    }
+    snapshot_ = make_frame(common::MessageType::ROSTER_SNAPSHOT, std::move(payload));
+    snapshot_version_ = version_;
+    return snapshot_;
+}
+
+std::shared_ptr<const std::vector<char>> Roster::reply(uint32_t epoch, uint32_t version) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The log covers versions from log_.front().version - 1 onwards
+    bool in_log = version == version_ || (!log_.empty() && version + 1 >= log_.front().version && version < version_);
+    if (epoch != epoch_ || version == 0 || !in_log) {
+        return snapshot();
+    }
+
+    // Net effect per client: a join and a leave since `version` cancel out
+    std::map<uint32_t, int> net;
+    for (auto it = log_.rbegin(); it != log_.rend() && it->version > version; ++it) {
+        net[it->client_id] += it->added ? 1 : -1;
+    }
+    std::vector<uint32_t> added;
+    std::vector<uint32_t> removed;
+    for (const auto& entry : net) {
+        if (entry.second > 0) added.push_back(entry.first);
+        if (entry.second < 0) removed.push_back(entry.first);
+    }
+    if (added.size() + removed.size() >= members_.size()) {
+        return snapshot(); // No smaller than the full list
+    }
+
+    std::vector<char> payload;
+    payload.reserve(20 + 4 * (added.size() + removed.size()));
+    common::append_u32(payload, epoch_);
+    common::append_u32(payload, version);
+    common::append_u32(payload, version_);
+    for (const auto* ids : {&added, &removed}) {
+        common::append_u32(payload, static_cast<uint32_t>(ids->size()));
+        for (uint32_t id : *ids) {
+            common::append_u32(payload, id);
+        }
+    }
+    return make_frame(common::MessageType::ROSTER_DELTA, std::move(payload));
+}
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,677 @@
+#include "server/search_index.h"
+#include "common/message_serialization.h"
+#include <algorithm>
+#include <cstdio>  // For perror, snprintf
+#include <cstring> // For memcpy, memcmp
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace chat_app {
+namespace server {
+
+namespace {
+
+constexpr size_t kMaxTermBytes = 64;  // Longer words are indexed by their first 64 bytes
+constexpr size_t kMaxQueryTerms = 16;
+constexpr char kSegmentMagic[8] = {'C', 'H', 'A', 'T', 'S', 'I', 'X', '1'};
+constexpr int64_t kKeyOverhead = 64; // Rough cost of a live segment's map entry
+
+// Segment file layout, host byte order: the header, then these tables and
+// blobs at the offsets it gives.
+struct SegmentHeader {
+    char magic[8];
+    uint64_t base_id;         // Id of the segment's first message
+    uint64_t doc_count;
+    uint64_t term_count;
+    uint64_t docs_offset;     // DocRecord[doc_count], by id
+    uint64_t terms_offset;    // TermRecord[term_count], by key
+    uint64_t keys_offset;     // Key bytes
+    uint64_t postings_offset; // Posting list bytes
+    uint64_t text_offset;     // Message text
+    uint64_t file_size;
+};
+
+struct DocRecord {
+    uint64_t text_offset; // Into the text blob
+    uint32_t room_id;
+    uint32_t sequence;
+    uint32_t sender_id;
+    uint32_t size;
+};
+
+struct TermRecord {
+    uint64_t key_offset;
+    uint64_t postings_offset;
+    uint32_t key_size;
+    uint32_t postings_size;
+};
+
+bool is_term_byte(unsigned char c) {
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Terms of [data, data + size) in order; a term's position is its index.
+void tokenize(const char* data, size_t size, std::vector<std::string>& terms) {
+    size_t i = 0;
+    while (i < size) {
+        while (i < size && !is_term_byte(static_cast<unsigned char>(data[i]))) ++i;
+        if (i == size) break;
+        std::string term;
+        for (; i < size && is_term_byte(static_cast<unsigned char>(data[i])); ++i) {
+            if (term.size() == kMaxTermBytes) continue;
+            char c = data[i];
+            term.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+        }
+        terms.push_back(std::move(term));
+    }
+}
+
+// Room first, big-endian, so a room's terms sort together
+std::string posting_key(uint32_t room_id, const std::string& term) {
+    std::string key(4, '\0');
+    key[0] = static_cast<char>(room_id >> 24);
+    key[1] = static_cast<char>(room_id >> 16);
+    key[2] = static_cast<char>(room_id >> 8);
+    key[3] = static_cast<char>(room_id);
+    return key + term;
+}
+
+void append_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool read_varint(const char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+// A posting list, decoded: docs[i] holds the term at positions[offsets[i] .. offsets[i + 1]).
+struct PostingList {
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> positions;
+};
+
+// Each entry: varint doc (the first absolute, then the gap from the one before),
+// varint position count, varint positions (the first absolute, then gaps).
+// Docs must be below doc_count.
+bool decode_postings(const char* p, size_t size, size_t doc_count, PostingList& list) {
+    const char* end = p + size;
+    uint64_t doc = 0;
+    while (p < end) {
+        uint64_t delta = 0;
+        uint64_t count = 0;
+        if (!read_varint(p, end, delta) || !read_varint(p, end, count) || count > static_cast<uint64_t>(end - p)) {
+            return false;
+        }
+        doc = list.docs.empty() ? delta : doc + delta;
+        if (doc >= doc_count || doc < delta) return false; // Out of the segment, or wrapped around
+        list.docs.push_back(static_cast<uint32_t>(doc));
+        list.offsets.push_back(static_cast<uint32_t>(list.positions.size()));
+        uint64_t position = 0;
+        for (uint64_t k = 0; k < count; ++k) {
+            if (!read_varint(p, end, delta)) return false;
+            position = k == 0 ? delta : position + delta;
+            list.positions.push_back(static_cast<uint32_t>(position));
+        }
+    }
+    list.offsets.push_back(static_cast<uint32_t>(list.positions.size()));
+    return true;
+}
+
+// All phrases must occur; a word outside quotes is a phrase of one.
+struct Query {
+    std::vector<std::string> terms;          // Distinct
+    std::vector<std::vector<size_t>> phrases; // Indexes into terms
+};
+
+bool parse_query(const std::string& text, Query& query) {
+    bool quoted = false;
+    size_t start = 0;
+    auto add_words = [&](size_t begin, size_t end, bool phrase) {
+        std::vector<std::string> words;
+        tokenize(text.data() + begin, end - begin, words);
+        std::vector<size_t> indexes;
+        for (std::string& word : words) {
+            auto it = std::find(query.terms.begin(), query.terms.end(), word);
+            indexes.push_back(static_cast<size_t>(it - query.terms.begin()));
+            if (it == query.terms.end()) query.terms.push_back(std::move(word));
+            if (!phrase) query.phrases.push_back({indexes.back()});
+        }
+        if (phrase && !indexes.empty()) query.phrases.push_back(std::move(indexes));
+    };
+    for (size_t i = 0; i <= text.size(); ++i) {
+        if (i < text.size() && text[i] != '"') continue;
+        add_words(start, i, quoted);
+        quoted = !quoted;
+        start = i + 1;
+    }
+    return !query.terms.empty() && query.terms.size() <= kMaxQueryTerms;
+}
+
+bool has_position(const PostingList& list, size_t entry, uint32_t position) {
+    auto begin = list.positions.begin() + list.offsets[entry];
+    auto end = list.positions.begin() + list.offsets[entry + 1];
+    return std::binary_search(begin, end, position);
+}
+
+} // namespace
+
+// Messages with consecutive ids, their text and their posting lists.
+class SearchIndex::Segment {
+public:
+    explicit Segment(uint64_t base_id) : base_id_(base_id) {}
+    virtual ~Segment() = default;
+
+    uint64_t base_id() const { return base_id_; }
+    virtual size_t doc_count() const = 0;
+    // False if no message here has the key's term
+    virtual bool postings(const std::string& key, const char*& data, size_t& size) const = 0;
+    virtual DocRecord doc(size_t index, const char*& text) const = 0;
+
+    // Appends the hits with ids below `before`, newest first, until there are limit.
+    void search(uint32_t room_id, const Query& query, uint64_t before, size_t limit,
+                std::vector<SearchIndex::Hit>& hits) const {
+        if (base_id_ >= before || doc_count() == 0) return;
+        std::vector<PostingList> lists(query.terms.size());
+        for (size_t t = 0; t < query.terms.size(); ++t) {
+            const char* data = nullptr;
+            size_t size = 0;
+            if (!postings(posting_key(room_id, query.terms[t]), data, size)) return; // Some term is missing
+            if (!decode_postings(data, size, doc_count(), lists[t])) {
+                std::cerr << "SearchIndex: Corrupt posting list in the segment at id " << base_id_ << "." << std::endl;
+                return;
+            }
+        }
+        // Walk the rarest term's messages newest first; look the rest up
+        size_t rarest = 0;
+        for (size_t t = 1; t < lists.size(); ++t) {
+            if (lists[t].docs.size() < lists[rarest].docs.size()) rarest = t;
+        }
+        std::vector<size_t> entry(lists.size());
+        for (size_t i = lists[rarest].docs.size(); i-- > 0 && hits.size() < limit;) {
+            uint32_t doc = lists[rarest].docs[i];
+            if (base_id_ + doc >= before) continue;
+            bool all = true;
+            for (size_t t = 0; t < lists.size() && all; ++t) {
+                auto it = std::lower_bound(lists[t].docs.begin(), lists[t].docs.end(), doc);
+                all = it != lists[t].docs.end() && *it == doc;
+                entry[t] = static_cast<size_t>(it - lists[t].docs.begin());
+            }
+            for (size_t p = 0; p < query.phrases.size() && all; ++p) {
+                all = phrase_at(lists, entry, query.phrases[p]);
+            }
+            if (!all) continue;
+            const char* text = nullptr;
+            DocRecord record = this->doc(doc, text);
+            hits.push_back({base_id_ + doc, record.sequence, record.sender_id, std::string(text, record.size)});
+        }
+    }
+
+private:
+    static bool phrase_at(const std::vector<PostingList>& lists, const std::vector<size_t>& entry,
+                          const std::vector<size_t>& phrase) {
+        const PostingList& first = lists[phrase[0]];
+        for (uint32_t k = first.offsets[entry[phrase[0]]]; k < first.offsets[entry[phrase[0]] + 1]; ++k) {
+            uint32_t start = first.positions[k];
+            bool follows = true;
+            for (size_t w = 1; w < phrase.size() && follows; ++w) {
+                follows = has_position(lists[phrase[w]], entry[phrase[w]], start + static_cast<uint32_t>(w));
+            }
+            if (follows) return true;
+        }
+        return false;
+    }
+
+    uint64_t base_id_;
+};
+
+// The segment new messages go into. Only read once sealed, except under the
+// index's mutex.
+class SearchIndex::LiveSegment : public SearchIndex::Segment {
+public:
+    LiveSegment(uint64_t base_id, MemoryBudget* memory) : Segment(base_id), memory_(memory), charged_(0) {}
+    ~LiveSegment() override { charge(-charged_); }
+
+    void add(uint32_t room_id, const common::Message& msg) {
+        const uint32_t doc = static_cast<uint32_t>(docs_.size());
+        std::vector<std::string> terms;
+        tokenize(msg.payload.data(), msg.payload.size(), terms);
+        std::map<std::string, std::vector<uint32_t>> positions; // Ordered positions per distinct term
+        for (size_t i = 0; i < terms.size(); ++i) {
+            positions[terms[i]].push_back(static_cast<uint32_t>(i));
+        }
+        int64_t added = static_cast<int64_t>(msg.payload.size() + sizeof(DocRecord));
+        for (const auto& term : positions) {
+            auto inserted = postings_.try_emplace(posting_key(room_id, term.first));
+            Postings& list = inserted.first->second;
+            if (inserted.second) added += static_cast<int64_t>(inserted.first->first.size()) + kKeyOverhead;
+            size_t before = list.bytes.size();
+            append_varint(list.bytes, list.bytes.empty() ? doc : doc - list.last_doc);
+            append_varint(list.bytes, term.second.size());
+            for (size_t k = 0; k < term.second.size(); ++k) {
+                append_varint(list.bytes, k == 0 ? term.second[k] : term.second[k] - term.second[k - 1]);
+            }
+            list.last_doc = doc;
+            added += static_cast<int64_t>(list.bytes.size() - before);
+        }
+        DocRecord record{};
+        record.text_offset = text_.size();
+        record.room_id = room_id;
+        record.sequence = msg.header.sequence;
+        record.sender_id = msg.header.sender_id;
+        record.size = static_cast<uint32_t>(msg.payload.size());
+        docs_.push_back(record);
+        text_.insert(text_.end(), msg.payload.begin(), msg.payload.end());
+        charge(added);
+    }
+
+    size_t doc_count() const override { return docs_.size(); }
+    size_t text_bytes() const { return text_.size(); }
+
+    bool postings(const std::string& key, const char*& data, size_t& size) const override {
+        auto it = postings_.find(key);
+        if (it == postings_.end()) return false;
+        data = it->second.bytes.data();
+        size = it->second.bytes.size();
+        return true;
+    }
+
+    DocRecord doc(size_t index, const char*& text) const override {
+        text = text_.data() + docs_[index].text_offset;
+        return docs_[index];
+    }
+
+    // Writes the segment file, through a temporary file so a crash never
+    // leaves half of one at path.
+    bool write(const std::string& path) const {
+        std::vector<const std::pair<const std::string, Postings>*> sorted;
+        sorted.reserve(postings_.size());
+        for (const auto& entry : postings_) sorted.push_back(&entry);
+        std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+        SegmentHeader header{};
+        std::memcpy(header.magic, kSegmentMagic, sizeof(header.magic));
+        header.base_id = base_id();
+        header.doc_count = docs_.size();
+        header.term_count = sorted.size();
+        std::vector<TermRecord> terms;
+        terms.reserve(sorted.size());
+        uint64_t keys_size = 0;
+        uint64_t postings_size = 0;
+        for (const auto* entry : sorted) {
+            TermRecord term{};
+            term.key_offset = keys_size;
+            term.key_size = static_cast<uint32_t>(entry->first.size());
+            term.postings_offset = postings_size;
+            term.postings_size = static_cast<uint32_t>(entry->second.bytes.size());
+            keys_size += term.key_size;
+            postings_size += term.postings_size;
+            terms.push_back(term);
+        }
+        header.docs_offset = sizeof(SegmentHeader);
+        header.terms_offset = header.docs_offset + docs_.size() * sizeof(DocRecord);
+        header.keys_offset = header.terms_offset + terms.size() * sizeof(TermRecord);
+        header.postings_offset = header.keys_offset + keys_size;
+        header.text_offset = header.postings_offset + postings_size;
+        header.file_size = header.text_offset + text_.size();
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(docs_.data()), static_cast<std::streamsize>(docs_.size() * sizeof(DocRecord)));
+            file.write(reinterpret_cast<const char*>(terms.data()), static_cast<std::streamsize>(terms.size() * sizeof(TermRecord)));
+            for (const auto* entry : sorted) file.write(entry->first.data(), static_cast<std::streamsize>(entry->first.size()));
+            for (const auto* entry : sorted) {
+                file.write(entry->second.bytes.data(), static_cast<std::streamsize>(entry->second.bytes.size()));
+            }
+            file.write(text_.data(), static_cast<std::streamsize>(text_.size()));
+            file.flush();
+            if (!file) {
+                std::cerr << "SearchIndex: Cannot write " << temporary << "." << std::endl;
+                std::error_code ignored;
+                std::filesystem::remove(temporary, ignored);
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            std::cerr << "SearchIndex: Cannot rename " << temporary << ": " << error.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Postings {
+        std::string bytes;
+        uint32_t last_doc = 0;
+    };
+
+    void charge(int64_t bytes) {
+        charged_ += bytes;
+        if (memory_) memory_->charge(MemoryUse::HISTORY, bytes);
+    }
+
+    MemoryBudget* memory_;
+    int64_t charged_;
+    std::vector<DocRecord> docs_;
+    std::vector<char> text_;
+    std::unordered_map<std::string, Postings> postings_; // By posting_key
+};
+
+namespace {
+
+// A segment file, mapped read-only.
+class MappedSegment : public SearchIndex::Segment {
+public:
+    // Null if the file cannot be mapped or is not a segment (or mapping is
+    // not supported here).
+    static std::shared_ptr<const MappedSegment> open(const std::string& path);
+    ~MappedSegment() override;
+
+    size_t doc_count() const override { return static_cast<size_t>(header_.doc_count); }
+
+    bool postings(const std::string& key, const char*& data, size_t& size) const override {
+        // Binary search of the term table, comparing key bytes
+        size_t low = 0;
+        size_t high = static_cast<size_t>(header_.term_count);
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            TermRecord term = term_record(middle);
+            const char* term_key = base_ + header_.keys_offset + term.key_offset;
+            int order = std::memcmp(term_key, key.data(), std::min<size_t>(term.key_size, key.size()));
+            if (order == 0) order = term.key_size < key.size() ? -1 : (term.key_size > key.size() ? 1 : 0);
+            if (order == 0) {
+                data = base_ + header_.postings_offset + term.postings_offset;
+                size = term.postings_size;
+                return true;
+            }
+            if (order < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return false;
+    }
+
+    DocRecord doc(size_t index, const char*& text) const override {
+        DocRecord record;
+        std::memcpy(&record, base_ + header_.docs_offset + index * sizeof(DocRecord), sizeof(record));
+        text = base_ + header_.text_offset + record.text_offset;
+        return record;
+    }
+
+private:
+    MappedSegment(const SegmentHeader& header, const char* base, size_t size)
+        : Segment(header.base_id), header_(header), base_(base), size_(size) {}
+
+    // Every term's key and posting list and every message's text lie within
+    // their sections, so lookups need no checks of their own.
+    bool records_valid() const {
+        uint64_t keys_size = header_.postings_offset - header_.keys_offset;
+        uint64_t postings_size = header_.text_offset - header_.postings_offset;
+        uint64_t text_size = size_ - header_.text_offset;
+        for (size_t i = 0; i < header_.term_count; ++i) {
+            TermRecord term = term_record(i);
+            if (term.key_offset > keys_size || term.key_size > keys_size - term.key_offset ||
+                term.postings_offset > postings_size || term.postings_size > postings_size - term.postings_offset) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < header_.doc_count; ++i) {
+            DocRecord record;
+            std::memcpy(&record, base_ + header_.docs_offset + i * sizeof(DocRecord), sizeof(record));
+            if (record.text_offset > text_size || record.size > text_size - record.text_offset) return false;
+        }
+        return true;
+    }
+
+    TermRecord term_record(size_t index) const {
+        TermRecord term;
+        std::memcpy(&term, base_ + header_.terms_offset + index * sizeof(TermRecord), sizeof(term));
+        return term;
+    }
+
+    SegmentHeader header_;
+    const char* base_;
+    size_t size_;
+};
+
+#ifndef _WIN32
+
+std::shared_ptr<const MappedSegment> MappedSegment::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        perror(("SearchIndex: Cannot open " + path).c_str());
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SegmentHeader)) {
+        std::cerr << "SearchIndex: " << path << " is not a segment." << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file
+    if (mapped == MAP_FAILED) {
+        perror("SearchIndex: mmap failed");
+        return nullptr;
+    }
+    const char* base = static_cast<const char*>(mapped);
+    SegmentHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    // Offsets and counts are bounded by the size first, so the sums cannot overflow
+    bool valid = std::memcmp(header.magic, kSegmentMagic, sizeof(header.magic)) == 0 && header.file_size == size &&
+                 header.docs_offset <= size && header.terms_offset <= size && header.keys_offset <= size &&
+                 header.doc_count <= size / sizeof(DocRecord) && header.term_count <= size / sizeof(TermRecord) &&
+                 header.docs_offset + header.doc_count * sizeof(DocRecord) <= header.terms_offset &&
+                 header.terms_offset + header.term_count * sizeof(TermRecord) <= header.keys_offset &&
+                 header.keys_offset <= header.postings_offset && header.postings_offset <= header.text_offset &&
+                 header.text_offset <= size;
+    std::shared_ptr<const MappedSegment> segment;
+    if (valid) {
+        segment.reset(new MappedSegment(header, base, size)); // Unmaps the file again if it is rejected
+        valid = segment->records_valid();
+    } else {
+        munmap(mapped, size);
+    }
+    if (!valid) {
+        std::cerr << "SearchIndex: " << path << " is not a segment." << std::endl;
+        return nullptr;
+    }
+    return segment;
+}
+
+MappedSegment::~MappedSegment() {
+    munmap(const_cast<char*>(base_), size_);
+}
+
+#else // _WIN32: segments are written but not mapped, so only this run's messages are searched
+
+std::shared_ptr<const MappedSegment> MappedSegment::open(const std::string& path) {
+    (void)path;
+    return nullptr;
+}
+
+MappedSegment::~MappedSegment() {}
+
+#endif
+
+std::string segment_path(const std::string& directory, uint64_t base_id) {
+    char name[48];
+    std::snprintf(name, sizeof(name), "segment-%016llx.idx", static_cast<unsigned long long>(base_id));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+} // namespace
+
+SearchIndex::SearchIndex(const SearchConfig& config, MemoryBudget* memory)
+    : config_(config), memory_(memory), running_(false), next_id_(1) {}
+
+SearchIndex::~SearchIndex() {
+    stop();
+}
+
+void SearchIndex::start() {
+    if (!enabled()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return;
+    load_segments();
+    running_ = true;
+    writer_ = std::thread(&SearchIndex::write_segments, this);
+}
+
+void SearchIndex::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        seal_locked();
+        running_ = false;
+    }
+    sealed_cv_.notify_all();
+    writer_.join();
+}
+
+void SearchIndex::load_segments() {
+    std::error_code error;
+    std::filesystem::create_directories(config_.directory, error);
+    segments_.clear();
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(config_.directory, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("segment-", 0) == 0 && name.size() > 4 && name.compare(name.size() - 4, 4, ".idx") == 0) {
+            paths.push_back(entry.path().string());
+        }
+    }
+    if (error) {
+        std::cerr << "SearchIndex: Cannot read " << config_.directory << ": " << error.message() << std::endl;
+    }
+    std::sort(paths.begin(), paths.end()); // Fixed-width hex names: by base id
+    size_t messages = 0;
+    for (const std::string& path : paths) {
+        auto segment = MappedSegment::open(path);
+        if (!segment) continue;
+        messages += segment->doc_count();
+        next_id_ = std::max<uint64_t>(next_id_, segment->base_id() + segment->doc_count());
+        segments_.push_back(std::move(segment));
+    }
+    std::cout << "SearchIndex: Opened " << segments_.size() << " segments with " << messages << " messages in "
+              << config_.directory << "." << std::endl;
+}
+
+void SearchIndex::add(uint32_t room_id, const common::Message& msg) {
+    if (!enabled()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    if (!live_) live_ = std::make_shared<LiveSegment>(next_id_, memory_);
+    live_->add(room_id, msg);
+    ++next_id_;
+    if (live_->doc_count() >= config_.segment_messages || live_->text_bytes() >= config_.segment_bytes) {
+        seal_locked();
+    }
+}
+
+void SearchIndex::seal_locked() {
+    if (!live_ || live_->doc_count() == 0) return;
+    segments_.push_back(live_); // Searched from memory until the writer has mapped its file
+    unwritten_.push_back(std::move(live_));
+    live_.reset();
+    sealed_cv_.notify_one();
+}
+
+void SearchIndex::write_segments() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        sealed_cv_.wait(lock, [this] { return !running_ || !unwritten_.empty(); });
+        if (unwritten_.empty()) break; // Stopping, and everything sealed is written
+        std::shared_ptr<LiveSegment> sealed = unwritten_.front();
+        lock.unlock();
+        std::string path = segment_path(config_.directory, sealed->base_id());
+        std::shared_ptr<const Segment> mapped;
+        if (sealed->write(path)) mapped = MappedSegment::open(path);
+        lock.lock();
+        unwritten_.pop_front();
+        if (!mapped) continue; // Kept in memory; lost at exit
+        auto it = std::find(segments_.begin(), segments_.end(), sealed);
+        if (it != segments_.end()) *it = std::move(mapped); // The live copy goes with the last search using it
+    }
+}
+
+std::vector<SearchIndex::Hit> SearchIndex::search(uint32_t room_id, const std::string& query, size_t limit,
+                                                  uint64_t before, uint64_t& next_cursor) {
+    std::vector<Hit> hits;
+    next_cursor = 0;
+    Query parsed;
+    if (!enabled() || !parse_query(query, parsed)) return hits;
+    limit = std::clamp<size_t>(limit, 1, config_.max_results);
+    if (before == 0) before = UINT64_MAX;
+
+    std::vector<std::shared_ptr<const Segment>> segments;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (live_) live_->search(room_id, parsed, before, limit, hits); // Newest, and still changing
+        segments = segments_;
+    }
+    for (auto it = segments.rbegin(); it != segments.rend() && hits.size() < limit; ++it) {
+        (*it)->search(room_id, parsed, before, limit, hits);
+    }
+    if (hits.size() == limit) next_cursor = hits.back().id;
+    return hits;
+}
+
+common::Message SearchIndex::reply(uint32_t room_id, uint32_t recipient_id, const common::Message& request) {
+    const auto& payload = request.payload;
+    if (payload.size() < 16) {
+        return common::Message(common::MessageType::ERROR_MESSAGE, 0, recipient_id, "Malformed search request.");
+    }
+    if (!enabled()) {
+        return common::Message(common::MessageType::ERROR_MESSAGE, 0, recipient_id, "Search is not enabled on this server.");
+    }
+    uint32_t tag = common::read_u32(payload.data());
+    uint32_t limit = common::read_u32(payload.data() + 4);
+    uint64_t cursor = common::read_u64(payload.data() + 8);
+    std::string query(payload.begin() + 16, payload.end());
+
+    uint64_t next_cursor = 0;
+    std::vector<Hit> hits = search(room_id, query, limit, cursor, next_cursor);
+    common::Message results(common::MessageType::SEARCH_RESULTS, 0, recipient_id, "");
+    common::append_u32(results.payload, tag);
+    common::append_u64(results.payload, next_cursor);
+    common::append_u32(results.payload, static_cast<uint32_t>(hits.size()));
+    for (const Hit& hit : hits) {
+        common::append_u32(results.payload, hit.sequence);
+        common::append_u32(results.payload, hit.sender_id);
+        common::append_u32(results.payload, static_cast<uint32_t>(hit.text.size()));
+        results.payload.insert(results.payload.end(), hit.text.begin(), hit.text.end());
+    }
+    results.header.payload_size = static_cast<uint32_t>(results.payload.size());
+    return results;
+}
+
+} // namespace server
+} // namespace chat_app
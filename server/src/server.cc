@@ -1,9 +1,14 @@
 #include "server/server.h"
 #include "common/socket_factory.h"
+#include "common/cpu_affinity.h"
 #include "common/message.h"
+#include "common/message_serialization.h"
 #include <iostream>
 #include <algorithm>
 #include <chrono>
+#include <functional> // For std::ref
+#include <latch>
+#include <cstring> // For memcpy
 
 #ifdef _WIN32
     #include <winsock2.h> // Ensure Winsock headers are included for Windows
@@ -17,14 +22,47 @@
     #endif
 #else
     #include <sys/socket.h> // For SOMAXCONN on POSIX
+    #include <poll.h>       // For the outbound thread
 #endif
 
 namespace chat_app {
 namespace server {
 
-Server::Server(int port)
-    : port_(port), running_(false), next_client_id_(1) {
+namespace {
+// Where an EPHEMERAL broadcast waits in outbound queues: one per sender, room and key
+std::string ephemeral_slot(const common::Message& msg, uint32_t room_id) {
+    std::string key;
+    std::string value;
+    if (!common::parse_ephemeral(msg, key, value)) return std::string();
+    std::string slot(8, '\0');
+    std::memcpy(&slot[0], &msg.header.sender_id, 4);
+    std::memcpy(&slot[4], &room_id, 4);
+    return slot + key;
+}
+} // namespace
+
+Server::Server(int port, const ServerConfig& config)
+    : port_(port), config_(config), receive_pool_(config.receive_buffers.buffer_size, config.receive_buffers.max_free),
+      memory_(config.memory), memory_pressure_(MemoryPressure::NORMAL), rate_limiter_(config.rate_limits, clock_),
+      heartbeats_(config.heartbeat, clock_, *this), federation_(config.federation, *this), sessions_(config.sessions, &memory_),
+      content_filter_(config.content_filter),
+      search_(config.search, &memory_), offline_(config.offline), presence_(config.presence, *this), running_(false),
+      next_client_id_(1), next_shard_(0), next_event_loop_(0), local_members_(0), quiescing_(false),
+      fanout_executor_(config.fanout.workers) {
+    if (config.federation.node_id != 0) {
+        // Disjoint id ranges keep client ids unique across the mesh
+        next_client_id_ = (config.federation.node_id << 24) + 1;
+    }
     listen_socket_ = common::SocketFactory::create_socket();
+    if (config.shards.count != 0 && common::EventLoop::supported()) {
+        for (size_t i = 0; i < config.shards.count; ++i) {
+            shards_.push_back(std::make_unique<Shard>(i, config.shards.mailbox_capacity));
+        }
+        if (shards_.size() > 1) listen_socket_->set_reuse_port(true);
+    }
+    for (size_t i = 0; i < std::max<size_t>(shards_.size(), 1); ++i) {
+        client_groups_.push_back(std::make_unique<ClientGroup>());
+    }
     // message_handler_ = std::make_unique<BroadcastMessageHandler>(); // If using unique_ptr
     std::cout << "Server created for port " << port_ << "." << std::endl;
 }
@@ -45,12 +83,372 @@ void Server::start() {
         std::cerr << "Server: Failed to listen on socket." << std::endl;
         return;
     }
+    if (!open_local_listeners() || !open_shard_listeners()) {
+        return;
+    }
 
+    start_threads(false);
+    std::cout << "Server started and listening on port " << port_ << "." << std::endl;
+}
+
+void Server::start_threads(bool handed_off) {
     running_ = true;
-    accept_thread_ = std::thread(&Server::accept_connections, this);
+    clock_.start();
+    plan_placement();
+    handler_executor_.start();
+    if (config_.fanout.parallel_threshold != 0 && shards_.empty()) fanout_executor_.start();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        shards_[i]->start(loop_cpus_[i]);
+    }
+    if (!shards_.empty()) {
+        std::cout << "Server: Running " << shards_.size() << " shards." << std::endl;
+    }
+    start_event_loops();
+    search_.start();
+    offline_.start(handed_off);
+    heartbeats_.start();
+    federation_.start();
+    presence_.start();
+    std::cout << "Server: Message handler executor running " << handler_executor_.thread_count() << " workers." << std::endl;
+    start_accept_threads();
     cleanup_thread_ = std::thread(&Server::cleanup_clients, this);
+    if (!config_.outbound.spool_directory.empty()) {
+        outbound_thread_ = std::thread(&Server::drain_outbound, this);
+    }
+    log_placement();
+}
 
-    std::cout << "Server started and listening on port " << port_ << "." << std::endl;
+void Server::plan_placement() {
+    placement_cpus_.clear();
+    loop_cpus_.clear();
+    loop_nodes_.clear();
+    size_t loops = shards_.empty() && common::EventLoop::supported() ? config_.event_loops : shards_.size();
+    if (config_.placement.pin_threads) {
+        std::vector<int> usable = common::usable_cpus();
+        for (int cpu : config_.placement.cpus.empty() ? usable : config_.placement.cpus) {
+            if (std::find(usable.begin(), usable.end(), cpu) != usable.end()) {
+                placement_cpus_.push_back(cpu);
+            } else {
+                std::cerr << "Server: CPU " << cpu << " is not available to this process; not pinning to it." << std::endl;
+            }
+        }
+        if (placement_cpus_.empty()) std::cerr << "Server: No CPUs to pin threads to." << std::endl;
+    }
+    for (size_t i = 0; i < loops; ++i) {
+        int cpu = placement_cpus_.empty() ? -1 : placement_cpus_[i % placement_cpus_.size()];
+        loop_cpus_.push_back(cpu);
+        loop_nodes_.push_back(cpu < 0 ? -1 : common::numa_node_of(cpu));
+    }
+    handler_executor_.set_cpus(placement_cpus_);
+    fanout_executor_.set_cpus(placement_cpus_);
+
+    if (!config_.placement.steer_incoming_cpu || placement_cpus_.empty() || shards_.empty()) return;
+    // Shard i's listener gets the connections whose packets land on its CPU
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        common::ISocket* listener = i == 0 ? listen_socket_.get() : nullptr;
+        if (i > 0 && i - 1 < shard_listeners_.size()) listener = shard_listeners_[i - 1].get();
+        if (listener && !listener->set_incoming_cpu(loop_cpus_[i])) {
+            std::cerr << "Server: Shard " << i << "'s listener cannot prefer CPU " << loop_cpus_[i]
+                      << "; its connections are steered after accept instead." << std::endl;
+        }
+    }
+}
+
+void Server::log_placement() const {
+    auto describe = [](int cpu) {
+        int node = common::numa_node_of(cpu);
+        return "CPU " + std::to_string(cpu) + ", NUMA node " + (node < 0 ? std::string("unknown") : std::to_string(node));
+    };
+    std::vector<int> usable = common::usable_cpus();
+    std::vector<int> nodes;
+    for (int cpu : usable) {
+        int node = common::numa_node_of(cpu);
+        if (node >= 0) nodes.push_back(node);
+    }
+    std::cout << "Server: Thread placement over CPUs " << common::format_cpu_list(usable)
+              << " (NUMA nodes " << (nodes.empty() ? "unknown" : common::format_cpu_list(nodes)) << "):" << std::endl;
+    if (placement_cpus_.empty()) {
+        std::cout << "  No threads are pinned." << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        std::cout << "  Shard " << i << " event loop and accept thread: " << describe(loop_cpus_[i]) << std::endl;
+    }
+    for (size_t i = 0; i < event_loops_.size(); ++i) {
+        std::cout << "  Event loop " << i << ": " << describe(loop_cpus_[i]) << std::endl;
+    }
+    std::cout << "  Message handler workers: CPUs " << common::format_cpu_list(handler_executor_.cpus()) << std::endl;
+    if (fanout_executor_.is_running()) {
+        std::cout << "  Fan-out workers: CPUs " << common::format_cpu_list(fanout_executor_.cpus()) << std::endl;
+    }
+    std::cout << "  Not pinned: " << (shards_.empty() ? "accept, " : "local accept, ")
+              << (event_loops_.empty() && shards_.empty() ? "connection receive, " : "")
+              << "cleanup, heartbeat, federation and presence threads." << std::endl;
+    if (config_.placement.steer_incoming_cpu && !loop_cpus_.empty()) {
+        std::cout << "  Connections go to the " << (shards_.empty() ? "event loop" : "shard")
+                  << " on the CPU that receives their packets." << std::endl;
+    }
+}
+
+void Server::start_event_loops() {
+    if (config_.event_loops == 0 || !event_loops_.empty() || !shards_.empty()) return;
+    if (!common::EventLoop::supported()) {
+        std::cerr << "Server: Event loops are not supported here; using a thread per connection." << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < config_.event_loops; ++i) {
+        event_loops_.push_back(std::make_unique<common::EventLoop>());
+        event_loops_.back()->start(i < loop_cpus_.size() ? loop_cpus_[i] : -1);
+    }
+    std::cout << "Server: Reading connections on " << event_loops_.size() << " event loops." << std::endl;
+}
+
+void Server::stop_event_loops() {
+    for (auto& loop : event_loops_) {
+        loop->stop();
+    }
+    event_loops_.clear();
+}
+
+Shard* Server::shard_for(Shard* accepted_by, const common::ISocket* socket) {
+    if (shards_.empty()) return nullptr;
+    int slot = socket ? steered_slot(*socket, next_shard_) : -1;
+    if (slot >= 0) return shards_[slot].get();
+    if (accepted_by) return accepted_by;
+    return shards_[next_shard_++ % shards_.size()].get();
+}
+
+common::EventLoop* Server::event_loop_for(const common::ISocket& socket, Shard* shard) {
+    // Shared memory rings are not a descriptor epoll can wait on
+    if (!socket.is_transferable()) return nullptr;
+    if (shard) return &shard->loop();
+    if (event_loops_.empty()) return nullptr;
+    int slot = steered_slot(socket, next_event_loop_);
+    if (slot >= 0) return event_loops_[slot].get();
+    return event_loops_[next_event_loop_++ % event_loops_.size()].get();
+}
+
+int Server::steered_slot(const common::ISocket& socket, std::atomic<size_t>& rotation) const {
+    if (!config_.placement.steer_incoming_cpu || placement_cpus_.empty()) return -1;
+    int cpu = socket.incoming_cpu();
+    if (cpu < 0) return -1;
+    std::vector<int> candidates;
+    for (size_t i = 0; i < loop_cpus_.size(); ++i) {
+        if (loop_cpus_[i] == cpu) candidates.push_back(static_cast<int>(i));
+    }
+    if (candidates.empty()) {
+        int node = common::numa_node_of(cpu);
+        for (size_t i = 0; node >= 0 && i < loop_nodes_.size(); ++i) {
+            if (loop_nodes_[i] == node) candidates.push_back(static_cast<int>(i));
+        }
+    }
+    if (candidates.empty()) return -1;
+    return candidates[rotation++ % candidates.size()];
+}
+
+void Server::add_client(std::unique_ptr<ClientHandler> client_handler, Shard* shard) {
+    uint32_t client_id = client_handler->get_id();
+    size_t group_index = shard ? shard->index() : 0;
+    ClientGroup& group = *client_groups_[group_index];
+    {
+        // order_mutex_ only for the welcome; no broadcast may slip in between it and the join
+        std::lock_guard<std::mutex> order_lock(order_mutex_);
+        std::lock_guard<std::mutex> lock(group.mutex);
+        // Whatever it receives is handled once we release these, when it is registered
+        client_handler->start();
+        welcome_locked(*client_handler); // Before any broadcast can reach it
+        if (shard) {
+            client_handler->set_shard_index(shard->index());
+            shard->join(client_handler.get());
+        }
+        group.clients[client_id] = std::move(client_handler);
+        lobby_roster_.add(client_id);
+        std::lock_guard<std::mutex> routes_lock(routes_mutex_);
+        routes_[client_id] = Route{client_id, group_index};
+    }
+    ++local_members_;
+    federation_.change_local_members(kLobbyRoomId, 1);
+}
+
+void Server::flush_shards_locked() {
+    if (shards_.empty()) return;
+    std::latch reached(static_cast<std::ptrdiff_t>(shards_.size()));
+    for (auto& shard : shards_) {
+        shard->barrier(&reached);
+    }
+    reached.wait(); // Shards never take order_mutex_
+}
+
+bool Server::open_shard_listeners() {
+    for (size_t i = 1; i < shards_.size(); ++i) {
+        auto listener = common::SocketFactory::create_socket();
+        if (!listener || !listener->set_reuse_port(true) || !listener->bind_socket(port_) ||
+            !listener->listen_socket(SOMAXCONN)) {
+            std::cerr << "Server: Shard " << i << " cannot listen on port " << port_
+                      << "; its connections come through the other shards." << std::endl;
+            return false;
+        }
+        shard_listeners_.push_back(std::move(listener));
+    }
+    return true;
+}
+
+bool Server::open_local_listeners() {
+    struct Endpoint {
+        common::Transport transport;
+        const std::string& path;
+        const char* name;
+    };
+    const Endpoint endpoints[] = {{common::Transport::UNIX_STREAM, config_.local.unix_path, "Unix socket"},
+                                  {common::Transport::SHARED_MEMORY, config_.local.shm_path, "shared memory"}};
+    bool all_open = true;
+    for (const auto& endpoint : endpoints) {
+        if (endpoint.path.empty()) continue;
+        auto listener = common::SocketFactory::create_socket(endpoint.transport, endpoint.path);
+        if (!listener || !listener->bind_socket(0) || !listener->listen_socket(SOMAXCONN)) {
+            std::cerr << "Server: Failed to accept " << endpoint.name << " clients on " << endpoint.path << std::endl;
+            all_open = false;
+            continue;
+        }
+        std::cout << "Server: Accepting " << endpoint.name << " clients on " << endpoint.path << "." << std::endl;
+        local_listeners_.push_back(std::move(listener));
+    }
+    return all_open;
+}
+
+void Server::start_accept_threads() {
+    Shard* first_shard = shards_.empty() ? nullptr : shards_.front().get();
+    accept_threads_.emplace_back(&Server::accept_connections, this, std::ref(*listen_socket_), first_shard);
+    for (size_t i = 0; i < shard_listeners_.size(); ++i) {
+        accept_threads_.emplace_back(&Server::accept_connections, this, std::ref(*shard_listeners_[i]),
+                                     shards_[i + 1].get());
+    }
+    for (auto& listener : local_listeners_) {
+        accept_threads_.emplace_back(&Server::accept_connections, this, std::ref(*listener), nullptr);
+    }
+}
+
+void Server::join_accept_threads() {
+    for (auto& thread : accept_threads_) {
+        if (thread.joinable()) thread.join();
+    }
+    accept_threads_.clear();
+}
+
+bool Server::start_from_handoff(HandoffState& state) {
+    if (running_) return false;
+
+    listen_socket_ = common::SocketFactory::adopt_socket(state.listen_fd);
+    if (!listen_socket_) {
+        std::cerr << "Server: Cannot adopt the inherited listening socket." << std::endl;
+        return false;
+    }
+    state.listen_fd = -1;
+    next_client_id_ = state.next_client_id;
+    open_local_listeners(); // Rebinding the paths takes them over from the predecessor
+    open_shard_listeners(); // Joins the inherited socket's group if the predecessor was sharded too
+    start_threads(true);
+
+    for (auto& connection : state.connections) {
+        auto socket = common::SocketFactory::adopt_socket(connection.fd);
+        connection.fd = -1;
+        if (socket) socket->continue_zerocopy_numbering(connection.zerocopy_sends);
+        Shard* shard = shard_for(nullptr, socket.get());
+        common::EventLoop* loop = socket ? event_loop_for(*socket, shard) : nullptr;
+        auto client_handler = std::make_unique<ClientHandler>(connection.client_id, std::move(socket), *this,
+                                                              default_message_handler_, handler_executor_, loop);
+        client_handler->restore_receive_buffer(std::move(connection.partial_frame));
+        // Sessions do not survive the handoff; this welcomes it to a fresh one
+        add_client(std::move(client_handler), shard);
+        heartbeats_.track(connection.client_id);
+        // No CLIENT_JOINED: to everyone else this client never left
+    }
+
+    std::cout << "Server: Took over port " << port_ << " with " << state.connections.size()
+              << " live connections." << std::endl;
+    return true;
+}
+
+bool Server::export_for_handoff(HandoffState& state) {
+    if (!running_ || quiescing_) return false;
+
+    heartbeats_.stop(); // No PINGs or reaping while nobody is reading; first, as it takes the removal lock
+    handoff_lock_ = std::unique_lock<std::mutex>(removal_mutex_);
+    quiescing_ = true;
+    quiesce_signal_.notify();
+
+    join_accept_threads(); // New connections wait in the kernel backlog for the successor
+    federation_.stop(); // Frees the federation port; peers redial the successor
+
+    std::vector<ClientHandler*> handlers;
+    for (auto& group : client_groups_) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        for (auto& entry : group->clients) {
+            if (entry.second) handlers.push_back(entry.second.get());
+        }
+    }
+    for (ClientHandler* handler : handlers) {
+        handler->quiesce(); // Not under a group's lock: queued messages may still broadcast
+    }
+    {
+        std::lock_guard<std::mutex> lock(order_mutex_);
+        flush_shards_locked(); // Every broadcast so far is on the wire before the successor's
+    }
+    search_.stop(); // The successor opens what we indexed
+
+    state.listen_fd = listen_socket_->get_fd();
+    state.next_client_id = next_client_id_;
+    for (ClientHandler* handler : handlers) {
+        if (!handler->is_running()) continue; // Disconnected meanwhile; cleanup will take it
+        // Closed with us, and the client reconnects to the successor: shared memory
+        // cannot be passed on, and virtual clients are not part of the handoff
+        if (!handler->is_transferable() || handler->virtual_client_count() != 0) continue;
+        ConnectionHandoff connection;
+        connection.client_id = handler->get_id();
+        connection.fd = handler->socket_fd();
+        connection.zerocopy_sends = handler->zerocopy_sends();
+        connection.partial_frame = handler->receive_buffer_snapshot();
+        connection.rooms.push_back(kLobbyRoomId);
+        state.connections.push_back(std::move(connection));
+    }
+    return true;
+}
+
+void Server::complete_handoff() {
+    for (auto& group : client_groups_) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        for (auto& entry : group->clients) {
+            if (entry.second) entry.second->abandon();
+        }
+    }
+    if (listen_socket_) {
+        listen_socket_->close_socket(); // A plain close; shutdown would end it for the successor too
+    }
+    for (auto& listener : local_listeners_) {
+        listener->close_socket(); // The successor bound the paths anew
+    }
+    for (auto& listener : shard_listeners_) {
+        listener->close_socket(); // Connections still in its backlog are reset; clients reconnect
+    }
+    handoff_lock_.unlock();
+    stop();
+}
+
+void Server::abort_handoff() {
+    if (!quiescing_) return;
+    quiesce_signal_.reset();
+    quiescing_ = false;
+    for (auto& group : client_groups_) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        for (auto& entry : group->clients) {
+            if (entry.second && entry.second->is_running()) entry.second->resume();
+        }
+    }
+    heartbeats_.start();
+    federation_.start();
+    search_.start();
+    start_accept_threads();
+    handoff_lock_.unlock();
 }
 
 void Server::stop() {
@@ -59,36 +457,88 @@ void Server::stop() {
 
     std::cout << "Server stopping..." << std::endl;
 
-    // Close the listening socket to unblock accept_thread_'s accept call
+    federation_.stop(); // Its receive threads broadcast to our clients
+    presence_.stop();
+
+    // Shut down the listening sockets to unblock the accept threads' accept calls
     if (listen_socket_ && listen_socket_->is_valid()) {
-        listen_socket_->close_socket(); 
+        listen_socket_->shutdown_socket();
+    }
+    for (auto& listener : local_listeners_) {
+        if (listener->is_valid()) listener->shutdown_socket();
+    }
+    for (auto& listener : shard_listeners_) {
+        if (listener->is_valid()) listener->shutdown_socket();
     }
 
     // Notify cleanup thread to wake up and exit
     finished_clients_cv_.notify_one();
 
-    if (accept_thread_.joinable()) {
-        accept_thread_.join();
+    join_accept_threads();
+    std::cout << "Accept threads joined." << std::endl;
+    if (listen_socket_) {
+        listen_socket_->close_socket();
     }
-    std::cout << "Accept thread joined." << std::endl;
+    for (auto& listener : local_listeners_) {
+        listener->close_socket();
+    }
+    local_listeners_.clear();
+    for (auto& listener : shard_listeners_) {
+        listener->close_socket();
+    }
+    shard_listeners_.clear();
+
+    heartbeats_.stop();
     
     if (cleanup_thread_.joinable()) {
         cleanup_thread_.join();
     }
     std::cout << "Cleanup thread joined." << std::endl;
+    if (outbound_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(backlog_mutex_);
+            backlog_signal_.notify();
+        }
+        outbound_thread_.join();
+    }
 
-    // Stop all client handlers
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    for (auto& client_handler : clients_) {
+    // Stop all client handlers. They are moved out first: stopping a handler waits for its
+    // queued messages, and handling those may need their group's lock to broadcast.
+    std::vector<std::unique_ptr<ClientHandler>> clients_to_stop;
+    for (auto& group : client_groups_) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        for (auto& entry : group->clients) {
+            clients_to_stop.push_back(std::move(entry.second));
+        }
+        group->clients.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(routes_mutex_);
+        routes_.clear();
+    }
+    for (auto& client_handler : clients_to_stop) {
         if (client_handler) {
             client_handler->stop();
         }
     }
-    clients_.clear(); // This will call destructors of ClientHandler unique_ptrs
+    for (auto& shard : shards_) {
+        shard->stop(); // Lets go of the handlers; they read on its loop until stopped above
+    }
+    clients_to_stop.clear(); // This will call destructors of ClientHandler unique_ptrs
     std::cout << "All client handlers stopped and cleared." << std::endl;
+    stop_event_loops();
+    search_.stop(); // Writes out what is still only in memory
+
+    handler_executor_.stop();
+    fanout_executor_.stop();
+    clock_.stop();
     std::cout << "Server stopped." << std::endl;
 }
 
+void Server::log_throttled_clients() {
+    rate_limiter_.log_throttled_clients();
+}
+
 bool Server::is_running_properly() const {
     // running_ is atomic, listen_socket_ is a unique_ptr
     bool socket_ok = false;
@@ -98,18 +548,25 @@ bool Server::is_running_properly() const {
     return running_.load() && socket_ok;
 }
 
-void Server::accept_connections() {
+void Server::accept_connections(common::ISocket& listener, Shard* accepting_shard) {
     std::cout << "Accept thread started." << std::endl;
+    if (accepting_shard && accepting_shard->cpu() >= 0 && !common::pin_current_thread(accepting_shard->cpu())) {
+        std::cerr << "Accept thread: Cannot pin to CPU " << accepting_shard->cpu() << "; running unpinned." << std::endl;
+    }
     while (running_) {
-        if (!listen_socket_ || !listen_socket_->is_valid()) {
+        if (!listener.is_valid()) {
              if (running_) std::cerr << "Accept thread: Listen socket became invalid." << std::endl;
              break; // Exit if socket is closed (e.g. during shutdown)
         }
 
-        auto client_socket = listen_socket_->accept_socket();
+        if (listener.wait_readable(-1, quiesce_signal_.fd()) == common::WaitResult::WOKEN) {
+            break; // Handing the listening socket to a successor
+        }
+
+        auto client_socket = listener.accept_socket();
         if (!client_socket || !client_socket->is_valid()) {
             if (running_) { // Only log error if we are supposed to be running
-                // This can happen if listen_socket_ is closed during shutdown
+                // This can happen if the listener is closed during shutdown
                 // std::cerr << "Server: Failed to accept new connection or server shutting down." << std::endl;
             }
             // Small pause to prevent busy loop if accept fails repeatedly but server is running
@@ -117,35 +574,287 @@ void Server::accept_connections() {
             continue;
         }
 
+        if (memory_.pressure() == MemoryPressure::HARD) {
+            std::cerr << "Server: Out of memory; turning a new connection away." << std::endl;
+            client_socket->send_data(common::serialize_message(common::Message(
+                common::MessageType::ERROR_MESSAGE, 0, 0, "Server is out of memory; try again later.")));
+            client_socket->close_socket();
+            continue;
+        }
+
         std::cout << "Server: Accepted new connection." << std::endl;
         uint32_t client_id = next_client_id_++;
         
-        auto client_handler = std::make_unique<ClientHandler>(client_id, std::move(client_socket), *this, default_message_handler_);
-        client_handler->start();
+        Shard* shard = shard_for(accepting_shard, client_socket.get());
+        common::EventLoop* loop = event_loop_for(*client_socket, shard);
+        auto client_handler = std::make_unique<ClientHandler>(client_id, std::move(client_socket), *this, default_message_handler_,
+                                                              handler_executor_, loop);
 
-        {
-            std::lock_guard<std::mutex> lock(clients_mutex_);
-            clients_.push_back(std::move(client_handler));
-        }
-        
-        // Notify other clients about the new join (optional)
-        common::Message join_msg(common::MessageType::CLIENT_JOINED, 0, 0, "Client " + std::to_string(client_id) + " joined.");
-        join_msg.header.sender_id = client_id; // Or 0 for server notification
-        broadcast_message(join_msg, client_id); // Don't send to the new client itself yet
+        add_client(std::move(client_handler), shard);
+        heartbeats_.track(client_id);
+        presence_.joined(client_id); // Reported to everyone in the next presence digest
     }
     std::cout << "Accept thread finished." << std::endl;
 }
 
+void Server::welcome_locked(ClientHandler& client_handler) {
+    auto session = sessions_.open(client_handler.get_id(), kLobbyRoomId, clock_.now_ms());
+    common::Message welcome(common::MessageType::SESSION_WELCOME, 0, client_handler.get_id(), "");
+    common::append_u64(welcome.payload, session.first);
+    common::append_u32(welcome.payload, session.second);
+    welcome.header.payload_size = static_cast<uint32_t>(welcome.payload.size());
+    client_handler.send_message(welcome);
+}
+
+void Server::resume_session(ClientHandler& client_handler, uint64_t token, uint32_t last_seen) {
+    uint32_t previous_client = 0;
+    std::vector<common::Message> missed;
+    std::unique_ptr<ReliableState> reliable;
+    OfflineStore::Ticket mailbox; // For the direct messages stored while the session was away
+    {
+        // Holding order_mutex_ keeps broadcasts from interleaving with the replay
+        std::lock_guard<std::mutex> lock(order_mutex_);
+        flush_shards_locked(); // Nor may queued ones arrive after it
+        common::ResumeStatus status =
+            sessions_.resume(token, client_handler.get_id(), kLobbyRoomId, last_seen, previous_client, missed, reliable);
+        with_connection(previous_client, [&reliable](ClientHandler* previous) {
+            if (!previous) return;
+            reliable = previous->take_reliable_state();
+            previous->shutdown_connection(); // Superseded; the peer is not coming back on it
+        });
+        for (auto& msg : missed) {
+            msg.header.flags &= ~common::kFlagReliable; // If it was, the retransmit window has it
+            client_handler.send_message(msg);
+        }
+        if (status != common::ResumeStatus::UNKNOWN && offline_.enabled()) {
+            // Stores ticketed before this are read by it; later messages find the session attached
+            mailbox = offline_.reserve(sessions_.mailbox_id(client_handler.get_id(), clock_.now_ms()));
+        }
+        client_handler.adopt_reliable_state(std::move(reliable));
+        common::Message resumed(common::MessageType::SESSION_RESUMED, 0, client_handler.get_id(), "");
+        resumed.payload.push_back(static_cast<char>(status));
+        common::append_u64(resumed.payload, status == common::ResumeStatus::UNKNOWN ? 0 : token);
+        common::append_u32(resumed.payload, static_cast<uint32_t>(missed.size()));
+        resumed.header.payload_size = static_cast<uint32_t>(resumed.payload.size());
+        client_handler.send_message(resumed);
+    }
+    size_t delivered = 0;
+    if (mailbox.mailbox) {
+        uint64_t end = 0;
+        auto stored = offline_.read(mailbox, delivered, end); // Off order_mutex_: this is disk I/O
+        if (stored) {
+            // One write for all of them, kept on disk until the socket has taken it
+            client_handler.send_serialized(stored, [this, mailbox, end](bool written) {
+                if (!written) return; // Read again on the next resume
+                handler_executor_.submit([this, mailbox, end] { offline_.consume(mailbox, end); });
+            });
+        }
+    }
+    std::cout << "Server: Client " << client_handler.get_id() << " resumed a session"
+              << (previous_client ? " of client " + std::to_string(previous_client) : std::string(" (unknown)"))
+              << ", replayed " << missed.size() << " messages"
+              << (delivered ? " and delivered " + std::to_string(delivered) + " stored direct messages" : std::string())
+              << "." << std::endl;
+}
+
+void Server::send_direct(ClientHandler& sender, const common::Message& msg) {
+    uint32_t recipient_id = msg.header.recipient_id;
+    bool delivered = false;
+    auto deliver = [&msg, &delivered](ClientHandler* recipient) {
+        if (!recipient || !recipient->is_running()) return;
+        common::Message direct = msg;
+        direct.header.sequence = 0; // Not part of the room's stream
+        recipient->send_message(direct);
+        delivered = true;
+    };
+    with_connection(recipient_id, deliver); // Under the recipient's group lock only
+    if (delivered) return;
+
+    const char* error = nullptr;
+    OfflineStore::Ticket mailbox;
+    {
+        // Keeps the recipient from resuming between our look and our ticket
+        std::lock_guard<std::mutex> lock(order_mutex_);
+        with_connection(recipient_id, deliver); // Or from connecting
+        if (delivered) return;
+        uint32_t mailbox_id = sessions_.mailbox_id(recipient_id, clock_.now_ms());
+        if (mailbox_id == 0) {
+            error = "Unknown recipient; message dropped.";
+        } else if (!offline_.enabled()) {
+            error = "Recipient is offline; message dropped.";
+        } else {
+            mailbox = offline_.reserve(mailbox_id); // Fixes our place before any resume's read
+        }
+    }
+    if (mailbox.mailbox && !offline_.store(mailbox, msg)) { // Off order_mutex_: this is disk I/O
+        error = "Recipient's offline messages are full; message dropped.";
+    }
+    if (error) {
+        sender.send_message(common::Message(common::MessageType::ERROR_MESSAGE, 0, sender.get_id(), error));
+    }
+}
+
 void Server::broadcast_message(const common::Message& msg, uint32_t sender_id_to_exclude) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
+    std::lock_guard<std::mutex> lock(order_mutex_);
+    common::Message stamped = msg;
+    std::string slot;
+    if (stamped.header.type == common::MessageType::EPHEMERAL) {
+        stamped.header.flags &= ~common::kFlagReliable; // A retransmit could only be stale
+        slot = ephemeral_slot(stamped, kLobbyRoomId);
+    } else {
+        sessions_.stamp(kLobbyRoomId, stamped, sender_id_to_exclude);
+        if (stamped.header.type == common::MessageType::TEXT_MESSAGE) search_.add(kLobbyRoomId, stamped);
+    }
+    if (!shards_.empty()) {
+        auto broadcast = std::make_shared<Shard::Broadcast>();
+        broadcast->slot = std::move(slot);
+        if (stamped.header.flags & common::kFlagReliable) {
+            broadcast->msg = std::move(stamped); // Numbered per connection
+        } else {
+            broadcast->frame = make_shared_frame(stamped);
+        }
+        broadcast->exclude_id = sender_id_to_exclude;
+        for (auto& shard : shards_) {
+            shard->deliver(broadcast);
+        }
+        return;
+    }
     // std::cout << "Server broadcasting message from " << msg.header.sender_id << " (excluding " << sender_id_to_exclude << ")" << std::endl;
-    for (const auto& client_handler : clients_) {
+    ClientGroup& group = *client_groups_.front(); // Unsharded, every connection is in it
+    std::lock_guard<std::mutex> group_lock(group.mutex);
+    std::vector<ClientHandler*> recipients;
+    recipients.reserve(group.clients.size());
+    for (const auto& entry : group.clients) {
+        const auto& client_handler = entry.second;
         if (client_handler && client_handler->is_running()) {
-            if (sender_id_to_exclude == 0 || client_handler->get_id() != sender_id_to_exclude) {
-                client_handler->send_message(msg);
+            // A multiplexed connection gets it for its other logical clients even from one of them
+            if (sender_id_to_exclude == 0 || client_handler->get_id() != sender_id_to_exclude ||
+                client_handler->virtual_client_count() != 0) {
+                recipients.push_back(client_handler.get());
             }
         }
     }
+    fan_out_locked(recipients, stamped, slot);
+}
+
+void Server::fan_out_locked(const std::vector<ClientHandler*>& recipients, const common::Message& msg,
+                            const std::string& slot) {
+    // A reliable message is numbered per connection; anything else is serialized once for all
+    const bool shared = (msg.header.flags & common::kFlagReliable) == 0;
+    std::shared_ptr<const std::vector<char>> frame; // Zero-copy sends may keep it past our return
+    if (shared) {
+        frame = make_shared_frame(msg);
+    }
+    auto deliver = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (!slot.empty()) {
+                recipients[i]->send_latest(frame, slot);
+            } else if (shared) {
+                recipients[i]->send_serialized(frame);
+            } else {
+                recipients[i]->send_message(msg);
+            }
+        }
+    };
+
+    const FanoutConfig& fanout = config_.fanout;
+    size_t partitions = 1;
+    if (fanout.parallel_threshold != 0 && recipients.size() >= fanout.parallel_threshold &&
+        fanout_executor_.is_running()) {
+        size_t by_size = recipients.size() / std::max<size_t>(fanout.min_partition, 1);
+        partitions = std::max<size_t>(1, std::min(by_size, fanout_executor_.thread_count() + 1));
+    }
+    if (partitions == 1) {
+        deliver(0, recipients.size());
+        return;
+    }
+
+    // Partition 0 is ours; the workers take the rest
+    size_t per_partition = (recipients.size() + partitions - 1) / partitions;
+    std::latch delivered(static_cast<std::ptrdiff_t>(partitions - 1));
+    for (size_t p = 1; p < partitions; ++p) {
+        size_t begin = std::min(p * per_partition, recipients.size());
+        size_t end = std::min(begin + per_partition, recipients.size());
+        fanout_executor_.submit([&deliver, &delivered, begin, end] {
+            deliver(begin, end);
+            delivered.count_down();
+        });
+    }
+    deliver(0, std::min(per_partition, recipients.size()));
+    delivered.wait();
+}
+
+std::shared_ptr<const std::vector<char>> Server::make_shared_frame(const common::Message& msg) {
+    auto* frame = new std::vector<char>(common::serialize_message(msg));
+    const int64_t bytes = static_cast<int64_t>(frame->size());
+    memory_.charge(MemoryUse::OUTBOUND, bytes);
+    // Released by whichever queue or zero-copy send lets go of it last
+    return std::shared_ptr<const std::vector<char>>(frame, [this, bytes](const std::vector<char>* done) {
+        memory_.charge(MemoryUse::OUTBOUND, -bytes);
+        delete done;
+    });
+}
+
+size_t Server::member_count(uint32_t room_id) {
+    (void)room_id; // Every client is in the lobby
+    return local_members_.load();
+}
+
+Server::ClientGroup* Server::group_of(uint32_t client_id, uint32_t& connection_id) {
+    std::lock_guard<std::mutex> lock(routes_mutex_);
+    auto it = routes_.find(client_id);
+    if (it == routes_.end()) return nullptr;
+    connection_id = it->second.connection_id;
+    return client_groups_[it->second.group].get();
+}
+
+void Server::attach_virtual_client(ClientHandler& client_handler, uint32_t tag) {
+    uint32_t virtual_id = 0;
+    {
+        ClientGroup& group = *client_groups_[client_handler.shard_index()];
+        std::lock_guard<std::mutex> lock(group.mutex);
+        auto it = group.clients.find(client_handler.get_id());
+        if (it == group.clients.end() || it->second.get() != &client_handler) return; // Being removed
+        if (client_handler.virtual_client_count() >= config_.max_virtual_clients) {
+            client_handler.send_message(common::Message(common::MessageType::ERROR_MESSAGE, 0, client_handler.get_id(),
+                                                        "Too many virtual clients on this connection."));
+            return;
+        }
+        virtual_id = next_client_id_++;
+        client_handler.add_virtual_client(virtual_id);
+        lobby_roster_.add(virtual_id);
+        {
+            std::lock_guard<std::mutex> routes_lock(routes_mutex_);
+            routes_[virtual_id] = Route{client_handler.get_id(), client_handler.shard_index()};
+        }
+
+        common::Message attached(common::MessageType::MUX_ATTACHED, 0, virtual_id, "");
+        common::append_u32(attached.payload, tag);
+        attached.header.payload_size = static_cast<uint32_t>(attached.payload.size());
+        client_handler.send_message(attached);
+    }
+    ++local_members_;
+    federation_.change_local_members(kLobbyRoomId, 1);
+    presence_.joined(virtual_id);
+}
+
+void Server::detach_virtual_client(ClientHandler& client_handler, uint32_t virtual_id) {
+    {
+        ClientGroup& group = *client_groups_[client_handler.shard_index()];
+        std::lock_guard<std::mutex> lock(group.mutex);
+        if (!client_handler.remove_virtual_client(virtual_id)) return;
+        lobby_roster_.remove(virtual_id);
+        std::lock_guard<std::mutex> routes_lock(routes_mutex_);
+        routes_.erase(virtual_id);
+    }
+    --local_members_;
+    federation_.change_local_members(kLobbyRoomId, -1);
+    presence_.left(virtual_id);
+}
+
+void Server::deliver_from_peer(const common::Message& msg, uint32_t room_id) {
+    (void)room_id; // Every room is the lobby for now
+    broadcast_message(msg, 0);
 }
 
 void Server::signal_client_finished(uint32_t client_id) {
@@ -162,9 +871,17 @@ void Server::cleanup_clients() {
     while (running_) {
         std::unique_lock<std::mutex> lock(finished_clients_mutex_);
         // Wait until notified or server is stopping or queue is not empty
-        finished_clients_cv_.wait(lock, [this] { 
-            return !running_ || !finished_client_ids_.empty(); 
-        });
+        auto ready = [this] { return !running_ || !finished_client_ids_.empty(); };
+        bool limits = config_.memory.soft_limit_bytes != 0 || config_.memory.hard_limit_bytes != 0;
+        if (limits || config_.zerocopy_min_bytes != 0) {
+            finished_clients_cv_.wait_for(lock, std::chrono::milliseconds(config_.memory.check_interval_ms), ready);
+            lock.unlock();
+            if (limits) shed_load();
+            common::SocketFactory::reap_closed_sockets(); // Zero-copy frames of closed connections
+            lock.lock();
+        } else {
+            finished_clients_cv_.wait(lock, ready);
+        }
 
         if (!running_ && finished_client_ids_.empty()) {
             break; // Server is stopping and no more clients to cleanup
@@ -183,34 +900,163 @@ void Server::cleanup_clients() {
     std::cout << "Cleanup thread finished." << std::endl;
 }
 
+void Server::shed_load() {
+    MemoryPressure pressure = memory_.pressure();
+    if (pressure != memory_pressure_) {
+        static const char* const kNames[] = {"normal", "soft", "hard"};
+        std::cout << "Server: Memory pressure " << kNames[static_cast<int>(memory_pressure_)] << " -> "
+                  << kNames[static_cast<int>(pressure)] << " at " << memory_.total() << " bytes (";
+        for (size_t i = 0; i < static_cast<size_t>(MemoryUse::COUNT); ++i) {
+            MemoryUse use = static_cast<MemoryUse>(i);
+            std::cout << (i == 0 ? "" : ", ") << memory_use_name(use) << " " << memory_.used(use);
+        }
+        std::cout << ")." << std::endl;
+        memory_pressure_ = pressure;
+    }
+    if (pressure != MemoryPressure::HARD) return;
+
+    // History is only a convenience for resuming clients, so it goes first
+    const MemoryConfig& limits = memory_.config();
+    int64_t target = static_cast<int64_t>(limits.soft_limit_bytes != 0 ? limits.soft_limit_bytes : limits.hard_limit_bytes);
+    int64_t released = sessions_.trim_history(memory_.total() - target);
+    if (released > 0) {
+        std::cerr << "Server: Over the hard memory limit; dropped " << released << " bytes of history." << std::endl;
+    }
+    if (memory_.pressure() != MemoryPressure::HARD) return;
+
+    // Then one connection per check, so the effect of each is seen before the next
+    uint32_t heaviest_id = 0;
+    int64_t heaviest_bytes = 0;
+    for (auto& group : client_groups_) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        for (const auto& entry : group->clients) {
+            ClientHandler* client_handler = entry.second.get();
+            if (!client_handler || !client_handler->is_running() || client_handler->is_shut_down()) continue;
+            int64_t bytes = client_handler->memory().total();
+            if (bytes > heaviest_bytes || (bytes == heaviest_bytes && client_handler->get_id() < heaviest_id)) {
+                heaviest_id = client_handler->get_id();
+                heaviest_bytes = bytes;
+            }
+        }
+    }
+    if (heaviest_id == 0) return; // Nothing a disconnect would give back
+    with_connection(heaviest_id, [](ClientHandler* heaviest) {
+        if (!heaviest) return; // Gone meanwhile
+        std::cerr << "Server: Over the hard memory limit; dropping client " << heaviest->get_id() << ", which holds "
+                  << heaviest->memory().total() << " bytes." << std::endl;
+        heaviest->shutdown_connection(); // Its receive thread exits and signals the server
+    });
+}
+
+void Server::outbound_backlogged(uint32_t client_id) {
+    std::lock_guard<std::mutex> lock(backlog_mutex_);
+    if (backlogged_clients_.insert(client_id).second) {
+        backlog_signal_.notify();
+    }
+}
+
+void Server::outbound_drained(uint32_t client_id) {
+    std::lock_guard<std::mutex> lock(backlog_mutex_);
+    backlogged_clients_.erase(client_id);
+}
+
+void Server::drain_outbound() {
+#ifndef _WIN32
+    std::cout << "Outbound thread started." << std::endl;
+    std::vector<uint32_t> ids;
+    std::vector<pollfd> fds;
+    while (running_) {
+        {
+            std::lock_guard<std::mutex> lock(backlog_mutex_);
+            backlog_signal_.reset(); // Whatever it announced is in the set
+            ids.assign(backlogged_clients_.begin(), backlogged_clients_.end());
+        }
+        fds.clear();
+        for (size_t i = 0; i < ids.size();) {
+            with_connection(ids[i], [&fds](ClientHandler* client_handler) {
+                if (!client_handler) return;
+                bool readable = false;
+                int fd = client_handler->send_ready_fd(readable);
+                fds.push_back(pollfd{fd, static_cast<short>(readable ? POLLIN : POLLOUT), 0});
+            });
+            if (fds.size() == i) { // Gone, backlog and all
+                outbound_drained(ids[i]);
+                ids[i] = ids.back();
+                ids.pop_back();
+                continue;
+            }
+            ++i;
+        }
+        fds.push_back(pollfd{backlog_signal_.fd(), POLLIN, 0});
+        // A peer that never reads is left to the heartbeat, or to its spool filling up
+        if (poll(fds.data(), fds.size(), static_cast<int>(config_.outbound.rescan_interval_ms)) <= 0) continue;
+
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (fds[i].revents == 0) continue;
+            with_connection(ids[i], [](ClientHandler* client_handler) {
+                if (client_handler) client_handler->drain_outbound();
+            });
+        }
+    }
+    std::cout << "Outbound thread finished." << std::endl;
+#endif
+}
+
 void Server::remove_client(uint32_t client_id) {
+    std::lock_guard<std::mutex> removal_lock(removal_mutex_); // Waits out a handoff in progress
     std::cout << "Server: Attempting to remove client " << client_id << std::endl;
     std::unique_ptr<ClientHandler> handler_to_delete = nullptr;
-    {
-        std::lock_guard<std::mutex> lock(clients_mutex_);
-        auto it = std::find_if(clients_.begin(), clients_.end(),
-                               [client_id](const auto& handler_ptr) {
-                                   return handler_ptr && handler_ptr->get_id() == client_id;
-                               });
-
-        if (it != clients_.end()) {
-            handler_to_delete = std::move(*it); // Move ownership out of vector
-            clients_.erase(it);
-            std::cout << "Server: Client " << client_id << " removed from active list." << std::endl;
-        } else {
-            std::cout << "Server: Client " << client_id << " not found for removal (possibly already removed)." << std::endl;
+    std::vector<uint32_t> virtual_clients; // Leave with their connection
+    std::latch shard_left(1);
+    uint32_t connection_id = 0;
+    ClientGroup* group = group_of(client_id, connection_id);
+    if (group && connection_id == client_id) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        auto it = group->clients.find(client_id);
+        if (it != group->clients.end()) {
+            handler_to_delete = std::move(it->second); // Move ownership out of the map
+            group->clients.erase(it);
+            if (!shards_.empty()) {
+                shards_[handler_to_delete->shard_index()]->leave(handler_to_delete.get(), &shard_left);
+            } else {
+                shard_left.count_down();
+            }
+            lobby_roster_.remove(client_id);
+            virtual_clients = handler_to_delete->virtual_clients();
+            for (uint32_t virtual_id : virtual_clients) {
+                handler_to_delete->remove_virtual_client(virtual_id);
+                lobby_roster_.remove(virtual_id);
+            }
+            std::lock_guard<std::mutex> routes_lock(routes_mutex_);
+            routes_.erase(client_id);
+            for (uint32_t virtual_id : virtual_clients) {
+                routes_.erase(virtual_id);
+            }
         }
-    } // clients_mutex_ released
+    } // The group's lock released
 
     if (handler_to_delete) {
+        int64_t members = 1 + static_cast<int64_t>(virtual_clients.size());
+        local_members_ -= static_cast<size_t>(members);
+        federation_.change_local_members(kLobbyRoomId, -members);
+        std::cout << "Server: Client " << client_id << " removed from active list." << std::endl;
+    } else {
+        std::cout << "Server: Client " << client_id << " not found for removal (possibly already removed)." << std::endl;
+    }
+
+    heartbeats_.untrack(client_id);
+
+    if (handler_to_delete) {
+        shard_left.wait(); // Its shard may still be sending it broadcasts queued earlier
         handler_to_delete->stop(); // This joins the thread
+        sessions_.detach(client_id, clock_.now_ms(), handler_to_delete->take_reliable_state());
+        rate_limiter_.forget_client(client_id);
         // The unique_ptr will delete the ClientHandler object when it goes out of scope here
         std::cout << "Server: ClientHandler for " << client_id << " stopped and resources released." << std::endl;
-        
-        // Notify other clients about the departure (optional)
-        common::Message leave_msg(common::MessageType::CLIENT_LEFT, 0, 0, "Client " + std::to_string(client_id) + " left.");
-        leave_msg.header.sender_id = client_id; // Or 0 for server notification
-        broadcast_message(leave_msg);
+        presence_.left(client_id);
+        for (uint32_t virtual_id : virtual_clients) {
+            presence_.left(virtual_id);
+        }
     }
 }
 
@@ -0,0 +1,196 @@
+#include "server/session_store.h"
+#include "common/message.h" // For HEADER_SIZE
+#include <random>
+
+#ifdef __linux__
+#include <sys/random.h>
+#endif
+
+namespace chat_app {
+namespace server {
+
+namespace {
+// 64 bits from the kernel's CSPRNG, or else from fresh random_device draws
+// (which libstdc++ also takes from the OS), never from a seeded generator.
+uint64_t secure_random_u64() {
+    uint64_t value = 0;
+#ifdef __linux__
+    if (getrandom(&value, sizeof(value), 0) == static_cast<ssize_t>(sizeof(value))) return value;
+#endif
+    std::random_device device;
+    value = device();
+    return (value << 32) ^ device();
+}
+} // namespace
+
+size_t SessionStore::TokenHash::operator()(uint64_t token) const {
+    uint64_t h = token ^ key; // splitmix64's finalizer
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<size_t>(h ^ (h >> 31));
+}
+
+bool SessionStore::TokenEqual::operator()(uint64_t a, uint64_t b) const {
+    volatile uint64_t difference = a ^ b; // One comparison of the whole word, whatever the bits
+    return difference == 0;
+}
+
+SessionStore::SessionStore(const SessionConfig& config, MemoryBudget* memory)
+    : config_(config), memory_(memory), sessions_(0, TokenHash{secure_random_u64()}) {}
+
+void SessionStore::charge(int64_t bytes) {
+    if (memory_) memory_->charge(MemoryUse::HISTORY, bytes);
+}
+
+std::pair<uint64_t, uint32_t> SessionStore::open(uint32_t client_id, uint32_t room_id, int64_t now_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    expire(now_ms);
+
+    uint64_t token;
+    do {
+        token = secure_random_u64();
+    } while (token == 0 || sessions_.count(token) != 0);
+
+    Session& session = sessions_[token];
+    session.client_id = client_id;
+    session.first_client_id = client_id;
+    session.start_sequence = rooms_[room_id].last_sequence;
+    client_tokens_[client_id] = token;
+    return {token, session.start_sequence};
+}
+
+void SessionStore::detach(uint32_t client_id, int64_t now_ms, std::unique_ptr<ReliableState> reliable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = client_tokens_.find(client_id);
+    if (it == client_tokens_.end()) return;
+    uint64_t token = it->second;
+    client_tokens_.erase(it);
+
+    Session& session = sessions_[token];
+    session.attached = false;
+    session.detached_at_ms = now_ms;
+    session.reliable = std::move(reliable);
+    session.charged_bytes = session.reliable ? static_cast<int64_t>(session.reliable->outbound.bytes()) : 0;
+    charge(session.charged_bytes);
+    detached_.emplace_back(token, now_ms);
+    detached_clients_[client_id] = token;
+    expire(now_ms);
+}
+
+void SessionStore::expire(int64_t now_ms) {
+    while (!detached_.empty()) {
+        const auto& oldest = detached_.front();
+        bool over_capacity = sessions_.size() > config_.max_sessions;
+        if (!over_capacity && now_ms - oldest.second < config_.resume_window_ms) break;
+        auto it = sessions_.find(oldest.first);
+        // Skip entries for sessions resumed (and perhaps detached again) since
+        if (it != sessions_.end() && !it->second.attached && it->second.detached_at_ms == oldest.second) {
+            charge(-it->second.charged_bytes);
+            detached_clients_.erase(it->second.client_id);
+            sessions_.erase(it);
+        }
+        detached_.pop_front();
+    }
+}
+
+void SessionStore::stamp(uint32_t room_id, common::Message& msg, uint32_t excluded_client) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Room& room = rooms_[room_id];
+    msg.header.sequence = ++room.last_sequence;
+    if (room.last_sequence == 0) { // Wrapped; 0 means unsequenced
+        msg.header.sequence = room.last_sequence = 1;
+    }
+
+    room.history.push_back(HistoryEntry{msg, excluded_client});
+    room.history_bytes += msg.payload.size();
+    charge(static_cast<int64_t>(common::HEADER_SIZE + msg.payload.size()));
+    while (room.history.size() > config_.history_messages ||
+           (room.history_bytes > config_.history_bytes && room.history.size() > 1)) {
+        drop_oldest(room);
+    }
+}
+
+int64_t SessionStore::trim_history(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t released = 0;
+    while (released < bytes) {
+        Room* largest = nullptr;
+        for (auto& entry : rooms_) {
+            if (!entry.second.history.empty() && (!largest || entry.second.history_bytes > largest->history_bytes)) {
+                largest = &entry.second;
+            }
+        }
+        if (!largest) break;
+        released += drop_oldest(*largest);
+    }
+    return released;
+}
+
+int64_t SessionStore::drop_oldest(Room& room) {
+    size_t dropped = room.history.front().msg.payload.size();
+    room.history_bytes -= dropped;
+    room.history.pop_front();
+    int64_t released = static_cast<int64_t>(common::HEADER_SIZE + dropped);
+    charge(-released);
+    return released;
+}
+
+uint32_t SessionStore::mailbox_id(uint32_t client_id, int64_t now_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    expire(now_ms);
+    auto it = client_tokens_.find(client_id);
+    if (it == client_tokens_.end()) {
+        it = detached_clients_.find(client_id);
+        if (it == detached_clients_.end()) return 0;
+    }
+    auto session = sessions_.find(it->second);
+    return session == sessions_.end() ? 0 : session->second.first_client_id;
+}
+
+common::ResumeStatus SessionStore::resume(uint64_t token, uint32_t client_id, uint32_t room_id, uint32_t last_seen,
+                                          uint32_t& previous_client, std::vector<common::Message>& missed,
+                                          std::unique_ptr<ReliableState>& reliable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    previous_client = 0;
+    auto resumed = sessions_.find(token);
+    auto own_token = client_tokens_.find(client_id);
+    if (resumed == sessions_.end() || own_token == client_tokens_.end() || TokenEqual()(own_token->second, token)) {
+        return common::ResumeStatus::UNKNOWN;
+    }
+
+    // Broadcasts after the new connection joined reach it live; replay up to there
+    uint32_t replay_until = sessions_[own_token->second].start_sequence;
+    sessions_.erase(own_token->second);
+
+    Session& session = resumed->second;
+    previous_client = session.client_id;
+    if (session.attached) {
+        client_tokens_.erase(session.client_id); // Half-open old connection; the caller closes it
+    } else {
+        detached_clients_.erase(session.client_id);
+    }
+    session.client_id = client_id;
+    session.attached = true;
+    reliable = std::move(session.reliable);
+    charge(-session.charged_bytes); // The new connection's account takes it on
+    session.charged_bytes = 0;
+    session.start_sequence = replay_until;
+    own_token->second = token;
+
+    Room& room = rooms_[room_id];
+    if (last_seen >= replay_until) {
+        return common::ResumeStatus::RESUMED;
+    }
+    uint32_t first_kept = room.history.empty() ? room.last_sequence + 1 : room.history.front().msg.header.sequence;
+    for (const auto& entry : room.history) {
+        uint32_t sequence = entry.msg.header.sequence;
+        if (sequence > replay_until) break;
+        if (sequence > last_seen && entry.excluded_client != previous_client) {
+            missed.push_back(entry.msg);
+        }
+    }
+    return last_seen + 1 >= first_kept ? common::ResumeStatus::RESUMED : common::ResumeStatus::PARTIAL;
+}
+
+} // namespace server
+} // namespace chat_app
@@ -0,0 +1,145 @@
+#include "server/shard.h"
+#include "server/client_handler.h"
+#include <thread> // For std::this_thread::yield
+
+namespace chat_app {
+namespace server {
+
+Shard::Shard(size_t index, size_t mailbox_capacity)
+    : index_(index), mailbox_capacity_(mailbox_capacity), cpu_(-1), drain_scheduled_(false) {}
+
+Shard::~Shard() {
+    stop();
+}
+
+void Shard::start(int cpu) {
+    if (mailbox_) return;
+    cpu_ = cpu;
+    if (!loop_.start(cpu)) {
+        mailbox_ = std::make_unique<common::SpscRing<Entry>>(mailbox_capacity_);
+        return;
+    }
+    std::latch allocated(1);
+    loop_.post([this, &allocated] {
+        mailbox_ = std::make_unique<common::SpscRing<Entry>>(mailbox_capacity_); // Touched here, on our node
+        allocated.count_down();
+    });
+    allocated.wait();
+}
+
+void Shard::stop() {
+    loop_.stop();
+    if (!mailbox_) return;
+    // The loop is gone, so this thread is the consumer now
+    Entry entry;
+    while (mailbox_->try_pop(entry)) {
+        handle(entry);
+    }
+    drain_scheduled_ = false;
+}
+
+void Shard::join(ClientHandler* handler) {
+    Entry entry;
+    entry.kind = Entry::Kind::JOIN;
+    entry.handler = handler;
+    push(std::move(entry));
+}
+
+void Shard::leave(ClientHandler* handler, std::latch* left) {
+    Entry entry;
+    entry.kind = Entry::Kind::LEAVE;
+    entry.handler = handler;
+    entry.done = left;
+    push(std::move(entry));
+}
+
+void Shard::deliver(std::shared_ptr<const Broadcast> broadcast) {
+    Entry entry;
+    entry.kind = Entry::Kind::DELIVER;
+    entry.broadcast = std::move(broadcast);
+    push(std::move(entry));
+}
+
+void Shard::barrier(std::latch* reached) {
+    Entry entry;
+    entry.kind = Entry::Kind::BARRIER;
+    entry.done = reached;
+    push(std::move(entry));
+}
+
+void Shard::push(Entry entry) {
+    std::lock_guard<std::mutex> lock(producer_mutex_);
+    while (!mailbox_->try_push(std::move(entry))) { // Leaves entry alone when full
+        schedule_drain();
+        std::this_thread::yield(); // The loop is behind; it never waits on the producer
+    }
+    schedule_drain();
+}
+
+void Shard::schedule_drain() {
+    // Pairs with the fence in drain(): either it sees our entry or we see it idle
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!drain_scheduled_.exchange(true)) {
+        loop_.post([this] { drain(); });
+    }
+}
+
+void Shard::drain() {
+    drain_scheduled_.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Entry entry;
+    for (size_t handled = 0; handled < kDrainBatch; ++handled) {
+        if (!mailbox_->try_pop(entry)) return;
+        handle(entry);
+    }
+    schedule_drain(); // More waiting; take it after the loop's reads
+}
+
+void Shard::handle(Entry& entry) {
+    switch (entry.kind) {
+        case Entry::Kind::JOIN:
+            member_slots_[entry.handler] = members_.size();
+            members_.push_back(entry.handler);
+            break;
+        case Entry::Kind::LEAVE: {
+            auto it = member_slots_.find(entry.handler);
+            if (it != member_slots_.end()) {
+                size_t slot = it->second;
+                member_slots_.erase(it);
+                if (slot + 1 != members_.size()) {
+                    members_[slot] = members_.back();
+                    member_slots_[members_[slot]] = slot;
+                }
+                members_.pop_back();
+            }
+            entry.done->count_down();
+            break;
+        }
+        case Entry::Kind::DELIVER: {
+            const Broadcast& broadcast = *entry.broadcast;
+            for (ClientHandler* handler : members_) {
+                if (!handler->is_running()) continue;
+                // A multiplexed connection gets it for its other logical clients even from one of them
+                if (broadcast.exclude_id != 0 && handler->get_id() == broadcast.exclude_id &&
+                    handler->virtual_client_count() == 0) {
+                    continue;
+                }
+                if (!broadcast.frame) {
+                    handler->send_message(broadcast.msg);
+                } else if (!broadcast.slot.empty()) {
+                    handler->send_latest(broadcast.frame, broadcast.slot);
+                } else {
+                    handler->send_serialized(broadcast.frame);
+                }
+            }
+            break;
+        }
+        case Entry::Kind::BARRIER:
+            entry.done->count_down();
+            break;
+    }
+    entry.broadcast.reset(); // The last shard to deliver frees the frame, unless a zero-copy send holds it
+}
+
+} // namespace server
+} // namespace chat_app